@@ -0,0 +1,231 @@
+/**
+ * @file bench_vm.cpp
+ * @brief Google Benchmark cases for the interpreter, the engines, memory access and image handling.
+ *
+ * Every case reports ns per iteration; cases that execute guest code also
+ * report retired instructions per second as the "instructions/s" counter.
+ * `make bench` writes the results to build/bench.json.
+ */
+#include <benchmark/benchmark.h>
+#include "console.hpp"
+#include "keyboard.hpp"
+#include "lc3.hpp"
+#include "registers.hpp"
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#ifndef LC3_OBJ_DIR
+/** @brief Directory holding the sample object files, relative to lc3vm/. */
+#define LC3_OBJ_DIR "../obj"
+#endif
+
+/** @brief Origin of the synthetic programs. */
+static const std::uint16_t ORIGIN = 0x3000;
+
+/**
+ * @brief Stream buffer discarding everything written to it.
+ */
+class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) override { return traits_type::not_eof(c); }
+        std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+/**
+ * @brief Creates a VM writing its console output to memory.
+ * @return The VM.
+ */
+static std::unique_ptr<LC3State> make_vm() {
+    std::unique_ptr<LC3State> vm(new LC3State());
+    vm->set_console(std::unique_ptr<Console>(new BufferConsole()));
+    return vm;
+}
+
+/**
+ * @brief Writes a program to consecutive words.
+ * @param vm The VM.
+ * @param origin Address of the first word.
+ * @param program The words.
+ */
+static void load(LC3State& vm, std::uint16_t origin, const std::vector<std::uint16_t>& program) {
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        vm.write_memory(static_cast<std::uint16_t>(origin + i), program[i]);
+    }
+}
+
+/**
+ * @brief Executes one instruction word with step(), resetting the PC each time.
+ * Base registers point to 0x4000 and the PC-relative operand at 0x3100 holds
+ * 0x4000, so loads, stores and jumps touch neither the instruction nor its page.
+ * @param word The instruction.
+ */
+static void BM_Step(benchmark::State& state, std::uint16_t word) {
+    std::unique_ptr<LC3State> vm = make_vm();
+    vm->write_memory(ORIGIN, word);
+    vm->write_memory(0x3100, 0x4000);
+    vm->write_memory(0x4000, 0x4000);
+    vm->set_register_value(R_R0, 0x4000);
+    vm->set_register_value(R_R2, 0x4000);
+    vm->set_register_value(R_R7, 0x4000);
+    for (auto _ : state) {
+        vm->set_register_value(R_PC, ORIGIN);
+        vm->step();
+    }
+    benchmark::DoNotOptimize(vm->get_register_value(R_R1));
+    state.counters["instructions/s"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                                          benchmark::Counter::kIsRate);
+}
+BENCHMARK_CAPTURE(BM_Step, BR, 0x0E00);        // BRnzp #0
+BENCHMARK_CAPTURE(BM_Step, ADD_reg, 0x1242);   // ADD R1, R1, R2
+BENCHMARK_CAPTURE(BM_Step, ADD_imm, 0x1261);   // ADD R1, R1, #1
+BENCHMARK_CAPTURE(BM_Step, LD, 0x22FF);        // LD R1, 0x3100
+BENCHMARK_CAPTURE(BM_Step, ST, 0x30FF);        // ST R0, 0x3100
+BENCHMARK_CAPTURE(BM_Step, JSR, 0x4800);       // JSR #0
+BENCHMARK_CAPTURE(BM_Step, JSRR, 0x4080);      // JSRR R2
+BENCHMARK_CAPTURE(BM_Step, AND_imm, 0x527F);   // AND R1, R1, #-1
+BENCHMARK_CAPTURE(BM_Step, LDR, 0x6280);       // LDR R1, R2, #0
+BENCHMARK_CAPTURE(BM_Step, STR, 0x7080);       // STR R0, R2, #0
+BENCHMARK_CAPTURE(BM_Step, NOT, 0x927F);       // NOT R1, R1
+BENCHMARK_CAPTURE(BM_Step, LDI, 0xA2FF);       // LDI R1, 0x3100
+BENCHMARK_CAPTURE(BM_Step, STI, 0xB0FF);       // STI R0, 0x3100
+BENCHMARK_CAPTURE(BM_Step, JMP, 0xC080);       // JMP R2
+BENCHMARK_CAPTURE(BM_Step, LEA, 0xE2FF);       // LEA R1, 0x3100
+
+/** @brief Counts R1 down from 10000: 20002 instructions. */
+static const std::vector<std::uint16_t> COUNTDOWN_LOOP = {
+    0x2203, // LD R1, count
+    0x127F, // loop: ADD R1, R1, #-1
+    0x03FE, // BRp loop
+    0xF025, // HALT
+    10000   // count: .FILL #10000
+};
+
+/** @brief Copies 4096 words from 0x4000 to 0x5000: 24580 instructions. */
+static const std::vector<std::uint16_t> COPY_LOOP = {
+    0x2409, // LD R2, source
+    0x2609, // LD R3, destination
+    0x2209, // LD R1, count
+    0x6080, // loop: LDR R0, R2, #0
+    0x70C0, // STR R0, R3, #0
+    0x14A1, // ADD R2, R2, #1
+    0x16E1, // ADD R3, R3, #1
+    0x127F, // ADD R1, R1, #-1
+    0x03FA, // BRp loop
+    0xF025, // HALT
+    0x4000, // source: .FILL x4000
+    0x5000, // destination: .FILL x5000
+    4096    // count: .FILL #4096
+};
+
+/** @brief Calls an empty subroutine 10000 times: 40002 instructions. */
+static const std::vector<std::uint16_t> CALL_LOOP = {
+    0x2205, // LD R1, count
+    0x4803, // loop: JSR return
+    0x127F, // ADD R1, R1, #-1
+    0x03FD, // BRp loop
+    0xF025, // HALT
+    0xC1C0, // return: RET
+    10000   // count: .FILL #10000
+};
+
+/**
+ * @brief Runs a synthetic loop to HALT with run() on the engine given as the
+ * argument: 0 interpreter, 1 superblock, 2 JIT.
+ * @param program The loop, loaded at ORIGIN.
+ */
+static void BM_Run(benchmark::State& state, const std::vector<std::uint16_t>& program) {
+    std::unique_ptr<LC3State> vm = make_vm();
+    vm->set_execution_mode(static_cast<ExecutionMode>(state.range(0)));
+    load(*vm, ORIGIN, program);
+    RunResult probe = vm->run_for(std::numeric_limits<std::uint64_t>::max());
+    if (probe.reason != StopReason::Halted) {
+        state.SkipWithError("The loop does not halt.");
+        return;
+    }
+    BufferConsole& console = static_cast<BufferConsole&>(vm->get_console());
+    for (auto _ : state) {
+        vm->set_register_value(R_PC, ORIGIN);
+        vm->run();
+        console.take_output();
+    }
+    state.counters["instructions/s"] = benchmark::Counter(static_cast<double>(probe.instructions),
+                                                          benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK_CAPTURE(BM_Run, countdown, COUNTDOWN_LOOP)->ArgName("engine")->DenseRange(0, 2);
+BENCHMARK_CAPTURE(BM_Run, copy, COPY_LOOP)->ArgName("engine")->DenseRange(0, 2);
+BENCHMARK_CAPTURE(BM_Run, call, CALL_LOOP)->ArgName("engine")->DenseRange(0, 2);
+
+/**
+ * @brief Reads one address with Memory::read().
+ * The VM is bound to an empty BufferConsole, so keyboard register reads poll
+ * it; as in run_for(), polling does not sleep when no key is pending.
+ * @param address The address.
+ */
+static void BM_MemoryRead(benchmark::State& state, std::uint16_t address) {
+    std::unique_ptr<LC3State> vm = make_vm();
+    vm->run_for(0);
+    vm->memory.keyboard_device().set_idle_wait(false);
+    Memory& memory = vm->memory;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(memory.read(address));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_MemoryRead, RAM, 0x3000);
+BENCHMARK_CAPTURE(BM_MemoryRead, KBSR, Keyboard::MR_KBSR);
+BENCHMARK_CAPTURE(BM_MemoryRead, KBDR, Keyboard::MR_KBDR);
+
+/**
+ * @brief Loads a sample object file into a fresh VM.
+ * @param name The file in LC3_OBJ_DIR.
+ */
+static void BM_LoadImage(benchmark::State& state, const char* name) {
+    std::string path = std::string(LC3_OBJ_DIR) + "/" + name;
+    try {
+        LC3State probe;
+        probe.load_image(path);
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::unique_ptr<LC3State> vm(new LC3State());
+        state.ResumeTiming();
+        vm->load_image(path);
+        state.PauseTiming();
+        vm.reset();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK_CAPTURE(BM_LoadImage, 2048, "2048.obj");
+BENCHMARK_CAPTURE(BM_LoadImage, rogue, "rogue.obj");
+
+/**
+ * @brief Disassembles a loaded sample object file with disassemble_all(), discarding the text.
+ * @param name The file in LC3_OBJ_DIR.
+ */
+static void BM_DisassembleAll(benchmark::State& state, const char* name) {
+    LC3State vm;
+    try {
+        vm.load_image(std::string(LC3_OBJ_DIR) + "/" + name);
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+    NullBuffer discard;
+    std::streambuf* previous = std::cout.rdbuf(&discard);
+    for (auto _ : state) {
+        vm.disassemble_all();
+    }
+    std::cout.rdbuf(previous);
+}
+BENCHMARK_CAPTURE(BM_DisassembleAll, 2048, "2048.obj");
+BENCHMARK_CAPTURE(BM_DisassembleAll, rogue, "rogue.obj");
+
+BENCHMARK_MAIN();
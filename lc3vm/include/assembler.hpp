@@ -0,0 +1,70 @@
+/**
+ * @file assembler.hpp
+ * @brief Defines the in-process LC-3 assembler.
+ *
+ * The assembler accepts the usual LC-3 assembly language: one statement per
+ * line, an optional label first, `;` comments, case-insensitive opcodes and
+ * directives, case-sensitive labels. Operands are registers R0-R7, numbers
+ * written as `#-5`, `5`, `x3000` or `0x3000`, and labels wherever an address
+ * or PC-relative offset is expected. The trap aliases GETC, OUT, PUTS, IN,
+ * PUTSP and HALT, RET and a bare BR (branch always) are understood, as are
+ * the directives `.ORIG`, `.FILL`, `.BLKW`, `.STRINGZ` (with `\n`, `\t`,
+ * `\r`, `\e`, `\"`, `\\` and `\0` escapes) and `.END`.
+ *
+ * Assembly takes two passes over statements tokenized once: the first
+ * assigns addresses and fills a hashed symbol table, the second encodes.
+ * A source may hold several `.ORIG`...`.END` blocks; each becomes a segment.
+ */
+#ifndef LC3_ASSEMBLER_H
+#define LC3_ASSEMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The words of one `.ORIG` block.
+ */
+struct AssembledSegment {
+    std::uint16_t origin;             ///< Address of the first word.
+    std::vector<std::uint16_t> words; ///< The words, in host byte order.
+};
+
+/**
+ * @brief An assembled program.
+ */
+struct AssembledProgram {
+    std::vector<AssembledSegment> segments;                 ///< The blocks, in source order.
+    std::unordered_map<std::string, std::uint16_t> symbols; ///< Address of every label.
+};
+
+/**
+ * @brief Assembles a source text.
+ * @param source The assembly language program.
+ * @return The segments and symbols.
+ * @throw std::runtime_error naming the line of the first error, e.g. an
+ *        unknown opcode, a malformed operand, an undefined or duplicate label,
+ *        or an offset out of range.
+ */
+AssembledProgram assemble(const std::string& source);
+
+/**
+ * @brief Reads and assembles a source file.
+ * @param path The .asm file.
+ * @return The segments and symbols.
+ * @throw std::runtime_error if the file cannot be read or does not assemble;
+ *        errors are prefixed with the path.
+ */
+AssembledProgram assemble_file(const std::string& path);
+
+/**
+ * @brief Writes a segment as an object file: the origin, then the words, all big-endian.
+ * @param segment The segment.
+ * @param path The .obj file, replaced if it exists.
+ * @throw std::runtime_error if the file cannot be written.
+ */
+void write_object(const AssembledSegment& segment, const std::string& path);
+
+#endif // LC3_ASSEMBLER_H
@@ -0,0 +1,141 @@
+/**
+ * @file cfg.hpp
+ * @brief Defines the control-flow graph of loaded programs and the loops and subroutines found in it.
+ *
+ * The graph covers the words of a set of code segments. Every word that
+ * could execute is decoded with LC3State::decode(); words with opcode RTI or
+ * RES and BR words without condition bits (zeros, characters and other
+ * small data) are not instructions. Basic blocks end at branches, jumps,
+ * calls and HALT, and before the target of any of them. A JMP or JSRR right
+ * after an LD or LEA of its base register is taken to go where that loaded,
+ * the usual idiom for far jumps and calls; other register jumps have no
+ * known target.
+ *
+ * Blocks are reachable if a path of successors and calls leads to them from
+ * the first word of a segment. Natural loops are found from the back edges
+ * of the dominator tree of the reachable blocks, each segment entry and
+ * subroutine entry being a root. Everything is computed once, in time
+ * roughly linear in the number of words covered, so the graph of a full
+ * 64K-word image takes milliseconds.
+ */
+#ifndef LC3_CFG_H
+#define LC3_CFG_H
+
+#include "lc3.hpp"
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+/** @brief Block index meaning "no block", e.g. for an address that is not an instruction. */
+#define CFG_NONE 0xFFFFFFFFu
+
+/**
+ * @brief A straight-line run of instructions entered only at its first one.
+ */
+struct BasicBlock {
+    std::uint16_t start;                     ///< Address of the first instruction.
+    std::uint16_t last;                      ///< Address of the last instruction; blocks are contiguous.
+    std::vector<std::uint32_t> successors;   ///< Blocks control passes to next, calls excluded; ascending.
+    std::vector<std::uint32_t> predecessors; ///< Blocks having this one as a successor; ascending.
+    std::uint32_t call = CFG_NONE;           ///< Block the last instruction calls, if it is a JSR or resolved JSRR.
+    bool reachable = false;                  ///< Whether a path from a segment entry leads here.
+};
+
+/**
+ * @brief A natural loop: a header and the blocks that reach a back edge to it without passing through it.
+ * Loops sharing a header are merged.
+ */
+struct NaturalLoop {
+    std::uint32_t header;               ///< The block every iteration enters through.
+    std::vector<std::uint32_t> latches; ///< Blocks with a back edge to the header; ascending.
+    std::vector<std::uint32_t> blocks;  ///< All blocks of the loop, the header included; ascending.
+    std::uint32_t parent = CFG_NONE;    ///< Index of the innermost loop containing this one.
+};
+
+/**
+ * @brief A called block from which a RET is reachable.
+ */
+struct Subroutine {
+    std::uint32_t entry;                ///< Block at the called address.
+    std::vector<std::uint32_t> blocks;  ///< Blocks reachable from the entry without following calls; ascending.
+    std::vector<std::uint32_t> callers; ///< Blocks ending in a call to it; ascending.
+    std::uint32_t instructions;         ///< Instructions in its blocks.
+};
+
+/**
+ * @brief Control-flow graph of the code in a set of segments, with its loops, subroutines and unreachable code.
+ */
+class ControlFlowGraph {
+    public:
+        /**
+         * @brief Builds the graph.
+         * @param memory All MEMORY_MAX words; only read, and not kept.
+         * @param segments The segments to cover; the first word of each is an entry point.
+         */
+        ControlFlowGraph(const std::uint16_t* memory, const std::vector<CodeSegment>& segments);
+
+        /** @brief Returns all blocks, ascending by address. */
+        const std::vector<BasicBlock>& blocks() const { return block_list; }
+
+        /**
+         * @brief Returns the block containing an address.
+         * @param address The address.
+         * @return The block index, or CFG_NONE if the address holds no instruction in the graph.
+         */
+        std::uint32_t block_at(std::uint16_t address) const { return block_of[address]; }
+
+        /** @brief Returns the blocks at segment entries, in segment order. */
+        const std::vector<std::uint32_t>& entries() const { return entry_blocks; }
+
+        /** @brief Returns the natural loops, ascending by header address. */
+        const std::vector<NaturalLoop>& loops() const { return loop_list; }
+
+        /** @brief Returns the subroutines, ascending by entry address. */
+        const std::vector<Subroutine>& subroutines() const { return subroutine_list; }
+
+        /**
+         * @brief Returns the blocks no entry reaches, except those the reachable code reads or writes as data.
+         * @return Block indices, ascending; dead code, or data that decodes as instructions.
+         */
+        const std::vector<std::uint32_t>& unreachable() const { return unreachable_blocks; }
+
+        /**
+         * @brief Returns whether one reachable block dominates another.
+         * @param dominator The block every path to block must pass through.
+         * @param block The dominated block.
+         * @return false if either block is unreachable.
+         */
+        bool dominates(std::uint32_t dominator, std::uint32_t block) const;
+
+        /**
+         * @brief Writes the graph in Graphviz DOT format.
+         * Reachable and unreachable blocks are nodes labelled with their
+         * disassembly; unreachable ones are dashed, loop headers drawn bold and
+         * subroutine entries double-framed. Successor edges are solid, call edges dotted.
+         * @param out The stream.
+         * @param memory The words the graph was built from, for the labels.
+         */
+        void write_dot(std::ostream& out, const std::uint16_t* memory) const;
+
+    private:
+        std::vector<BasicBlock> block_list;            ///< All blocks.
+        std::vector<std::uint32_t> block_of;           ///< Block of every address, or CFG_NONE.
+        std::vector<std::uint32_t> entry_blocks;       ///< Blocks at segment entries.
+        std::vector<NaturalLoop> loop_list;            ///< Natural loops.
+        std::vector<Subroutine> subroutine_list;       ///< Subroutines.
+        std::vector<std::uint32_t> unreachable_blocks; ///< Unreachable code blocks.
+        std::vector<std::uint32_t> preorder;           ///< Dominator-tree preorder number of each block, or CFG_NONE.
+        std::vector<std::uint32_t> postorder;          ///< Dominator-tree postorder number of each block.
+
+        /** @brief Flags instructions and leaders, splits the covered words into blocks and links them. */
+        void find_blocks(const std::uint16_t* memory, const std::vector<CodeSegment>& segments,
+                         std::vector<std::uint8_t>& flags);
+        /** @brief Marks blocks reachable from the entries and collects the unreachable code. */
+        void mark_reachable(const std::uint16_t* memory, std::vector<std::uint8_t>& flags);
+        /** @brief Builds the dominator tree and the natural loops of its back edges. */
+        void find_loops();
+        /** @brief Collects the called blocks that reach a RET. */
+        void find_subroutines(const std::uint16_t* memory);
+};
+
+#endif // LC3_CFG_H
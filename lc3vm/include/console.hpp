@@ -0,0 +1,225 @@
+/**
+ * @file console.hpp
+ * @brief Defines the console a VM reads keys from and writes output to.
+ *
+ * Every LC3State owns a Console. When a run starts, the VM connects its
+ * OutputBuffer and its keyboard device to the console once; the traps and
+ * KBSR polls then go straight to that console instead of choosing between
+ * standard input, a queue or test registers on every call.
+ */
+#ifndef LC3_CONSOLE_H
+#define LC3_CONSOLE_H
+
+#include "input_queue.hpp"
+#include "output_buffer.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+class Memory;
+
+/**
+ * @brief Source of keys and destination of output for one VM.
+ */
+class Console {
+    public:
+        virtual ~Console() = default;
+
+        /**
+         * @brief Routes a VM's output to this console.
+         * Called whenever the console becomes active; the buffer keeps batching writes.
+         * @param output The VM's output buffer.
+         */
+        virtual void connect(OutputBuffer& output) = 0;
+
+        /**
+         * @brief Checks without blocking whether a key is available.
+         * @return true if read_key() would return a key immediately.
+         */
+        virtual bool key_pending() = 0;
+
+        /**
+         * @brief Takes the next key.
+         * @param c Receives the key.
+         * @param wait Whether to wait for a key when none is pending.
+         * @return false if no key was available, or input ended while waiting.
+         */
+        virtual bool read_key(char& c, bool wait) = 0;
+
+        /**
+         * @brief Blocks until a key may be available or a timeout passes.
+         * Used to idle the host while the guest spins on KBSR; it may return early.
+         * @param timeout The longest time to wait.
+         */
+        virtual void wait_for_key(std::chrono::milliseconds timeout) = 0;
+};
+
+/**
+ * @brief Console on a pair of file descriptors.
+ *
+ * Keys are read directly from the input descriptor, polling it when the
+ * guest checks for input, unless start_reader() moved reading to a
+ * background thread feeding an InputQueue. Output is written to the
+ * output descriptor.
+ */
+class FdConsole : public Console {
+    public:
+        /**
+         * @brief Creates a console; the descriptors stay owned by the caller.
+         * @param in_fd The descriptor keys are read from.
+         * @param out_fd The descriptor output is written to.
+         */
+        explicit FdConsole(int in_fd = STDIN_FILENO, int out_fd = STDOUT_FILENO);
+
+        /**
+         * @brief Stops the background reader, if running.
+         */
+        ~FdConsole() override;
+
+        FdConsole(const FdConsole&) = delete;
+        FdConsole& operator=(const FdConsole&) = delete;
+
+        /**
+         * @brief Starts a background thread reading keys into a ring buffer.
+         * Polls and reads then consume the buffer instead of issuing a system call each.
+         * @throw std::runtime_error if the thread cannot be set up.
+         */
+        void start_reader();
+
+        /**
+         * @brief Stops the background thread and returns to direct reads.
+         * Keys it already buffered are still returned first.
+         */
+        void stop_reader();
+
+        void connect(OutputBuffer& output) override;
+        bool key_pending() override;
+        bool read_key(char& c, bool wait) override;
+        void wait_for_key(std::chrono::milliseconds timeout) override;
+
+    private:
+        int in_fd;  ///< Descriptor keys are read from.
+        int out_fd; ///< Descriptor output is written to.
+        /**
+         * @brief Keys read by reader and not yet consumed.
+         * Declared before reader so the thread is stopped before the queue goes away.
+         */
+        InputQueue queue;
+        std::unique_ptr<InputReader> reader; ///< Background reader, if started.
+};
+
+/**
+ * @brief FdConsole on standard input and output with the terminal in raw mode.
+ *
+ * Raw mode is enabled by the constructor and restored by the destructor, so
+ * at most one TerminalConsole should exist at a time.
+ */
+class TerminalConsole : public FdConsole {
+    public:
+        /**
+         * @brief Puts the terminal into raw mode.
+         * @throw std::runtime_error if standard input is not a terminal.
+         */
+        TerminalConsole();
+
+        /**
+         * @brief Restores the terminal mode.
+         */
+        ~TerminalConsole() override;
+};
+
+/**
+ * @brief Console on in-memory buffers, for scripted input and captured output.
+ *
+ * Keys come from a string that can be extended with feed(); once it is
+ * consumed, reads fail instead of blocking. Output is appended to a string.
+ */
+class BufferConsole : public Console {
+    public:
+        /**
+         * @brief Creates a console.
+         * @param input The keys to deliver, in order.
+         */
+        explicit BufferConsole(std::string input = std::string());
+
+        /**
+         * @brief Appends keys to deliver after the remaining ones.
+         * @param keys The keys.
+         */
+        void feed(const std::string& keys) {
+            input += keys;
+            misses = 0;
+        }
+
+        /**
+         * @brief Returns the number of keys not yet read.
+         * @return The count.
+         */
+        std::size_t remaining_input() const { return input.size() - position; }
+
+        /**
+         * @brief Returns how many reads found no key left since the input was last extended.
+         * @return The count.
+         */
+        std::uint64_t missed_reads() const { return misses; }
+
+        /**
+         * @brief Returns the output flushed to this console so far.
+         * @return The output; call the VM's output.flush() first to include pending bytes.
+         */
+        const std::string& output() const { return captured; }
+
+        /**
+         * @brief Returns and clears the output flushed so far.
+         * @return The output.
+         */
+        std::string take_output();
+
+        void connect(OutputBuffer& output) override;
+        bool key_pending() override { return position < input.size(); }
+        bool read_key(char& c, bool wait) override;
+        void wait_for_key(std::chrono::milliseconds timeout) override;
+
+    private:
+        std::string input;     ///< Keys, consumed from position on.
+        std::size_t position;  ///< Index of the next key.
+        std::string captured;  ///< Output.
+        std::uint64_t misses = 0; ///< Reads that found no key since the last feed().
+};
+
+/**
+ * @brief Console for tests that simulate input through the keyboard registers.
+ *
+ * Keys read the KBDR register, so tests simulate input by writing it. GETC
+ * and IN always find a key; a KBSR poll only while the ready bit written to
+ * KBSR is set, so KBSR reads back what the test stored. Output is discarded.
+ * Select it with LC3State::use_test_console().
+ */
+class TestConsole : public Console {
+    public:
+        /**
+         * @brief Creates a console.
+         * @param memory The memory holding the keyboard registers.
+         */
+        explicit TestConsole(Memory& memory) : memory(memory) {}
+
+        void connect(OutputBuffer& output) override;
+        bool key_pending() override { return true; }
+        bool read_key(char& c, bool wait) override;
+        void wait_for_key(std::chrono::milliseconds) override {}
+
+    private:
+        Memory& memory;
+};
+
+/**
+ * @brief Returns a process-wide FdConsole on standard input and output.
+ * Used by a keyboard device no VM has connected a console to.
+ * @return The console.
+ */
+Console& standard_console();
+
+#endif // LC3_CONSOLE_H
@@ -0,0 +1,95 @@
+/**
+ * @file decode_cache.hpp
+ * @brief Defines the pre-decoded instruction format and the per-address decode cache.
+ */
+#ifndef LC3_DECODE_CACHE_H
+#define LC3_DECODE_CACHE_H
+
+#include "memory.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+
+class LC3State;
+
+/**
+ * @brief An LC-3 instruction with all of its fields already extracted.
+ *
+ * Register indices are taken from their fixed bit positions and every
+ * immediate/offset field is stored already sign-extended to 16 bits, so the
+ * handler does no bit twiddling at execution time.
+ */
+struct DecodedInstruction {
+    /** @brief Handler executing this instruction; nullptr marks an empty cache slot. */
+    void (*handler)(LC3State&, const DecodedInstruction&);
+    std::uint16_t imm;  ///< Sign-extended imm5/offset6/PCoffset9/PCoffset11, or the trap vector.
+    std::uint8_t op;    ///< Opcode (bits 15..12).
+    std::uint8_t dr;    ///< Bits 11..9: DR, SR of a store, or the nzp mask of BR.
+    std::uint8_t sr1;   ///< Bits 8..6: SR1 or BaseR.
+    std::uint8_t sr2;   ///< Bits 2..0: SR2 of the register forms of ADD/AND.
+    std::uint8_t mode;  ///< Immediate flag of ADD/AND, or the long (JSR vs JSRR) flag of JSR.
+};
+
+/**
+ * @brief Lazily allocated cache of decoded instructions, one slot per memory word.
+ *
+ * Storage is split into pages of the same size as Memory pages and a page is
+ * only allocated once an instruction on it has been executed, so a VM running
+ * a small program pays for a few KiB rather than one slot per address.
+ */
+class DecodeCache {
+    public:
+        /**
+         * @brief Looks up the decoded instruction for an address.
+         * @param address The memory address of the instruction.
+         * @return The cached entry, or nullptr if the address has not been decoded
+         *         or was invalidated since.
+         */
+        const DecodedInstruction* lookup(std::uint16_t address) const {
+            const auto& page = pages[address >> MEMORY_PAGE_SHIFT];
+            if (!page) return nullptr;
+            const DecodedInstruction& entry = page[address & MEMORY_PAGE_MASK];
+            return entry.handler ? &entry : nullptr;
+        }
+
+        /**
+         * @brief Stores a decoded instruction for an address, allocating its page on demand.
+         * @param address The memory address of the instruction.
+         * @param decoded The decoded form of the word at that address.
+         * @return Reference to the stored entry.
+         */
+        const DecodedInstruction& insert(std::uint16_t address, const DecodedInstruction& decoded) {
+            auto& page = pages[address >> MEMORY_PAGE_SHIFT];
+            if (!page) {
+                page.reset(new DecodedInstruction[MEMORY_PAGE_SIZE]());
+            }
+            DecodedInstruction& entry = page[address & MEMORY_PAGE_MASK];
+            entry = decoded;
+            return entry;
+        }
+
+        /**
+         * @brief Drops the cached entry for an address so it is decoded again on next use.
+         * @param address The memory address that was modified.
+         */
+        void invalidate(std::uint16_t address) {
+            auto& page = pages[address >> MEMORY_PAGE_SHIFT];
+            if (page) {
+                page[address & MEMORY_PAGE_MASK].handler = nullptr;
+            }
+        }
+
+        /**
+         * @brief Releases every cached page.
+         */
+        void clear() {
+            for (auto& page : pages) {
+                page.reset();
+            }
+        }
+
+    private:
+        std::array<std::unique_ptr<DecodedInstruction[]>, MEMORY_PAGE_COUNT> pages; ///< Per-page slot arrays.
+};
+
+#endif // LC3_DECODE_CACHE_H
@@ -0,0 +1,53 @@
+/**
+ * @file device.hpp
+ * @brief Defines the interface of memory-mapped devices.
+ */
+#ifndef LC3_DEVICE_H
+#define LC3_DEVICE_H
+
+#include <cstdint>
+#include <vector>
+
+class Memory;
+
+/**
+ * @brief A device handling every read and write to the memory pages it is mapped to.
+ *
+ * Devices are mapped with Memory::map_device() at page granularity. Addresses
+ * on a mapped page that the device does not implement can simply be backed by
+ * Memory::memory.
+ */
+class Device {
+    public:
+        virtual ~Device() = default;
+
+        /**
+         * @brief Handles a read from a mapped page.
+         * @param memory The memory the device is mapped into.
+         * @param address The address being read.
+         * @return The value of the addressed register.
+         */
+        virtual std::uint16_t read(Memory& memory, std::uint16_t address) = 0;
+
+        /**
+         * @brief Handles a write to a mapped page.
+         * @param memory The memory the device is mapped into.
+         * @param address The address being written.
+         * @param value The value written.
+         */
+        virtual void write(Memory& memory, std::uint16_t address, std::uint16_t value) = 0;
+
+        /**
+         * @brief Captures state that is not backed by Memory::memory, for LC3State::snapshot().
+         * @return Opaque bytes later passed to restore_state(); empty by default.
+         */
+        virtual std::vector<std::uint8_t> save_state() const { return {}; }
+
+        /**
+         * @brief Restores state captured by save_state(), for LC3State::restore().
+         * @param state The bytes returned by save_state().
+         */
+        virtual void restore_state(const std::vector<std::uint8_t>& state) { (void)state; }
+};
+
+#endif // LC3_DEVICE_H
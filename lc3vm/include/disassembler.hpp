@@ -0,0 +1,75 @@
+/**
+ * @file disassembler.hpp
+ * @brief Defines the allocation-free, table-driven LC-3 disassembler.
+ *
+ * Instructions are formatted straight into caller-supplied buffers: the
+ * mnemonic and operand layout come from a table indexed by opcode, hex
+ * digits from a table of precomputed byte pairs and decimals from
+ * std::to_chars, so listing an image needs no allocation and no stream
+ * formatting state. PC-relative targets wrap at 16 bits, as the PC does.
+ *
+ * Whole segments are listed after separating code from data by recursive
+ * descent: starting at the segment's first word, every path through
+ * fallthroughs, BR and JSR targets is followed, stopping at RET, JMP, HALT
+ * and unconditional branches. Words never reached are data and are listed
+ * as .FILL words or, for runs of characters ending in a zero, .STRINGZ.
+ */
+#ifndef LC3_DISASSEMBLER_H
+#define LC3_DISASSEMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+/** @brief Longest line disassemble_instruction() writes, e.g. "0x3000: LDR R0, R1, #-32"; no terminator is written. */
+#define DISASSEMBLY_MAX_LINE 32
+
+/** @brief Bytes LC3State::disassemble_range() and write_listing() format before writing them to their stream at once. */
+#define DISASSEMBLY_CHUNK_SIZE 16384
+
+/**
+ * @brief Formats an instruction as "0x3000: ADD R1, R2, #-1".
+ * @param address The address of the instruction.
+ * @param instr The instruction word.
+ * @param buffer Receives the line; must hold DISASSEMBLY_MAX_LINE characters.
+ * @return The length of the line.
+ */
+std::size_t disassemble_instruction(std::uint16_t address, std::uint16_t instr, char* buffer);
+
+/**
+ * @brief Flags map_code() sets for each word of a segment.
+ */
+enum WordKind : std::uint8_t {
+    WORD_DATA = 0,   ///< Never reached as an instruction.
+    WORD_CODE = 1,   ///< Reached as an instruction.
+    WORD_TARGET = 2  ///< Named by a branch, call or load in the code, e.g. the start of a string.
+};
+
+/**
+ * @brief Separates the code of a segment from its data by recursive descent from its first word.
+ * Targets outside the segment are not followed. Besides direct branches
+ * and calls, a JMP or JSRR right after an LD or LEA of its base register
+ * is followed to the address loaded, the usual idiom for far calls.
+ * Paths end at opcodes RTI and RES, which the VM does not execute.
+ * @param memory All MEMORY_MAX words; only read.
+ * @param start The address of the segment's first word, its entry point.
+ * @param size The number of words in the segment.
+ * @return size WordKind flags, for start onwards.
+ */
+std::vector<std::uint8_t> map_code(const std::uint16_t* memory, std::uint16_t start, std::uint32_t size);
+
+/**
+ * @brief Writes the listing of a segment: code lines as disassemble_instruction() formats them,
+ * data as ".FILL 0x1234" or ".STRINGZ \"...\"" lines.
+ * A run of data words holding characters and ending in a zero is a string
+ * if it has two or more characters or the code names its first word.
+ * @param out The stream; written DISASSEMBLY_CHUNK_SIZE bytes at a time, not flushed.
+ * @param memory All MEMORY_MAX words.
+ * @param start The address of the segment's first word.
+ * @param kinds The segment's flags from map_code().
+ */
+void write_listing(std::ostream& out, const std::uint16_t* memory, std::uint16_t start,
+                   const std::vector<std::uint8_t>& kinds);
+
+#endif // LC3_DISASSEMBLER_H
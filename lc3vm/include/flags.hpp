@@ -5,6 +5,8 @@
 #ifndef LC3_FLAGS_H
 #define LC3_FLAGS_H
 
+#include <cstdint>
+
 /**
  * @brief Enumeration for LC-3 condition flags.
  * These flags are set by arithmetic and logical operations.
@@ -15,4 +17,14 @@ enum StatusFlags {
     FL_NEG = 1 << 2   ///< Negative condition flag (N)
 };
 
+/**
+ * @brief Computes the condition flag a result value sets.
+ * @param value The value just written to a general-purpose register.
+ * @return FL_ZRO, FL_NEG or FL_POS.
+ */
+inline std::uint16_t flag_for(std::uint16_t value) {
+    if (value == 0) return FL_ZRO;
+    return (value >> 15) ? FL_NEG : FL_POS;
+}
+
 #endif // LC3_FLAGS_H
\ No newline at end of file
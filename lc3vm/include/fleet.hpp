@@ -0,0 +1,101 @@
+/**
+ * @file fleet.hpp
+ * @brief Defines the runner executing many independent VMs in one process.
+ *
+ * A Fleet takes a list of jobs, each an LC-3 program with its own scripted
+ * input, and runs them on a pool of worker threads, one per host core by
+ * default. Every VM executes in slices of FLEET_SLICE instructions; a VM
+ * that is not finished after a slice goes to the back of the deque of the
+ * worker that ran it, which takes turns among its VMs, and workers whose
+ * deque is empty steal from the others, so long and short jobs spread
+ * evenly over the cores and a long job does not hold up the ones behind
+ * it. Each VM has a BufferConsole, so input comes from the job and output
+ * is captured in memory instead of touching standard input and output.
+ */
+#ifndef LC3_FLEET_H
+#define LC3_FLEET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include "lc3.hpp"
+
+/** @brief Instructions a fleet VM executes before it yields its worker. */
+#define FLEET_SLICE 100000
+
+/** @brief VMs each worker keeps alive at once; further jobs start as earlier ones finish. */
+#define FLEET_VMS_PER_WORKER 4
+
+/** @brief KBSR polls without a key after FleetJob::input is used up that end a job as out of input. */
+#define FLEET_IDLE_POLLS 65536
+
+/**
+ * @brief One program to run in a Fleet.
+ */
+struct FleetJob {
+    /** @brief Object files loaded with LC3State::load_images(); ignored if snapshot is set. */
+    std::vector<std::string> images;
+    /** @brief State to start from instead of images; must outlive Fleet::run(). */
+    const Snapshot* snapshot = nullptr;
+    /** @brief Keys the program reads. */
+    std::string input;
+    /** @brief Instructions after which the job is stopped with StopReason::BudgetExhausted. */
+    std::uint64_t max_instructions = std::numeric_limits<std::uint64_t>::max();
+    /** @brief Engine the VM runs on. */
+    ExecutionMode mode = ExecutionMode::Interpreter;
+};
+
+/**
+ * @brief Outcome of one FleetJob.
+ */
+struct FleetResult {
+    /**
+     * @brief Why the job ended.
+     * StopReason::WaitingForInput means the program wanted more input than
+     * FleetJob::input provided, in a GETC or IN trap or by polling KBSR
+     * FLEET_IDLE_POLLS times after the input was used up;
+     * StopReason::BudgetExhausted means it reached FleetJob::max_instructions.
+     */
+    StopReason reason = StopReason::Halted;
+    std::uint16_t fault_pc = 0;    ///< Address of the faulting or waiting instruction.
+    std::uint64_t instructions = 0; ///< Instructions retired in total.
+    std::size_t finish_order = 0;  ///< How many jobs of the run finished before this one.
+    std::string output;            ///< Everything the program wrote to the console.
+    /** @brief Why the job could not be started, e.g. a missing image; empty if it ran. */
+    std::string error;
+};
+
+/**
+ * @brief Runs batches of jobs on a work-stealing thread pool.
+ */
+class Fleet {
+    public:
+        /**
+         * @brief Creates a fleet.
+         * @param threads Number of worker threads; 0 uses one per hardware thread.
+         */
+        explicit Fleet(unsigned threads = 0);
+
+        /**
+         * @brief Returns the number of worker threads run() uses.
+         * @return The thread count.
+         */
+        unsigned threads() const { return thread_count; }
+
+        /**
+         * @brief Runs every job to completion.
+         * Failing jobs do not affect the others: load errors end up in
+         * FleetResult::error and guest faults in FleetResult::reason.
+         * @param jobs The jobs.
+         * @return One result per job, in the order of jobs.
+         * @throw std::system_error if the worker threads cannot be started.
+         */
+        std::vector<FleetResult> run(const std::vector<FleetJob>& jobs);
+
+    private:
+        unsigned thread_count; ///< Worker threads per run().
+};
+
+#endif // LC3_FLEET_H
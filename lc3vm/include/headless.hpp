@@ -0,0 +1,112 @@
+/**
+ * @file headless.hpp
+ * @brief Defines headless runs: scripted keyboard input, output to a descriptor, no terminal.
+ *
+ * A headless run feeds the guest a script of keys read up front from a file
+ * or pipe and writes its output to any descriptor, so interactive programs
+ * can be driven unattended. Keys are normally available as fast as the guest
+ * takes them. With a key delay, each key taken holds back the next one until
+ * the guest has retired that many more instructions, like a typist pausing
+ * between keystrokes; a guest blocked in GETC or IN receives the held key
+ * at once, since it retires no instructions while it waits. A guest that
+ * keeps polling KBSR after the script is used up will never see another
+ * key, so the run ends as out of input.
+ */
+#ifndef LC3_HEADLESS_H
+#define LC3_HEADLESS_H
+
+#include "console.hpp"
+#include "lc3.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unistd.h>
+
+/** @brief Instructions per run_for() slice of a headless run without a key delay. */
+#define HEADLESS_SLICE 1000000
+
+/** @brief KBSR polls without a key after the script is used up that end a headless run as out of input. */
+#define HEADLESS_IDLE_POLLS 65536
+
+/**
+ * @brief Console delivering keys from a script and writing output to a descriptor.
+ *
+ * Reads never wait: once the script is used up, or while the next key is
+ * held, the guest sees no key.
+ */
+class ScriptConsole : public Console {
+    public:
+        /**
+         * @brief Creates a console.
+         * @param keys The keys to deliver, in order.
+         * @param out_fd The descriptor output is written to; it stays owned by the caller.
+         * @param paced Whether taking a key holds the next one until release().
+         */
+        explicit ScriptConsole(std::string keys, int out_fd = STDOUT_FILENO, bool paced = false);
+
+        /**
+         * @brief Returns whether the next key is held back.
+         * @return true from a key being taken by a paced console until release().
+         */
+        bool held() const { return holding; }
+
+        /**
+         * @brief Makes the next key available.
+         */
+        void release() { holding = false; }
+
+        /**
+         * @brief Returns the number of keys not yet taken.
+         * @return The count.
+         */
+        std::size_t remaining_input() const { return keys.size() - position; }
+
+        /**
+         * @brief Returns whether the guest has kept asking for keys after the script was used up.
+         * @return true once HEADLESS_IDLE_POLLS reads have found no key left.
+         */
+        bool out_of_input() const { return idle_polls >= HEADLESS_IDLE_POLLS; }
+
+        void connect(OutputBuffer& output) override;
+        bool key_pending() override { return !holding && position < keys.size(); }
+        bool read_key(char& c, bool wait) override;
+        void wait_for_key(std::chrono::milliseconds) override {}
+
+    private:
+        std::string keys;      ///< The script, consumed from position on.
+        std::size_t position;  ///< Index of the next key.
+        int out_fd;            ///< Descriptor output is written to.
+        bool paced;            ///< Whether taking a key sets holding.
+        bool holding = false;  ///< Whether the next key is held back.
+        std::uint32_t idle_polls = 0; ///< Reads made after the script was used up.
+};
+
+/**
+ * @brief Reads a whole input script.
+ * @param path The file to read, or "-" for standard input; pipes are read to their end.
+ * @return The keys.
+ * @throw std::runtime_error if the file cannot be read.
+ */
+std::string read_script(const std::string& path);
+
+/**
+ * @brief Runs a VM on a script until it halts, faults, runs out of input or exhausts a budget.
+ *
+ * Without a key delay the VM runs in slices of HEADLESS_SLICE instructions.
+ * With one, a held key is released after key_delay instructions, counted from
+ * the end of the slice that took the previous key; slices are then an
+ * eighth of the delay long, so the guest sees each key at most that much
+ * late. The console must be a paced ScriptConsole for the delay to apply.
+ * @param vm The VM, using console.
+ * @param console The script.
+ * @param key_delay Instructions between a key being taken and the next one becoming available; 0 for none.
+ * @param max_instructions Budget of the whole run.
+ * @return The combined result: Halted, a fault, WaitingForInput once the
+ *         script is used up and the guest blocks in GETC or IN or keeps
+ *         polling KBSR (fault_pc is then the PC the run stopped at), or
+ *         BudgetExhausted.
+ */
+RunResult run_headless(LC3State& vm, ScriptConsole& console, std::uint64_t key_delay,
+                       std::uint64_t max_instructions);
+
+#endif // LC3_HEADLESS_H
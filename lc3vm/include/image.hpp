@@ -0,0 +1,126 @@
+/**
+ * @file image.hpp
+ * @brief Defines read-only access to LC-3 object files.
+ *
+ * An object file is a big-endian origin word followed by big-endian program
+ * words. ProgramImage maps the file instead of reading it, so loading copies
+ * each word exactly once: from the page cache straight into guest memory,
+ * byte-swapped on the way by Memory::load().
+ *
+ * A SharedImage holds the memory contents produced by loading a set of
+ * object files, once per process. Any number of VMs can map it copy-on-write
+ * with LC3State::load_shared_image(), so they share the pages they never
+ * write.
+ */
+#ifndef LC3_IMAGE_H
+#define LC3_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief An LC-3 object file mapped into the host address space.
+ *
+ * Files that cannot be mapped, such as pipes, are read into a buffer instead.
+ * Program words that would extend past the end of guest memory are ignored,
+ * as is a trailing odd byte.
+ */
+class ProgramImage {
+    public:
+        /**
+         * @brief Opens and maps an object file.
+         * @param filename The path to the .obj file.
+         * @throw std::runtime_error if the file cannot be opened or has no origin word.
+         */
+        explicit ProgramImage(const std::string& filename);
+
+        /**
+         * @brief Unmaps the file.
+         */
+        ~ProgramImage();
+
+        ProgramImage(const ProgramImage&) = delete;
+        ProgramImage& operator=(const ProgramImage&) = delete;
+
+        /**
+         * @brief Returns the address the program is loaded at.
+         * @return The origin, already converted to host byte order.
+         */
+        std::uint16_t origin() const { return load_address; }
+
+        /**
+         * @brief Returns the program words in the file's big-endian byte order.
+         * @return Pointer to size() words; may be unaligned.
+         */
+        const std::uint16_t* words() const { return payload; }
+
+        /**
+         * @brief Returns the number of program words that fit in guest memory.
+         * @return The word count.
+         */
+        std::size_t size() const { return word_count; }
+
+    private:
+        void* mapping;                  ///< Start of the mapped file, or nullptr if it was read into buffer.
+        std::size_t mapping_length;     ///< Length of the mapping in bytes.
+        std::vector<std::uint8_t> buffer; ///< File contents when the file could not be mapped.
+        const std::uint16_t* payload;   ///< First program word.
+        std::size_t word_count;         ///< Program words within guest memory.
+        std::uint16_t load_address;     ///< Origin in host byte order.
+};
+
+/**
+ * @brief Guest memory contents built from object files, shareable between VMs.
+ *
+ * The MEMORY_MAX words live in an anonymous shared-memory file (memfd).
+ * Memory::map_image() maps that file privately, so the kernel shares its
+ * pages between all VMs using the image and copies a page only when a VM
+ * first writes to it. Where memfd_create() is unavailable the words are kept
+ * in ordinary memory and map_image() copies them instead.
+ */
+class SharedImage {
+    public:
+        /**
+         * @brief Loads object files, later ones overwriting earlier ones where they overlap.
+         * @param filenames The .obj files, in load order.
+         * @throw std::runtime_error if a file cannot be loaded.
+         * @throw std::bad_alloc if the memory for the image cannot be mapped.
+         */
+        explicit SharedImage(const std::vector<std::string>& filenames);
+
+        /**
+         * @brief Releases the image; VMs that mapped it keep their copy-on-write view.
+         */
+        ~SharedImage();
+
+        SharedImage(const SharedImage&) = delete;
+        SharedImage& operator=(const SharedImage&) = delete;
+
+        /**
+         * @brief Returns the image contents.
+         * @return MEMORY_MAX words in host byte order.
+         */
+        const std::uint16_t* words() const { return view; }
+
+        /**
+         * @brief Returns the shared-memory file holding words().
+         * @return The descriptor, or -1 if the words are not backed by a file.
+         */
+        int descriptor() const { return fd; }
+
+        /**
+         * @brief Returns where each file was loaded.
+         * @return Origin and word count of every non-empty file, in load order.
+         */
+        const std::vector<std::pair<std::uint16_t, std::uint16_t>>& ranges() const { return loaded; }
+
+    private:
+        int fd;               ///< memfd holding the words, or -1.
+        std::uint16_t* view;  ///< Read-only mapping of the words.
+        std::vector<std::pair<std::uint16_t, std::uint16_t>> loaded; ///< See ranges().
+};
+
+#endif // LC3_IMAGE_H
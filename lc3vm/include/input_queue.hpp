@@ -0,0 +1,139 @@
+/**
+ * @file input_queue.hpp
+ * @brief Defines the keyboard input ring buffer and the thread filling it.
+ *
+ * A single InputReader thread reads the input file descriptor and pushes the
+ * bytes into an InputQueue; the VM thread pops them when the guest polls
+ * KBSR or executes GETC/IN. Pushing and popping are lock-free, so the guest's
+ * polling loop makes no system calls. Only a consumer that has to wait for
+ * input sleeps on a condition variable.
+ */
+#ifndef LC3_INPUT_QUEUE_H
+#define LC3_INPUT_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+/** @brief Capacity of an InputQueue in bytes; must be a power of two. */
+#define INPUT_QUEUE_CAPACITY 4096
+
+/**
+ * @brief Single-producer single-consumer ring buffer of input bytes.
+ */
+class InputQueue {
+    public:
+        /**
+         * @brief Appends a byte. Must only be called by the producer.
+         * @param c The byte.
+         * @return false if the queue is full.
+         */
+        bool push(char c) {
+            std::size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == INPUT_QUEUE_CAPACITY) return false;
+            buffer[t & (INPUT_QUEUE_CAPACITY - 1)] = c;
+            tail.store(t + 1, std::memory_order_release);
+            wake();
+            return true;
+        }
+
+        /**
+         * @brief Removes the oldest byte without waiting. Must only be called by the consumer.
+         * @param c Receives the byte.
+         * @return false if the queue is empty.
+         */
+        bool pop(char& c) {
+            std::size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) return false;
+            c = buffer[h & (INPUT_QUEUE_CAPACITY - 1)];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief Checks whether a byte is available to the consumer.
+         * @return true if pop() would succeed.
+         */
+        bool empty() const {
+            return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @brief Removes the oldest byte, waiting for one if necessary.
+         * @param c Receives the byte.
+         * @return false if the queue is empty and close() was called.
+         */
+        bool wait_pop(char& c);
+
+        /**
+         * @brief Waits until a byte is available, the queue is closed or a timeout expires.
+         * @param timeout The longest time to wait.
+         * @return true if a byte is available.
+         */
+        bool wait_for(std::chrono::milliseconds timeout);
+
+        /**
+         * @brief Marks the end of input and wakes a waiting consumer.
+         * Bytes already queued can still be popped.
+         */
+        void close();
+
+        /**
+         * @brief Checks whether close() was called.
+         * @return true once no further input will arrive.
+         */
+        bool closed() const { return finished.load(std::memory_order_acquire); }
+
+    private:
+        std::array<char, INPUT_QUEUE_CAPACITY> buffer{};
+        alignas(64) std::atomic<std::size_t> head{0}; ///< Next index to pop; written by the consumer.
+        alignas(64) std::atomic<std::size_t> tail{0}; ///< Next index to push; written by the producer.
+        std::atomic<bool> finished{false};            ///< Set by close().
+        std::atomic<bool> waiting{false};             ///< Set while the consumer sleeps in wait_pop().
+        std::mutex wait_mutex;                        ///< Guards the sleep in wait_pop().
+        std::condition_variable wait_condition;       ///< Signalled by push() and close() while waiting.
+
+        /**
+         * @brief Wakes the consumer if it sleeps in wait_pop().
+         */
+        void wake();
+};
+
+/**
+ * @brief Thread reading a file descriptor into an InputQueue until stopped, end of input or a read error.
+ */
+class InputReader {
+    public:
+        /**
+         * @brief Starts the reader thread.
+         * @param queue The queue to fill; must outlive the reader.
+         * @param fd The descriptor to read, usually STDIN_FILENO.
+         * @throw std::runtime_error if the thread's wake-up pipe cannot be created.
+         */
+        InputReader(InputQueue& queue, int fd);
+
+        /**
+         * @brief Stops and joins the reader thread.
+         */
+        ~InputReader();
+
+        InputReader(const InputReader&) = delete;
+        InputReader& operator=(const InputReader&) = delete;
+
+    private:
+        InputQueue& queue;
+        int fd;
+        int stop_pipe[2]; ///< Written by the destructor to interrupt the thread's poll().
+        std::thread thread;
+
+        /**
+         * @brief Body of the reader thread.
+         */
+        void loop();
+};
+
+#endif // LC3_INPUT_QUEUE_H
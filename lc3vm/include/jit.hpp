@@ -0,0 +1,137 @@
+/**
+ * @file jit.hpp
+ * @brief Defines the x86-64 JIT backend compiling hot superblocks to native code.
+ *
+ * Compiled blocks keep R0-R7 in r8d-r15d and COND in ebp for their whole
+ * body; PC is a compile-time constant inside a block and is only materialized
+ * on exit. Loads and stores go straight to the memory array, except loads from
+ * PAGE_DEVICE pages and stores to pages with any PageFlags bit set, which call
+ * back into Memory::read and Memory::write. A terminating TRAP or illegal
+ * opcode is left to the interpreter. A block whose BR targets its own start
+ * loops natively until the branch falls through or JitContext::loop_budget
+ * runs out.
+ *
+ * On hosts other than x86-64 the compiler is unavailable and compile() always
+ * fails, so ExecutionMode::Jit degrades to plain superblock execution.
+ */
+#ifndef LC3_JIT_H
+#define LC3_JIT_H
+
+#include "registers.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class LC3State;
+struct Block;
+
+/** @brief Number of times a superblock is interpreted before it is compiled. */
+#define JIT_HOT_THRESHOLD 32
+
+/**
+ * @brief Shortest superblock worth compiling unless it loops back to its own start.
+ * Entering native code costs a prologue and a copy of the register file each
+ * way, which shorter blocks, such as subroutine calls and returns, do not win back.
+ */
+#define JIT_MIN_LENGTH 4
+
+/** @brief Back-edges a self-looping compiled block may take before returning to the run loop. */
+#define JIT_LOOP_BUDGET 4096
+
+/** @brief Size of the executable code arena in bytes. */
+#define JIT_ARENA_SIZE (4 << 20)
+
+/**
+ * @brief State shared between the run loop and compiled code.
+ * The layout is fixed because generated code addresses the fields by offset.
+ */
+struct JitContext {
+    std::uint16_t reg[R_COUNT];     ///< Register file loaded on entry and stored on exit.
+    std::uint16_t* memory;          ///< Base of Memory::memory.
+    const std::uint8_t* page_flags; ///< Memory's per-page PageFlags bits.
+    LC3State* state;                ///< VM used by the Memory::read/Memory::write callbacks.
+    std::uint32_t loop_budget;      ///< Back-edges a self-looping block may still take; nonzero on entry.
+};
+
+/**
+ * @brief How a compiled block returned, stored in the low two bits of its return value.
+ * The remaining bits hold the number of instructions executed in the final
+ * pass through the block, including a terminator still left to the run loop.
+ * Passes of a self-looping block that reached its back-edge are counted by the
+ * decrease of JitContext::loop_budget instead.
+ */
+enum JitExit {
+    JIT_EXIT_FALLTHROUGH = 0, ///< Continue at the block's EXIT_FALLTHROUGH successor.
+    JIT_EXIT_TAKEN = 1,       ///< Continue at the block's EXIT_TAKEN successor.
+    JIT_EXIT_DYNAMIC = 2,     ///< Continue at the PC stored in the context (JMP, JSRR, invalidated code).
+    JIT_EXIT_TERMINATOR = 3   ///< Body done; the terminating TRAP or illegal opcode must be interpreted.
+};
+
+/** @brief Entry point of a compiled block. */
+using JitFunction = std::uint32_t (*)(JitContext* context);
+
+/**
+ * @brief Compiles superblocks into an mmap'd code arena.
+ *
+ * The arena is only writable while code is being copied into it and is
+ * executable otherwise. When it is full, compile() fails and the caller is
+ * expected to drop every compiled block and call reset().
+ */
+class JitCompiler {
+    public:
+        JitCompiler();
+        ~JitCompiler();
+
+        JitCompiler(const JitCompiler&) = delete;
+        JitCompiler& operator=(const JitCompiler&) = delete;
+
+        /**
+         * @brief Checks whether native code can be generated on this host.
+         * @return true if the arena was mapped and the host is x86-64.
+         */
+        bool available() const { return arena != nullptr; }
+
+        /**
+         * @brief Compiles a superblock.
+         * @param block The block to compile.
+         * @return The entry point, or nullptr if the JIT is unavailable or the arena is full.
+         */
+        JitFunction compile(const Block& block);
+
+        /**
+         * @brief Discards all generated code.
+         * Entry points returned earlier must no longer be called.
+         */
+        void reset();
+
+        /**
+         * @brief Returns the number of blocks compiled since the last reset().
+         * @return The block count.
+         */
+        std::size_t compiled_blocks() const { return compiled; }
+
+    private:
+        std::uint8_t* arena;   ///< Executable mapping, or nullptr when unavailable.
+        std::size_t used;      ///< Bytes of the arena in use.
+        std::size_t compiled;  ///< Blocks compiled since the last reset.
+        std::vector<std::uint8_t> code; ///< Scratch buffer the next block is assembled into.
+
+        /**
+         * @brief Called by compiled code to read a word from a device page.
+         * @param context The context of the running block.
+         * @param address The address to read.
+         * @return The value returned by Memory::read.
+         */
+        static std::uint32_t read_callback(JitContext* context, std::uint32_t address);
+
+        /**
+         * @brief Called by compiled code to store to a page with PageFlags set.
+         * @param context The context of the running block.
+         * @param address The address to write.
+         * @param value The value to write.
+         * @return Nonzero if the store invalidated translated code.
+         */
+        static std::uint32_t write_callback(JitContext* context, std::uint32_t address, std::uint32_t value);
+};
+
+#endif // LC3_JIT_H
@@ -5,6 +5,10 @@
 #ifndef LC3_KEYBOARD_H
 #define LC3_KEYBOARD_H
 
+#include "console.hpp"
+#include "device.hpp"
+#include "output_buffer.hpp"
+#include <chrono>
 #include <cstdint>
 
 /**
@@ -19,6 +23,15 @@ enum Keyboard {
 
 };
 
+/** @brief Consecutive KBSR polls without a key after which the poll rate is checked. */
+#define KBSR_IDLE_POLLS 1024
+
+/** @brief KBSR_IDLE_POLLS misses within this many microseconds mark the guest as idle. */
+#define KBSR_IDLE_WINDOW_US 5000
+
+/** @brief Longest time an idle guest's KBSR poll waits on the host for input. */
+#define KBSR_IDLE_TIMEOUT_MS 20
+
 /**
  * @brief Gets a key from standard input (non-blocking if possible, platform dependent).
  * This function is intended to be called when MR_KBSR indicates a key is ready.
@@ -28,4 +41,85 @@ enum Keyboard {
  */
 std::uint16_t get_key();
 
+/**
+ * @brief The keyboard status and data registers, mapped on the MR_KBSR page.
+ *
+ * Reading MR_KBSR polls for input and latches a pending key into MR_KBDR.
+ * All registers are backed by Memory::memory.
+ *
+ * Input comes from the attached Console, standard_console() until a VM
+ * attaches its own. Every read of input first flushes the attached
+ * OutputBuffer, so a prompt is visible before the guest waits for its answer.
+ *
+ * A guest spinning on KBSR, i.e. one polling it KBSR_IDLE_POLLS times without
+ * a key within KBSR_IDLE_WINDOW_US and without writing memory or producing
+ * output in between, has nothing to do but wait. Its next poll blocks the
+ * host thread until input arrives or KBSR_IDLE_TIMEOUT_MS pass and then
+ * still reports no key, so the guest sees the same register values as with
+ * a busy loop while the host idles. A guest that polls between bouts of
+ * work is never slowed down. Writes are noticed through
+ * Memory::watch_writes(), armed once per window of polls, and output
+ * through the OutputBuffer still holding bytes when a poll flushes it.
+ */
+class KeyboardDevice : public Device {
+    public:
+        std::uint16_t read(Memory& memory, std::uint16_t address) override;
+        void write(Memory& memory, std::uint16_t address, std::uint16_t value) override;
+
+        /**
+         * @brief Selects where keys come from.
+         * @param source The console to read, or nullptr for standard_console().
+         */
+        void attach(Console* source) { console = source ? source : &standard_console(); }
+
+        /**
+         * @brief Sets the output buffer flushed before input is read.
+         * @param buffer The buffer, or nullptr for none.
+         */
+        void attach_output(OutputBuffer* buffer) { output = buffer; }
+
+        /**
+         * @brief Checks without blocking whether a key is available.
+         * @return true if read_key() would return a key immediately.
+         */
+        bool key_pending() const { return console->key_pending(); }
+
+        /**
+         * @brief Takes the next key, as used by KBSR polling and the GETC/IN traps.
+         * @param c Receives the key.
+         * @param wait Whether to wait for a key when none is pending.
+         * @return false if no key was available (or input ended while waiting).
+         */
+        bool read_key(char& c, bool wait);
+
+        /**
+         * @brief Enables or disables host waits for guests spinning on KBSR.
+         * @param enabled Whether idle polls may block; enabled by default.
+         */
+        void set_idle_wait(bool enabled) { idle_wait = enabled; }
+
+        /**
+         * @brief Returns how many times an idle guest's KBSR poll waited for input.
+         * @return The number of idle waits.
+         */
+        std::uint64_t idle_waits() const { return waits; }
+
+    private:
+        Console* console = &standard_console(); ///< Where keys come from.
+        OutputBuffer* output = nullptr; ///< Output flushed before each read, if any.
+        bool idle_wait = true;          ///< Whether idle polls may block.
+        unsigned misses = 0;            ///< KBSR polls without a key since the window started.
+        std::chrono::steady_clock::time_point window_start; ///< When the window's first miss happened.
+        std::uint64_t window_writes = 0; ///< Memory::watched_writes() when the window started.
+        bool window_output = false;     ///< Whether the guest produced output during the window.
+        std::uint64_t waits = 0;        ///< Idle waits so far.
+
+        /**
+         * @brief Counts a KBSR poll without a key and waits for input if the guest is idle.
+         * @param memory The memory polled, watched for writes during the window.
+         * @param printed Whether output was pending when the poll flushed it.
+         */
+        void missed_poll(Memory& memory, bool printed);
+};
+
 #endif // LC3_KEYBOARD_H
\ No newline at end of file
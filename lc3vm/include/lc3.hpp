@@ -12,9 +12,25 @@
 #include "registers.hpp"
 #include "flags.hpp"
 #include "opcodes.hpp"
+#include "decode_cache.hpp"
+#include "superblock.hpp"
+#include "jit.hpp"
+#include "console.hpp"
+#include "output_buffer.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
+#include <iosfwd>
 #include <string>
 #include <array>
+#include <atomic>
 #include <vector>
+#include <stdexcept>
+#include <memory>
+#include <chrono>
+
+class ProgramImage;
+struct AssembledProgram;
+class ControlFlowGraph;
 
 /**
  * @brief Represents a loaded code/data segment in memory.
@@ -24,6 +40,64 @@ struct CodeSegment {
     std::uint16_t size;          ///< The size of the segment in words.
 };
 
+/**
+ * @brief Selects how run() executes instructions.
+ */
+enum class ExecutionMode {
+    Interpreter, ///< One decoded instruction at a time (threaded dispatch when enabled at build time).
+    Superblock,  ///< Translated straight-line blocks from the BlockCache, chained directly.
+    Jit          ///< Superblocks, with hot blocks compiled to native code by the JitCompiler.
+};
+
+/** @brief Instructions run_until() executes between two checks of the clock. */
+#define RUN_UNTIL_SLICE 65536
+
+/** @brief Instructions run() executes between two checks for pending output that is due. */
+#define RUN_OUTPUT_SLICE (1 << 20)
+
+/**
+ * @brief Why run_for() or run_until() returned.
+ */
+enum class StopReason {
+    Halted,          ///< A HALT trap executed or request_halt() was called.
+    BudgetExhausted, ///< The instruction budget or the deadline ran out; the VM can be resumed.
+    IllegalOpcode,   ///< RTI or the reserved opcode was executed.
+    UnknownTrap,     ///< A TRAP with an unsupported vector was executed.
+    WaitingForInput  ///< GETC or IN found no pending input; PC still points at the TRAP.
+};
+
+/**
+ * @brief Outcome of a budgeted run.
+ */
+struct RunResult {
+    StopReason reason;          ///< Why execution stopped.
+    std::uint16_t fault_pc;     ///< Address of the faulting or waiting instruction, 0 for Halted and BudgetExhausted.
+    std::uint64_t instructions; ///< Instructions retired; the faulting or waiting instruction is not counted.
+};
+
+/**
+ * @brief A copy of a VM's complete state, taken by LC3State::snapshot().
+ *
+ * Holds memory, registers, the run state, the loaded segments and the state
+ * of mapped devices. The contents are opaque; a snapshot can only be passed
+ * back to LC3State::restore(), of the same VM or of another one.
+ */
+class Snapshot {
+    private:
+        friend class LC3State;
+
+        std::uint64_t id;                          ///< Unique among all snapshots of the process.
+
+        std::vector<std::uint16_t> memory;         ///< All MEMORY_MAX words.
+        std::array<std::uint16_t, R_COUNT> reg;    ///< Register file.
+        bool running;                              ///< LC3State::running.
+        StopReason stop_reason;                    ///< LC3State::stop_reason.
+        std::uint16_t fault_pc;                    ///< LC3State::fault_pc.
+        std::vector<CodeSegment> segments;         ///< LC3State::loaded_code_segments.
+        /** @brief First page and saved state of each run of pages mapped to the same device. */
+        std::vector<std::pair<unsigned, std::vector<std::uint8_t>>> devices;
+};
+
 /**
  * @brief Represents the state of an LC-3 virtual machine.
  *
@@ -34,6 +108,11 @@ struct CodeSegment {
 class LC3State {
     public:
         Memory memory;  // Made public for testing
+        /**
+         * @brief Console output of the guest, delivered to the console.
+         * Flushed when the guest reads input, on HALT, when full, and periodically by run().
+         */
+        OutputBuffer output;
     private:
         /**
          * @brief Array of 16-bit registers.
@@ -49,14 +128,174 @@ class LC3State {
          */
         void update_flags(std::uint16_t r);
         bool running; ///< Flag indicating whether the LC-3 VM is currently running.
+        std::atomic<bool> halt_requested{false}; ///< Set by request_halt() until a run loop acts on it.
+        StopReason stop_reason; ///< Why running was last cleared.
+        std::uint16_t fault_pc; ///< Address of the instruction that set a fault stop_reason.
+        /**
+         * @brief Whether GETC and IN may block for input.
+         * Cleared during run_for() so they stop with StopReason::WaitingForInput instead.
+         */
+        bool blocking_input;
+
+        std::unique_ptr<Console> console;  ///< Console of the guest, an FdConsole on standard input and output by default.
+        Console* bound_console = nullptr;  ///< Console output and keyboard are currently connected to.
+        FdConsole* reader_console = nullptr; ///< console, if created by start_input_thread().
+
+        /**
+         * @brief Connects output and the keyboard device to the console in use, if it changed.
+         * Called when execution starts, so traps and KBSR polls never choose a console themselves.
+         */
+        void bind_console();
 
         std::vector<CodeSegment> loaded_code_segments; ///< Stores info about loaded program segments.
+
+        /**
+         * @brief Snapshot::id that memory equals apart from dirty pages, or 0 for none.
+         * Only valid while memory.dirty_epoch() still equals baseline_epoch.
+         */
+        std::uint64_t baseline_id = 0;
+        std::uint64_t baseline_epoch = 0; ///< memory.dirty_epoch() when the baseline was set.
+
+        /**
+         * @brief Returns the pages in which memory may differ from a snapshot.
+         * @param snapshot The snapshot.
+         * @return The dirty pages if snapshot is the baseline, else every page.
+         */
+        DirtyPages pages_changed_since(const Snapshot& snapshot) const;
      
         /**
-         * @brief Table of function pointers for dispatching LC-3 opcodes.
-         * Each entry corresponds to an opcode and points to its handler function.
+         * @brief Table of decoded-instruction handlers, indexed by opcode.
+         * decode() copies the entry for an instruction's opcode into DecodedInstruction::handler.
+         */
+        static const std::array<void(*)(LC3State&, const DecodedInstruction&), 16> op_table;
+
+        /**
+         * @brief Decoded form of every instruction executed so far, keyed by address.
+         * Entries are dropped by on_code_write() when the word they were decoded from changes.
+         */
+        DecodeCache decode_cache;
+
+        /**
+         * @brief Translated superblocks used by run() in ExecutionMode::Superblock.
+         * Invalidated by on_code_write() together with the decode cache.
+         */
+        BlockCache block_cache;
+
+        ExecutionMode execution_mode; ///< Engine used by run().
+
+        /**
+         * @brief Native code generator for ExecutionMode::Jit, created on first use.
+         */
+        std::unique_ptr<JitCompiler> jit;
+
+        friend class JitCompiler;
+
+        /**
+         * @brief Holds the decoded instruction when fetching a word that is never cached.
+         */
+        DecodedInstruction uncached_instruction;
+
+        /**
+         * @brief Returns the decoded instruction at an address, decoding and caching it on a miss.
+         * Words on pages mapped to a Device are decoded on every fetch since
+         * reading them has side effects, and so is the last word of memory, so
+         * that run_threaded() can charge runs wrapping around to the budget.
+         * @param address The address of the instruction.
+         * @return Reference to the decoded instruction.
+         */
+        const DecodedInstruction& fetch(std::uint16_t address);
+
+        /**
+         * @brief Copies a mapped image into memory without recording its segment.
+         * @param image The image.
+         */
+        void place_image(const ProgramImage& image);
+
+        /**
+         * @brief Memory write hook dropping stale decode cache entries and superblocks.
+         * @param context The LC3State owning the memory.
+         * @param address The address that was written.
+         */
+        static void on_code_write(void* context, std::uint16_t address);
+
+        /**
+         * @brief Stops the VM because of the instruction just executed.
+         * Called by handlers with PC already pointing past the instruction.
+         * @param reason The fault; never StopReason::Halted or StopReason::BudgetExhausted.
+         */
+        void fault(StopReason reason);
+
+        /**
+         * @brief Halts the VM if request_halt() was called since the last check.
+         * @return true if the VM was halted.
+         */
+        bool take_halt_request();
+
+        /**
+         * @brief Throws the exception the legacy run() and step() API reports a fault with.
+         * Does nothing unless stop_reason is StopReason::IllegalOpcode or
+         * StopReason::UnknownTrap; otherwise the running flag is set again first.
+         * @throw std::runtime_error for StopReason::IllegalOpcode and StopReason::UnknownTrap.
+         */
+        void throw_fault();
+
+        /**
+         * @brief Checks whether GETC or IN can complete without waiting.
+         * @return true when input may block or the console has a key pending.
+         */
+        bool input_ready() const;
+
+        /**
+         * @brief Executes one instruction like step(), reporting faults only through stop_reason.
+         */
+        void execute_one();
+
+        /**
+         * @brief Runs the selected engine until it stops or budget instructions have retired.
+         * @param budget Maximum number of instructions to retire.
+         * @return The number of instructions retired.
+         */
+        std::uint64_t execute(std::uint64_t budget);
+
+        /**
+         * @brief Threaded-code run loop used by run() when built with LC3_THREADED_DISPATCH.
+         * Keeps the registers in locals and only writes them back around TRAPs,
+         * which are also the only points where the running flag is checked.
+         * @param budget Maximum number of instructions to retire.
+         * @return The number of instructions retired.
+         */
+        std::uint64_t run_threaded(std::uint64_t budget);
+
+        /**
+         * @brief Run loop used by run() in ExecutionMode::Superblock and ExecutionMode::Jit.
+         * Executes whole superblocks and only checks the running flag after TRAPs.
+         * In ExecutionMode::Jit a block entered JIT_HOT_THRESHOLD times is compiled
+         * and runs natively from then on. A block longer than the remaining budget
+         * is executed one instruction at a time.
+         * @param budget Maximum number of instructions to retire.
+         * @return The number of instructions retired.
+         */
+        std::uint64_t run_superblocks(std::uint64_t budget);
+
+        /**
+         * @brief Execution counts gathered while profiling, or nullptr when not profiling.
+         */
+        std::unique_ptr<Profile> profiler;
+
+        /**
+         * @brief Trace the VM appends retired instructions to, or nullptr when not tracing.
+         * Not owned.
+         */
+        TraceWriter* tracer = nullptr;
+
+        /**
+         * @brief Run loop used instead of the selected engine while profiling or tracing.
+         * Executes one decoded instruction at a time and records each retired one
+         * in profiler and tracer.
+         * @param budget Maximum number of instructions to retire.
+         * @return The number of instructions retired.
          */
-        static const std::array<void(*)(LC3State&, std::uint16_t), 16> op_table;
+        std::uint64_t run_instrumented(std::uint64_t budget);
 
     public:
         /**
@@ -69,6 +308,24 @@ class LC3State {
         template <unsigned op>
         static void ins(LC3State& state, std::uint16_t instr);
 
+        /**
+         * @brief Executes an already decoded LC-3 instruction.
+         * This is a template function specialized for each opcode. RTI, RES and
+         * unknown TRAP vectors stop the VM with a fault StopReason instead of throwing.
+         * @tparam op The opcode to execute (e.g., OP_ADD, OP_LD).
+         * @param state Reference to the current LC3State.
+         * @param decoded The decoded instruction.
+         */
+        template <unsigned op>
+        static void exec(LC3State& state, const DecodedInstruction& decoded);
+
+        /**
+         * @brief Splits an instruction word into its fields.
+         * @param instr The 16-bit instruction word.
+         * @return The decoded instruction, with its handler selected by opcode.
+         */
+        static DecodedInstruction decode(std::uint16_t instr);
+
         /**
          * @brief Constructs a new LC3State object.
          * Initializes registers (PC to 0x3000, COND to FL_ZRO) and sets the VM to running.
@@ -78,40 +335,254 @@ class LC3State {
          * @brief Destroys the LC3State object.
          */
         ~LC3State();
+
+        /**
+         * @brief LC3State is not copyable.
+         * Its memory reports writes back to the owning object through a pointer.
+         */
+        LC3State(const LC3State&) = delete;
+        LC3State& operator=(const LC3State&) = delete;
         /**
          * @brief Loads an LC-3 program image into memory.
          * @param filename The path to the .obj file to load.
          * @throw std::runtime_error if the file cannot be opened or is malformed.
          */
         void load_image(const std::string& filename);
+        /**
+         * @brief Loads several LC-3 program images, as given on the command line.
+         * The files are mapped concurrently. If no image overlaps another one or
+         * an image loaded earlier, they are also copied into memory concurrently;
+         * otherwise they are copied one after another in the given order, so
+         * later images overwrite earlier ones. Nothing is loaded if any file fails.
+         * @param filenames The paths to the .obj files, in load order.
+         * @throw std::runtime_error if a file cannot be opened or is malformed.
+         */
+        void load_images(const std::vector<std::string>& filenames);
+
+        /**
+         * @brief Loads the segments of an assembled program, in order.
+         * @param program The output of assemble().
+         */
+        void load_program(const AssembledProgram& program);
+
+        /**
+         * @brief Replaces all of memory with a SharedImage, mapped copy-on-write.
+         * Unlike load_images(), the guest shares every page it does not write
+         * with the other VMs using the image, and earlier contents are discarded.
+         * Registers are kept; cached and compiled code is dropped.
+         * @param image The image; may be destroyed afterwards.
+         */
+        void load_shared_image(const SharedImage& image);
+        /**
+         * @brief Returns the VM to its freshly constructed state.
+         * Memory is zeroed, registers and run state are reinitialized, and all
+         * cached and compiled code and the list of loaded segments are dropped.
+         * The execution mode, device mappings, input thread and output buffer are kept.
+         */
+        void reset();
+
+        /**
+         * @brief Captures the complete VM state.
+         * Also resets the memory's dirty tracking, so that a later restore() of
+         * this snapshot and memory_changes() only have to look at pages written
+         * since. Dirty tracking has a single consumer: resetting it elsewhere
+         * just makes the next restore() copy all of memory.
+         * @return A snapshot that restore() can return this or another VM to.
+         */
+        Snapshot snapshot();
+
+        /**
+         * @brief Returns the VM to the state captured by snapshot().
+         * If the VM was last synchronized with the same snapshot, by taking or
+         * restoring it, only pages dirtied since are copied back; otherwise all
+         * of memory is. Cached and compiled code survives wherever the code it
+         * was translated from is unchanged, so a restored program runs at full speed right away.
+         * Devices mapped on the same pages as at snapshot time get their state
+         * back through Device::restore_state(). Execution mode, input and output
+         * are not part of the state.
+         * @param snapshot The snapshot.
+         */
+        void restore(const Snapshot& snapshot);
+
+        /**
+         * @brief Lists the memory words that differ from a snapshot.
+         * Only dirty pages are compared if the VM was last synchronized with the snapshot.
+         * @param snapshot The snapshot.
+         * @return The differing addresses in ascending order.
+         */
+        std::vector<std::uint16_t> memory_changes(const Snapshot& snapshot) const;
+
+        /**
+         * @brief Compares the architectural state of two VMs.
+         * @param other The VM to compare with.
+         * @return true if all registers and all memory words are equal.
+         */
+        bool state_equals(const LC3State& other) const;
+
         /**
          * @brief Runs the LC-3 virtual machine until halted.
-         * Continuously fetches, decodes, and executes instructions.
+         * Continuously fetches, decodes, and executes instructions. In
+         * ExecutionMode::Superblock and ExecutionMode::Jit this uses run_superblocks(); otherwise, when built
+         * with LC3_THREADED_DISPATCH, run_threaded() instead of calling step().
+         * GETC and IN block until input arrives. Every RUN_OUTPUT_SLICE instructions
+         * output that has been pending for OUTPUT_FLUSH_INTERVAL_MS is flushed, and
+         * all of it is flushed before returning.
+         * @throw std::runtime_error if an illegal opcode or unknown TRAP vector is encountered.
          */
         void run();
+
+        /**
+         * @brief Runs the VM for at most a number of instructions.
+         * Never throws for guest faults and never blocks for input: GETC and IN
+         * without pending input stop with StopReason::WaitingForInput and are
+         * retried by the next call. Pending output is flushed on return if it is
+         * due; call output.flush() to force it out.
+         * @param max_instructions Maximum number of instructions to retire.
+         * @return Why execution stopped, the fault PC and the instructions retired.
+         */
+        RunResult run_for(std::uint64_t max_instructions);
+
+        /**
+         * @brief Runs the VM until a deadline, checking the clock every RUN_UNTIL_SLICE instructions.
+         * Behaves like run_for() otherwise.
+         * @param deadline The time after which no further slice is started.
+         * @return Why execution stopped, the fault PC and the instructions retired.
+         */
+        RunResult run_until(std::chrono::steady_clock::time_point deadline);
+
+        /**
+         * @brief Replaces the console.
+         * Pending output is flushed to the old console first.
+         * @param replacement The new console.
+         */
+        void set_console(std::unique_ptr<Console> replacement);
+
+        /**
+         * @brief Replaces the console with a TestConsole on this VM's keyboard registers.
+         */
+        void use_test_console() { set_console(std::unique_ptr<Console>(new TestConsole(memory))); }
+
+        /**
+         * @brief Returns the console set for the guest.
+         * @return The console.
+         */
+        Console& get_console() { return *console; }
+
+        /**
+         * @brief Switches to an FdConsole reading keys on a background thread.
+         * KBSR polling and the GETC/IN traps then consume a ring buffer instead
+         * of issuing a system call per poll. Output keeps going to the current
+         * output descriptor.
+         * @param fd The descriptor to read keys from.
+         * @throw std::runtime_error if the thread cannot be set up.
+         */
+        void start_input_thread(int fd = 0);
+
+        /**
+         * @brief Stops the thread started by start_input_thread() and returns to direct reads.
+         * Keys it already buffered but the guest has not consumed are still delivered.
+         */
+        void stop_input_thread();
+
+        /**
+         * @brief Selects the engine used by run().
+         * @param mode The execution mode.
+         */
+        void set_execution_mode(ExecutionMode mode) { execution_mode = mode; }
+
+        /**
+         * @brief Returns the engine used by run().
+         * @return The execution mode.
+         */
+        ExecutionMode get_execution_mode() const { return execution_mode; }
+
+        /**
+         * @brief Returns how many superblocks are currently compiled to native code.
+         * @return The number of compiled blocks, 0 if the JIT was never used or is unavailable.
+         */
+        std::size_t jit_compiled_blocks() const { return jit ? jit->compiled_blocks() : 0; }
         /**
          * @brief Executes a single LC-3 instruction.
-         * Fetches the instruction at PC, increments PC, and executes the instruction.
+         * Fetches the decoded instruction at PC, increments PC, and executes it.
          * @throw std::runtime_error if an illegal or unsupported opcode is encountered.
          */
         void step();
         /**
          * @brief Disassembles the instruction at a given memory address.
-         * (Currently not implemented)
          * @param address The memory address of the instruction to disassemble.
-         * @return A string representation of the disassembled instruction.
+         * @return The line, e.g. "0x3000: ADD R1, R2, #-1".
          */
         std::string disassemble(std::uint16_t address);
         /**
-         * @brief Disassembles all instructions in loaded memory segments.
-         * (Currently not implemented)
+         * @brief Writes the disassembly of consecutive words, one line each.
+         * Lines are formatted into a buffer and written DISASSEMBLY_CHUNK_SIZE
+         * bytes at a time; the stream is not flushed.
+         * @param out The stream.
+         * @param start The address of the first word.
+         * @param count The number of words, at most MEMORY_MAX; addresses wrap.
+         */
+        void disassemble_range(std::ostream& out, std::uint16_t start, std::uint32_t count);
+        /**
+         * @brief Builds the control-flow graph of the loaded segments.
+         * @return The graph, with its loops, subroutines and unreachable code.
+         */
+        ControlFlowGraph control_flow_graph() const;
+        /**
+         * @brief Lists all loaded segments on standard output.
+         * Code and data are told apart with map_code(), segments being
+         * analyzed concurrently, and listed with write_listing().
          */
         void disassemble_all();
         /**
-         * @brief Requests the VM to halt execution after the current instruction.
-         * Sets the internal running flag to false.
+         * @brief Starts or stops counting executed instructions.
+         * While profiling, run(), run_for() and run_until() replace every engine
+         * with a counting interpreter loop; step() is not counted. Turning
+         * profiling off discards the counts; turning it on again while it is on
+         * keeps those gathered so far.
+         * @param enabled Whether to profile.
+         */
+        void set_profiling(bool enabled);
+
+        /**
+         * @brief Returns the counts gathered while profiling.
+         * @return The profile, or nullptr if profiling is off.
+         */
+        const Profile* profile() const { return profiler.get(); }
+
+        /**
+         * @brief Writes a profile report: instructions per opcode and TRAP vector,
+         * then the hottest addresses with their disassembly, grouped by loaded segment.
+         * @param out The stream to write to.
+         * @param hot The number of hottest addresses to list.
+         * @throw std::logic_error if profiling is off.
+         */
+        void write_profile(std::ostream& out, std::size_t hot = PROFILE_HOT_ADDRESSES);
+
+        /**
+         * @brief Starts or stops appending retired instructions to a trace.
+         * While tracing, run(), run_for() and run_until() replace every engine
+         * with the instrumented interpreter loop also used for profiling;
+         * step() is not traced.
+         * @param trace The trace to append to, or nullptr to stop. Not owned;
+         *              it must outlive its use by the VM.
+         */
+        void set_trace(TraceWriter* trace) { tracer = trace; }
+
+        /**
+         * @brief Returns the trace the VM appends to.
+         * @return The trace, or nullptr if not tracing.
+         */
+        TraceWriter* get_trace() const { return tracer; }
+
+        /**
+         * @brief Requests the VM to halt, e.g. from a signal handler or another thread.
+         * The request is kept until the VM acts on it: a running engine stops
+         * after the next TRAP it executes or at the end of its slice, which for
+         * run() is at most RUN_OUTPUT_SLICE instructions away, and the next
+         * run(), run_for(), run_until() or step() stops at once. Either way the
+         * VM ends up halted with StopReason::Halted.
          */
-        void request_halt() { running = false; }
+        void request_halt() { halt_requested.store(true, std::memory_order_relaxed); }
 
         /**
          * @brief Checks if the VM is currently running.
@@ -5,47 +5,350 @@
 #ifndef LC3_MEMORY_H
 #define LC3_MEMORY_H
 
+#include "device.hpp"
+#include "keyboard.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 
 /** @brief Maximum memory addressable by the LC-3 (2^16 locations). */
 #define MEMORY_MAX 65536
 
+class SharedImage;
+
+/** @brief Number of low address bits selecting a word within a page. */
+#define MEMORY_PAGE_SHIFT 8
+/** @brief Number of words in a page. */
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_SHIFT)
+/** @brief Mask extracting the in-page offset of an address. */
+#define MEMORY_PAGE_MASK (MEMORY_PAGE_SIZE - 1)
+/** @brief Number of pages covering the address space. */
+#define MEMORY_PAGE_COUNT (MEMORY_MAX >> MEMORY_PAGE_SHIFT)
+
+/**
+ * @brief Per-page attribute bits kept by Memory.
+ */
+enum PageFlags : std::uint8_t {
+    PAGE_CODE = 1 << 0,  ///< Page holds cached instructions; writes are reported to the write hook.
+    PAGE_DEVICE = 1 << 1, ///< Page is mapped to a Device; reads and writes go through it.
+    PAGE_CLEAN = 1 << 2,  ///< Page was not written since dirty tracking was last reset; the next write marks it dirty.
+    PAGE_WATCHED = 1 << 3 ///< The next write to the page is counted, see watch_writes().
+};
+
+/** @brief One bit per page, set for pages written since dirty tracking was last reset. */
+using DirtyPages = std::array<std::uint64_t, MEMORY_PAGE_COUNT / 64>;
+
 /**
  * @brief Represents the memory unit of the LC-3 VM.
  *
  * This class manages the 65536 x 16-bit word addressable memory space.
  * It provides methods for reading from and writing to memory, and handles
  * memory-mapped I/O like keyboard status and data registers.
+ *
+ * Memory-mapped I/O is dispatched per page: read() and write() test one flag
+ * byte of the accessed page and only pages mapped to a Device leave the plain
+ * array access. The keyboard is mapped on the MR_KBSR page by default.
+ *
+ * The words live in a private host mapping of their own. A fresh or cleared
+ * memory is anonymous zero pages, and map_image() maps a SharedImage
+ * copy-on-write, so the host only allocates the pages a VM actually writes.
+ *
+ * Written pages are tracked in a dirty bitmap at no cost to the fast path: a
+ * clean page carries PAGE_CLEAN, so its first write takes the slow path, which
+ * sets the page's dirty bit and drops the flag. Writes made through write(),
+ * load(), assign() and clear() are tracked; stores straight into the memory
+ * array are not unless followed by note_write(), as devices do.
  */
 class Memory {
     public:
-        /** 
+        /**
+         * @brief Callback invoked when a word on a PAGE_CODE page is written.
+         * @param context The opaque pointer registered with set_write_hook().
+         * @param address The address that was written.
+         */
+        using WriteHook = void (*)(void* context, std::uint16_t address);
+
+        /**
          * @brief The main memory array.
-         * Stores 65536 16-bit words.
+         * Points to 65536 16-bit words mapped for this memory alone; the address never changes.
+         */
+        std::uint16_t* const memory;
+
+        /**
+         * @brief Constructs zeroed memory with the keyboard mapped on its page.
+         * @throw std::bad_alloc if the words cannot be mapped.
          */
-        std::uint16_t memory[MEMORY_MAX];
+        Memory();
 
         /**
-         * @brief Flag to indicate if we're in test mode.
-         * When true, keyboard input is simulated using memory values.
+         * @brief Unmaps the words.
          */
-        bool test_mode = false;
+        ~Memory();
+
+        Memory(const Memory&) = delete;
+        Memory& operator=(const Memory&) = delete;
 
         /**
          * @brief Reads a 16-bit word from the specified memory address.
-         * Handles memory-mapped I/O for keyboard status (MR_KBSR) and 
-         * data (MR_KBDR) registers.
+         * Reads from pages mapped to a Device, such as the keyboard status
+         * (MR_KBSR) and data (MR_KBDR) registers, are handled by that device.
          * @param address The 16-bit memory address to read from.
          * @return The 16-bit value stored at the given address.
          * @see MR_KBSR, MR_KBDR
          */
-        std::uint16_t read(std::uint16_t address);
+        std::uint16_t read(std::uint16_t address) {
+            unsigned page = address >> MEMORY_PAGE_SHIFT;
+            if (page_flags[page] & PAGE_DEVICE) {
+                return devices[page]->read(*this, address);
+            }
+            return memory[address];
+        }
         /**
          * @brief Writes a 16-bit word to the specified memory address.
+         * Pages with any PageFlags bit set take the out-of-line slow path.
          * @param address The 16-bit memory address to write to.
          * @param value The 16-bit value to write.
          */
-        void write(std::uint16_t address, std::uint16_t value);
+        void write(std::uint16_t address, std::uint16_t value) {
+            if (page_flags[address >> MEMORY_PAGE_SHIFT]) {
+                write_flagged(address, value);
+                return;
+            }
+            memory[address] = value;
+        }
+
+        /**
+         * @brief Copies big-endian words, as stored in object files, into memory.
+         * Runs of pages without PageFlags are byte-swapped straight into the
+         * array; flagged pages go through write() so devices and the write hook
+         * still see every word.
+         * @param address The first address to fill.
+         * @param words The words in big-endian byte order; need not be aligned.
+         * @param count The number of words; address + count must not exceed MEMORY_MAX.
+         */
+        void load(std::uint16_t address, const std::uint16_t* words, std::size_t count);
+
+        /**
+         * @brief Checks whether a page was written since dirty tracking was last reset.
+         * Safe to call from any thread.
+         * @param address Any address within the page.
+         * @return true if the page is dirty.
+         */
+        bool is_dirty(std::uint16_t address) const {
+            unsigned page = address >> MEMORY_PAGE_SHIFT;
+            return (dirty[page / 64].load(std::memory_order_relaxed) >> (page % 64)) & 1;
+        }
+
+        /**
+         * @brief Returns the dirty bitmap without resetting it.
+         * Safe to call from any thread.
+         * @return One bit per page, page 0 in the lowest bit of the first word.
+         */
+        DirtyPages dirty_pages() const;
+
+        /**
+         * @brief Returns the dirty bitmap and resets tracking, so every page is clean again.
+         * Each word of the bitmap is read and cleared in one atomic step, so a
+         * concurrent write is reported either by this call or by the next one.
+         * Must be called by the thread running the VM, or while it is stopped.
+         * @return The pages written since the previous reset.
+         */
+        DirtyPages take_dirty_pages();
+
+        /**
+         * @brief Counts calls to take_dirty_pages().
+         * A caller that remembers this value can tell later whether someone else reset tracking meanwhile.
+         * @return The number of resets so far.
+         */
+        std::uint64_t dirty_epoch() const { return epoch; }
+
+        /**
+         * @brief Records that a device changed a word straight in the memory array.
+         * Marks the page dirty like write() would, so restore() and
+         * LC3State::memory_changes() see device registers that changed.
+         * @param address The address that was changed.
+         */
+        void note_write(std::uint16_t address) {
+            unsigned page = address >> MEMORY_PAGE_SHIFT;
+            if (page_flags[page] & PAGE_CLEAN) {
+                page_flags[page] &= ~PAGE_CLEAN;
+                mark_dirty(page);
+            }
+        }
+
+        /**
+         * @brief Flags every page so that the next write to it is counted by watched_writes().
+         * Like dirty tracking, this costs one slow-path write per page and
+         * sees the writes made through write().
+         */
+        void watch_writes();
+
+        /**
+         * @brief Counts writes to pages flagged by watch_writes().
+         * A caller that remembers this value after watch_writes() can tell later whether memory was written since.
+         * @return The number of watched writes so far.
+         */
+        std::uint64_t watched_writes() const { return watch_hits; }
+
+        /**
+         * @brief Replaces the whole contents with a copy of another array.
+         * Words are copied without going through devices. Changed words on
+         * PAGE_CODE pages are reported to the write hook, so cached code stays
+         * valid where it did not change.
+         * @param words MEMORY_MAX words to copy.
+         */
+        void assign(const std::uint16_t* words);
+
+        /**
+         * @brief Like assign(), but only for the pages set in a bitmap.
+         * @param words MEMORY_MAX words, of which only the selected pages are read.
+         * @param pages The pages to copy.
+         */
+        void assign_pages(const std::uint16_t* words, const DirtyPages& pages);
+
+        /**
+         * @brief Sets every word to zero and forgets which pages hold code.
+         * The words are replaced by fresh zero pages, returning their host memory.
+         * Device mappings stay in place. Callers must drop any cached code themselves.
+         */
+        void clear();
+
+        /**
+         * @brief Replaces the whole contents with a SharedImage, mapped copy-on-write.
+         * Pages the guest never writes stay shared with every other memory using
+         * the image. Like clear(), all pages become dirty and no page holds
+         * code; words on device pages are replaced without going through the device.
+         * @param image The image; the memory keeps its own view, so it may be destroyed afterwards.
+         */
+        void map_image(const SharedImage& image);
+
+        /**
+         * @brief Compares the contents of two memories.
+         * @param other The memory to compare with.
+         * @return true if all 65536 words are equal.
+         */
+        bool equals(const Memory& other) const;
+
+        /**
+         * @brief Finds the first word that differs from another memory.
+         * Calling it again from the returned address plus one walks all differences.
+         * @param other The memory to compare with.
+         * @param from The first address to compare.
+         * @return The address of the first difference at or after from, or MEMORY_MAX if there is none.
+         */
+        std::size_t first_difference(const Memory& other, std::size_t from = 0) const;
+
+        /**
+         * @brief Checks whether any page overlapping a range has PageFlags set.
+         * @param address The first address of the range.
+         * @param count The number of words; address + count must not exceed MEMORY_MAX.
+         * @return true if a write to the range could reach a device or the write hook.
+         */
+        bool range_flagged(std::uint16_t address, std::size_t count) const;
+
+        /**
+         * @brief Maps a device on the page containing an address.
+         * Pages holding code that was already executed must not be remapped.
+         * @param address Any address within the page.
+         * @param device The device, or nullptr to turn the page back into plain memory.
+         *               The caller keeps ownership; it must outlive the mapping.
+         */
+        void map_device(std::uint16_t address, Device* device);
+
+        /**
+         * @brief Returns the keyboard device mapped on the MR_KBSR page by default.
+         * @return The keyboard, which stays owned by the memory.
+         */
+        KeyboardDevice& keyboard_device() { return keyboard; }
+        const KeyboardDevice& keyboard_device() const { return keyboard; }
+
+        /**
+         * @brief Returns the device mapped on the page containing an address.
+         * @param address Any address within the page.
+         * @return The device, or nullptr if the page is plain memory.
+         */
+        Device* device_at(std::uint16_t address) const { return devices[address >> MEMORY_PAGE_SHIFT]; }
+
+        /**
+         * @brief Checks whether an address lies on a page mapped to a device.
+         * Such pages are never decoded ahead of time since reading them has side effects.
+         * @param address The address to check.
+         * @return true if accesses to the address go through a Device.
+         */
+        bool is_device(std::uint16_t address) const {
+            return (page_flags[address >> MEMORY_PAGE_SHIFT] & PAGE_DEVICE) != 0;
+        }
+
+        /**
+         * @brief Registers the callback notified about writes to code pages.
+         * @param hook The callback, or nullptr to disable notifications.
+         * @param context Opaque pointer passed back to the callback.
+         */
+        void set_write_hook(WriteHook hook, void* context) {
+            write_hook = hook;
+            write_hook_context = context;
+        }
+
+        /**
+         * @brief Marks the page containing an address as holding cached code.
+         * Subsequent writes anywhere on that page are reported to the write hook.
+         * @param address Any address within the page.
+         */
+        void mark_code(std::uint16_t address) {
+            page_flags[address >> MEMORY_PAGE_SHIFT] |= PAGE_CODE;
+        }
+
+        /**
+         * @brief Returns the PageFlags bits of every page.
+         * Used by generated code to decide whether a store can bypass write().
+         * @return Pointer to MEMORY_PAGE_COUNT flag bytes.
+         */
+        const std::uint8_t* page_flag_table() const { return page_flags; }
+
+    private:
+        std::uint8_t page_flags[MEMORY_PAGE_COUNT];     ///< PageFlags bits for every page.
+        std::atomic<std::uint64_t> dirty[MEMORY_PAGE_COUNT / 64] = {}; ///< Dirty bitmap, see DirtyPages.
+        std::uint64_t epoch = 0;                         ///< Calls to take_dirty_pages().
+        std::uint64_t watch_hits = 0;                    ///< Writes that found PAGE_WATCHED set.
+        Device* devices[MEMORY_PAGE_COUNT] = {};         ///< Device mapped on each PAGE_DEVICE page.
+        KeyboardDevice keyboard;                         ///< Default device on the MR_KBSR page.
+        WriteHook write_hook = nullptr;                  ///< Callback for writes to code pages.
+        void* write_hook_context = nullptr;              ///< Context passed to write_hook.
+
+        /**
+         * @brief Slow path of write() for pages with PageFlags set.
+         * @param address The address to write to.
+         * @param value The value to write.
+         */
+        void write_flagged(std::uint16_t address, std::uint16_t value);
+
+        /**
+         * @brief Sets the dirty bit of a page.
+         * @param page The page number.
+         */
+        void mark_dirty(unsigned page) {
+            dirty[page / 64].fetch_or(std::uint64_t(1) << (page % 64), std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Copies one page for assign() and assign_pages().
+         * @param page The page number.
+         * @param words MEMORY_MAX words to copy the page from.
+         */
+        void assign_page(unsigned page, const std::uint16_t* words);
+
+        /**
+         * @brief Replaces the words with a private mapping of a file, or with zero pages.
+         * @param fd The file, or -1 for zero pages.
+         * @return false if the mapping failed; the words are then zero pages.
+         */
+        bool remap(int fd);
+
+        /**
+         * @brief Marks every page dirty and drops PAGE_CODE, after the whole contents changed.
+         */
+        void replaced_all();
 };
 
 #endif // LC3_MEMORY_H
@@ -0,0 +1,106 @@
+/**
+ * @file output_buffer.hpp
+ * @brief Defines the buffer batching guest console output.
+ *
+ * OUT, PUTS, PUTSP, IN and HALT append to an OutputBuffer instead of writing
+ * each character. The buffer is written to its file descriptor only at flush
+ * points: when it fills up, when the guest reads input, on HALT, and at least
+ * every OUTPUT_FLUSH_INTERVAL_MS while run() keeps the guest running.
+ */
+#ifndef LC3_OUTPUT_BUFFER_H
+#define LC3_OUTPUT_BUFFER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+/** @brief Number of bytes buffered before output is flushed. */
+#define OUTPUT_BUFFER_SIZE 8192
+
+/** @brief Longest time pending output may wait for a flush while the guest keeps running. */
+#define OUTPUT_FLUSH_INTERVAL_MS 50
+
+/**
+ * @brief Byte buffer written to a file descriptor with write()/writev().
+ *
+ * Write errors other than interruptions are not reported: the pending bytes
+ * are dropped, as std::cout would drop them after setting its failbit.
+ */
+class OutputBuffer {
+    public:
+        /**
+         * @brief Creates an empty buffer.
+         * @param fd The descriptor flushed output is written to.
+         */
+        explicit OutputBuffer(int fd);
+
+        /**
+         * @brief Flushes pending output.
+         */
+        ~OutputBuffer();
+
+        OutputBuffer(const OutputBuffer&) = delete;
+        OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+        /**
+         * @brief Appends a byte, flushing first if the buffer is full.
+         * @param c The byte.
+         */
+        void put(char c) {
+            if (size == OUTPUT_BUFFER_SIZE) flush();
+            buffer[size++] = c;
+        }
+
+        /**
+         * @brief Appends a run of bytes.
+         * Runs that do not fit are written together with the pending output in a single writev().
+         * @param data The bytes.
+         * @param length The number of bytes.
+         */
+        void write(const char* data, std::size_t length);
+
+        /**
+         * @brief Writes all pending output.
+         */
+        void flush();
+
+        /**
+         * @brief Flushes pending output if the last flush is more than OUTPUT_FLUSH_INTERVAL_MS ago.
+         */
+        void flush_if_due();
+
+        /**
+         * @brief Flushes pending output and sends further output to another descriptor.
+         * Ends a capture().
+         * @param fd The new descriptor, or -1 to discard output.
+         */
+        void set_descriptor(int fd);
+
+        /**
+         * @brief Returns the descriptor output is written to when it is not captured.
+         * @return The descriptor, -1 if output is discarded.
+         */
+        int descriptor() const { return fd; }
+
+        /**
+         * @brief Flushes pending output and appends further flushed output to a string instead of the descriptor.
+         * @param sink The string, or nullptr to write to the descriptor again.
+         */
+        void capture(std::string* sink);
+
+        /**
+         * @brief Returns the number of bytes waiting for a flush.
+         * @return The pending byte count.
+         */
+        std::size_t pending() const { return size; }
+
+    private:
+        std::array<char, OUTPUT_BUFFER_SIZE> buffer;
+        std::size_t size; ///< Bytes of buffer in use.
+        int fd;           ///< Destination descriptor.
+        std::string* sink; ///< Destination string; replaces fd if set.
+        std::chrono::steady_clock::time_point last_flush; ///< When output was last written.
+};
+
+#endif // LC3_OUTPUT_BUFFER_H
@@ -0,0 +1,91 @@
+/**
+ * @file profile.hpp
+ * @brief Defines the execution profile counting instructions per address, opcode and TRAP vector.
+ *
+ * While LC3State::set_profiling() is on, the VM runs every instruction
+ * through a counting loop over the decode cache instead of the selected
+ * engine: each retired instruction adds one to the counter of its address,
+ * its opcode and, for TRAP, its vector. A faulting or waiting instruction is
+ * not counted, so the totals match the instruction counts run_for() reports.
+ */
+#ifndef LC3_PROFILE_H
+#define LC3_PROFILE_H
+
+#include "memory.hpp"
+#include "opcodes.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** @brief Hottest addresses LC3State::write_profile() lists by default. */
+#define PROFILE_HOT_ADDRESSES 20
+
+/**
+ * @brief Execution counts of one VM.
+ */
+class Profile {
+    public:
+        /**
+         * @brief Creates an empty profile.
+         */
+        Profile();
+
+        /**
+         * @brief Counts one retired instruction.
+         * @param pc The address it was fetched from.
+         * @param op Its opcode.
+         * @param vector Its TRAP vector; ignored for other opcodes.
+         */
+        void record(std::uint16_t pc, std::uint8_t op, std::uint16_t vector) {
+            ++addresses[pc];
+            ++opcodes[op];
+            if (op == OP_TRAP) ++traps[vector & 0xFF];
+        }
+
+        /**
+         * @brief Returns the number of instructions counted.
+         * @return The total over all opcodes.
+         */
+        std::uint64_t instructions() const;
+
+        /**
+         * @brief Returns how often the instruction at an address was executed.
+         * @param address The address.
+         * @return The count.
+         */
+        std::uint64_t at(std::uint16_t address) const { return addresses[address]; }
+
+        /**
+         * @brief Returns how often an opcode was executed.
+         * @param op The opcode.
+         * @return The count.
+         */
+        std::uint64_t opcode(unsigned op) const { return opcodes[op & 0xF]; }
+
+        /**
+         * @brief Returns how often a TRAP vector was executed.
+         * @param vector The vector.
+         * @return The count.
+         */
+        std::uint64_t trap(std::uint8_t vector) const { return traps[vector]; }
+
+        /**
+         * @brief Returns the most executed addresses.
+         * @param count The number of addresses wanted.
+         * @return Up to count executed addresses, most executed first, ties in address order.
+         */
+        std::vector<std::uint16_t> hottest(std::size_t count) const;
+
+        /**
+         * @brief Resets every counter to zero.
+         */
+        void clear();
+
+    private:
+        std::vector<std::uint64_t> addresses;   ///< Count per address, MEMORY_MAX entries.
+        std::array<std::uint64_t, 16> opcodes;  ///< Count per opcode.
+        std::array<std::uint64_t, 256> traps;   ///< Count per TRAP vector.
+};
+
+#endif // LC3_PROFILE_H
@@ -0,0 +1,225 @@
+/**
+ * @file replay.hpp
+ * @brief Defines consoles that record a VM's input to a log and replay it.
+ *
+ * An LC-3 program is deterministic except for what it learns from the
+ * keyboard: whether KBSR reports a key, which key KBDR and the GETC/IN traps
+ * deliver. A RecordingConsole wraps the real console and logs the answer to
+ * every one of these questions; a ReplayConsole answers them from the log,
+ * so the guest retraces the recorded run exactly, without a terminal and
+ * without waiting for keys.
+ *
+ * Recorded runs execute in slices of run_for() with a fixed budget, and the
+ * log stores the instructions each slice retired after the events that
+ * happened in it. Replay runs the same slices and checks every count, so an
+ * event is pinned to the slice it occurred in and any divergence, e.g. from
+ * replaying against a different program, is detected at the next slice end.
+ *
+ * The log is a four-byte magic "LC3R", a version byte and the slice budget,
+ * followed by records. Each record is one LEB128 varint holding a kind in
+ * its low three bits and a value above them; repeated answers are
+ * run-length encoded, so a guest spinning on KBSR costs a few bytes per slice.
+ */
+#ifndef LC3_REPLAY_H
+#define LC3_REPLAY_H
+
+#include "console.hpp"
+#include "lc3.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+/** @brief Instructions per run_for() slice of a recorded run. */
+#define RECORD_SLICE 100000
+
+/** @brief Log format version written by RecordingConsole. */
+#define RECORD_VERSION 1
+
+/** @brief Recorded bytes buffered before they are written out. */
+#define RECORD_BUFFER_SIZE 65536
+
+/**
+ * @brief Kinds of log records.
+ */
+enum RecordKind : std::uint8_t {
+    REC_IDLE = 0,        ///< key_pending() returned false; value is the repeat count.
+    REC_PENDING = 1,     ///< key_pending() returned true; value is the repeat count.
+    REC_NO_KEY = 2,      ///< read_key() returned no key; value is the repeat count.
+    REC_KEY = 3,         ///< read_key() returned a key; value is the key.
+    REC_SLICE = 4,       ///< A slice ended; value is the instructions it retired.
+    REC_FULL_SLICES = 5, ///< Slices without events that used their whole budget; value is their count.
+};
+
+/**
+ * @brief Console passing through to another one and logging every answer it gives.
+ */
+class RecordingConsole : public Console {
+    public:
+        /**
+         * @brief Creates the log file and writes its header.
+         * @param inner The console keys actually come from; output also goes there.
+         * @param path The log file, replaced if it exists.
+         * @param slice The budget of each run_for() slice.
+         * @throw std::runtime_error if the file cannot be created.
+         */
+        RecordingConsole(std::unique_ptr<Console> inner, const std::string& path, std::uint64_t slice = RECORD_SLICE);
+
+        /**
+         * @brief Writes the rest of the log and closes it.
+         */
+        ~RecordingConsole() override;
+
+        RecordingConsole(const RecordingConsole&) = delete;
+        RecordingConsole& operator=(const RecordingConsole&) = delete;
+
+        /**
+         * @brief Returns the budget each slice must be run with.
+         * @return The slice budget.
+         */
+        std::uint64_t slice() const { return slice_budget; }
+
+        /**
+         * @brief Logs the end of a slice.
+         * @param instructions The instructions the slice retired.
+         */
+        void end_slice(std::uint64_t instructions);
+
+        /**
+         * @brief Reports whether the last slice only spun on KBSR.
+         * @return true if it polled KBSR_IDLE_POLLS times or more without getting a key.
+         */
+        bool idle() const { return last_idle; }
+
+        /**
+         * @brief Writes everything logged so far to the file.
+         * @throw std::runtime_error if writing fails.
+         */
+        void flush();
+
+        void connect(OutputBuffer& output) override { inner->connect(output); }
+        bool key_pending() override;
+        bool read_key(char& c, bool wait) override;
+        void wait_for_key(std::chrono::milliseconds timeout) override { inner->wait_for_key(timeout); }
+
+    private:
+        std::unique_ptr<Console> inner; ///< The console being recorded.
+        int fd;                         ///< The log file.
+        std::uint64_t slice_budget;     ///< Budget of every slice.
+        std::string buffer;             ///< Encoded records not yet written.
+        RecordKind run_kind = REC_IDLE; ///< Kind of the answer being repeated.
+        std::uint64_t run_length = 0;   ///< Repeats of run_kind not yet encoded.
+        std::uint64_t full_slices = 0;  ///< Event-free full slices not yet encoded.
+        std::uint64_t answers = 0;      ///< Answers given in the current slice.
+        std::uint64_t misses = 0;       ///< Answers without a key in the current slice.
+        bool keys = false;              ///< Whether the current slice delivered a key.
+        bool last_idle = false;         ///< Whether the previous slice only spun on KBSR.
+
+        /** @brief Counts one answer, extending the current run if it repeats. */
+        void note(RecordKind kind);
+        /** @brief Encodes the pending run of answers, if any. */
+        void close_run();
+        /** @brief Encodes the pending full slices, if any. */
+        void close_full_slices();
+        /** @brief Appends one record. */
+        void put(RecordKind kind, std::uint64_t value);
+};
+
+/**
+ * @brief Console answering from a log written by RecordingConsole.
+ *
+ * Keys are never waited for. Once the guest asks a question the log does not
+ * answer at that point, the console reports divergence and answers "no key"
+ * from then on.
+ */
+class ReplayConsole : public Console {
+    public:
+        /**
+         * @brief Reads a log.
+         * @param path The log file.
+         * @param out_fd The descriptor guest output is written to; -1 discards it.
+         * @throw std::runtime_error if the file cannot be read or is not a log.
+         */
+        explicit ReplayConsole(const std::string& path, int out_fd = STDOUT_FILENO);
+
+        /**
+         * @brief Returns the budget each slice must be run with.
+         * @return The slice budget from the log header.
+         */
+        std::uint64_t slice() const { return slice_budget; }
+
+        /**
+         * @brief Checks whether every slice in the log has been replayed.
+         * @return true at the end of the log.
+         */
+        bool finished() const;
+
+        /**
+         * @brief Checks a slice against the log.
+         * @param instructions The instructions the slice retired.
+         * @return false if the run diverged from the log during or at the end of the slice.
+         */
+        bool end_slice(std::uint64_t instructions);
+
+        /**
+         * @brief Reports whether the run diverged from the log.
+         * @return true after a question or slice the log did not match.
+         */
+        bool diverged() const { return divergence; }
+
+        void connect(OutputBuffer& output) override { output.set_descriptor(out_fd); }
+        bool key_pending() override;
+        bool read_key(char& c, bool wait) override;
+        void wait_for_key(std::chrono::milliseconds) override {}
+
+    private:
+        std::string log;              ///< The whole log file.
+        std::size_t position = 0;     ///< Offset of the next record.
+        int out_fd;                   ///< Descriptor guest output is written to.
+        std::uint64_t slice_budget = 0; ///< Budget of every slice.
+        RecordKind kind = REC_IDLE;   ///< Kind of the current record.
+        std::uint64_t value = 0;      ///< Key or instruction count of the current REC_KEY or REC_SLICE record.
+        std::uint64_t remaining = 0;  ///< Uses left of the current record; 0 if none is loaded.
+        bool divergence = false;      ///< Whether the run left the log.
+
+        /**
+         * @brief Loads the next record once the current one is used up.
+         * @return false at the end of the log.
+         */
+        bool current();
+        /**
+         * @brief Uses the current record if it has a given kind.
+         * @param expected The kind.
+         * @return true if the record matched.
+         */
+        bool take(RecordKind expected);
+        /**
+         * @brief Decodes a varint at position.
+         * @param value Receives the value.
+         * @return false if the log ends inside it.
+         */
+        bool varint(std::uint64_t& value);
+};
+
+/**
+ * @brief Runs a VM whose console is a RecordingConsole until it halts or faults.
+ * Waits for keys between slices while the guest waits for input or spins on
+ * KBSR, then writes out the whole log.
+ * @param vm The VM; its console must be console.
+ * @param console The recording console.
+ * @return Why the run stopped, the fault PC and the instructions retired in total.
+ * @throw std::runtime_error if the log cannot be written.
+ */
+RunResult run_recorded(LC3State& vm, RecordingConsole& console);
+
+/**
+ * @brief Runs a VM whose console is a ReplayConsole through every slice of the log.
+ * @param vm The VM, loaded with the program that was recorded; its console must be console.
+ * @param console The replay console.
+ * @return Why the last slice stopped, the fault PC and the instructions retired in total.
+ * @throw std::runtime_error if the run diverges from the log.
+ */
+RunResult run_replayed(LC3State& vm, ReplayConsole& console);
+
+#endif // LC3_REPLAY_H
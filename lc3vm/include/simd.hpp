@@ -0,0 +1,71 @@
+/**
+ * @file simd.hpp
+ * @brief Declares vectorized kernels over arrays of 16-bit words.
+ *
+ * Each kernel has a scalar, an SSE2 and an AVX2 implementation. The widest
+ * one the host CPU supports is selected at run time on first use; hosts
+ * other than x86 always use the scalar code. Image loading, snapshot
+ * restores and Memory state comparisons run on these kernels.
+ */
+#ifndef LC3_SIMD_H
+#define LC3_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Instruction set used by the kernels.
+ */
+enum class SimdLevel {
+    Scalar, ///< Portable code, 64 bits at a time.
+    Sse2,   ///< 128-bit SSE2.
+    Avx2    ///< 256-bit AVX2.
+};
+
+/**
+ * @brief Returns the instruction set the kernels currently use.
+ * @return The active level; the best supported one unless set_simd_level() changed it.
+ */
+SimdLevel simd_level();
+
+/**
+ * @brief Checks whether the host CPU supports an instruction set.
+ * @param level The level to check.
+ * @return true if kernels for the level can run here.
+ */
+bool simd_supported(SimdLevel level);
+
+/**
+ * @brief Selects the instruction set used by the kernels, e.g. to test every implementation.
+ * @param level The level to use.
+ * @return false, leaving the selection unchanged, if the host does not support the level.
+ */
+bool set_simd_level(SimdLevel level);
+
+/**
+ * @brief Copies 16-bit words while swapping the byte order of each.
+ * @param dst The destination; must not overlap src.
+ * @param src The source; need not be aligned.
+ * @param count The number of words.
+ */
+void swap16_copy(std::uint16_t* dst, const std::uint16_t* src, std::size_t count);
+
+/**
+ * @brief Compares two arrays of 16-bit words.
+ * @param a The first array.
+ * @param b The second array.
+ * @param count The number of words.
+ * @return true if all words are equal.
+ */
+bool equal16(const std::uint16_t* a, const std::uint16_t* b, std::size_t count);
+
+/**
+ * @brief Finds the first position at which two arrays of 16-bit words differ.
+ * @param a The first array.
+ * @param b The second array.
+ * @param count The number of words.
+ * @return The index of the first differing word, or count if the arrays are equal.
+ */
+std::size_t mismatch16(const std::uint16_t* a, const std::uint16_t* b, std::size_t count);
+
+#endif // LC3_SIMD_H
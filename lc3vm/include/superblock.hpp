@@ -0,0 +1,134 @@
+/**
+ * @file superblock.hpp
+ * @brief Defines translated superblocks and the PC-keyed cache holding them.
+ *
+ * A superblock is a straight-line run of instructions ending at the first
+ * BR, JMP, JSR, TRAP or illegal opcode. It is translated once into a flat
+ * array of decoded operations in which every PC-relative operand has already
+ * been turned into an absolute address, so executing it needs neither the
+ * PC nor a fetch per instruction.
+ */
+#ifndef LC3_SUPERBLOCK_H
+#define LC3_SUPERBLOCK_H
+
+#include "decode_cache.hpp"
+#include "jit.hpp"
+#include "memory.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/** @brief Maximum number of instructions translated into a single superblock. */
+#define SUPERBLOCK_MAX_LENGTH 128
+
+/**
+ * @brief Exit slots of a superblock.
+ */
+enum BlockExit {
+    EXIT_FALLTHROUGH = 0, ///< Execution continues after the last instruction of the block.
+    EXIT_TAKEN = 1        ///< The terminating BR or JSR transferred control to its target.
+};
+
+/**
+ * @brief A translated straight-line run of LC-3 instructions.
+ */
+struct Block {
+    std::uint16_t start;  ///< Address of the first instruction.
+    std::uint16_t length; ///< Number of words covered, including the terminator.
+    /**
+     * @brief Decoded operations, one per covered word.
+     * PC-relative offsets of LD, ST, LDI, STI, LEA, BR and JSR are replaced by
+     * the absolute address they resolve to.
+     */
+    std::vector<DecodedInstruction> ops;
+    /** @brief True if the last operation is a BR, JMP, JSR, TRAP or illegal opcode. */
+    bool terminated;
+    /** @brief Statically known successor address for each BlockExit slot. */
+    std::uint16_t exit_pc[2];
+    /** @brief Directly chained successor blocks, filled in lazily as exits are taken. */
+    Block* next[2];
+    /** @brief Native code for the block once the JIT compiled it, else nullptr. */
+    JitFunction native;
+    /** @brief Number of times the block was entered, up to JIT_HOT_THRESHOLD; the JIT hotness counter. */
+    std::uint32_t executions;
+};
+
+/**
+ * @brief Cache of translated superblocks keyed by start address.
+ *
+ * Both the start-address table and the per-page coverage lists are split into
+ * Memory-sized pages. Blocks removed by invalidate() are kept alive until the
+ * next collect(), because the block currently executing may be the one a store
+ * just invalidated.
+ */
+class BlockCache {
+    public:
+        /**
+         * @brief Looks up the block starting at an address.
+         * @param address The start address.
+         * @return The block, or nullptr if none is cached.
+         */
+        Block* lookup(std::uint16_t address) const {
+            const auto& page = starts[address >> MEMORY_PAGE_SHIFT];
+            return page ? page[address & MEMORY_PAGE_MASK].get() : nullptr;
+        }
+
+        /**
+         * @brief Translates the superblock starting at an address and caches it.
+         * Every page the block covers is marked as code in memory.
+         * @param memory The memory to read the instructions from.
+         * @param address The start address; must not lie on a device page.
+         * @return The new block.
+         */
+        Block* translate(Memory& memory, std::uint16_t address);
+
+        /**
+         * @brief Removes every block covering an address.
+         * Chain links between all remaining blocks are dropped as well.
+         * @param address The address that was written.
+         */
+        void invalidate(std::uint16_t address);
+
+        /**
+         * @brief Reports and resets whether invalidate() removed any block since the last call.
+         * @return true if at least one block was removed.
+         */
+        bool take_invalidated() {
+            bool was = invalidated;
+            invalidated = false;
+            return was;
+        }
+
+        /**
+         * @brief Frees blocks removed by invalidate().
+         * Must only be called while no block is executing.
+         */
+        void collect() { retired.clear(); }
+
+        /**
+         * @brief Removes and frees every block.
+         */
+        void clear();
+
+        /**
+         * @brief Forgets the native code of every block, e.g. after the JIT arena was reset.
+         * Hotness counters restart so blocks can be compiled again.
+         */
+        void drop_native();
+
+    private:
+        /** @brief Blocks owned by start address, one lazily allocated array per page. */
+        std::array<std::unique_ptr<std::unique_ptr<Block>[]>, MEMORY_PAGE_COUNT> starts;
+        /** @brief Blocks covering at least one word of each page. */
+        std::array<std::vector<Block*>, MEMORY_PAGE_COUNT> coverage;
+        std::vector<std::unique_ptr<Block>> retired; ///< Removed blocks awaiting collect().
+        bool invalidated = false; ///< Set when invalidate() removes a block.
+
+        /**
+         * @brief Drops every chain link between cached blocks.
+         */
+        void unchain_all();
+};
+
+#endif // LC3_SUPERBLOCK_H
@@ -0,0 +1,188 @@
+/**
+ * @file trace.hpp
+ * @brief Defines the binary execution trace and its writer and reader.
+ *
+ * While a TraceWriter is attached with LC3State::set_trace(), every retired
+ * instruction is appended to the trace: its address, its instruction word,
+ * the registers it changed and the memory word it stored, if any. Records
+ * are delta-encoded against the state the previous record left behind:
+ *
+ * - A flags byte. TRACE_BRANCH means the next PC is not the following
+ *   address; TRACE_WORD that the instruction word differs from the one last
+ *   executed at this address; TRACE_REGISTERS that a mask byte of changed
+ *   general purpose registers follows; TRACE_STORE that the instruction
+ *   stored to memory. The bits under TRACE_COND_MASK hold the new condition
+ *   code (1 = P, 2 = Z, 3 = N) or 0 if it is unchanged.
+ * - If TRACE_BRANCH: the next PC minus the following address, as a zigzag varint.
+ * - If TRACE_WORD: the instruction word, big-endian.
+ * - If TRACE_REGISTERS: the mask, then each changed register's difference
+ *   to its old value as a zigzag varint, in register order.
+ * - If TRACE_STORE: the stored address minus the previously stored one as a
+ *   zigzag varint, then the stored value, big-endian.
+ *
+ * A TRACE_SYNC byte followed by all R_COUNT registers, big-endian, starts
+ * the trace and precedes any record whose registers were changed from
+ * outside the VM's instructions in between, e.g. by set_register_value().
+ * The file begins with the magic "LC3T" and a version byte.
+ *
+ * The VM appends records to one of two chunk buffers while a background
+ * thread writes the other to the file, so the run loop only waits when the
+ * disk falls a whole chunk behind.
+ */
+#ifndef LC3_TRACE_H
+#define LC3_TRACE_H
+
+#include "memory.hpp"
+#include "registers.hpp"
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** @brief Size of each of the two chunk buffers of a TraceWriter, in bytes. */
+#define TRACE_CHUNK_SIZE (1u << 20)
+
+/** @brief Trace format version written by TraceWriter. */
+#define TRACE_VERSION 1
+
+/**
+ * @brief Bits of the flags byte starting every trace record.
+ */
+enum TraceFlags : std::uint8_t {
+    TRACE_BRANCH = 1 << 0,    ///< The next PC follows as a difference.
+    TRACE_WORD = 1 << 1,      ///< The instruction word follows.
+    TRACE_REGISTERS = 1 << 2, ///< A mask of changed registers and their differences follow.
+    TRACE_STORE = 1 << 3,     ///< A stored address and value follow.
+    TRACE_COND_SHIFT = 4,     ///< Position of the condition code field.
+    TRACE_COND_MASK = 3 << 4, ///< New condition code: 0 unchanged, 1 P, 2 Z, 3 N.
+    TRACE_SYNC = 1 << 7,      ///< Alone: a full register file follows.
+};
+
+/**
+ * @brief Appends execution records to a trace file from a background thread.
+ */
+class TraceWriter {
+    public:
+        /**
+         * @brief Creates the trace file, writes its header and starts the writer thread.
+         * @param path The trace file, replaced if it exists.
+         * @throw std::runtime_error if the file cannot be created.
+         */
+        explicit TraceWriter(const std::string& path);
+
+        /**
+         * @brief Writes the remaining records and closes the file; errors are ignored.
+         */
+        ~TraceWriter();
+
+        TraceWriter(const TraceWriter&) = delete;
+        TraceWriter& operator=(const TraceWriter&) = delete;
+
+        /**
+         * @brief Appends the record of one retired instruction.
+         * @param word The instruction word.
+         * @param before The registers before the instruction; R_PC is its address.
+         * @param after The registers after it.
+         * @param stored Whether it stored to memory.
+         * @param address The address it stored to, if stored.
+         * @param value The value it stored, if stored.
+         */
+        void record(std::uint16_t word, const std::array<std::uint16_t, R_COUNT>& before,
+                    const std::array<std::uint16_t, R_COUNT>& after,
+                    bool stored, std::uint16_t address, std::uint16_t value);
+
+        /**
+         * @brief Returns the number of instructions recorded.
+         * @return The count.
+         */
+        std::uint64_t records() const { return count; }
+
+        /**
+         * @brief Writes the remaining records, stops the thread and closes the file.
+         * Further records are dropped.
+         * @throw std::runtime_error if writing any part of the trace failed.
+         */
+        void close();
+
+    private:
+        int fd;                               ///< The trace file, or -1 once closed.
+        std::vector<std::uint8_t> active;     ///< Chunk the VM appends to.
+        std::vector<std::uint8_t> pending;    ///< Chunk handed to the thread.
+        bool pending_full = false;            ///< Whether pending is waiting to be written.
+        bool closing = false;                 ///< Whether the thread should exit once pending is written.
+        std::string error;                    ///< First write error of the thread.
+        std::mutex mutex;                     ///< Guards pending_full, closing and error.
+        std::condition_variable changed;      ///< Signals changes of pending_full and closing.
+        std::thread writer;                   ///< Writes pending chunks to fd.
+
+        std::uint64_t count = 0;              ///< Instructions recorded.
+        bool synced = false;                  ///< Whether a register file was written yet.
+        std::array<std::uint16_t, R_COUNT> last{}; ///< Registers after the previous record.
+        std::uint16_t last_store = 0;         ///< Address of the previous store.
+        std::vector<std::uint16_t> words;     ///< Instruction word last recorded per address.
+        std::vector<bool> seen;               ///< Whether words holds the word of an address.
+
+        /** @brief Hands the active chunk to the thread, first waiting for the previous one. */
+        void submit();
+        /** @brief Body of the writer thread. */
+        void drain();
+        /** @brief Appends a zigzag varint of a 16-bit difference. */
+        void put_delta(std::uint16_t difference);
+        /** @brief Appends a big-endian word. */
+        void put_word(std::uint16_t word);
+};
+
+/**
+ * @brief One decoded trace record.
+ */
+struct TraceEvent {
+    std::uint16_t pc;                          ///< Address of the instruction.
+    std::uint16_t word;                        ///< The instruction word.
+    std::array<std::uint16_t, R_COUNT> registers; ///< Registers after the instruction.
+    std::uint8_t changed;                      ///< Mask of general purpose registers it changed.
+    bool stored;                               ///< Whether it stored to memory.
+    std::uint16_t address;                     ///< Address stored to, if stored.
+    std::uint16_t value;                       ///< Value stored, if stored.
+};
+
+/**
+ * @brief Reads a trace written by TraceWriter, one instruction at a time.
+ */
+class TraceReader {
+    public:
+        /**
+         * @brief Opens a trace and checks its header.
+         * @param path The trace file.
+         * @throw std::runtime_error if the file cannot be opened or is not a trace.
+         */
+        explicit TraceReader(const std::string& path);
+
+        /**
+         * @brief Decodes the next instruction.
+         * @param event Receives the instruction.
+         * @return false at the end of the trace.
+         * @throw std::runtime_error if the trace is malformed or truncated inside a record.
+         */
+        bool next(TraceEvent& event);
+
+    private:
+        std::ifstream file;                        ///< The trace.
+        bool synced = false;                       ///< Whether registers holds a register file.
+        std::array<std::uint16_t, R_COUNT> registers{}; ///< Registers after the previous record.
+        std::uint16_t last_store = 0;              ///< Address of the previous store.
+        std::vector<std::uint16_t> words;          ///< Instruction word last seen per address.
+
+        /** @brief Reads one byte, throwing if the trace ends. */
+        std::uint8_t byte();
+        /** @brief Reads a zigzag varint of a 16-bit difference. */
+        std::uint16_t delta();
+        /** @brief Reads a big-endian word. */
+        std::uint16_t word();
+};
+
+#endif // LC3_TRACE_H
@@ -0,0 +1,530 @@
+/**
+ * @file assembler.cpp
+ * @brief Implements the two-pass LC-3 assembler and LC3State::load_program().
+ */
+#include "assembler.hpp"
+#include "lc3.hpp"
+#include "opcodes.hpp"
+#include "traps.hpp"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string_view>
+#include <unistd.h>
+
+/**
+ * @brief Opcodes, trap aliases and directives the assembler understands.
+ */
+enum Mnemonic : std::uint8_t {
+    M_ADD, M_AND, M_NOT, M_BR, M_JMP, M_RET, M_JSR, M_JSRR,
+    M_LD, M_LDI, M_LDR, M_LEA, M_ST, M_STI, M_STR, M_TRAP, M_RTI,
+    M_GETC, M_OUT, M_PUTS, M_IN, M_PUTSP, M_HALT,
+    M_ORIG, M_FILL, M_BLKW, M_STRINGZ, M_END,
+    M_NONE
+};
+
+/** @brief Spelling and operand count of each Mnemonic except M_BR, which takes any n/z/p suffix. */
+static const struct {
+    const char* name;
+    std::uint8_t operands;
+} MNEMONICS[M_NONE] = {
+    {"ADD", 3}, {"AND", 3}, {"NOT", 2}, {"BR", 1}, {"JMP", 1}, {"RET", 0}, {"JSR", 1}, {"JSRR", 1},
+    {"LD", 2}, {"LDI", 2}, {"LDR", 3}, {"LEA", 2}, {"ST", 2}, {"STI", 2}, {"STR", 3}, {"TRAP", 1}, {"RTI", 0},
+    {"GETC", 0}, {"OUT", 0}, {"PUTS", 0}, {"IN", 0}, {"PUTSP", 0}, {"HALT", 0},
+    {".ORIG", 1}, {".FILL", 1}, {".BLKW", 1}, {".STRINGZ", 1}, {".END", 0}
+};
+
+/** @brief Most tokens a statement can have: a label, a mnemonic and three operands. */
+#define ASM_MAX_TOKENS 5
+
+/**
+ * @brief One tokenized statement, kept between the two passes.
+ */
+struct Statement {
+    std::size_t line;                       ///< Source line, counted from 1.
+    Mnemonic mnemonic;                      ///< What the statement is.
+    std::uint8_t condition;                 ///< n/z/p bits of a BR.
+    std::uint16_t address;                  ///< Address of its first word.
+    std::uint32_t segment;                  ///< Index of its segment.
+    std::array<std::string_view, 3> operands; ///< Its operands, views into the source.
+};
+
+/**
+ * @brief Throws an assembly error for a line.
+ * @param line The source line.
+ * @param message What is wrong.
+ */
+[[noreturn]] static void fail(std::size_t line, const std::string& message) {
+    throw std::runtime_error("line " + std::to_string(line) + ": " + message);
+}
+
+/**
+ * @brief Looks up a mnemonic, ignoring case.
+ * @param token The token.
+ * @param condition Receives the n/z/p bits if the token is a branch.
+ * @return The mnemonic, or M_NONE.
+ */
+static Mnemonic lookup(std::string_view token, std::uint8_t& condition) {
+    char upper[9];
+    if (token.empty() || token.size() >= sizeof(upper)) return M_NONE;
+    for (std::size_t i = 0; i < token.size(); ++i) {
+        char c = token[i];
+        upper[i] = c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+    }
+    std::string_view name(upper, token.size());
+
+    if (name.size() >= 2 && name[0] == 'B' && name[1] == 'R') {
+        std::uint8_t bits = 0;
+        std::size_t i = 2;
+        if (i < name.size() && name[i] == 'N') { bits |= 4; ++i; }
+        if (i < name.size() && name[i] == 'Z') { bits |= 2; ++i; }
+        if (i < name.size() && name[i] == 'P') { bits |= 1; ++i; }
+        if (i == name.size()) {
+            condition = bits ? bits : 7;
+            return M_BR;
+        }
+        return M_NONE;
+    }
+    for (unsigned m = 0; m < M_NONE; ++m) {
+        if (name == MNEMONICS[m].name) return static_cast<Mnemonic>(m);
+    }
+    return M_NONE;
+}
+
+/**
+ * @brief Parses a register operand.
+ * @param token The token.
+ * @return The register number, or -1 if the token is not a register.
+ */
+static int parse_register(std::string_view token) {
+    if (token.size() == 2 && (token[0] == 'R' || token[0] == 'r') && token[1] >= '0' && token[1] <= '7') {
+        return token[1] - '0';
+    }
+    return -1;
+}
+
+/**
+ * @brief Parses a number written as #-5, 5, -5, x3000, X3000 or 0x3000.
+ * @param token The token.
+ * @param value Receives the value.
+ * @return false if the token is not a number.
+ */
+static bool parse_number(std::string_view token, long& value) {
+    int base = 10;
+    if (!token.empty() && token[0] == '#') {
+        token.remove_prefix(1);
+    } else if (token.size() > 2 && token[0] == '0' && (token[1] == 'x' || token[1] == 'X')) {
+        base = 16;
+        token.remove_prefix(2);
+    } else if (!token.empty() && (token[0] == 'x' || token[0] == 'X')) {
+        base = 16;
+        token.remove_prefix(1);
+    }
+    bool negative = !token.empty() && token[0] == '-';
+    if (negative) token.remove_prefix(1);
+    if (token.empty()) return false;
+
+    long result = 0;
+    for (char c : token) {
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (base == 16 && c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+        // Saturate; anything this large is out of range for every operand.
+        if (result < 0x100000) result = result * base + digit;
+    }
+    value = negative ? -result : result;
+    return true;
+}
+
+/**
+ * @brief Checks whether a token may name a label.
+ * @param token The token.
+ * @return true for a letter or underscore followed by letters, digits and underscores, other than a register.
+ */
+static bool is_label(std::string_view token) {
+    if (token.empty() || parse_register(token) >= 0) return false;
+    char first = token[0];
+    if (!((first >= 'A' && first <= 'Z') || (first >= 'a' && first <= 'z') || first == '_')) return false;
+    for (char c : token) {
+        if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_')) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Splits a line into tokens, dropping the comment.
+ * Tokens are separated by whitespace or commas; a double-quoted string is one token.
+ * @param text The line.
+ * @param line Its number, for errors.
+ * @param tokens Receives the tokens.
+ * @return The number of tokens.
+ */
+static std::size_t tokenize(std::string_view text, std::size_t line,
+                            std::array<std::string_view, ASM_MAX_TOKENS>& tokens) {
+    std::size_t count = 0;
+    std::size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == ',') {
+            ++i;
+            continue;
+        }
+        if (c == ';') break;
+        std::size_t start = i;
+        if (c == '"') {
+            for (++i; i < text.size() && text[i] != '"'; ++i) {
+                if (text[i] == '\\') ++i;
+            }
+            if (i >= text.size()) fail(line, "Unterminated string.");
+            ++i;
+        } else {
+            while (i < text.size() && text[i] != ' ' && text[i] != '\t' && text[i] != '\r' &&
+                   text[i] != ',' && text[i] != ';' && text[i] != '"') {
+                ++i;
+            }
+        }
+        if (count == ASM_MAX_TOKENS) fail(line, "Too many operands.");
+        tokens[count++] = text.substr(start, i - start);
+    }
+    return count;
+}
+
+/**
+ * @brief Decodes a .STRINGZ operand.
+ * @param token The quoted string.
+ * @param line Its line, for errors.
+ * @param out Receives one word per character and the terminating zero; may be nullptr to only count.
+ * @return The number of words, including the terminating zero.
+ */
+static std::size_t decode_string(std::string_view token, std::size_t line, std::vector<std::uint16_t>* out) {
+    if (token.size() < 2 || token.front() != '"') fail(line, ".STRINGZ expects a quoted string.");
+    std::size_t count = 0;
+    for (std::size_t i = 1; i + 1 < token.size(); ++i) {
+        char c = token[i];
+        if (c == '\\') {
+            switch (token[++i]) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'e': c = '\x1b'; break;
+                case '0': c = '\0'; break;
+                case '"': c = '"'; break;
+                case '\\': c = '\\'; break;
+                default: fail(line, std::string("Unknown escape \\") + token[i] + ".");
+            }
+        }
+        if (out) out->push_back(static_cast<unsigned char>(c));
+        ++count;
+    }
+    if (out) out->push_back(0);
+    return count + 1;
+}
+
+/**
+ * @brief Second pass: encodes statements with a complete symbol table.
+ */
+class Encoder {
+    public:
+        Encoder(const std::unordered_map<std::string_view, std::uint16_t>& symbols) : symbols(symbols) {}
+
+        /**
+         * @brief Encodes one statement, appending its words.
+         * @param s The statement.
+         * @param out The words of its segment.
+         */
+        void encode(const Statement& s, std::vector<std::uint16_t>& out) {
+            statement = &s;
+            switch (s.mnemonic) {
+                case M_ADD:
+                case M_AND: {
+                    std::uint16_t op = s.mnemonic == M_ADD ? OP_ADD : OP_AND;
+                    std::uint16_t word = static_cast<std::uint16_t>(op << 12 | reg(0) << 9 | reg(1) << 6);
+                    int sr2 = parse_register(s.operands[2]);
+                    word |= sr2 >= 0 ? sr2 : 0x20 | immediate(2, 5);
+                    out.push_back(word);
+                    break;
+                }
+                case M_NOT: out.push_back(static_cast<std::uint16_t>(OP_NOT << 12 | reg(0) << 9 | reg(1) << 6 | 0x3F)); break;
+                case M_BR: out.push_back(static_cast<std::uint16_t>(s.condition << 9 | offset(0, 9))); break;
+                case M_JMP: out.push_back(static_cast<std::uint16_t>(OP_JMP << 12 | reg(0) << 6)); break;
+                case M_RET: out.push_back(static_cast<std::uint16_t>(OP_JMP << 12 | R_R7 << 6)); break;
+                case M_JSR: out.push_back(static_cast<std::uint16_t>(OP_JSR << 12 | 0x800 | offset(0, 11))); break;
+                case M_JSRR: out.push_back(static_cast<std::uint16_t>(OP_JSR << 12 | reg(0) << 6)); break;
+                case M_LD: out.push_back(static_cast<std::uint16_t>(OP_LD << 12 | reg(0) << 9 | offset(1, 9))); break;
+                case M_LDI: out.push_back(static_cast<std::uint16_t>(OP_LDI << 12 | reg(0) << 9 | offset(1, 9))); break;
+                case M_LEA: out.push_back(static_cast<std::uint16_t>(OP_LEA << 12 | reg(0) << 9 | offset(1, 9))); break;
+                case M_ST: out.push_back(static_cast<std::uint16_t>(OP_ST << 12 | reg(0) << 9 | offset(1, 9))); break;
+                case M_STI: out.push_back(static_cast<std::uint16_t>(OP_STI << 12 | reg(0) << 9 | offset(1, 9))); break;
+                case M_LDR: out.push_back(static_cast<std::uint16_t>(OP_LDR << 12 | reg(0) << 9 | reg(1) << 6 | immediate(2, 6))); break;
+                case M_STR: out.push_back(static_cast<std::uint16_t>(OP_STR << 12 | reg(0) << 9 | reg(1) << 6 | immediate(2, 6))); break;
+                case M_TRAP: out.push_back(static_cast<std::uint16_t>(OP_TRAP << 12 | unsigned_value(0, 0xFF))); break;
+                case M_RTI: out.push_back(static_cast<std::uint16_t>(OP_RTI << 12)); break;
+                case M_GETC: out.push_back(OP_TRAP << 12 | TRAP_GETC); break;
+                case M_OUT: out.push_back(OP_TRAP << 12 | TRAP_OUT); break;
+                case M_PUTS: out.push_back(OP_TRAP << 12 | TRAP_PUTS); break;
+                case M_IN: out.push_back(OP_TRAP << 12 | TRAP_IN); break;
+                case M_PUTSP: out.push_back(OP_TRAP << 12 | TRAP_PUTSP); break;
+                case M_HALT: out.push_back(OP_TRAP << 12 | TRAP_HALT); break;
+                case M_FILL: out.push_back(fill_value(0)); break;
+                case M_BLKW: out.resize(out.size() + unsigned_value(0, 0xFFFF), 0); break;
+                case M_STRINGZ: decode_string(s.operands[0], s.line, &out); break;
+                default: break;
+            }
+        }
+
+    private:
+        const std::unordered_map<std::string_view, std::uint16_t>& symbols; ///< Address of every label.
+        const Statement* statement = nullptr;                               ///< Statement being encoded.
+
+        /** @brief Parses operand i as a register. */
+        unsigned reg(std::size_t i) {
+            int r = parse_register(statement->operands[i]);
+            if (r < 0) fail(statement->line, "Expected a register, got '" + std::string(statement->operands[i]) + "'.");
+            return static_cast<unsigned>(r);
+        }
+
+        /** @brief Parses operand i as a signed number of the given width, returned in its low bits. */
+        unsigned immediate(std::size_t i, unsigned bits) {
+            long value;
+            if (!parse_number(statement->operands[i], value)) {
+                fail(statement->line, "Expected a number, got '" + std::string(statement->operands[i]) + "'.");
+            }
+            check_signed(value, bits, statement->operands[i]);
+            return static_cast<unsigned>(value) & ((1u << bits) - 1);
+        }
+
+        /** @brief Parses operand i as a number from 0 to max. */
+        unsigned unsigned_value(std::size_t i, long max) {
+            long value;
+            if (!parse_number(statement->operands[i], value)) {
+                fail(statement->line, "Expected a number, got '" + std::string(statement->operands[i]) + "'.");
+            }
+            if (value < 0 || value > max) {
+                fail(statement->line, std::string(statement->operands[i]) + " is out of range.");
+            }
+            return static_cast<unsigned>(value);
+        }
+
+        /** @brief Parses operand i as a PC-relative offset of the given width: a number or a label. */
+        unsigned offset(std::size_t i, unsigned bits) {
+            std::string_view token = statement->operands[i];
+            long value;
+            if (!parse_number(token, value)) {
+                value = static_cast<long>(address_of(token)) - (statement->address + 1);
+            }
+            check_signed(value, bits, token);
+            return static_cast<unsigned>(value) & ((1u << bits) - 1);
+        }
+
+        /** @brief Parses operand i as a .FILL value: a 16-bit number or a label's address. */
+        std::uint16_t fill_value(std::size_t i) {
+            std::string_view token = statement->operands[i];
+            long value;
+            if (!parse_number(token, value)) return address_of(token);
+            if (value < -0x8000 || value > 0xFFFF) fail(statement->line, std::string(token) + " is out of range.");
+            return static_cast<std::uint16_t>(value);
+        }
+
+        /** @brief Looks up a label. */
+        std::uint16_t address_of(std::string_view label) {
+            auto it = symbols.find(label);
+            if (it == symbols.end()) fail(statement->line, "Undefined label '" + std::string(label) + "'.");
+            return it->second;
+        }
+
+        /** @brief Fails unless value fits a signed field of the given width. */
+        void check_signed(long value, unsigned bits, std::string_view token) {
+            long limit = 1L << (bits - 1);
+            if (value < -limit || value >= limit) {
+                fail(statement->line, std::string(token) + " is out of range for a " + std::to_string(bits) +
+                                      "-bit field (" + std::to_string(value) + ").");
+            }
+        }
+};
+
+AssembledProgram assemble(const std::string& source) {
+    std::vector<Statement> statements;
+    statements.reserve(source.size() / 16 + 1);
+    std::unordered_map<std::string_view, std::uint16_t> symbols;
+    symbols.reserve(source.size() / 64 + 16);
+    std::vector<std::size_t> segment_sizes;
+    AssembledProgram program;
+
+    // Pass 1: tokenize, assign addresses, collect labels.
+    bool in_block = false;
+    std::uint32_t address = 0;
+    std::array<std::string_view, ASM_MAX_TOKENS> tokens;
+    std::string_view text(source);
+    std::size_t line = 0;
+    std::size_t line_start = 0;
+    while (line_start <= text.size()) {
+        std::size_t line_end = text.find('\n', line_start);
+        if (line_end == std::string_view::npos) line_end = text.size();
+        std::string_view line_text = text.substr(line_start, line_end - line_start);
+        line_start = line_end + 1;
+        ++line;
+
+        std::size_t count = tokenize(line_text, line, tokens);
+        if (count == 0) continue;
+
+        Statement s{line, M_NONE, 0, 0, 0, {}};
+        std::size_t first = 0;
+        std::string_view label;
+        s.mnemonic = lookup(tokens[0], s.condition);
+        if (s.mnemonic == M_NONE) {
+            label = tokens[0];
+            if (!label.empty() && label.back() == ':') label.remove_suffix(1);
+            if (!is_label(label)) fail(line, "'" + std::string(tokens[0]) + "' is neither an opcode nor a valid label.");
+            first = 1;
+            if (count > 1) {
+                s.mnemonic = lookup(tokens[1], s.condition);
+                if (s.mnemonic == M_NONE) fail(line, "Unknown opcode or directive '" + std::string(tokens[1]) + "'.");
+            }
+        }
+
+        if (s.mnemonic == M_ORIG) {
+            if (in_block) fail(line, ".ORIG inside a block; end the previous one with .END.");
+            if (!label.empty()) fail(line, "A label cannot name .ORIG.");
+        } else if (!in_block) {
+            fail(line, "Statement outside a .ORIG block.");
+        }
+        if (!label.empty()) {
+            if (s.mnemonic == M_END) fail(line, "A label cannot name .END.");
+            if (!symbols.emplace(label, static_cast<std::uint16_t>(address)).second) {
+                fail(line, "Duplicate label '" + std::string(label) + "'.");
+            }
+        }
+        if (first == count) continue;
+
+        std::size_t operands = count - first - 1;
+        if (operands != MNEMONICS[s.mnemonic].operands) {
+            fail(line, std::string(MNEMONICS[s.mnemonic].name) + " takes " +
+                       std::to_string(MNEMONICS[s.mnemonic].operands) + " operand(s), got " + std::to_string(operands) + ".");
+        }
+        for (std::size_t i = 0; i < operands; ++i) {
+            s.operands[i] = tokens[first + 1 + i];
+        }
+
+        std::uint32_t size = 1;
+        switch (s.mnemonic) {
+            case M_ORIG: {
+                long origin;
+                if (!parse_number(s.operands[0], origin) || origin < 0 || origin > 0xFFFF) {
+                    fail(line, ".ORIG expects an address from x0000 to xFFFF.");
+                }
+                in_block = true;
+                address = static_cast<std::uint32_t>(origin);
+                program.segments.push_back({static_cast<std::uint16_t>(origin), {}});
+                segment_sizes.push_back(0);
+                continue;
+            }
+            case M_END:
+                in_block = false;
+                continue;
+            case M_BLKW: {
+                long words;
+                if (!parse_number(s.operands[0], words) || words < 0 || words > 0xFFFF) {
+                    fail(line, ".BLKW expects a word count.");
+                }
+                size = static_cast<std::uint32_t>(words);
+                break;
+            }
+            case M_STRINGZ:
+                size = static_cast<std::uint32_t>(decode_string(s.operands[0], line, nullptr));
+                break;
+            default:
+                break;
+        }
+        s.address = static_cast<std::uint16_t>(address);
+        s.segment = static_cast<std::uint32_t>(program.segments.size() - 1);
+        address += size;
+        if (address > MEMORY_MAX) fail(line, "The block runs past the end of memory.");
+        segment_sizes.back() += size;
+        statements.push_back(s);
+    }
+
+    // Pass 2: encode.
+    Encoder encoder(symbols);
+    for (std::size_t i = 0; i < program.segments.size(); ++i) {
+        program.segments[i].words.reserve(segment_sizes[i]);
+    }
+    for (const Statement& s : statements) {
+        encoder.encode(s, program.segments[s.segment].words);
+    }
+
+    program.symbols.reserve(symbols.size());
+    for (const auto& symbol : symbols) {
+        program.symbols.emplace(std::string(symbol.first), symbol.second);
+    }
+    return program;
+}
+
+AssembledProgram assemble_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+    }
+    std::string source;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = ::read(fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to read " + path + ": " + std::strerror(error));
+        }
+        source.append(buffer, static_cast<std::size_t>(n));
+    }
+    ::close(fd);
+    try {
+        return assemble(source);
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error(path + ": " + e.what());
+    }
+}
+
+void write_object(const AssembledSegment& segment, const std::string& path) {
+    std::vector<std::uint8_t> bytes;
+    bytes.reserve(2 * (segment.words.size() + 1));
+    bytes.push_back(static_cast<std::uint8_t>(segment.origin >> 8));
+    bytes.push_back(static_cast<std::uint8_t>(segment.origin));
+    for (std::uint16_t word : segment.words) {
+        bytes.push_back(static_cast<std::uint8_t>(word >> 8));
+        bytes.push_back(static_cast<std::uint8_t>(word));
+    }
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to create " + path + ": " + std::strerror(errno));
+    }
+    std::size_t written = 0;
+    while (written < bytes.size()) {
+        ssize_t n = ::write(fd, bytes.data() + written, bytes.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to write " + path + ": " + std::strerror(error));
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    if (::close(fd) == -1) {
+        throw std::runtime_error("Failed to write " + path + ": " + std::strerror(errno));
+    }
+}
+
+void LC3State::load_program(const AssembledProgram& program) {
+    for (const AssembledSegment& segment : program.segments) {
+        for (std::size_t i = 0; i < segment.words.size(); ++i) {
+            this->memory.write(static_cast<std::uint16_t>(segment.origin + i), segment.words[i]);
+        }
+        if (!segment.words.empty()) {
+            loaded_code_segments.push_back({segment.origin, static_cast<std::uint16_t>(segment.words.size())});
+        }
+    }
+}
@@ -0,0 +1,449 @@
+/**
+ * @file cfg.cpp
+ * @brief Implements the control-flow graph and its loop and subroutine analyses.
+ */
+#include "cfg.hpp"
+#include "disassembler.hpp"
+#include "memory.hpp"
+#include "opcodes.hpp"
+#include "traps.hpp"
+#include <algorithm>
+#include <ostream>
+#include <utility>
+
+/**
+ * @brief Per-address flags used while building a graph.
+ */
+enum AddressFlags : std::uint8_t {
+    ADDRESS_COVERED = 1,     ///< In one of the segments.
+    ADDRESS_INSTRUCTION = 2, ///< Covered and decodes to an instruction.
+    ADDRESS_LEADER = 4,      ///< Starts a block.
+    ADDRESS_DATA = 8         ///< Read or written by reachable code.
+};
+
+/**
+ * @brief Returns whether a decoded word counts as an instruction.
+ * @param d The decoded word.
+ * @return false for RTI, RES and BR without condition bits.
+ */
+static bool is_instruction(const DecodedInstruction& d) {
+    return d.op != OP_RTI && d.op != OP_RES && !(d.op == OP_BR && d.dr == 0);
+}
+
+/**
+ * @brief Returns whether a decoded instruction ends its block.
+ * @param d The decoded instruction.
+ * @return true for BR, JSR, JSRR, JMP, RET and HALT.
+ */
+static bool ends_block(const DecodedInstruction& d) {
+    return d.op == OP_BR || d.op == OP_JSR || d.op == OP_JMP || (d.op == OP_TRAP && d.imm == TRAP_HALT);
+}
+
+/**
+ * @brief Returns the address a PC-relative instruction names.
+ * @param address The address of the instruction.
+ * @param d The decoded instruction.
+ * @return address + 1 + its offset, wrapped at 16 bits.
+ */
+static std::uint16_t pc_relative(std::uint16_t address, const DecodedInstruction& d) {
+    return static_cast<std::uint16_t>(address + 1 + d.imm);
+}
+
+/**
+ * @brief Resolves a JMP or JSRR through an LD or LEA of its base register right before it.
+ * @param memory All MEMORY_MAX words.
+ * @param flags The address flags.
+ * @param address The address of the JMP or JSRR.
+ * @param base Its base register.
+ * @param target Receives the address jumped to.
+ * @return Whether the target is known.
+ */
+static bool register_target(const std::uint16_t* memory, const std::vector<std::uint8_t>& flags,
+                            std::uint16_t address, unsigned base, std::uint16_t& target) {
+    std::uint16_t before = static_cast<std::uint16_t>(address - 1);
+    if (!(flags[before] & ADDRESS_INSTRUCTION)) return false;
+    DecodedInstruction loader = LC3State::decode(memory[before]);
+    if (loader.dr != base) return false;
+    if (loader.op == OP_LEA) {
+        target = pc_relative(before, loader);
+        return true;
+    }
+    if (loader.op == OP_LD) {
+        target = memory[pc_relative(before, loader)];
+        return true;
+    }
+    return false;
+}
+
+ControlFlowGraph::ControlFlowGraph(const std::uint16_t* memory, const std::vector<CodeSegment>& segments) {
+    std::vector<std::uint8_t> flags(MEMORY_MAX, 0);
+    find_blocks(memory, segments, flags);
+    mark_reachable(memory, flags);
+    find_loops();
+    find_subroutines(memory);
+}
+
+void ControlFlowGraph::find_blocks(const std::uint16_t* memory, const std::vector<CodeSegment>& segments,
+                                   std::vector<std::uint8_t>& flags) {
+    for (const CodeSegment& segment : segments) {
+        std::fill(flags.begin() + segment.start_address, flags.begin() + segment.start_address + segment.size,
+                  static_cast<std::uint8_t>(ADDRESS_COVERED));
+    }
+    for (std::uint32_t a = 0; a < MEMORY_MAX; ++a) {
+        if ((flags[a] & ADDRESS_COVERED) && is_instruction(LC3State::decode(memory[a]))) {
+            flags[a] |= ADDRESS_INSTRUCTION;
+        }
+    }
+
+    // Leaders: entries, targets, and whatever follows a block-ending instruction.
+    auto lead = [&](std::uint16_t address) {
+        if (flags[address] & ADDRESS_INSTRUCTION) flags[address] |= ADDRESS_LEADER;
+    };
+    for (const CodeSegment& segment : segments) {
+        if (segment.size > 0) lead(segment.start_address);
+    }
+    for (std::uint32_t a = 0; a < MEMORY_MAX; ++a) {
+        if (!(flags[a] & ADDRESS_INSTRUCTION)) continue;
+        std::uint16_t address = static_cast<std::uint16_t>(a);
+        DecodedInstruction d = LC3State::decode(memory[a]);
+        std::uint16_t target;
+        if (d.op == OP_BR || (d.op == OP_JSR && d.mode)) {
+            lead(pc_relative(address, d));
+        } else if ((d.op == OP_JSR || (d.op == OP_JMP && d.sr1 != 7)) &&
+                   register_target(memory, flags, address, d.sr1, target)) {
+            lead(target);
+        }
+        if (ends_block(d)) lead(static_cast<std::uint16_t>(address + 1));
+    }
+
+    block_of.assign(MEMORY_MAX, CFG_NONE);
+    bool open = false;
+    for (std::uint32_t a = 0; a < MEMORY_MAX; ++a) {
+        if (!(flags[a] & ADDRESS_INSTRUCTION)) {
+            open = false;
+            continue;
+        }
+        if (!open || (flags[a] & ADDRESS_LEADER)) {
+            block_list.emplace_back();
+            block_list.back().start = static_cast<std::uint16_t>(a);
+            open = true;
+        }
+        block_of[a] = static_cast<std::uint32_t>(block_list.size() - 1);
+        block_list.back().last = static_cast<std::uint16_t>(a);
+        if (ends_block(LC3State::decode(memory[a]))) open = false;
+    }
+    for (const CodeSegment& segment : segments) {
+        std::uint32_t entry = segment.size > 0 ? block_of[segment.start_address] : CFG_NONE;
+        if (entry != CFG_NONE && std::find(entry_blocks.begin(), entry_blocks.end(), entry) == entry_blocks.end()) {
+            entry_blocks.push_back(entry);
+        }
+    }
+
+    for (std::uint32_t b = 0; b < block_list.size(); ++b) {
+        BasicBlock& block = block_list[b];
+        DecodedInstruction d = LC3State::decode(memory[block.last]);
+        std::uint16_t next = static_cast<std::uint16_t>(block.last + 1);
+        auto add = [&](std::uint16_t address) {
+            if (block_of[address] != CFG_NONE) block.successors.push_back(block_of[address]);
+        };
+        std::uint16_t target;
+        switch (d.op) {
+            case OP_BR:
+                add(pc_relative(block.last, d));
+                if (d.dr != 0x7) add(next);
+                break;
+            case OP_JSR:
+                if (d.mode) {
+                    block.call = block_of[pc_relative(block.last, d)];
+                } else if (register_target(memory, flags, block.last, d.sr1, target)) {
+                    block.call = block_of[target];
+                }
+                add(next);
+                break;
+            case OP_JMP:
+                if (d.sr1 != 7 && register_target(memory, flags, block.last, d.sr1, target)) add(target);
+                break;
+            case OP_TRAP:
+                if (d.imm != TRAP_HALT) add(next);
+                break;
+            default:
+                add(next);
+                break;
+        }
+        std::sort(block.successors.begin(), block.successors.end());
+        block.successors.erase(std::unique(block.successors.begin(), block.successors.end()), block.successors.end());
+        for (std::uint32_t s : block.successors) {
+            block_list[s].predecessors.push_back(b);
+        }
+    }
+}
+
+void ControlFlowGraph::mark_reachable(const std::uint16_t* memory, std::vector<std::uint8_t>& flags) {
+    std::vector<std::uint32_t> pending(entry_blocks.begin(), entry_blocks.end());
+    for (std::uint32_t b : pending) block_list[b].reachable = true;
+    while (!pending.empty()) {
+        const BasicBlock& block = block_list[pending.back()];
+        pending.pop_back();
+        auto visit = [&](std::uint32_t next) {
+            if (next != CFG_NONE && !block_list[next].reachable) {
+                block_list[next].reachable = true;
+                pending.push_back(next);
+            }
+        };
+        for (std::uint32_t s : block.successors) visit(s);
+        visit(block.call);
+    }
+
+    for (const BasicBlock& block : block_list) {
+        if (!block.reachable) continue;
+        for (std::uint32_t a = block.start; a <= block.last; ++a) {
+            DecodedInstruction d = LC3State::decode(memory[a]);
+            if (d.op == OP_LD || d.op == OP_LDI || d.op == OP_ST || d.op == OP_STI || d.op == OP_LEA) {
+                flags[pc_relative(static_cast<std::uint16_t>(a), d)] |= ADDRESS_DATA;
+            }
+        }
+    }
+    for (std::uint32_t b = 0; b < block_list.size(); ++b) {
+        const BasicBlock& block = block_list[b];
+        if (block.reachable) continue;
+        bool data = false;
+        for (std::uint32_t a = block.start; a <= block.last && !data; ++a) {
+            data = flags[a] & ADDRESS_DATA;
+        }
+        if (!data) unreachable_blocks.push_back(b);
+    }
+}
+
+void ControlFlowGraph::find_loops() {
+    // Dominators (Cooper, Harvey and Kennedy) over the reachable blocks, below
+    // a virtual root whose children are the entries and the called blocks.
+    std::uint32_t count = static_cast<std::uint32_t>(block_list.size());
+    std::uint32_t root = count;
+    std::vector<std::uint32_t> roots(entry_blocks.begin(), entry_blocks.end());
+    for (const BasicBlock& block : block_list) {
+        if (block.reachable && block.call != CFG_NONE) roots.push_back(block.call);
+    }
+    std::sort(roots.begin(), roots.end());
+    roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+    std::vector<bool> is_root(count, false);
+    for (std::uint32_t r : roots) is_root[r] = true;
+
+    auto children = [&](std::uint32_t node) -> const std::vector<std::uint32_t>& {
+        return node == root ? roots : block_list[node].successors;
+    };
+    std::vector<std::uint32_t> rpo_number(count + 1, CFG_NONE);
+    std::vector<std::uint32_t> order; // Postorder.
+    order.reserve(count + 1);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> stack{{root, 0}};
+    rpo_number[root] = 0;
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        const std::vector<std::uint32_t>& next = children(top.first);
+        if (top.second < next.size()) {
+            std::uint32_t child = next[top.second++];
+            if (rpo_number[child] == CFG_NONE) {
+                rpo_number[child] = 0;
+                stack.emplace_back(child, 0);
+            }
+        } else {
+            order.push_back(top.first);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    for (std::uint32_t i = 0; i < order.size(); ++i) rpo_number[order[i]] = i;
+
+    std::vector<std::uint32_t> idom(count + 1, CFG_NONE);
+    idom[root] = root;
+    auto intersect = [&](std::uint32_t a, std::uint32_t b) {
+        while (a != b) {
+            while (rpo_number[a] > rpo_number[b]) a = idom[a];
+            while (rpo_number[b] > rpo_number[a]) b = idom[b];
+        }
+        return a;
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (std::size_t i = 1; i < order.size(); ++i) {
+            std::uint32_t node = order[i];
+            std::uint32_t new_idom = is_root[node] ? root : CFG_NONE;
+            for (std::uint32_t p : block_list[node].predecessors) {
+                if (idom[p] == CFG_NONE) continue;
+                new_idom = new_idom == CFG_NONE ? p : intersect(p, new_idom);
+            }
+            if (new_idom != idom[node]) {
+                idom[node] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    // Number the dominator tree so that dominates() is two comparisons.
+    std::vector<std::vector<std::uint32_t>> tree(count + 1);
+    for (std::size_t i = 1; i < order.size(); ++i) tree[idom[order[i]]].push_back(order[i]);
+    preorder.assign(count + 1, CFG_NONE);
+    postorder.assign(count + 1, CFG_NONE);
+    std::uint32_t pre = 0;
+    std::uint32_t post = 0;
+    stack.assign({{root, 0}});
+    preorder[root] = pre++;
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        if (top.second < tree[top.first].size()) {
+            std::uint32_t child = tree[top.first][top.second++];
+            preorder[child] = pre++;
+            stack.emplace_back(child, 0);
+        } else {
+            postorder[top.first] = post++;
+            stack.pop_back();
+        }
+    }
+
+    // Natural loops of the back edges, merged by header. Each header's back
+    // edges are walked together under its own stamp, which the header keeps
+    // throughout, so no walk passes up through the header of another loop.
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> back_edges; // Header, latch.
+    for (std::size_t i = 1; i < order.size(); ++i) {
+        std::uint32_t latch = order[i];
+        for (std::uint32_t header : block_list[latch].successors) {
+            if (dominates(header, latch)) back_edges.emplace_back(header, latch);
+        }
+    }
+    std::sort(back_edges.begin(), back_edges.end());
+    std::vector<std::uint32_t> stamp(count, CFG_NONE);
+    std::vector<std::uint32_t> pending;
+    for (std::size_t i = 0; i < back_edges.size();) {
+        std::uint32_t header = back_edges[i].first;
+        std::uint32_t id = static_cast<std::uint32_t>(loop_list.size());
+        loop_list.push_back({header, {}, {header}, CFG_NONE});
+        NaturalLoop& loop = loop_list.back();
+        stamp[header] = id;
+        for (; i < back_edges.size() && back_edges[i].first == header; ++i) {
+            std::uint32_t latch = back_edges[i].second;
+            loop.latches.push_back(latch);
+            if (stamp[latch] != id) {
+                stamp[latch] = id;
+                pending.push_back(latch);
+            }
+        }
+        while (!pending.empty()) {
+            std::uint32_t block = pending.back();
+            pending.pop_back();
+            loop.blocks.push_back(block);
+            for (std::uint32_t p : block_list[block].predecessors) {
+                if (idom[p] != CFG_NONE && stamp[p] != id) {
+                    stamp[p] = id;
+                    pending.push_back(p);
+                }
+            }
+        }
+    }
+    for (NaturalLoop& loop : loop_list) {
+        std::sort(loop.latches.begin(), loop.latches.end());
+        std::sort(loop.blocks.begin(), loop.blocks.end());
+    }
+    std::sort(loop_list.begin(), loop_list.end(),
+              [](const NaturalLoop& a, const NaturalLoop& b) { return a.header < b.header; });
+
+    // Outer loops are larger; visiting loops largest first leaves each
+    // block's innermost loop so far in innermost when an inner header is reached.
+    std::vector<std::uint32_t> by_size(loop_list.size());
+    for (std::uint32_t i = 0; i < by_size.size(); ++i) by_size[i] = i;
+    std::stable_sort(by_size.begin(), by_size.end(), [this](std::uint32_t a, std::uint32_t b) {
+        return loop_list[a].blocks.size() > loop_list[b].blocks.size();
+    });
+    std::vector<std::uint32_t> innermost(count, CFG_NONE);
+    for (std::uint32_t id : by_size) {
+        NaturalLoop& loop = loop_list[id];
+        loop.parent = innermost[loop.header];
+        for (std::uint32_t block : loop.blocks) innermost[block] = id;
+    }
+}
+
+void ControlFlowGraph::find_subroutines(const std::uint16_t* memory) {
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> calls; // Callee, caller.
+    for (std::uint32_t b = 0; b < block_list.size(); ++b) {
+        if (block_list[b].reachable && block_list[b].call != CFG_NONE) calls.emplace_back(block_list[b].call, b);
+    }
+    std::sort(calls.begin(), calls.end());
+
+    std::vector<std::uint32_t> stamp(block_list.size(), CFG_NONE);
+    std::vector<std::uint32_t> pending;
+    for (std::size_t i = 0; i < calls.size();) {
+        Subroutine subroutine{calls[i].first, {}, {}, 0};
+        for (; i < calls.size() && calls[i].first == subroutine.entry; ++i) {
+            subroutine.callers.push_back(calls[i].second);
+        }
+
+        bool returns = false;
+        stamp[subroutine.entry] = subroutine.entry;
+        pending.push_back(subroutine.entry);
+        while (!pending.empty()) {
+            std::uint32_t b = pending.back();
+            pending.pop_back();
+            const BasicBlock& block = block_list[b];
+            subroutine.blocks.push_back(b);
+            subroutine.instructions += block.last - block.start + 1u;
+            DecodedInstruction d = LC3State::decode(memory[block.last]);
+            returns |= d.op == OP_JMP && d.sr1 == 7;
+            for (std::uint32_t s : block.successors) {
+                if (stamp[s] != subroutine.entry) {
+                    stamp[s] = subroutine.entry;
+                    pending.push_back(s);
+                }
+            }
+        }
+        if (returns) {
+            std::sort(subroutine.blocks.begin(), subroutine.blocks.end());
+            subroutine_list.push_back(std::move(subroutine));
+        }
+    }
+}
+
+bool ControlFlowGraph::dominates(std::uint32_t dominator, std::uint32_t block) const {
+    if (dominator >= block_list.size() || block >= block_list.size()) return false;
+    if (preorder[dominator] == CFG_NONE || preorder[block] == CFG_NONE) return false;
+    return preorder[dominator] <= preorder[block] && postorder[block] <= postorder[dominator];
+}
+
+void ControlFlowGraph::write_dot(std::ostream& out, const std::uint16_t* memory) const {
+    std::vector<std::uint8_t> drawn(block_list.size(), 0);
+    std::vector<std::uint8_t> header(block_list.size(), 0);
+    std::vector<std::uint8_t> entry(block_list.size(), 0);
+    for (std::uint32_t b = 0; b < block_list.size(); ++b) drawn[b] = block_list[b].reachable;
+    for (std::uint32_t b : unreachable_blocks) drawn[b] = 1;
+    for (const NaturalLoop& loop : loop_list) header[loop.header] = 1;
+    for (const Subroutine& subroutine : subroutine_list) entry[subroutine.entry] = 1;
+
+    out << "digraph cfg {\n    node [shape=box, fontname=\"monospace\"];\n";
+    char line[DISASSEMBLY_MAX_LINE];
+    for (std::uint32_t b = 0; b < block_list.size(); ++b) {
+        if (!drawn[b]) continue;
+        const BasicBlock& block = block_list[b];
+        out << "    b" << b << " [label=\"";
+        for (std::uint32_t a = block.start; a <= block.last; ++a) {
+            out.write(line, static_cast<std::streamsize>(
+                disassemble_instruction(static_cast<std::uint16_t>(a), memory[a], line)));
+            out << "\\l";
+        }
+        out << '"';
+        if (!block.reachable) out << ", style=dashed";
+        if (header[b]) out << ", penwidth=3";
+        if (entry[b]) out << ", peripheries=2";
+        out << "];\n";
+    }
+    for (std::uint32_t b = 0; b < block_list.size(); ++b) {
+        if (!drawn[b]) continue;
+        for (std::uint32_t s : block_list[b].successors) {
+            if (drawn[s]) out << "    b" << b << " -> b" << s << ";\n";
+        }
+        if (block_list[b].call != CFG_NONE && drawn[block_list[b].call]) {
+            out << "    b" << b << " -> b" << block_list[b].call << " [style=dotted];\n";
+        }
+    }
+    out << "}\n";
+}
+
+ControlFlowGraph LC3State::control_flow_graph() const {
+    return ControlFlowGraph(memory.memory, loaded_code_segments);
+}
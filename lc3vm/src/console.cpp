@@ -0,0 +1,116 @@
+/**
+ * @file console.cpp
+ * @brief Implements the descriptor, terminal, buffer and test consoles.
+ */
+#include "console.hpp"
+#include "keyboard.hpp"
+#include "memory.hpp"
+#include "terminal_input.hpp"
+#include <poll.h>
+#include <thread>
+
+/**
+ * @brief Waits until a descriptor is readable.
+ * @param fd The descriptor.
+ * @param timeout_ms The longest time to wait; 0 only checks.
+ * @return true if a read would not block.
+ */
+static bool readable(int fd, int timeout_ms) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    return poll(&pfd, 1, timeout_ms) > 0;
+}
+
+FdConsole::FdConsole(int in_fd, int out_fd) : in_fd(in_fd), out_fd(out_fd) {
+}
+
+FdConsole::~FdConsole() {
+    stop_reader();
+}
+
+void FdConsole::start_reader() {
+    stop_reader();
+    reader.reset(new InputReader(queue, in_fd));
+}
+
+void FdConsole::stop_reader() {
+    reader.reset();
+}
+
+void FdConsole::connect(OutputBuffer& output) {
+    output.set_descriptor(out_fd);
+}
+
+bool FdConsole::key_pending() {
+    if (!queue.empty()) return true;
+    return !reader && readable(in_fd, 0);
+}
+
+bool FdConsole::read_key(char& c, bool wait) {
+    if (queue.pop(c)) return true;
+    if (reader) {
+        return wait && queue.wait_pop(c);
+    }
+    if (!wait && !readable(in_fd, 0)) {
+        return false;
+    }
+    return ::read(in_fd, &c, 1) == 1;
+}
+
+void FdConsole::wait_for_key(std::chrono::milliseconds timeout) {
+    if (!reader) {
+        readable(in_fd, static_cast<int>(timeout.count()));
+    } else if (!queue.wait_for(timeout) && queue.closed()) {
+        // No more input will come; still keep a spinning guest off the CPU.
+        std::this_thread::sleep_for(timeout);
+    }
+}
+
+TerminalConsole::TerminalConsole() {
+    enable_raw_mode();
+}
+
+TerminalConsole::~TerminalConsole() {
+    stop_reader();
+    disable_raw_mode();
+}
+
+BufferConsole::BufferConsole(std::string input) : input(std::move(input)), position(0) {
+}
+
+std::string BufferConsole::take_output() {
+    std::string output;
+    output.swap(captured);
+    return output;
+}
+
+void BufferConsole::connect(OutputBuffer& output) {
+    output.capture(&captured);
+}
+
+bool BufferConsole::read_key(char& c, bool) {
+    if (position == input.size()) {
+        ++misses;
+        return false;
+    }
+    c = input[position++];
+    return true;
+}
+
+void BufferConsole::wait_for_key(std::chrono::milliseconds timeout) {
+    // Keys only arrive through feed() between runs; keep a spinning guest off the CPU.
+    std::this_thread::sleep_for(timeout);
+}
+
+void TestConsole::connect(OutputBuffer& output) {
+    output.set_descriptor(-1);
+}
+
+bool TestConsole::read_key(char& c, bool wait) {
+    c = static_cast<char>(memory.memory[Keyboard::MR_KBDR]);
+    return wait || (memory.memory[Keyboard::MR_KBSR] >> Keyboard::MR_KBSR_SHIFT) != 0;
+}
+
+Console& standard_console() {
+    static FdConsole console;
+    return console;
+}
@@ -0,0 +1,300 @@
+/**
+ * @file disassembler.cpp
+ * @brief Implements the table-driven disassembler and the code/data separation of listings.
+ */
+#include "disassembler.hpp"
+#include "opcodes.hpp"
+#include "traps.hpp"
+#include <charconv>
+#include <cstring>
+#include <ostream>
+
+/**
+ * @brief How an opcode's operands are laid out.
+ */
+enum OperandFormat : std::uint8_t {
+    FORMAT_ARITHMETIC,  ///< DR, SR1, SR2 or #imm5 (ADD, AND).
+    FORMAT_NOT,         ///< DR, SR.
+    FORMAT_BRANCH,      ///< n/z/p suffix, then the target.
+    FORMAT_JUMP,        ///< RET, or JMP BaseR.
+    FORMAT_SUBROUTINE,  ///< The target, or BaseR (JSR, JSRR).
+    FORMAT_PC_RELATIVE, ///< R, then the target of a 9-bit offset (LD, LDI, LEA, ST, STI).
+    FORMAT_BASE_OFFSET, ///< R, BaseR, #offset6 (LDR, STR).
+    FORMAT_TRAP,        ///< Two hex digits of the trap vector.
+    FORMAT_BAD          ///< No operands.
+};
+
+/**
+ * @brief Mnemonic text and operand layout of each opcode, indexed by opcode.
+ */
+static const struct {
+    const char* text;     ///< Written as is, including the separating space.
+    std::uint8_t length;  ///< Length of text.
+    OperandFormat format; ///< Operands following it.
+} OPCODE_TABLE[16] = {
+    {"BR", 2, FORMAT_BRANCH},         // OP_BR
+    {"ADD ", 4, FORMAT_ARITHMETIC},   // OP_ADD
+    {"LD ", 3, FORMAT_PC_RELATIVE},   // OP_LD
+    {"ST ", 3, FORMAT_PC_RELATIVE},   // OP_ST
+    {"JSR ", 4, FORMAT_SUBROUTINE},   // OP_JSR
+    {"AND ", 4, FORMAT_ARITHMETIC},   // OP_AND
+    {"LDR ", 4, FORMAT_BASE_OFFSET},  // OP_LDR
+    {"STR ", 4, FORMAT_BASE_OFFSET},  // OP_STR
+    {"BAD OPCODE", 10, FORMAT_BAD},   // OP_RTI
+    {"NOT ", 4, FORMAT_NOT},          // OP_NOT
+    {"LDI ", 4, FORMAT_PC_RELATIVE},  // OP_LDI
+    {"STI ", 4, FORMAT_PC_RELATIVE},  // OP_STI
+    {"", 0, FORMAT_JUMP},             // OP_JMP
+    {"BAD OPCODE", 10, FORMAT_BAD},   // OP_RES
+    {"LEA ", 4, FORMAT_PC_RELATIVE},  // OP_LEA
+    {"TRAP x", 6, FORMAT_TRAP}        // OP_TRAP
+};
+
+/**
+ * @brief Lowercase hex digits of every byte value.
+ */
+struct HexPairs {
+    char digits[256][2]; ///< High and low digit of each byte.
+
+    constexpr HexPairs() : digits() {
+        const char* hex = "0123456789abcdef";
+        for (int i = 0; i < 256; ++i) {
+            digits[i][0] = hex[i >> 4];
+            digits[i][1] = hex[i & 0xF];
+        }
+    }
+};
+static constexpr HexPairs HEX_PAIRS;
+
+/** @brief Writes "0x" and four hex digits. */
+static char* put_address(char* p, std::uint16_t value) {
+    p[0] = '0';
+    p[1] = 'x';
+    std::memcpy(p + 2, HEX_PAIRS.digits[value >> 8], 2);
+    std::memcpy(p + 4, HEX_PAIRS.digits[value & 0xFF], 2);
+    return p + 6;
+}
+
+/** @brief Writes "R" and a register number. */
+static char* put_register(char* p, unsigned r) {
+    p[0] = 'R';
+    p[1] = static_cast<char>('0' + (r & 0x7));
+    return p + 2;
+}
+
+/** @brief Writes ", ". */
+static char* put_separator(char* p) {
+    p[0] = ',';
+    p[1] = ' ';
+    return p + 2;
+}
+
+/** @brief Writes "#" and the sign-extended low bits of a word in decimal. */
+static char* put_immediate(char* p, std::uint16_t instr, int bits) {
+    int value = instr & ((1 << bits) - 1);
+    if (value >> (bits - 1)) value -= 1 << bits;
+    *p++ = '#';
+    return std::to_chars(p, p + 4, value).ptr;
+}
+
+/** @brief Returns the target of a PC-relative offset in the low bits of a word, wrapped at 16 bits. */
+static std::uint16_t target(std::uint16_t address, std::uint16_t instr, int bits) {
+    int offset = instr & ((1 << bits) - 1);
+    if (offset >> (bits - 1)) offset -= 1 << bits;
+    return static_cast<std::uint16_t>(address + 1 + offset);
+}
+
+std::size_t disassemble_instruction(std::uint16_t address, std::uint16_t instr, char* buffer) {
+    const auto& entry = OPCODE_TABLE[instr >> 12];
+    char* p = put_address(buffer, address);
+    *p++ = ':';
+    *p++ = ' ';
+    std::memcpy(p, entry.text, entry.length);
+    p += entry.length;
+
+    unsigned dr = (instr >> 9) & 0x7;
+    unsigned base = (instr >> 6) & 0x7;
+    switch (entry.format) {
+        case FORMAT_ARITHMETIC:
+            p = put_separator(put_register(put_separator(put_register(p, dr)), base));
+            p = (instr & 0x20) ? put_immediate(p, instr, 5) : put_register(p, instr & 0x7);
+            break;
+        case FORMAT_NOT:
+            p = put_register(put_separator(put_register(p, dr)), base);
+            break;
+        case FORMAT_BRANCH:
+            if (instr & 0x800) *p++ = 'n';
+            if (instr & 0x400) *p++ = 'z';
+            if (instr & 0x200) *p++ = 'p';
+            *p++ = ' ';
+            p = put_address(p, target(address, instr, 9));
+            break;
+        case FORMAT_JUMP:
+            if (base == 7) {
+                std::memcpy(p, "RET", 3);
+                p += 3;
+            } else {
+                std::memcpy(p, "JMP ", 4);
+                p = put_register(p + 4, base);
+            }
+            break;
+        case FORMAT_SUBROUTINE:
+            p = (instr & 0x800) ? put_address(p, target(address, instr, 11)) : put_register(p, base);
+            break;
+        case FORMAT_PC_RELATIVE:
+            p = put_address(put_separator(put_register(p, dr)), target(address, instr, 9));
+            break;
+        case FORMAT_BASE_OFFSET:
+            p = put_immediate(put_separator(put_register(put_separator(put_register(p, dr)), base)), instr, 6);
+            break;
+        case FORMAT_TRAP:
+            std::memcpy(p, HEX_PAIRS.digits[instr & 0xFF], 2);
+            p += 2;
+            break;
+        case FORMAT_BAD:
+            break;
+    }
+    return static_cast<std::size_t>(p - buffer);
+}
+
+std::vector<std::uint8_t> map_code(const std::uint16_t* memory, std::uint16_t start, std::uint32_t size) {
+    std::vector<std::uint8_t> kinds(size, WORD_DATA);
+    std::vector<std::uint16_t> pending;
+    auto index = [start](std::uint16_t address) -> std::uint32_t { return static_cast<std::uint16_t>(address - start); };
+    auto reach = [&](std::uint16_t address, bool execute) {
+        std::uint32_t i = index(address);
+        if (i >= size) return;
+        kinds[i] |= WORD_TARGET;
+        if (execute && !(kinds[i] & WORD_CODE)) pending.push_back(address);
+    };
+    // A register jump right after LD or LEA of its base register goes where that loaded.
+    auto follow_register = [&](std::uint16_t address, unsigned base) {
+        std::uint32_t i = index(address);
+        if (i == 0 || !(kinds[i - 1] & WORD_CODE)) return;
+        std::uint16_t before = static_cast<std::uint16_t>(address - 1);
+        std::uint16_t loader = memory[before];
+        if (((loader >> 9) & 0x7) != base) return;
+        if ((loader >> 12) == OP_LEA) {
+            reach(target(before, loader, 9), true);
+        } else if ((loader >> 12) == OP_LD) {
+            reach(memory[target(before, loader, 9)], true);
+        }
+    };
+
+    if (size > 0) pending.push_back(start);
+    while (!pending.empty()) {
+        std::uint16_t address = pending.back();
+        pending.pop_back();
+        for (;;) {
+            std::uint32_t i = index(address);
+            if (i >= size || (kinds[i] & WORD_CODE)) break;
+            std::uint16_t instr = memory[address];
+            std::uint16_t opcode = instr >> 12;
+            if (opcode == OP_RTI || opcode == OP_RES) break;
+            kinds[i] |= WORD_CODE;
+
+            bool falls_through = true;
+            switch (opcode) {
+                case OP_BR: {
+                    unsigned nzp = (instr >> 9) & 0x7;
+                    if (nzp) reach(target(address, instr, 9), true);
+                    falls_through = nzp != 0x7;
+                    break;
+                }
+                case OP_JSR:
+                    if (instr & 0x800) {
+                        reach(target(address, instr, 11), true);
+                    } else {
+                        follow_register(address, (instr >> 6) & 0x7);
+                    }
+                    break;
+                case OP_JMP:
+                    if (((instr >> 6) & 0x7) != 7) follow_register(address, (instr >> 6) & 0x7);
+                    falls_through = false;
+                    break;
+                case OP_LD:
+                case OP_LDI:
+                case OP_LEA:
+                case OP_ST:
+                case OP_STI:
+                    reach(target(address, instr, 9), false);
+                    break;
+                case OP_TRAP:
+                    falls_through = (instr & 0xFF) != TRAP_HALT;
+                    break;
+                default:
+                    break;
+            }
+            if (!falls_through) break;
+            address = static_cast<std::uint16_t>(address + 1);
+        }
+    }
+    return kinds;
+}
+
+/**
+ * @brief Returns whether a word is a character .STRINGZ data is made of.
+ * @param word The word.
+ * @return true for printable ASCII, newline, tab, carriage return and escape.
+ */
+static bool is_text(std::uint16_t word) {
+    return (word >= 0x20 && word < 0x7F) || word == '\n' || word == '\t' || word == '\r' || word == 0x1B;
+}
+
+void write_listing(std::ostream& out, const std::uint16_t* memory, std::uint16_t start,
+                   const std::vector<std::uint8_t>& kinds) {
+    char chunk[DISASSEMBLY_CHUNK_SIZE];
+    std::size_t used = 0;
+    auto reserve = [&](std::size_t bytes) {
+        if (used > DISASSEMBLY_CHUNK_SIZE - bytes) {
+            out.write(chunk, static_cast<std::streamsize>(used));
+            used = 0;
+        }
+    };
+    auto word_at = [&](std::uint32_t i) { return memory[static_cast<std::uint16_t>(start + i)]; };
+
+    std::uint32_t size = static_cast<std::uint32_t>(kinds.size());
+    for (std::uint32_t i = 0; i < size;) {
+        reserve(DISASSEMBLY_MAX_LINE + 1);
+        std::uint16_t address = static_cast<std::uint16_t>(start + i);
+        if (kinds[i] & WORD_CODE) {
+            used += disassemble_instruction(address, word_at(i), chunk + used);
+            chunk[used++] = '\n';
+            ++i;
+            continue;
+        }
+
+        std::uint32_t end = i;
+        while (end < size && !(kinds[end] & WORD_CODE) && is_text(word_at(end))) ++end;
+        bool string = end < size && !(kinds[end] & WORD_CODE) && word_at(end) == 0 &&
+                      (end - i >= 2 || (end - i == 1 && (kinds[i] & WORD_TARGET)));
+        used = static_cast<std::size_t>(put_address(chunk + used, address) - chunk);
+        if (!string) {
+            std::memcpy(chunk + used, ": .FILL ", 8);
+            used = static_cast<std::size_t>(put_address(chunk + used + 8, word_at(i)) - chunk);
+            chunk[used++] = '\n';
+            ++i;
+            continue;
+        }
+
+        std::memcpy(chunk + used, ": .STRINGZ \"", 12);
+        used += 12;
+        for (; i < end; ++i) {
+            reserve(3);
+            char c = static_cast<char>(word_at(i));
+            char escape = c == '\n' ? 'n' : c == '\t' ? 't' : c == '\r' ? 'r' : c == 0x1B ? 'e' :
+                          c == '"' ? '"' : c == '\\' ? '\\' : 0;
+            if (escape) {
+                chunk[used++] = '\\';
+                chunk[used++] = escape;
+            } else {
+                chunk[used++] = c;
+            }
+        }
+        reserve(3);
+        chunk[used++] = '"';
+        chunk[used++] = '\n';
+        ++i; // The terminating zero.
+    }
+    out.write(chunk, static_cast<std::streamsize>(used));
+}
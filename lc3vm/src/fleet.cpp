@@ -0,0 +1,342 @@
+/**
+ * @file fleet.cpp
+ * @brief Implements the work-stealing fleet runner.
+ *
+ * Each worker owns a deque of live VMs. It tops its deque up with new jobs
+ * while it holds fewer than FLEET_VMS_PER_WORKER VMs and fewer than
+ * FLEET_VMS_PER_WORKER VMs per worker are live, then resumes its VMs round
+ * robin: one slice for the VM at the front, which goes back at the end.
+ * A worker with an empty deque steals from the back of another worker's,
+ * and one that finds nothing to steal sleeps until a VM is pushed behind
+ * another one, a job finishes or the run ends. A VM is only ever in one
+ * deque or running on one worker, so the VMs themselves need no locking.
+ *
+ * Object files named by more than one job are loaded once into a
+ * SharedImage that all of those VMs map copy-on-write.
+ */
+#include "fleet.hpp"
+#include "image.hpp"
+#include "registers.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+/**
+ * @brief A started job and the VM running it.
+ */
+struct FleetTask {
+    explicit FleetTask(std::size_t job, const std::string& input) : job(job), console(new BufferConsole(input)) {
+        vm.set_console(std::unique_ptr<Console>(console));
+    }
+
+    std::size_t job;
+    LC3State vm;
+    BufferConsole* console; ///< The VM's console, holding the job's input and output.
+};
+
+/**
+ * @brief Deque of the tasks a worker resumes next.
+ */
+struct WorkerDeque {
+    std::mutex lock;
+    std::deque<std::unique_ptr<FleetTask>> tasks;
+};
+
+/**
+ * @brief State shared by the workers of one Fleet::run().
+ */
+class FleetRun {
+    public:
+        FleetRun(const std::vector<FleetJob>& jobs, std::vector<FleetResult>& results, unsigned workers)
+            : jobs(jobs), results(results), deques(workers), live_limit(std::size_t(workers) * FLEET_VMS_PER_WORKER),
+              next_job(0), live(0), remaining(jobs.size()) {
+            share_images();
+        }
+
+        /**
+         * @brief Runs tasks until every job has finished.
+         * @param self Index of the calling worker.
+         */
+        void work(unsigned self) {
+            try {
+                while (remaining.load(std::memory_order_acquire) > 0) {
+                    std::uint64_t seen = generation.load(std::memory_order_acquire);
+                    fill(self);
+                    std::unique_ptr<FleetTask> task = pop(self);
+                    if (!task) task = steal(self);
+                    if (!task) {
+                        sleep(seen);
+                        continue;
+                    }
+                    if (run_slice(*task)) {
+                        push(self, std::move(task));
+                    } else {
+                        task.reset();
+                        live.fetch_sub(1, std::memory_order_relaxed);
+                        wake(false);
+                    }
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(error_lock);
+                if (!error) error = std::current_exception();
+                remaining.store(0, std::memory_order_release);
+                wake(true);
+            }
+        }
+
+        /**
+         * @brief Rethrows the first exception a worker failed with, if any.
+         */
+        void rethrow() {
+            if (error) std::rethrow_exception(error);
+        }
+
+    private:
+        const std::vector<FleetJob>& jobs;
+        std::vector<FleetResult>& results;
+        std::vector<WorkerDeque> deques;
+        const std::size_t live_limit;         ///< Most VMs alive at once.
+        std::atomic<std::size_t> next_job;    ///< Index of the next job to start.
+        std::atomic<std::size_t> live;        ///< VMs started and not yet finished.
+        std::atomic<std::size_t> remaining;   ///< Jobs not yet finished.
+        std::atomic<std::uint64_t> generation{0}; ///< Bumped, under idle_lock, whenever a sleeping worker may find work.
+        std::mutex idle_lock;
+        std::condition_variable idle;          ///< Where workers without work sleep.
+        std::mutex error_lock;
+        std::exception_ptr error;
+
+        /** @brief Image for a list of object files used by several jobs, or the error loading it. */
+        struct ImageEntry {
+            std::size_t users = 0;
+            std::unique_ptr<SharedImage> image;
+            std::string error;
+        };
+        std::map<std::vector<std::string>, ImageEntry> shared_images; ///< Keyed by FleetJob::images.
+
+        /**
+         * @brief Loads every list of object files that more than one job starts from.
+         */
+        void share_images() {
+            for (const auto& job : jobs) {
+                if (!job.snapshot) ++shared_images[job.images].users;
+            }
+            for (auto& entry : shared_images) {
+                if (entry.second.users < 2) continue;
+                try {
+                    entry.second.image.reset(new SharedImage(entry.first));
+                } catch (const std::exception& e) {
+                    entry.second.error = e.what();
+                }
+            }
+        }
+
+        /**
+         * @brief Fills a job's VM from its snapshot, shared image or object files.
+         * @param vm The VM.
+         * @param job The job.
+         * @throw std::runtime_error if the job's object files cannot be loaded.
+         */
+        void load(LC3State& vm, const FleetJob& job) {
+            if (job.snapshot) {
+                vm.restore(*job.snapshot);
+                return;
+            }
+            const ImageEntry& entry = shared_images.at(job.images);
+            if (!entry.error.empty()) throw std::runtime_error(entry.error);
+            if (entry.image) {
+                vm.load_shared_image(*entry.image);
+            } else {
+                vm.load_images(job.images);
+            }
+        }
+
+        std::unique_ptr<FleetTask> pop(unsigned self) {
+            WorkerDeque& own = deques[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (own.tasks.empty()) return nullptr;
+            std::unique_ptr<FleetTask> task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return task;
+        }
+
+        void push(unsigned self, std::unique_ptr<FleetTask> task) {
+            WorkerDeque& own = deques[self];
+            bool stealable;
+            {
+                std::lock_guard<std::mutex> guard(own.lock);
+                own.tasks.push_back(std::move(task));
+                stealable = own.tasks.size() > 1;
+            }
+            // A lone VM is resumed by this worker next; only a queue is worth stealing from.
+            if (stealable) wake(false);
+        }
+
+        std::unique_ptr<FleetTask> steal(unsigned self) {
+            for (std::size_t i = 1; i < deques.size(); ++i) {
+                WorkerDeque& victim = deques[(self + i) % deques.size()];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (victim.tasks.empty()) continue;
+                std::unique_ptr<FleetTask> task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                return task;
+            }
+            return nullptr;
+        }
+
+        /**
+         * @brief Starts jobs onto a worker's deque until it holds FLEET_VMS_PER_WORKER VMs or none can start.
+         * @param self Index of the worker.
+         */
+        void fill(unsigned self) {
+            for (;;) {
+                {
+                    WorkerDeque& own = deques[self];
+                    std::lock_guard<std::mutex> guard(own.lock);
+                    if (own.tasks.size() >= FLEET_VMS_PER_WORKER) return;
+                }
+                std::unique_ptr<FleetTask> task = start();
+                if (!task) return;
+                push(self, std::move(task));
+            }
+        }
+
+        /**
+         * @brief Blocks until another worker may have work for this one.
+         * @param seen The generation read before this worker last looked for work.
+         */
+        void sleep(std::uint64_t seen) {
+            std::unique_lock<std::mutex> guard(idle_lock);
+            idle.wait(guard, [&] {
+                return generation.load(std::memory_order_relaxed) != seen ||
+                       remaining.load(std::memory_order_acquire) == 0;
+            });
+        }
+
+        /**
+         * @brief Wakes sleeping workers.
+         * @param all Whether to wake every one, as when the run ends, or just one.
+         */
+        void wake(bool all) {
+            {
+                std::lock_guard<std::mutex> guard(idle_lock);
+                generation.fetch_add(1, std::memory_order_release);
+            }
+            if (all) {
+                idle.notify_all();
+            } else {
+                idle.notify_one();
+            }
+        }
+
+        /**
+         * @brief Counts a job as finished, waking every worker if it was the last.
+         * @param result The job's result, which records its place in the finishing order.
+         */
+        void finish(FleetResult& result) {
+            std::size_t left = remaining.fetch_sub(1, std::memory_order_acq_rel);
+            result.finish_order = jobs.size() - left;
+            if (left == 1) wake(true);
+        }
+
+        /**
+         * @brief Creates the VM for the next job that has not been started.
+         * Jobs that fail to load are finished with their error and skipped.
+         * @return The task, or nullptr if all jobs are started or too many VMs are live.
+         */
+        std::unique_ptr<FleetTask> start() {
+            for (;;) {
+                if (live.fetch_add(1, std::memory_order_relaxed) >= live_limit) {
+                    live.fetch_sub(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                std::size_t job = next_job.fetch_add(1, std::memory_order_relaxed);
+                if (job >= jobs.size()) {
+                    live.fetch_sub(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+
+                std::unique_ptr<FleetTask> task(new FleetTask(job, jobs[job].input));
+                FleetResult& result = results[job];
+                try {
+                    LC3State& vm = task->vm;
+                    vm.set_execution_mode(jobs[job].mode);
+                    load(vm, jobs[job]);
+                } catch (const std::exception& e) {
+                    result.error = e.what();
+                    live.fetch_sub(1, std::memory_order_relaxed);
+                    finish(result);
+                    continue;
+                }
+                return task;
+            }
+        }
+
+        /**
+         * @brief Runs a task for one slice.
+         * @param task The task.
+         * @return true if the job has not finished yet.
+         */
+        bool run_slice(FleetTask& task) {
+            const FleetJob& job = jobs[task.job];
+            FleetResult& result = results[task.job];
+            std::uint64_t budget = std::min<std::uint64_t>(FLEET_SLICE, job.max_instructions - result.instructions);
+            RunResult run = task.vm.run_for(budget);
+            result.instructions += run.instructions;
+            bool starved = task.console->missed_reads() >= FLEET_IDLE_POLLS;
+            if (run.reason == StopReason::BudgetExhausted && !starved && result.instructions < job.max_instructions) {
+                return true;
+            }
+            result.reason = run.reason;
+            result.fault_pc = run.fault_pc;
+            if (run.reason == StopReason::BudgetExhausted && starved) {
+                // A guest polling KBSR has no waiting instruction; report where it stopped.
+                result.reason = StopReason::WaitingForInput;
+                result.fault_pc = task.vm.get_register_value(R_PC);
+            }
+            task.vm.output.flush();
+            result.output = task.console->take_output();
+            finish(result);
+            return false;
+        }
+};
+
+} // namespace
+
+Fleet::Fleet(unsigned threads) : thread_count(threads) {
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+std::vector<FleetResult> Fleet::run(const std::vector<FleetJob>& jobs) {
+    std::vector<FleetResult> results(jobs.size());
+    unsigned workers = static_cast<unsigned>(std::min<std::size_t>(thread_count, std::max<std::size_t>(jobs.size(), 1)));
+    FleetRun run(jobs, results, workers);
+
+    std::vector<std::thread> threads;
+    try {
+        for (unsigned w = 1; w < workers; ++w) {
+            threads.emplace_back(&FleetRun::work, &run, w);
+        }
+    } catch (...) {
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        throw;
+    }
+    run.work(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    run.rethrow();
+    return results;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file headless.cpp
+ * @brief Implements the script console and the headless run loop.
+ */
+#include "headless.hpp"
+#include "registers.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+
+ScriptConsole::ScriptConsole(std::string keys, int out_fd, bool paced)
+    : keys(std::move(keys)), position(0), out_fd(out_fd), paced(paced) {
+}
+
+void ScriptConsole::connect(OutputBuffer& output) {
+    output.set_descriptor(out_fd);
+}
+
+bool ScriptConsole::read_key(char& c, bool) {
+    if (position == keys.size()) {
+        if (idle_polls < HEADLESS_IDLE_POLLS) ++idle_polls;
+        return false;
+    }
+    if (holding) return false;
+    c = keys[position++];
+    holding = paced;
+    return true;
+}
+
+std::string read_script(const std::string& path) {
+    int fd = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to open input " + path + ": " + std::strerror(errno));
+    }
+    std::string keys;
+    char buffer[65536];
+    for (;;) {
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int error = errno;
+            if (fd != STDIN_FILENO) ::close(fd);
+            throw std::runtime_error("Failed to read input " + path + ": " + std::strerror(error));
+        }
+        keys.append(buffer, static_cast<std::size_t>(n));
+    }
+    if (fd != STDIN_FILENO) ::close(fd);
+    return keys;
+}
+
+RunResult run_headless(LC3State& vm, ScriptConsole& console, std::uint64_t key_delay,
+                       std::uint64_t max_instructions) {
+    RunResult total{StopReason::BudgetExhausted, 0, 0};
+    std::uint64_t unheld_slice = key_delay ? std::max<std::uint64_t>(key_delay / 8, 1) : HEADLESS_SLICE;
+    bool counting = false;      // Whether held_for counts towards releasing the held key.
+    std::uint64_t held_for = 0; // Instructions retired since the slice that took the last key.
+
+    while (total.instructions < max_instructions) {
+        std::uint64_t budget = counting ? key_delay - held_for : std::min<std::uint64_t>(unheld_slice, HEADLESS_SLICE);
+        budget = std::min(budget, max_instructions - total.instructions);
+        RunResult slice = vm.run_for(budget);
+        total.reason = slice.reason;
+        total.fault_pc = slice.fault_pc;
+        total.instructions += slice.instructions;
+        if (slice.reason != StopReason::BudgetExhausted && slice.reason != StopReason::WaitingForInput) {
+            break;
+        }
+        if (console.out_of_input()) {
+            // A guest polling KBSR has no waiting instruction; report where it stopped.
+            if (slice.reason != StopReason::WaitingForInput) total.fault_pc = vm.get_register_value(R_PC);
+            total.reason = StopReason::WaitingForInput;
+            break;
+        }
+
+        if (console.held()) {
+            // The slice that took the key does not count towards its delay.
+            if (counting) {
+                held_for += slice.instructions;
+            } else {
+                counting = true;
+                held_for = 0;
+            }
+            if (held_for >= key_delay || slice.reason == StopReason::WaitingForInput) {
+                console.release();
+                counting = false;
+            }
+            total.reason = StopReason::BudgetExhausted;
+            continue;
+        }
+        if (slice.reason == StopReason::WaitingForInput) {
+            break;
+        }
+    }
+    vm.output.flush();
+    return total;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file image.cpp
+ * @brief Implements mapping of LC-3 object files and shared images.
+ */
+#include "image.hpp"
+#include "memory.hpp"
+#include "simd.hpp"
+#include <new>
+#include <cerrno>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Reads a whole descriptor into a buffer, for files that cannot be mapped.
+ * @param fd The descriptor.
+ * @param buffer Receives the contents.
+ * @return false on a read error.
+ */
+static bool read_all(int fd, std::vector<std::uint8_t>& buffer) {
+    std::uint8_t chunk[4096];
+    for (;;) {
+        ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) return true;
+        buffer.insert(buffer.end(), chunk, chunk + n);
+    }
+}
+
+ProgramImage::ProgramImage(const std::string& filename)
+    : mapping(nullptr), mapping_length(0), payload(nullptr), word_count(0), load_address(0) {
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open image file: " + filename);
+    }
+
+    const std::uint8_t* bytes = nullptr;
+    std::size_t length = 0;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* mapped = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            mapping = mapped;
+            mapping_length = static_cast<std::size_t>(info.st_size);
+            bytes = static_cast<const std::uint8_t*>(mapped);
+            length = mapping_length;
+        }
+    }
+    if (!mapping) {
+        bool ok = read_all(fd, buffer);
+        if (!ok) {
+            close(fd);
+            throw std::runtime_error("Failed to read image file: " + filename);
+        }
+        bytes = buffer.data();
+        length = buffer.size();
+    }
+    close(fd);
+
+    if (length < sizeof(std::uint16_t)) {
+        if (mapping) munmap(mapping, mapping_length);
+        throw std::runtime_error("Failed to read origin from image file: " + filename);
+    }
+    load_address = static_cast<std::uint16_t>((bytes[0] << 8) | bytes[1]);
+    payload = reinterpret_cast<const std::uint16_t*>(bytes + sizeof(std::uint16_t));
+    word_count = (length - sizeof(std::uint16_t)) / sizeof(std::uint16_t);
+    if (word_count > static_cast<std::size_t>(MEMORY_MAX - load_address)) {
+        word_count = MEMORY_MAX - load_address;
+    }
+}
+
+ProgramImage::~ProgramImage() {
+    if (mapping) {
+        munmap(mapping, mapping_length);
+    }
+}
+
+SharedImage::SharedImage(const std::vector<std::string>& filenames) : fd(-1), view(nullptr) {
+    const std::size_t length = MEMORY_MAX * sizeof(std::uint16_t);
+    void* mapped = MAP_FAILED;
+#ifdef MFD_CLOEXEC
+    fd = memfd_create("lc3-image", MFD_CLOEXEC);
+    if (fd >= 0 && ftruncate(fd, static_cast<off_t>(length)) == 0) {
+        mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mapped == MAP_FAILED && fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+#endif
+    if (mapped == MAP_FAILED) {
+        mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) throw std::bad_alloc();
+    }
+    view = static_cast<std::uint16_t*>(mapped);
+
+    try {
+        for (const auto& filename : filenames) {
+            ProgramImage image(filename);
+            if (image.size() == 0) continue;
+            swap16_copy(view + image.origin(), image.words(), image.size());
+            loaded.emplace_back(image.origin(), static_cast<std::uint16_t>(image.size()));
+        }
+    } catch (...) {
+        munmap(view, length);
+        if (fd >= 0) close(fd);
+        throw;
+    }
+    mprotect(view, length, PROT_READ);
+}
+
+SharedImage::~SharedImage() {
+    munmap(view, MEMORY_MAX * sizeof(std::uint16_t));
+    if (fd >= 0) close(fd);
+}
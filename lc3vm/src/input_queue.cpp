@@ -0,0 +1,89 @@
+/**
+ * @file input_queue.cpp
+ * @brief Implements the blocking paths of InputQueue and the InputReader thread.
+ */
+#include "input_queue.hpp"
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <stdexcept>
+
+bool InputQueue::wait_pop(char& c) {
+    if (pop(c)) return true;
+
+    std::unique_lock<std::mutex> lock(wait_mutex);
+    waiting.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in wake(): either the producer sees waiting or we see its byte.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wait_condition.wait(lock, [this] { return !empty() || closed(); });
+    waiting.store(false, std::memory_order_relaxed);
+    lock.unlock();
+    return pop(c);
+}
+
+bool InputQueue::wait_for(std::chrono::milliseconds timeout) {
+    if (!empty()) return true;
+
+    std::unique_lock<std::mutex> lock(wait_mutex);
+    waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool ready = wait_condition.wait_for(lock, timeout, [this] { return !empty() || closed(); });
+    waiting.store(false, std::memory_order_relaxed);
+    return ready && !empty();
+}
+
+void InputQueue::close() {
+    finished.store(true, std::memory_order_release);
+    wake();
+}
+
+void InputQueue::wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed)) {
+        // Taking the lock orders this notification after the consumer started waiting.
+        std::lock_guard<std::mutex> lock(wait_mutex);
+        wait_condition.notify_one();
+    }
+}
+
+InputReader::InputReader(InputQueue& queue, int fd) : queue(queue), fd(fd) {
+    if (pipe(stop_pipe) != 0) {
+        throw std::runtime_error("Failed to create input reader pipe.");
+    }
+    thread = std::thread(&InputReader::loop, this);
+}
+
+InputReader::~InputReader() {
+    char stop = 0;
+    if (write(stop_pipe[1], &stop, 1) != 1) {
+        // The thread will still exit at end of input.
+    }
+    thread.join();
+    ::close(stop_pipe[0]);
+    ::close(stop_pipe[1]);
+}
+
+void InputReader::loop() {
+    char chunk[256];
+    for (;;) {
+        struct pollfd fds[2] = {{fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) continue;
+        if (fds[1].revents) return;
+        if (!fds[0].revents) continue;
+
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        // Interrupted or drained by someone else since poll(): wait for input again.
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+        if (n <= 0) {
+            queue.close();
+            return;
+        }
+        for (ssize_t i = 0; i < n; ++i) {
+            while (!queue.push(chunk[i])) {
+                // The guest is not consuming; back off unless asked to stop.
+                struct pollfd stop_fd = {stop_pipe[0], POLLIN, 0};
+                if (poll(&stop_fd, 1, 10) > 0) return;
+            }
+        }
+    }
+}
@@ -0,0 +1,530 @@
+/**
+ * @file jit.cpp
+ * @brief Implements the x86-64 JIT backend for hot superblocks.
+ *
+ * Register assignment inside a compiled block:
+ *  - rbx: JitContext pointer
+ *  - rdi: base of guest memory
+ *  - r8d-r15d: guest R0-R7, always zero-extended 16-bit values
+ *  - ebp: guest COND
+ *  - eax, ecx, edx, esi: scratch; esi carries the exit PC to the common epilogue
+ *
+ * Guest registers live in caller-saved host registers, so every callback into
+ * Memory spills them to the context and reloads them afterwards. Callbacks
+ * only happen for loads from PAGE_DEVICE pages and for stores to pages with
+ * any PageFlags bit set; both are tested at run time, so mapping a device
+ * over a data page needs no recompilation.
+ */
+#include "jit.hpp"
+#include "lc3.hpp"
+#include "superblock.hpp"
+#include "opcodes.hpp"
+#include "flags.hpp"
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define LC3_JIT_SUPPORTED 1
+#else
+#define LC3_JIT_SUPPORTED 0
+#endif
+
+std::uint32_t JitCompiler::read_callback(JitContext* context, std::uint32_t address) {
+    return context->state->memory.read(static_cast<std::uint16_t>(address));
+}
+
+std::uint32_t JitCompiler::write_callback(JitContext* context, std::uint32_t address, std::uint32_t value) {
+    context->state->memory.write(static_cast<std::uint16_t>(address), static_cast<std::uint16_t>(value));
+    return context->state->block_cache.take_invalidated();
+}
+
+#if LC3_JIT_SUPPORTED
+
+namespace {
+
+enum HostReg {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15
+};
+
+enum ConditionCode {
+    CC_B = 0x2,  ///< Unsigned below.
+    CC_AE = 0x3, ///< Unsigned above or equal.
+    CC_E = 0x4,  ///< Equal / zero.
+    CC_NE = 0x5  ///< Not equal / not zero.
+};
+
+const int CONTEXT = RBX;
+const int MEMORY_BASE = RDI;
+const int GUEST_COND = RBP;
+
+const std::int32_t REG_OFFSET = offsetof(JitContext, reg);
+const std::int32_t MEMORY_OFFSET = offsetof(JitContext, memory);
+const std::int32_t PAGE_FLAGS_OFFSET = offsetof(JitContext, page_flags);
+const std::int32_t LOOP_BUDGET_OFFSET = offsetof(JitContext, loop_budget);
+
+/**
+ * @brief Host register holding a guest general-purpose register.
+ * @param r Guest register index (0-7).
+ * @return The host register number.
+ */
+int guest(unsigned r) {
+    return R8 + static_cast<int>(r);
+}
+
+/**
+ * @brief Minimal x86-64 instruction encoder covering what the JIT emits.
+ * All arithmetic uses 32-bit operands; guest values are 16-bit.
+ */
+class Emitter {
+    public:
+        explicit Emitter(std::vector<std::uint8_t>& out) : out(out) {}
+
+        std::size_t position() const { return out.size(); }
+
+        void mov(int dst, int src) { rex(false, src, 0, dst); byte(0x89); modrm(3, src, dst); }
+        void mov64(int dst, int src) { rex(true, src, 0, dst); byte(0x89); modrm(3, src, dst); }
+        void mov_imm(int dst, std::uint32_t imm) { rex(false, 0, 0, dst); byte(0xB8 + (dst & 7)); u32(imm); }
+        void mov_imm64(int dst, std::uint64_t imm) { rex(true, 0, 0, dst); byte(0xB8 + (dst & 7)); u64(imm); }
+        void add(int dst, int src) { rex(false, src, 0, dst); byte(0x01); modrm(3, src, dst); }
+        void and_(int dst, int src) { rex(false, src, 0, dst); byte(0x21); modrm(3, src, dst); }
+        void test(int dst, int src) { rex(false, src, 0, dst); byte(0x85); modrm(3, src, dst); }
+        void add_imm(int dst, std::uint32_t imm) { group1(0, dst, imm); }
+        void and_imm(int dst, std::uint32_t imm) { group1(4, dst, imm); }
+        void cmp_imm(int dst, std::uint32_t imm) { group1(7, dst, imm); }
+        void test_imm(int dst, std::uint32_t imm) { rex(false, 0, 0, dst); byte(0xF7); modrm(3, 0, dst); u32(imm); }
+        void not_(int dst) { rex(false, 0, 0, dst); byte(0xF7); modrm(3, 2, dst); }
+        void shr_imm(int dst, std::uint8_t count) { rex(false, 0, 0, dst); byte(0xC1); modrm(3, 5, dst); byte(count); }
+        void zero_extend16(int dst, int src) { rex(false, dst, 0, src); byte(0x0F); byte(0xB7); modrm(3, dst, src); }
+        void cmov(ConditionCode cc, int dst, int src) { rex(false, dst, 0, src); byte(0x0F); byte(0x40 | cc); modrm(3, dst, src); }
+
+        /** @brief movzx dst32, word [base + disp32] */
+        void load16(int dst, int base, std::int32_t disp) {
+            rex(false, dst, 0, base); byte(0x0F); byte(0xB7); modrm(2, dst, base); u32(disp);
+        }
+        /** @brief movzx dst32, word [base + index*2] */
+        void load16_indexed(int dst, int base, int index) {
+            rex(false, dst, index, base); byte(0x0F); byte(0xB7); modrm(0, dst, 4); sib(1, index, base);
+        }
+        /** @brief mov word [base + disp32], src16 */
+        void store16(int base, std::int32_t disp, int src) {
+            byte(0x66); rex(false, src, 0, base); byte(0x89); modrm(2, src, base); u32(disp);
+        }
+        /** @brief mov word [base + index*2], src16 */
+        void store16_indexed(int base, int index, int src) {
+            byte(0x66); rex(false, src, index, base); byte(0x89); modrm(0, src, 4); sib(1, index, base);
+        }
+        /** @brief mov dst64, [base + disp32] */
+        void load64(int dst, int base, std::int32_t disp) {
+            rex(true, dst, 0, base); byte(0x8B); modrm(2, dst, base); u32(disp);
+        }
+        /** @brief sub dword [base + disp32], 1 */
+        void decrement32(int base, std::int32_t disp) {
+            rex(false, 0, 0, base); byte(0x83); modrm(2, 5, base); u32(disp); byte(1);
+        }
+        /** @brief test byte [base + disp32], imm8 */
+        void test_byte(int base, std::int32_t disp, std::uint8_t imm) {
+            rex(false, 0, 0, base); byte(0xF6); modrm(2, 0, base); u32(disp); byte(imm);
+        }
+        /** @brief test byte [base + index], imm8 */
+        void test_byte_indexed(int base, int index, std::uint8_t imm) {
+            rex(false, 0, index, base); byte(0xF6); modrm(0, 0, 4); sib(0, index, base); byte(imm);
+        }
+
+        void push(int r) { rex(false, 0, 0, r); byte(0x50 + (r & 7)); }
+        void pop(int r) { rex(false, 0, 0, r); byte(0x58 + (r & 7)); }
+        void call(int r) { rex(false, 0, 0, r); byte(0xFF); modrm(3, 2, r); }
+        void adjust_stack(std::int8_t delta) {
+            byte(0x48); byte(0x83); modrm(3, delta < 0 ? 5 : 0, RSP); byte(static_cast<std::uint8_t>(delta < 0 ? -delta : delta));
+        }
+        void ret() { byte(0xC3); }
+
+        /** @brief Emits jcc rel32 and returns the position of its displacement. */
+        std::size_t jcc(ConditionCode cc) { byte(0x0F); byte(0x80 | cc); return placeholder(); }
+        /** @brief Emits jmp rel32 and returns the position of its displacement. */
+        std::size_t jmp() { byte(0xE9); return placeholder(); }
+
+        /** @brief Points the displacement at patch_pos to target. */
+        void patch(std::size_t patch_pos, std::size_t target) {
+            std::int32_t rel = static_cast<std::int32_t>(target - (patch_pos + 4));
+            std::memcpy(&out[patch_pos], &rel, sizeof(rel));
+        }
+        /** @brief Points the displacement at patch_pos to the current position. */
+        void bind(std::size_t patch_pos) { patch(patch_pos, position()); }
+
+    private:
+        std::vector<std::uint8_t>& out;
+
+        void byte(std::uint8_t b) { out.push_back(b); }
+        void u32(std::uint32_t v) { for (int i = 0; i < 4; ++i) byte(static_cast<std::uint8_t>(v >> (8 * i))); }
+        void u64(std::uint64_t v) { for (int i = 0; i < 8; ++i) byte(static_cast<std::uint8_t>(v >> (8 * i))); }
+        std::size_t placeholder() { std::size_t pos = position(); u32(0); return pos; }
+
+        void rex(bool w, int reg, int index, int base) {
+            std::uint8_t prefix = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | (((index >> 3) & 1) << 1) | ((base >> 3) & 1);
+            if (prefix != 0x40) byte(prefix);
+        }
+        void modrm(int mod, int reg, int rm) { byte(static_cast<std::uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7))); }
+        void sib(int scale, int index, int base) { byte(static_cast<std::uint8_t>((scale << 6) | ((index & 7) << 3) | (base & 7))); }
+        void group1(int ext, int dst, std::uint32_t imm) { rex(false, 0, 0, dst); byte(0x81); modrm(3, ext, dst); u32(imm); }
+};
+
+/**
+ * @brief Emits the code for one superblock.
+ */
+class BlockCompiler {
+    public:
+        explicit BlockCompiler(std::vector<std::uint8_t>& out) : e(out) {}
+
+        void compile(const Block& block, std::uint64_t read_fn, std::uint64_t write_fn) {
+            this->read_fn = read_fn;
+            this->write_fn = write_fn;
+
+            for (int r : {RBX, RBP, R12, R13, R14, R15}) e.push(r);
+            e.adjust_stack(-8);
+            e.mov64(CONTEXT, RDI);
+            reload();
+            loop_head = e.position();
+
+            const DecodedInstruction* ops = block.ops.data();
+            std::size_t body = block.length - (block.terminated ? 1 : 0);
+            std::vector<bool> live_flags = flag_liveness(ops, body);
+
+            for (std::size_t i = 0; i < body; ++i) {
+                emit_body(ops[i], live_flags[i],
+                          static_cast<std::uint16_t>(block.start + i + 1),
+                          static_cast<std::uint32_t>(i + 1));
+            }
+            emit_terminator(block, body);
+
+            std::size_t epilogue = e.position();
+            for (unsigned r = 0; r < 8; ++r) e.store16(CONTEXT, REG_OFFSET + 2 * r, guest(r));
+            e.store16(CONTEXT, REG_OFFSET + 2 * R_COND, GUEST_COND);
+            e.store16(CONTEXT, REG_OFFSET + 2 * R_PC, RSI);
+            e.adjust_stack(8);
+            for (int r : {R15, R14, R13, R12, RBP, RBX}) e.pop(r);
+            e.ret();
+
+            for (std::size_t pos : exits) e.patch(pos, epilogue);
+        }
+
+    private:
+        Emitter e;
+        std::vector<std::size_t> exits;
+        std::size_t loop_head = 0;
+        std::uint64_t read_fn = 0;
+        std::uint64_t write_fn = 0;
+
+        /**
+         * @brief Decides which flag-setting instructions must materialize COND.
+         * COND is only observable at block exits, and a store may exit early, so
+         * only the last flag-setting instruction before each store or the end counts.
+         */
+        static std::vector<bool> flag_liveness(const DecodedInstruction* ops, std::size_t count) {
+            std::vector<bool> live(count, false);
+            bool needed = true;
+            for (std::size_t i = count; i-- > 0;) {
+                switch (ops[i].op) {
+                    case OP_ST:
+                    case OP_STI:
+                    case OP_STR:
+                        needed = true;
+                        break;
+                    case OP_ADD:
+                    case OP_AND:
+                    case OP_NOT:
+                    case OP_LD:
+                    case OP_LDI:
+                    case OP_LDR:
+                    case OP_LEA:
+                        live[i] = needed;
+                        needed = false;
+                        break;
+                    default:
+                        break;
+                }
+            }
+            return live;
+        }
+
+        void spill() {
+            for (unsigned r = 0; r < 8; ++r) e.store16(CONTEXT, REG_OFFSET + 2 * r, guest(r));
+            e.store16(CONTEXT, REG_OFFSET + 2 * R_COND, GUEST_COND);
+        }
+
+        void reload() {
+            for (unsigned r = 0; r < 8; ++r) e.load16(guest(r), CONTEXT, REG_OFFSET + 2 * r);
+            e.load16(GUEST_COND, CONTEXT, REG_OFFSET + 2 * R_COND);
+            e.load64(MEMORY_BASE, CONTEXT, MEMORY_OFFSET);
+        }
+
+        /** @brief Leaves the block with a constant PC. */
+        void exit_to(std::uint16_t pc, std::uint32_t count, JitExit how) {
+            e.mov_imm(RSI, pc);
+            e.mov_imm(RAX, (count << 2) | how);
+            exits.push_back(e.jmp());
+        }
+
+        /** @brief Leaves the block with the PC held in a host register. */
+        void exit_to_reg(int pc_reg, std::uint32_t count, JitExit how) {
+            e.mov(RSI, pc_reg);
+            e.mov_imm(RAX, (count << 2) | how);
+            exits.push_back(e.jmp());
+        }
+
+        void set_flags(int value) {
+            e.mov_imm(GUEST_COND, FL_POS);
+            e.mov_imm(RCX, FL_NEG);
+            e.cmp_imm(value, 0x8000);
+            e.cmov(CC_AE, GUEST_COND, RCX);
+            e.mov_imm(RCX, FL_ZRO);
+            e.test(value, value);
+            e.cmov(CC_E, GUEST_COND, RCX);
+        }
+
+        /** @brief Calls Memory::read for the address in eax; the value is left in eax. */
+        void call_read() {
+            spill();
+            e.mov(RSI, RAX);
+            e.mov64(RDI, CONTEXT);
+            e.mov_imm64(RAX, read_fn);
+            e.call(RAX);
+            reload();
+        }
+
+        /** @brief Loads the word at a constant address into dst. */
+        void load_constant(int dst, std::uint16_t address) {
+            e.load64(RDX, CONTEXT, PAGE_FLAGS_OFFSET);
+            e.test_byte(RDX, address >> MEMORY_PAGE_SHIFT, PAGE_DEVICE);
+            std::size_t fast = e.jcc(CC_E);
+            e.mov_imm(RAX, address);
+            call_read();
+            if (dst != RAX) e.mov(dst, RAX);
+            std::size_t done = e.jmp();
+            e.bind(fast);
+            e.load16(dst, MEMORY_BASE, 2 * address);
+            e.bind(done);
+        }
+
+        /** @brief Loads the word at the address held in eax into dst. */
+        void load_dynamic(int dst) {
+            e.mov(RCX, RAX);
+            e.shr_imm(RCX, MEMORY_PAGE_SHIFT);
+            e.load64(RDX, CONTEXT, PAGE_FLAGS_OFFSET);
+            e.test_byte_indexed(RDX, RCX, PAGE_DEVICE);
+            std::size_t fast = e.jcc(CC_E);
+            call_read();
+            if (dst != RAX) e.mov(dst, RAX);
+            std::size_t done = e.jmp();
+            e.bind(fast);
+            e.load16_indexed(dst, MEMORY_BASE, RAX);
+            e.bind(done);
+        }
+
+        /**
+         * @brief Stores src to the address held in eax.
+         * Pages with any flag set go through Memory::write; if that invalidated
+         * translated code the block exits so the new code is picked up.
+         */
+        void store_dynamic(int src, std::uint16_t next_pc, std::uint32_t count) {
+            e.mov(RCX, RAX);
+            e.shr_imm(RCX, MEMORY_PAGE_SHIFT);
+            e.load64(RDX, CONTEXT, PAGE_FLAGS_OFFSET);
+            e.test_byte_indexed(RDX, RCX, 0xFF);
+            std::size_t slow = e.jcc(CC_NE);
+            e.store16_indexed(MEMORY_BASE, RAX, src);
+            std::size_t done = e.jmp();
+
+            e.bind(slow);
+            spill();
+            e.mov(RSI, RAX);
+            e.mov(RDX, src);
+            e.mov64(RDI, CONTEXT);
+            e.mov_imm64(RAX, write_fn);
+            e.call(RAX);
+            reload();
+            e.test(RAX, RAX);
+            std::size_t unchanged = e.jcc(CC_E);
+            exit_to(next_pc, count, JIT_EXIT_DYNAMIC);
+            e.bind(unchanged);
+            e.bind(done);
+        }
+
+        /** @brief Computes base register + offset into eax. */
+        void effective_address(const DecodedInstruction& d) {
+            e.mov(RAX, guest(d.sr1));
+            e.add_imm(RAX, d.imm);
+            e.zero_extend16(RAX, RAX);
+        }
+
+        void emit_body(const DecodedInstruction& d, bool flags, std::uint16_t next_pc, std::uint32_t count) {
+            int dr = guest(d.dr);
+            switch (d.op) {
+                case OP_ADD:
+                    e.mov(RAX, guest(d.sr1));
+                    if (d.mode) e.add_imm(RAX, d.imm);
+                    else e.add(RAX, guest(d.sr2));
+                    e.zero_extend16(dr, RAX);
+                    break;
+                case OP_AND:
+                    e.mov(RAX, guest(d.sr1));
+                    if (d.mode) e.and_imm(RAX, d.imm);
+                    else e.and_(RAX, guest(d.sr2));
+                    e.mov(dr, RAX);
+                    break;
+                case OP_NOT:
+                    e.mov(RAX, guest(d.sr1));
+                    e.not_(RAX);
+                    e.zero_extend16(dr, RAX);
+                    break;
+                case OP_LEA:
+                    e.mov_imm(dr, d.imm);
+                    break;
+                case OP_LD:
+                    load_constant(dr, d.imm);
+                    break;
+                case OP_LDI:
+                    load_constant(RAX, d.imm);
+                    load_dynamic(dr);
+                    break;
+                case OP_LDR:
+                    effective_address(d);
+                    load_dynamic(dr);
+                    break;
+                case OP_ST:
+                    e.mov_imm(RAX, d.imm);
+                    store_dynamic(dr, next_pc, count);
+                    return;
+                case OP_STI:
+                    load_constant(RAX, d.imm);
+                    store_dynamic(dr, next_pc, count);
+                    return;
+                case OP_STR:
+                    effective_address(d);
+                    store_dynamic(dr, next_pc, count);
+                    return;
+                default:
+                    return;
+            }
+            if (flags) set_flags(dr);
+        }
+
+        /**
+         * @brief Leaves through the EXIT_TAKEN slot of a BR.
+         * A branch back to the block's own start jumps straight to the top of
+         * the body while the loop budget lasts, keeping registers in place.
+         */
+        void take_branch(const Block& block, std::uint16_t target, std::uint32_t length) {
+            if (target == block.start) {
+                // Every pass through the back-edge is counted by the budget alone.
+                e.decrement32(CONTEXT, LOOP_BUDGET_OFFSET);
+                e.patch(e.jcc(CC_NE), loop_head);
+                exit_to(target, 0, JIT_EXIT_TAKEN);
+                return;
+            }
+            exit_to(target, length, JIT_EXIT_TAKEN);
+        }
+
+        void emit_terminator(const Block& block, std::size_t body) {
+            std::uint32_t length = block.length;
+            std::uint16_t fallthrough = block.exit_pc[EXIT_FALLTHROUGH];
+            if (!block.terminated) {
+                exit_to(fallthrough, length, JIT_EXIT_FALLTHROUGH);
+                return;
+            }
+
+            const DecodedInstruction& t = block.ops[body];
+            switch (t.op) {
+                case OP_BR:
+                    if (t.dr == 0) {
+                        exit_to(fallthrough, length, JIT_EXIT_FALLTHROUGH);
+                    } else if (t.dr == (FL_NEG | FL_ZRO | FL_POS)) {
+                        take_branch(block, t.imm, length);
+                    } else {
+                        e.test_imm(GUEST_COND, t.dr);
+                        std::size_t taken = e.jcc(CC_NE);
+                        exit_to(fallthrough, length, JIT_EXIT_FALLTHROUGH);
+                        e.bind(taken);
+                        take_branch(block, t.imm, length);
+                    }
+                    break;
+                case OP_JSR:
+                    e.mov_imm(guest(R_R7), fallthrough);
+                    if (t.mode) {
+                        exit_to(t.imm, length, JIT_EXIT_TAKEN);
+                    } else {
+                        exit_to_reg(guest(t.sr1), length, JIT_EXIT_DYNAMIC);
+                    }
+                    break;
+                case OP_JMP:
+                    exit_to_reg(guest(t.sr1), length, JIT_EXIT_DYNAMIC);
+                    break;
+                default:
+                    exit_to(static_cast<std::uint16_t>(block.start + body), length, JIT_EXIT_TERMINATOR);
+                    break;
+            }
+        }
+};
+
+} // namespace
+
+JitCompiler::JitCompiler() : arena(nullptr), used(0), compiled(0) {
+    void* mapping = mmap(nullptr, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping != MAP_FAILED) {
+        arena = static_cast<std::uint8_t*>(mapping);
+    }
+}
+
+JitCompiler::~JitCompiler() {
+    if (arena) {
+        munmap(arena, JIT_ARENA_SIZE);
+    }
+}
+
+JitFunction JitCompiler::compile(const Block& block) {
+    if (!arena) return nullptr;
+
+    code.clear();
+    BlockCompiler compiler(code);
+    compiler.compile(block,
+                     reinterpret_cast<std::uint64_t>(&JitCompiler::read_callback),
+                     reinterpret_cast<std::uint64_t>(&JitCompiler::write_callback));
+
+    std::size_t start = (used + 15) & ~static_cast<std::size_t>(15);
+    if (start + code.size() > JIT_ARENA_SIZE) return nullptr;
+
+    const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t first = start & ~(page_size - 1);
+    std::size_t last = (start + code.size() + page_size - 1) & ~(page_size - 1);
+    if (mprotect(arena + first, last - first, PROT_READ | PROT_WRITE) != 0) return nullptr;
+    std::memcpy(arena + start, code.data(), code.size());
+    if (mprotect(arena + first, last - first, PROT_READ | PROT_EXEC) != 0) return nullptr;
+
+    used = start + code.size();
+    ++compiled;
+    return reinterpret_cast<JitFunction>(arena + start);
+}
+
+void JitCompiler::reset() {
+    used = 0;
+    compiled = 0;
+}
+
+#else
+
+JitCompiler::JitCompiler() : arena(nullptr), used(0), compiled(0) {}
+
+JitCompiler::~JitCompiler() {}
+
+JitFunction JitCompiler::compile(const Block&) {
+    return nullptr;
+}
+
+void JitCompiler::reset() {
+    used = 0;
+    compiled = 0;
+}
+
+#endif
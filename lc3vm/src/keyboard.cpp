@@ -0,0 +1,55 @@
+/**
+ * @file keyboard.cpp
+ * @brief Implements the memory-mapped keyboard device.
+ */
+#include "keyboard.hpp"
+#include "memory.hpp"
+
+std::uint16_t KeyboardDevice::read(Memory& memory, std::uint16_t address) {
+    if (address == Keyboard::MR_KBSR) {
+        // read_key() flushes, so pending output was produced since the previous poll.
+        bool printed = output && output->pending() > 0;
+        char c_in;
+        if (read_key(c_in, false)) {
+            memory.memory[Keyboard::MR_KBSR] = (1 << 15);
+            memory.memory[Keyboard::MR_KBDR] = static_cast<std::uint16_t>(c_in);
+            misses = 0;
+        } else {
+            memory.memory[Keyboard::MR_KBSR] = 0;
+            if (idle_wait) missed_poll(memory, printed);
+        }
+        // KBDR shares the page, so this keeps both registers in snapshot deltas.
+        memory.note_write(Keyboard::MR_KBSR);
+    }
+    return memory.memory[address];
+}
+
+void KeyboardDevice::missed_poll(Memory& memory, bool printed) {
+    if (misses == 0) {
+        memory.watch_writes();
+        window_writes = memory.watched_writes();
+        window_output = false;
+        window_start = std::chrono::steady_clock::now();
+    }
+    window_output |= printed;
+    if (++misses < KBSR_IDLE_POLLS) return;
+    misses = 0;
+
+    // A guest that wrote memory or printed between polls is busy, not idle.
+    if (window_output || memory.watched_writes() != window_writes) return;
+    if (std::chrono::steady_clock::now() - window_start < std::chrono::microseconds(KBSR_IDLE_WINDOW_US)) {
+        ++waits;
+        console->wait_for_key(std::chrono::milliseconds(KBSR_IDLE_TIMEOUT_MS));
+    }
+}
+
+bool KeyboardDevice::read_key(char& c, bool wait) {
+    if (output) {
+        output->flush();
+    }
+    return console->read_key(c, wait);
+}
+
+void KeyboardDevice::write(Memory& memory, std::uint16_t address, std::uint16_t value) {
+    memory.memory[address] = value;
+}
@@ -6,11 +6,17 @@
  * program loading, and the main execution loop of the LC-3 VM.
  */
 #include <string>
-#include <fstream>
 #include <stdexcept>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <thread>
 #include "lc3.hpp"
+#include "disassembler.hpp"
+#include "image.hpp"
+#include "simd.hpp"
 #include "memory.hpp"
 #include "registers.hpp"
 #include "opcodes.hpp"
@@ -20,279 +26,610 @@
 #include "flags.hpp"
 #include "keyboard.hpp"
 #include <unistd.h>
-#include <sstream>
-#include <iomanip>
 
-/**
- * @brief Swaps the endianness of a 16-bit unsigned integer.
- * Useful for reading LC-3 object files which are typically big-endian.
- * @param x The 16-bit value to swap.
- * @return The endian-swapped 16-bit value.
- */
-static std::uint16_t swap16(std::uint16_t x) {
-    return (x << 8) | (x >> 8);
+template <unsigned op>
+void LC3State::ins(LC3State& state, std::uint16_t instr) {
+    exec<op>(state, decode(instr));
 }
 
 template <unsigned op>
-void LC3State::ins(LC3State& state, std::uint16_t instr) {
+void LC3State::exec(LC3State& state, const DecodedInstruction& d) {
     if (op == OP_BR) {
-        std::uint16_t cond_flag_from_instr = (instr >> 9) & 0x7;
-        if (cond_flag_from_instr & state.reg[R_COND]) {
-            state.reg[R_PC] += sign_extend(instr & 0x1FF, 9);
+        if (d.dr & state.reg[R_COND]) {
+            state.reg[R_PC] += d.imm;
         }
     }
     else if (op == OP_ADD) {
-        std::uint16_t r0 = (instr >> 9) & 0x7;
-        std::uint16_t r1 = (instr >> 6) & 0x7;
-        std::uint16_t imm_flag = (instr >> 5) & 0x1;
-        if (imm_flag) {
-            std::uint16_t imm5 = sign_extend(instr & 0x1F, 5);
-            state.reg[r0] = state.reg[r1] + imm5;
+        if (d.mode) {
+            state.reg[d.dr] = state.reg[d.sr1] + d.imm;
         } else {
-            std::uint16_t r2 = instr & 0x7;
-            state.reg[r0] = state.reg[r1] + state.reg[r2];
+            state.reg[d.dr] = state.reg[d.sr1] + state.reg[d.sr2];
         }
-        state.update_flags(r0);
+        state.update_flags(d.dr);
     }
     else if (op == OP_LD) {
-        std::uint16_t r0 = (instr >> 9) & 0x7;
-        std::uint16_t pc_offset9 = sign_extend(instr & 0x1FF, 9);
-        state.reg[r0] = state.memory.read(state.reg[R_PC] + pc_offset9);
-        state.update_flags(r0);
+        state.reg[d.dr] = state.memory.read(state.reg[R_PC] + d.imm);
+        state.update_flags(d.dr);
     }
     else if (op == OP_ST) {
-        std::uint16_t r0 = (instr >> 9) & 0x7;
-        std::uint16_t pc_offset9 = sign_extend(instr & 0x1FF, 9);
-        state.memory.write(state.reg[R_PC] + pc_offset9, state.reg[r0]);
+        state.memory.write(state.reg[R_PC] + d.imm, state.reg[d.dr]);
     }
     else if (op == OP_JSR) {
         state.reg[R_R7] = state.reg[R_PC];
-        std::uint16_t long_flag = (instr >> 11) & 1;
-        if (long_flag) {
-            std::uint16_t long_pc_offset = sign_extend(instr & 0x7FF, 11);
-            state.reg[R_PC] += long_pc_offset;
+        if (d.mode) {
+            state.reg[R_PC] += d.imm;
         } else {
-            std::uint16_t r1 = (instr >> 6) & 0x7;
-            state.reg[R_PC] = state.reg[r1];
+            state.reg[R_PC] = state.reg[d.sr1];
         }
     }
     else if (op == OP_AND) {
-        std::uint16_t r0 = (instr >> 9) & 0x7;
-        std::uint16_t r1 = (instr >> 6) & 0x7;
-        std::uint16_t imm_flag = (instr >> 5) & 0x1;
-        if (imm_flag) {
-            std::uint16_t imm5 = sign_extend(instr & 0x1F, 5);
-            state.reg[r0] = state.reg[r1] & imm5;
+        if (d.mode) {
+            state.reg[d.dr] = state.reg[d.sr1] & d.imm;
         } else {
-            std::uint16_t r2 = instr & 0x7;
-            state.reg[r0] = state.reg[r1] & state.reg[r2];
+            state.reg[d.dr] = state.reg[d.sr1] & state.reg[d.sr2];
         }
-        state.update_flags(r0);
+        state.update_flags(d.dr);
     }
     else if (op == OP_LDR) {
-        std::uint16_t r0 = (instr >> 9) & 0x7;
-        std::uint16_t r1 = (instr >> 6) & 0x7;
-        std::uint16_t offset6 = sign_extend(instr & 0x3F, 6);
-        state.reg[r0] = state.memory.read(state.reg[r1] + offset6);
-        state.update_flags(r0);
+        state.reg[d.dr] = state.memory.read(state.reg[d.sr1] + d.imm);
+        state.update_flags(d.dr);
     }
     else if (op == OP_STR) {
-        std::uint16_t r0 = (instr >> 9) & 0x7;
-        std::uint16_t r1 = (instr >> 6) & 0x7;
-        std::uint16_t offset6 = sign_extend(instr & 0x3F, 6);
-        state.memory.write(state.reg[r1] + offset6, state.reg[r0]);
+        state.memory.write(state.reg[d.sr1] + d.imm, state.reg[d.dr]);
     }
     else if (op == OP_NOT) {
-        std::uint16_t r0 = (instr >> 9) & 0x7;
-        std::uint16_t r1 = (instr >> 6) & 0x7;
-        state.reg[r0] = ~state.reg[r1];
-        state.update_flags(r0);
+        state.reg[d.dr] = ~state.reg[d.sr1];
+        state.update_flags(d.dr);
     }
     else if (op == OP_LDI) {
-        std::uint16_t r0 = (instr >> 9) & 0x7;
-        std::uint16_t pc_offset9 = sign_extend(instr & 0x1FF, 9);
-        std::uint16_t effective_address_location = state.reg[R_PC] + pc_offset9;
-        state.reg[r0] = state.memory.read(state.memory.read(effective_address_location));
-        state.update_flags(r0);
+        std::uint16_t effective_address_location = state.reg[R_PC] + d.imm;
+        state.reg[d.dr] = state.memory.read(state.memory.read(effective_address_location));
+        state.update_flags(d.dr);
     }
     else if (op == OP_STI) {
-        std::uint16_t r0 = (instr >> 9) & 0x7;
-        std::uint16_t pc_offset9 = sign_extend(instr & 0x1FF, 9);
-        std::uint16_t effective_address_location = state.reg[R_PC] + pc_offset9;
-        state.memory.write(state.memory.read(effective_address_location), state.reg[r0]);
+        std::uint16_t effective_address_location = state.reg[R_PC] + d.imm;
+        state.memory.write(state.memory.read(effective_address_location), state.reg[d.dr]);
     }
     else if (op == OP_JMP) {
-        std::uint16_t r1 = (instr >> 6) & 0x7;
-        state.reg[R_PC] = state.reg[r1];
+        state.reg[R_PC] = state.reg[d.sr1];
     }
     else if (op == OP_LEA) {
-        std::uint16_t r0 = (instr >> 9) & 0x7;
-        std::uint16_t pc_offset9 = sign_extend(instr & 0x1FF, 9);
-        state.reg[r0] = state.reg[R_PC] + pc_offset9;
-        state.update_flags(r0);
+        state.reg[d.dr] = state.reg[R_PC] + d.imm;
+        state.update_flags(d.dr);
     }
     else if (op == OP_TRAP) {
+        if ((d.imm == TRAP_GETC || d.imm == TRAP_IN) && !state.input_ready()) {
+            state.fault(StopReason::WaitingForInput);
+            state.reg[R_PC] = state.fault_pc;
+            return;
+        }
         state.reg[R_R7] = state.reg[R_PC];
-        switch (instr & 0xFF) {
+        switch (d.imm) {
             case TRAP_GETC:
                 {
-                    if (state.memory.test_mode) {
-                        state.reg[R_R0] = state.memory.read(Keyboard::MR_KBDR);
-                    } else {
-                        char c_in = 0;
-                        if (read(STDIN_FILENO, &c_in, 1) == 1) {
-                            state.reg[R_R0] = static_cast<std::uint16_t>(c_in);
-                        }
+                    char c_in = 0;
+                    if (state.memory.keyboard_device().read_key(c_in, true)) {
+                        state.reg[R_R0] = static_cast<std::uint16_t>(c_in);
                     }
                 }
                 state.update_flags(R_R0);
                 break;
             case TRAP_OUT:
-                if (!state.memory.test_mode) {
-                    std::cout.put(static_cast<char>(state.reg[R_R0]));
-                    std::cout.flush();
-                }
+                state.output.put(static_cast<char>(state.reg[R_R0]));
                 break;
             case TRAP_PUTS: {
-                if (!state.memory.test_mode) {
-                    std::uint16_t current_char_addr = state.reg[R_R0];
-                    std::uint16_t val = state.memory.read(current_char_addr);
-                    while (val != 0) {
-                        std::cout.put(static_cast<char>(val));
-                        current_char_addr++;
-                        val = state.memory.read(current_char_addr);
-                    }
-                    std::cout.flush();
+                std::uint16_t current_char_addr = state.reg[R_R0];
+                std::uint16_t val = state.memory.read(current_char_addr);
+                while (val != 0) {
+                    state.output.put(static_cast<char>(val));
+                    current_char_addr++;
+                    val = state.memory.read(current_char_addr);
                 }
                 break;
             }
             case TRAP_IN: {
-                if (state.memory.test_mode) {
-                    state.reg[R_R0] = state.memory.read(Keyboard::MR_KBDR);
-                } else {
-                    std::cout << "Enter a character: ";
-                    std::cout.flush();
-                    char c_in_trap = 0;
-                    if (read(STDIN_FILENO, &c_in_trap, 1) == 1) {
-                        std::cout.put(c_in_trap);
-                        std::cout.flush();
-                        state.reg[R_R0] = static_cast<std::uint16_t>(c_in_trap);
-                    }
+                static const char prompt[] = "Enter a character: ";
+                state.output.write(prompt, sizeof(prompt) - 1);
+                char c_in_trap = 0;
+                if (state.memory.keyboard_device().read_key(c_in_trap, true)) {
+                    state.output.put(c_in_trap);
+                    state.reg[R_R0] = static_cast<std::uint16_t>(c_in_trap);
                 }
                 state.update_flags(R_R0);
                 break;
             }
             case TRAP_PUTSP: {
-                if (!state.memory.test_mode) {
-                    std::uint16_t current_addr = state.reg[R_R0];
-                    std::uint16_t word = state.memory.read(current_addr);
-                    while (word != 0) {
-                        char char1 = word & 0xFF;
-                        std::cout.put(char1);
-                        char char2 = (word >> 8) & 0xFF;
-                        if (char2) {
-                            std::cout.put(char2);
-                        }
-                        current_addr++;
-                        word = state.memory.read(current_addr);
+                std::uint16_t current_addr = state.reg[R_R0];
+                std::uint16_t word = state.memory.read(current_addr);
+                while (word != 0) {
+                    char char1 = word & 0xFF;
+                    state.output.put(char1);
+                    char char2 = (word >> 8) & 0xFF;
+                    if (char2) {
+                        state.output.put(char2);
                     }
-                    std::cout.flush();
+                    current_addr++;
+                    word = state.memory.read(current_addr);
                 }
                 break;
             }
-            case TRAP_HALT:
-                if (!state.memory.test_mode) {
-                    std::cout << "HALT" << std::endl;
-                }
+            case TRAP_HALT: {
+                static const char halt_message[] = "HALT\n";
+                state.output.write(halt_message, sizeof(halt_message) - 1);
+                state.output.flush();
                 state.running = false;
                 break;
+            }
             default:
-                throw std::runtime_error("Unknown TRAP vector: " + std::to_string(instr & 0xFF));
+                state.fault(StopReason::UnknownTrap);
                 break;
         }
+        if (state.running) state.take_halt_request();
+    }
+    else {
+        state.fault(StopReason::IllegalOpcode);
     }
 }
 
-const std::array<void(*)(LC3State&, std::uint16_t), 16> LC3State::op_table = {
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_BR>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_ADD>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_LD>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_ST>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_JSR>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_AND>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_LDR>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_STR>(s,i); },
-    nullptr,
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_NOT>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_LDI>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_STI>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_JMP>(s,i); },
-    nullptr,
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_LEA>(s,i); },
-    [](LC3State& s, std::uint16_t i){ LC3State::ins<OP_TRAP>(s,i); }
+const std::array<void(*)(LC3State&, const DecodedInstruction&), 16> LC3State::op_table = {
+    &LC3State::exec<OP_BR>,
+    &LC3State::exec<OP_ADD>,
+    &LC3State::exec<OP_LD>,
+    &LC3State::exec<OP_ST>,
+    &LC3State::exec<OP_JSR>,
+    &LC3State::exec<OP_AND>,
+    &LC3State::exec<OP_LDR>,
+    &LC3State::exec<OP_STR>,
+    &LC3State::exec<OP_RTI>,
+    &LC3State::exec<OP_NOT>,
+    &LC3State::exec<OP_LDI>,
+    &LC3State::exec<OP_STI>,
+    &LC3State::exec<OP_JMP>,
+    &LC3State::exec<OP_RES>,
+    &LC3State::exec<OP_LEA>,
+    &LC3State::exec<OP_TRAP>
 };
 
-void LC3State::load_image(const std::string &filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open image file: " + filename);
+DecodedInstruction LC3State::decode(std::uint16_t instr) {
+    DecodedInstruction d{};
+    d.op = instr >> 12;
+    d.handler = op_table[d.op];
+    d.dr = (instr >> 9) & 0x7;
+    d.sr1 = (instr >> 6) & 0x7;
+    d.sr2 = instr & 0x7;
+
+    switch (d.op) {
+        case OP_ADD:
+        case OP_AND:
+            d.mode = (instr >> 5) & 0x1;
+            d.imm = sign_extend(instr & 0x1F, 5);
+            break;
+        case OP_LDR:
+        case OP_STR:
+            d.imm = sign_extend(instr & 0x3F, 6);
+            break;
+        case OP_JSR:
+            d.mode = (instr >> 11) & 0x1;
+            d.imm = sign_extend(instr & 0x7FF, 11);
+            break;
+        case OP_TRAP:
+            d.imm = instr & 0xFF;
+            break;
+        case OP_BR:
+        case OP_LD:
+        case OP_ST:
+        case OP_LDI:
+        case OP_STI:
+        case OP_LEA:
+            d.imm = sign_extend(instr & 0x1FF, 9);
+            break;
+        default:
+            break;
+    }
+    return d;
+}
+
+/**
+ * @brief Runs a function for every index in [0, count) on up to one thread per host core.
+ * @param count The number of indices.
+ * @param body The function; must not throw.
+ */
+static void parallel_for(std::size_t count, const std::function<void(std::size_t)>& body) {
+    std::size_t workers = std::min<std::size_t>(count, std::thread::hardware_concurrency());
+    std::atomic<std::size_t> next{0};
+    auto work = [&] {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+            body(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t w = 1; w < workers; ++w) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads) {
+        thread.join();
     }
+}
 
-    std::uint16_t origin;
-    file.read(reinterpret_cast<char*>(&origin), sizeof(origin));
-    if (file.gcount() != sizeof(origin)) {
-        throw std::runtime_error("Failed to read origin from image file: " + filename);
+void LC3State::load_shared_image(const SharedImage& image) {
+    this->memory.map_image(image);
+    this->decode_cache.clear();
+    this->block_cache.clear();
+    if (this->jit) {
+        this->jit->reset();
+    }
+    this->loaded_code_segments.clear();
+    for (const auto& range : image.ranges()) {
+        this->loaded_code_segments.push_back({range.first, range.second});
     }
-    origin = swap16(origin);
+    this->baseline_id = 0;
+}
+
+void LC3State::place_image(const ProgramImage& image) {
+    if (image.size() == 0) return;
+    this->memory.load(image.origin(), image.words(), image.size());
+}
 
-    std::uint16_t max_words_to_read = MEMORY_MAX - origin;
-    std::vector<std::uint16_t> image_data(max_words_to_read);
+void LC3State::load_image(const std::string &filename) {
+    ProgramImage image(filename);
+    place_image(image);
+    if (image.size() > 0) {
+        loaded_code_segments.push_back({image.origin(), static_cast<std::uint16_t>(image.size())});
+    }
+}
 
-    file.read(reinterpret_cast<char*>(image_data.data()), max_words_to_read * sizeof(std::uint16_t));
-    size_t words_actually_read = file.gcount() / sizeof(std::uint16_t);
+void LC3State::load_images(const std::vector<std::string>& filenames) {
+    std::vector<std::unique_ptr<ProgramImage>> images(filenames.size());
+    std::vector<std::exception_ptr> errors(filenames.size());
+    parallel_for(filenames.size(), [&](std::size_t i) {
+        try {
+            images[i].reset(new ProgramImage(filenames[i]));
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    });
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
 
-    for (size_t i = 0; i < words_actually_read; ++i) {
-        if (origin + i < MEMORY_MAX) {
-            this->memory.write(origin + i, swap16(image_data[i]));
-        } else {
-            throw std::runtime_error("Image too large for memory at specified origin.");
+    // Images may only be copied concurrently if their ranges are disjoint,
+    // from each other and from earlier images, and need no device or code-page writes.
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    for (const auto& segment : loaded_code_segments) {
+        ranges.emplace_back(segment.start_address, segment.start_address + segment.size);
+    }
+    bool concurrent = true;
+    for (const auto& image : images) {
+        if (image->size() == 0) continue;
+        ranges.emplace_back(image->origin(), image->origin() + image->size());
+        if (this->memory.range_flagged(image->origin(), image->size())) concurrent = false;
+    }
+    std::sort(ranges.begin(), ranges.end());
+    for (std::size_t i = 1; i < ranges.size(); ++i) {
+        if (ranges[i].first < ranges[i - 1].second) concurrent = false;
+    }
+
+    if (concurrent) {
+        parallel_for(images.size(), [&](std::size_t i) { place_image(*images[i]); });
+    } else {
+        // Overlapping images keep their command-line semantics: later ones overwrite earlier ones.
+        for (const auto& image : images) {
+            place_image(*image);
         }
     }
-    if (words_actually_read > 0) {
-        loaded_code_segments.push_back({origin, static_cast<std::uint16_t>(words_actually_read)});
+    for (const auto& image : images) {
+        if (image->size() > 0) {
+            loaded_code_segments.push_back({image->origin(), static_cast<std::uint16_t>(image->size())});
+        }
     }
 }
 
-LC3State::LC3State() : memory(), reg{}, running(true) {
+LC3State::LC3State() : memory(), output(STDOUT_FILENO), reg{}, running(true), stop_reason(StopReason::Halted), fault_pc(0), blocking_input(true),
+                       console(new FdConsole()),
+                       execution_mode(ExecutionMode::Interpreter), uncached_instruction{} {
     this->reg[R_PC] = 0x3000;
     this->reg[R_COND] = FL_ZRO;
+    this->memory.set_write_hook(&LC3State::on_code_write, this);
+    this->memory.keyboard_device().attach_output(&output);
+    bind_console();
 }
 
 LC3State::~LC3State() {
+    // Deliver pending output while its console still exists.
+    output.flush();
+    memory.keyboard_device().attach(nullptr);
+}
+
+void LC3State::reset() {
+    this->memory.clear();
+    this->reg.fill(0);
+    this->reg[R_PC] = 0x3000;
+    this->reg[R_COND] = FL_ZRO;
+    this->running = true;
+    this->stop_reason = StopReason::Halted;
+    this->fault_pc = 0;
+    this->decode_cache.clear();
+    this->block_cache.clear();
+    if (this->jit) {
+        this->jit->reset();
+    }
+    this->loaded_code_segments.clear();
+    this->baseline_id = 0;
+}
+
+/** @brief Source of Snapshot::id; 0 is never handed out. */
+static std::atomic<std::uint64_t> next_snapshot_id{1};
+
+DirtyPages LC3State::pages_changed_since(const Snapshot& snapshot) const {
+    if (snapshot.id == this->baseline_id && this->memory.dirty_epoch() == this->baseline_epoch) {
+        return this->memory.dirty_pages();
+    }
+    DirtyPages all;
+    all.fill(~std::uint64_t(0));
+    return all;
+}
+
+Snapshot LC3State::snapshot() {
+    Snapshot snapshot;
+    snapshot.id = next_snapshot_id.fetch_add(1, std::memory_order_relaxed);
+    snapshot.memory.assign(this->memory.memory, this->memory.memory + MEMORY_MAX);
+    snapshot.reg = this->reg;
+    snapshot.running = this->running;
+    snapshot.stop_reason = this->stop_reason;
+    snapshot.fault_pc = this->fault_pc;
+    snapshot.segments = this->loaded_code_segments;
+    const Device* previous = nullptr;
+    for (unsigned page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+        const Device* device = this->memory.device_at(static_cast<std::uint16_t>(page << MEMORY_PAGE_SHIFT));
+        if (device && device != previous) {
+            snapshot.devices.emplace_back(page, device->save_state());
+        }
+        previous = device;
+    }
+    this->memory.take_dirty_pages();
+    this->baseline_id = snapshot.id;
+    this->baseline_epoch = this->memory.dirty_epoch();
+    return snapshot;
+}
+
+void LC3State::restore(const Snapshot& snapshot) {
+    this->memory.assign_pages(snapshot.memory.data(), pages_changed_since(snapshot));
+    this->memory.take_dirty_pages();
+    this->baseline_id = snapshot.id;
+    this->baseline_epoch = this->memory.dirty_epoch();
+    this->reg = snapshot.reg;
+    this->running = snapshot.running;
+    this->stop_reason = snapshot.stop_reason;
+    this->fault_pc = snapshot.fault_pc;
+    this->loaded_code_segments = snapshot.segments;
+    for (const auto& entry : snapshot.devices) {
+        if (Device* device = this->memory.device_at(static_cast<std::uint16_t>(entry.first << MEMORY_PAGE_SHIFT))) {
+            device->restore_state(entry.second);
+        }
+    }
+}
+
+std::vector<std::uint16_t> LC3State::memory_changes(const Snapshot& snapshot) const {
+    std::vector<std::uint16_t> changes;
+    DirtyPages pages = pages_changed_since(snapshot);
+    for (unsigned i = 0; i < pages.size(); ++i) {
+        for (std::uint64_t bits = pages[i]; bits; bits &= bits - 1) {
+            std::size_t start = static_cast<std::size_t>(i * 64 + __builtin_ctzll(bits)) << MEMORY_PAGE_SHIFT;
+            const std::uint16_t* current = this->memory.memory + start;
+            const std::uint16_t* saved = snapshot.memory.data() + start;
+            std::size_t offset = 0;
+            while ((offset += mismatch16(current + offset, saved + offset, MEMORY_PAGE_SIZE - offset)) < MEMORY_PAGE_SIZE) {
+                changes.push_back(static_cast<std::uint16_t>(start + offset));
+                ++offset;
+            }
+        }
+    }
+    return changes;
+}
+
+bool LC3State::state_equals(const LC3State& other) const {
+    return this->reg == other.reg && this->memory.equals(other.memory);
+}
+
+void LC3State::bind_console() {
+    if (console.get() == bound_console) return;
+    output.flush();
+    console->connect(output);
+    memory.keyboard_device().attach(console.get());
+    bound_console = console.get();
+}
+
+void LC3State::set_console(std::unique_ptr<Console> replacement) {
+    output.flush();
+    console = std::move(replacement);
+    reader_console = nullptr;
+    bound_console = nullptr;
+    bind_console();
+}
+
+void LC3State::start_input_thread(int fd) {
+    std::unique_ptr<FdConsole> reading(new FdConsole(fd, output.descriptor()));
+    reading->start_reader();
+    FdConsole* started = reading.get();
+    set_console(std::move(reading));
+    reader_console = started;
+}
+
+void LC3State::stop_input_thread() {
+    if (reader_console) reader_console->stop_reader();
 }
 
 void LC3State::run() {
+    while (execute(RUN_OUTPUT_SLICE), this->running) {
+        output.flush_if_due();
+    }
+    output.flush();
+    throw_fault();
+}
+
+RunResult LC3State::run_for(std::uint64_t max_instructions) {
+    blocking_input = false;
+    memory.keyboard_device().set_idle_wait(false);
+    std::uint64_t executed = execute(max_instructions);
+    memory.keyboard_device().set_idle_wait(true);
+    blocking_input = true;
+    output.flush_if_due();
+
+    RunResult result{StopReason::BudgetExhausted, 0, executed};
+    if (!running) {
+        result.reason = stop_reason;
+        if (stop_reason != StopReason::Halted) {
+            result.fault_pc = fault_pc;
+        }
+    }
+    return result;
+}
+
+RunResult LC3State::run_until(std::chrono::steady_clock::time_point deadline) {
+    RunResult total{StopReason::BudgetExhausted, 0, 0};
+    while (std::chrono::steady_clock::now() < deadline) {
+        RunResult slice = run_for(RUN_UNTIL_SLICE);
+        total.reason = slice.reason;
+        total.fault_pc = slice.fault_pc;
+        total.instructions += slice.instructions;
+        if (slice.reason != StopReason::BudgetExhausted) break;
+    }
+    return total;
+}
+
+std::uint64_t LC3State::run_instrumented(std::uint64_t budget) {
+    std::uint64_t executed = 0;
+    while (this->running && executed < budget) {
+        std::uint16_t pc = this->reg[R_PC];
+        const DecodedInstruction& decoded = fetch(pc);
+        // Copied first: a store over its own word drops the cache entry.
+        std::uint8_t op = decoded.op;
+        std::uint16_t imm = decoded.imm;
+        std::uint16_t word = this->memory.memory[pc];
+        std::array<std::uint16_t, R_COUNT> before = this->reg;
+
+        // Resolved without device side effects, before the store can change the pointer.
+        bool stored = op == OP_ST || op == OP_STR || op == OP_STI;
+        std::uint16_t address = 0;
+        if (tracer && stored) {
+            std::uint16_t next_pc = pc + 1;
+            address = op == OP_ST ? next_pc + imm
+                    : op == OP_STR ? before[decoded.sr1] + imm
+                    : this->memory.memory[static_cast<std::uint16_t>(next_pc + imm)];
+        }
+        std::uint16_t value = before[decoded.dr];
+
+        this->reg[R_PC]++;
+        decoded.handler(*this, decoded);
+        if (!this->running && this->stop_reason != StopReason::Halted) {
+            break;
+        }
+        if (profiler) profiler->record(pc, op, imm);
+        if (tracer) tracer->record(word, before, this->reg, stored, address, value);
+        ++executed;
+    }
+    return executed;
+}
+
+std::uint64_t LC3State::execute(std::uint64_t budget) {
+    bind_console();
     this->running = true;
-    while (this->running) {
-        step();
+    this->stop_reason = StopReason::Halted;
+    if (take_halt_request()) return 0;
+    if (profiler || tracer) {
+        return run_instrumented(budget);
+    }
+    if (execution_mode != ExecutionMode::Interpreter) {
+        return run_superblocks(budget);
+    }
+#ifdef LC3_THREADED_DISPATCH
+    return run_threaded(budget);
+#else
+    std::uint64_t executed = 0;
+    while (this->running && executed < budget) {
+        execute_one();
+        ++executed;
     }
+    if (!this->running && this->stop_reason != StopReason::Halted) {
+        --executed;
+    }
+    return executed;
+#endif
 }
 
 void LC3State::step() {
     if (!this->running) return;
 
+    this->stop_reason = StopReason::Halted;
+    if (take_halt_request()) return;
+    bind_console();
+    execute_one();
+    throw_fault();
+}
+
+void LC3State::execute_one() {
     std::uint16_t current_pc = this->reg[R_PC];
+    const DecodedInstruction& decoded = fetch(current_pc);
     this->reg[R_PC]++;
-    
-    std::uint16_t instruction = this->memory.read(current_pc);
-    std::uint16_t opcode_val = instruction >> 12;
 
-    if (opcode_val >= op_table.size() || !op_table[opcode_val]) {
-        throw std::runtime_error("Illegal or unsupported opcode: " + std::to_string(opcode_val) + 
-                                 " at PC: " + std::to_string(current_pc));
+    decoded.handler(*this, decoded);
+}
+
+bool LC3State::take_halt_request() {
+    if (!this->halt_requested.load(std::memory_order_relaxed)) return false;
+    this->halt_requested.store(false, std::memory_order_relaxed);
+    this->running = false;
+    this->stop_reason = StopReason::Halted;
+    return true;
+}
+
+void LC3State::fault(StopReason reason) {
+    this->running = false;
+    this->stop_reason = reason;
+    this->fault_pc = this->reg[R_PC] - 1;
+}
+
+void LC3State::throw_fault() {
+    if (this->stop_reason != StopReason::IllegalOpcode && this->stop_reason != StopReason::UnknownTrap) return;
+
+    // The exception-based API never treated a fault as a halt.
+    this->running = true;
+    std::uint16_t instr = this->memory.memory[this->fault_pc];
+    switch (this->stop_reason) {
+        case StopReason::IllegalOpcode:
+            throw std::runtime_error("Illegal or unsupported opcode: " + std::to_string(instr >> 12) +
+                                     " at PC: " + std::to_string(this->fault_pc));
+        case StopReason::UnknownTrap:
+            throw std::runtime_error("Unknown TRAP vector: " + std::to_string(instr & 0xFF));
+        default:
+            break;
+    }
+}
+
+bool LC3State::input_ready() const {
+    return this->blocking_input || this->memory.keyboard_device().key_pending();
+}
+
+const DecodedInstruction& LC3State::fetch(std::uint16_t address) {
+    if (const DecodedInstruction* cached = decode_cache.lookup(address)) {
+        return *cached;
+    }
+
+    DecodedInstruction decoded = decode(memory.read(address));
+    // The last word stays uncached so the threaded loop sees every wrap of the PC.
+    if (memory.is_device(address) || address == MEMORY_MAX - 1) {
+        uncached_instruction = decoded;
+        return uncached_instruction;
     }
-    
-    op_table[opcode_val](*this, instruction);
+    memory.mark_code(address);
+    return decode_cache.insert(address, decoded);
+}
+
+void LC3State::on_code_write(void* context, std::uint16_t address) {
+    LC3State* state = static_cast<LC3State*>(context);
+    state->decode_cache.invalidate(address);
+    state->block_cache.invalidate(address);
 }
 
 void LC3State::update_flags(std::uint16_t r_idx) {
@@ -306,128 +643,23 @@ void LC3State::update_flags(std::uint16_t r_idx) {
 }
 
 std::string LC3State::disassemble(std::uint16_t address) {
-    std::uint16_t instr = memory.read(address);
-    std::uint16_t opcode = instr >> 12;
-    std::ostringstream oss;
-
-    oss << "0x" << std::nouppercase << std::hex << std::setfill('0') << std::setw(4) << address << ": ";
-
-    switch (opcode) {
-        case OP_ADD: {
-            std::uint16_t dr = (instr >> 9) & 0x7;
-            std::uint16_t sr1 = (instr >> 6) & 0x7;
-            oss << "ADD R" << dr << ", R" << sr1 << ", ";
-            if ((instr >> 5) & 0x1) {
-                std::int16_t imm5 = static_cast<std::int16_t>(sign_extend(instr & 0x1F, 5));
-                oss << "#" << std::dec << imm5;
-            } else {
-                std::uint16_t sr2 = instr & 0x7;
-                oss << "R" << sr2;
-            }
-            break;
-        }
-        case OP_AND: {
-            std::uint16_t dr = (instr >> 9) & 0x7;
-            std::uint16_t sr1 = (instr >> 6) & 0x7;
-            oss << "AND R" << dr << ", R" << sr1 << ", ";
-            if ((instr >> 5) & 0x1) {
-                std::int16_t imm5 = static_cast<std::int16_t>(sign_extend(instr & 0x1F, 5));
-                oss << "#" << std::dec << imm5;
-            } else {
-                std::uint16_t sr2 = instr & 0x7;
-                oss << "R" << sr2;
-            }
-            break;
-        }
-        case OP_NOT: {
-            std::uint16_t dr = (instr >> 9) & 0x7;
-            std::uint16_t sr = (instr >> 6) & 0x7;
-            oss << "NOT R" << dr << ", R" << sr;
-            break;
-        }
-        case OP_BR: {
-            std::uint16_t n = (instr >> 11) & 0x1;
-            std::uint16_t z = (instr >> 10) & 0x1;
-            std::uint16_t p = (instr >> 9) & 0x1;
-            std::int16_t pc_offset9 = static_cast<std::int16_t>(sign_extend(instr & 0x1FF, 9));
-            oss << "BR" << (n ? "n" : "") << (z ? "z" : "") << (p ? "p" : "") << " 0x" << std::nouppercase << std::hex << std::setfill('0') << std::setw(4) << (address + 1 + pc_offset9);
-            break;
-        }
-        case OP_JMP: {
-            std::uint16_t base_r = (instr >> 6) & 0x7;
-            if (base_r == 7) {
-                 oss << "RET";
-            } else {
-                 oss << "JMP R" << base_r;
-            }
-            break;
-        }
-        case OP_JSR: {
-            oss << "JSR ";
-            if ((instr >> 11) & 1) {
-                std::int16_t pc_offset11 = static_cast<std::int16_t>(sign_extend(instr & 0x7FF, 11));
-                oss << "0x" << std::nouppercase << std::hex << std::setfill('0') << std::setw(4) << (address + 1 + pc_offset11);
-            } else {
-                std::uint16_t base_r = (instr >> 6) & 0x7;
-                oss << "R" << base_r;
-            }
-            break;
-        }
-        case OP_LD: {
-            std::uint16_t dr = (instr >> 9) & 0x7;
-            std::int16_t pc_offset9 = static_cast<std::int16_t>(sign_extend(instr & 0x1FF, 9));
-            oss << "LD R" << dr << ", 0x" << std::nouppercase << std::hex << std::setfill('0') << std::setw(4) << (address + 1 + pc_offset9);
-            break;
-        }
-        case OP_LDI: {
-            std::uint16_t dr = (instr >> 9) & 0x7;
-            std::int16_t pc_offset9 = static_cast<std::int16_t>(sign_extend(instr & 0x1FF, 9));
-            oss << "LDI R" << dr << ", 0x" << std::nouppercase << std::hex << std::setfill('0') << std::setw(4) << (address + 1 + pc_offset9);
-            break;
-        }
-        case OP_LDR: {
-            std::uint16_t dr = (instr >> 9) & 0x7;
-            std::uint16_t base_r = (instr >> 6) & 0x7;
-            std::int16_t offset6 = static_cast<std::int16_t>(sign_extend(instr & 0x3F, 6));
-            oss << "LDR R" << dr << ", R" << base_r << ", #" << std::dec << offset6;
-            break;
-        }
-        case OP_LEA: {
-            std::uint16_t dr = (instr >> 9) & 0x7;
-            std::int16_t pc_offset9 = static_cast<std::int16_t>(sign_extend(instr & 0x1FF, 9));
-            oss << "LEA R" << dr << ", 0x" << std::nouppercase << std::hex << std::setfill('0') << std::setw(4) << (address + 1 + pc_offset9);
-            break;
-        }
-        case OP_ST: {
-            std::uint16_t sr = (instr >> 9) & 0x7;
-            std::int16_t pc_offset9 = static_cast<std::int16_t>(sign_extend(instr & 0x1FF, 9));
-            oss << "ST R" << sr << ", 0x" << std::nouppercase << std::hex << std::setfill('0') << std::setw(4) << (address + 1 + pc_offset9);
-            break;
-        }
-        case OP_STI: {
-            std::uint16_t sr = (instr >> 9) & 0x7;
-            std::int16_t pc_offset9 = static_cast<std::int16_t>(sign_extend(instr & 0x1FF, 9));
-            oss << "STI R" << sr << ", 0x" << std::nouppercase << std::hex << std::setfill('0') << std::setw(4) << (address + 1 + pc_offset9);
-            break;
-        }
-        case OP_STR: {
-            std::uint16_t sr = (instr >> 9) & 0x7;
-            std::uint16_t base_r = (instr >> 6) & 0x7;
-            std::int16_t offset6 = static_cast<std::int16_t>(sign_extend(instr & 0x3F, 6));
-            oss << "STR R" << sr << ", R" << base_r << ", #" << std::dec << offset6;
-            break;
-        }
-        case OP_TRAP: {
-            oss << "TRAP x" << std::nouppercase << std::hex << std::setfill('0') << std::setw(2) << (instr & 0xFF);
-            break;
+    char line[DISASSEMBLY_MAX_LINE];
+    return std::string(line, disassemble_instruction(address, memory.read(address), line));
+}
+
+void LC3State::disassemble_range(std::ostream& out, std::uint16_t start, std::uint32_t count) {
+    char chunk[DISASSEMBLY_CHUNK_SIZE];
+    std::size_t used = 0;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (used > DISASSEMBLY_CHUNK_SIZE - DISASSEMBLY_MAX_LINE - 1) {
+            out.write(chunk, static_cast<std::streamsize>(used));
+            used = 0;
         }
-        case OP_RES:
-        case OP_RTI:
-        default:
-            oss << "BAD OPCODE";
-            break;
+        std::uint16_t address = static_cast<std::uint16_t>(start + i);
+        used += disassemble_instruction(address, memory.read(address), chunk + used);
+        chunk[used++] = '\n';
     }
-    return oss.str();
+    out.write(chunk, static_cast<std::streamsize>(used));
 }
 
 void LC3State::disassemble_all() {
@@ -436,10 +668,12 @@ void LC3State::disassemble_all() {
         return;
     }
 
-    for (const auto& segment : loaded_code_segments) {
-        for (std::uint16_t i = 0; i < segment.size; ++i) {
-            std::uint16_t current_address = segment.start_address + i;
-            std::cout << disassemble(current_address) << std::endl;
-        }
+    std::vector<std::vector<std::uint8_t>> kinds(loaded_code_segments.size());
+    parallel_for(loaded_code_segments.size(), [&](std::size_t i) {
+        kinds[i] = map_code(memory.memory, loaded_code_segments[i].start_address, loaded_code_segments[i].size);
+    });
+    for (std::size_t i = 0; i < loaded_code_segments.size(); ++i) {
+        write_listing(std::cout, memory.memory, loaded_code_segments[i].start_address, kinds[i]);
     }
+    std::cout.flush();
 }
\ No newline at end of file
@@ -0,0 +1,163 @@
+/**
+ * @file lc3trace.cpp
+ * @brief Reads an execution trace written by lc3vm --trace.
+ *
+ * By default every traced instruction is listed with its disassembly, the
+ * registers and condition code it changed and the memory word it stored;
+ * --stats summarizes the trace instead.
+ */
+#include "disassembler.hpp"
+#include "lc3.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/** @brief Mnemonic of each opcode, as used in the statistics. */
+static const char* const OPCODE_NAMES[16] = {
+    "BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR",
+    "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP"
+};
+
+/** @brief Hottest addresses listed by --stats. */
+#define LC3TRACE_HOT_ADDRESSES 20
+
+/**
+ * @brief Prints the command-line usage to standard error.
+ * @param program The name the program was started as.
+ */
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--stats] <trace_file>" << std::endl;
+}
+
+/**
+ * @brief Returns the letter of a condition flag.
+ * @param cond FL_POS, FL_ZRO or FL_NEG.
+ * @return 'P', 'Z' or 'N'.
+ */
+static char cond_letter(std::uint16_t cond) {
+    return cond == FL_POS ? 'P' : cond == FL_ZRO ? 'Z' : 'N';
+}
+
+/**
+ * @brief Lists every instruction of a trace on standard output.
+ * @param reader The trace.
+ */
+static void list_trace(TraceReader& reader) {
+    TraceEvent event;
+    std::uint16_t cond = 0;
+    char text[32];
+    char line[DISASSEMBLY_MAX_LINE];
+    while (reader.next(event)) {
+        std::string effects;
+        for (unsigned r = R_R0; r <= R_R7; ++r) {
+            if (!(event.changed & (1u << r))) continue;
+            std::snprintf(text, sizeof(text), " R%u=0x%04x", r, event.registers[r]);
+            effects += text;
+        }
+        if (event.registers[R_COND] != cond) {
+            cond = event.registers[R_COND];
+            effects += " CC=";
+            effects += cond_letter(cond);
+        }
+        if (event.stored) {
+            std::snprintf(text, sizeof(text), " [0x%04x]=0x%04x", event.address, event.value);
+            effects += text;
+        }
+        // Instruction words are disassembled where they were executed, so that
+        // PC-relative operands show their targets.
+        std::size_t length = disassemble_instruction(event.pc, event.word, line);
+        std::cout.write(line, static_cast<std::streamsize>(length));
+        if (!effects.empty() && length < 31) std::cout << std::string(31 - length, ' ');
+        std::cout << effects << '\n';
+    }
+}
+
+/**
+ * @brief Prints a summary of a trace on standard output.
+ * @param reader The trace.
+ */
+static void summarize_trace(TraceReader& reader) {
+    std::vector<std::uint64_t> addresses(MEMORY_MAX, 0);
+    std::array<std::uint64_t, 16> opcodes{};
+    std::uint64_t total = 0;
+    std::uint64_t branches = 0;
+    std::uint64_t stores = 0;
+    TraceEvent event;
+    while (reader.next(event)) {
+        ++total;
+        ++addresses[event.pc];
+        ++opcodes[event.word >> 12];
+        if (event.registers[R_PC] != static_cast<std::uint16_t>(event.pc + 1)) ++branches;
+        if (event.stored) ++stores;
+    }
+
+    std::vector<std::uint16_t> executed;
+    for (std::uint32_t address = 0; address < MEMORY_MAX; ++address) {
+        if (addresses[address]) executed.push_back(static_cast<std::uint16_t>(address));
+    }
+    auto share = [total](std::uint64_t count) {
+        return total ? 100.0 * static_cast<double>(count) / static_cast<double>(total) : 0.0;
+    };
+
+    std::printf("Trace of %llu instructions\n", static_cast<unsigned long long>(total));
+    std::printf("  Non-sequential: %12llu %6.2f%%\n", static_cast<unsigned long long>(branches), share(branches));
+    std::printf("  Stores:         %12llu %6.2f%%\n", static_cast<unsigned long long>(stores), share(stores));
+    std::printf("  Addresses:      %12zu\n", executed.size());
+
+    std::printf("\nOpcodes:\n");
+    for (unsigned op = 0; op < 16; ++op) {
+        if (!opcodes[op]) continue;
+        std::printf("  %-10s%12llu %6.2f%%\n", OPCODE_NAMES[op],
+                    static_cast<unsigned long long>(opcodes[op]), share(opcodes[op]));
+    }
+
+    std::size_t hot = std::min<std::size_t>(LC3TRACE_HOT_ADDRESSES, executed.size());
+    std::partial_sort(executed.begin(), executed.begin() + hot, executed.end(),
+                      [&addresses](std::uint16_t a, std::uint16_t b) {
+                          return addresses[a] != addresses[b] ? addresses[a] > addresses[b] : a < b;
+                      });
+    std::printf("\nHot addresses:\n");
+    for (std::size_t i = 0; i < hot; ++i) {
+        std::printf("  0x%04x %12llu %6.2f%%\n", executed[i],
+                    static_cast<unsigned long long>(addresses[executed[i]]), share(addresses[executed[i]]));
+    }
+}
+
+/**
+ * @brief Main function of the trace reader.
+ * @param argc The number of command-line arguments.
+ * @param argv The arguments: an optional --stats, then the trace file.
+ * @return 0 if the whole trace was read, 1 on error.
+ */
+int main(int argc, const char* argv[]) {
+    bool stats = false;
+    int arg = 1;
+    if (arg < argc && std::strcmp(argv[arg], "--stats") == 0) {
+        stats = true;
+        ++arg;
+    }
+    if (arg + 1 != argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        TraceReader reader(argv[arg]);
+        if (stats) {
+            summarize_trace(reader);
+        } else {
+            list_trace(reader);
+        }
+    } catch (const std::exception& e) {
+        std::cout.flush();
+        std::cerr << "Trace Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -10,8 +10,23 @@
 #include <vector>
 #include <csignal>
 #include "lc3.hpp"
+#include "assembler.hpp"
+#include "cfg.hpp"
+#include "fleet.hpp"
+#include "headless.hpp"
+#include "replay.hpp"
+#include "trace.hpp"
 #include "terminal_input.hpp"
+#include <cerrno>
+#include <chrono>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <unistd.h>
 
 /** 
  * @brief Global pointer to the LC3State instance.
@@ -20,9 +35,15 @@
  */
 LC3State* g_vm_ptr = nullptr;
 
+/**
+ * @brief Whether SIGINT should only stop the VM, so that main() can still write a report or trace.
+ */
+bool g_report_on_interrupt = false;
+
 /**
  * @brief Signal handler for SIGINT (Ctrl+C).
- * Requests the LC-3 VM to halt its execution gracefully.
+ * Requests the LC-3 VM to halt its execution gracefully. Unless a report is
+ * pending, the process is then terminated; otherwise a second SIGINT does that.
  * @param sig The signal number (expected to be SIGINT).
  */
 void handle_sigint(int sig) {
@@ -31,12 +52,269 @@ void handle_sigint(int sig) {
         if (g_vm_ptr) {
             g_vm_ptr->request_halt();
         }
+        if (g_report_on_interrupt) {
+            std::signal(sig, SIG_DFL);
+            return;
+        }
         disable_raw_mode();
         std::signal(sig, SIG_DFL);
         std::raise(sig);
     }
 }
 
+/**
+ * @brief Prints the command-line usage to standard error.
+ * @param program The name the program was invoked with.
+ */
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " --assemble SOURCE [-o OBJECT]" << std::endl;
+    std::cerr << "       " << program << " [-d|--disassemble] [--cfg FILE] [-s|--superblock] [--jit] [--fleet [--budget N]] [--record LOG|--replay LOG] [--headless [--input FILE] [--output FILE] [--key-delay N] [--budget N]] [--profile] [--trace FILE] <image_file1> [image_file2] ...\n"
+              << "Images ending in .asm are assembled as they are loaded." << std::endl;
+}
+
+/**
+ * @brief Instructions a --fleet job may run unless --budget says otherwise.
+ * Guests that poll the keyboard spin forever once their input is used up; this stops them.
+ */
+#define FLEET_DEFAULT_BUDGET 1000000000ull
+
+/**
+ * @brief Instructions a --headless run may retire unless --budget says otherwise.
+ * Guests polling for keys after their script ends already stop as out of input;
+ * this only stops ones that never halt or ask for input, after a few minutes.
+ */
+#define HEADLESS_DEFAULT_BUDGET 100000000000ull
+
+/**
+ * @brief Describes how a run ended.
+ * @param reason Why it stopped.
+ * @param fault_pc The address of the faulting or waiting instruction.
+ * @return A short description such as "halted" or "illegal opcode at 0x3005".
+ */
+static std::string describe(StopReason reason, std::uint16_t fault_pc) {
+    char pc[8];
+    std::snprintf(pc, sizeof(pc), "0x%04x", fault_pc);
+    switch (reason) {
+        case StopReason::Halted:
+            return "halted";
+        case StopReason::BudgetExhausted:
+            return "out of budget";
+        case StopReason::IllegalOpcode:
+            return std::string("illegal opcode at ") + pc;
+        case StopReason::UnknownTrap:
+            return std::string("unknown trap at ") + pc;
+        case StopReason::WaitingForInput:
+            return std::string("out of input at ") + pc;
+    }
+    return "stopped";
+}
+
+/**
+ * @brief Runs every image as a separate job on a Fleet and prints each job's output and outcome.
+ * The jobs get no input and need no terminal.
+ * @param images The object files, one per job.
+ * @param mode The engine the jobs run on.
+ * @param budget Instructions after which a job is stopped.
+ * @return 0 if every job halted, 1 otherwise.
+ */
+static int run_fleet(const std::vector<std::string>& images, ExecutionMode mode, std::uint64_t budget) {
+    std::vector<FleetJob> jobs(images.size());
+    for (std::size_t i = 0; i < images.size(); ++i) {
+        jobs[i].images = {images[i]};
+        jobs[i].mode = mode;
+        jobs[i].max_instructions = budget;
+    }
+    std::vector<FleetResult> results;
+    try {
+        results = Fleet().run(jobs);
+    } catch (const std::exception& e) {
+        std::cerr << "Fleet Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    int status = 0;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const FleetResult& result = results[i];
+        std::cout << "=== " << images[i] << ": ";
+        if (!result.error.empty()) {
+            std::cout << "failed to start: " << result.error << std::endl;
+            status = 1;
+            continue;
+        }
+        std::cout << describe(result.reason, result.fault_pc) << " after " << result.instructions << " instructions" << std::endl;
+        std::cout << result.output;
+        if (!result.output.empty() && result.output.back() != '\n') std::cout << std::endl;
+        if (result.reason != StopReason::Halted) status = 1;
+    }
+    return status;
+}
+
+/**
+ * @brief Replays an input log against the loaded program without a terminal.
+ * Guest output goes to standard output; the instruction count and speed are
+ * reported on standard error.
+ * @param vm The VM, loaded with the recorded program.
+ * @param log The log written by --record.
+ * @return 0 if the replay matched the log and halted, 1 otherwise.
+ */
+static int run_replay(LC3State& vm, const std::string& log) {
+    ReplayConsole* replay = new ReplayConsole(log);
+    vm.set_console(std::unique_ptr<Console>(replay));
+
+    auto start = std::chrono::steady_clock::now();
+    RunResult result = run_replayed(vm, *replay);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::fprintf(stderr, "Replay %s after %llu instructions in %.3f s (%.1f MIPS).\n",
+                 describe(result.reason, result.fault_pc).c_str(),
+                 static_cast<unsigned long long>(result.instructions), seconds,
+                 seconds > 0 ? result.instructions / seconds / 1e6 : 0.0);
+    return result.reason == StopReason::Halted ? 0 : 1;
+}
+
+/**
+ * @brief Runs the loaded program on scripted input without a terminal.
+ * The instruction count, wall time and speed are reported on standard error.
+ * @param vm The VM, loaded with the program.
+ * @param input The file holding the keys, or "-" for standard input.
+ * @param output The file guest output is written to, or "-" for standard output.
+ * @param key_delay Instructions the guest runs between taking a key and the next one arriving.
+ * @param budget Instructions after which the run is stopped.
+ * @return 0 if the program halted or used up its input, 1 otherwise.
+ * @throw std::runtime_error if the input cannot be read or the output cannot be created.
+ */
+static int run_script(LC3State& vm, const std::string& input, const std::string& output,
+                      std::uint64_t key_delay, std::uint64_t budget) {
+    std::string keys = read_script(input);
+    int out_fd = STDOUT_FILENO;
+    if (output != "-") {
+        out_fd = ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out_fd == -1) {
+            throw std::runtime_error("Failed to create output " + output + ": " + std::strerror(errno));
+        }
+    }
+    ScriptConsole* console = new ScriptConsole(std::move(keys), out_fd, key_delay > 0);
+    vm.set_console(std::unique_ptr<Console>(console));
+
+    auto start = std::chrono::steady_clock::now();
+    RunResult result = run_headless(vm, *console, key_delay, budget);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (out_fd != STDOUT_FILENO) ::close(out_fd);
+
+    std::fprintf(stderr, "Headless run %s after %llu instructions in %.3f s (%.1f MIPS).\n",
+                 describe(result.reason, result.fault_pc).c_str(),
+                 static_cast<unsigned long long>(result.instructions), seconds,
+                 seconds > 0 ? result.instructions / seconds / 1e6 : 0.0);
+    return result.reason == StopReason::Halted || result.reason == StopReason::WaitingForInput ? 0 : 1;
+}
+
+/**
+ * @brief Writes the rest of a trace and reports its size to standard error.
+ * @param trace The trace of the run.
+ * @param path Its file.
+ * @return Whether the whole trace was written.
+ */
+static bool finish_trace(TraceWriter& trace, const std::string& path) {
+    try {
+        trace.close();
+    } catch (const std::exception& e) {
+        std::cerr << "Trace Error: " << e.what() << std::endl;
+        return false;
+    }
+    std::cerr << "Traced " << trace.records() << " instructions to " << path << "." << std::endl;
+    return true;
+}
+
+/**
+ * @brief Assembles a source file into an object file and reports its size.
+ * @param source The .asm file.
+ * @param object The .obj file; empty for the source path with its extension replaced by .obj.
+ * @return 0 on success, 1 if the source does not assemble or the object cannot be written.
+ */
+static int assemble_to_object(const std::string& source, std::string object) {
+    if (object.empty()) {
+        std::size_t dot = source.find_last_of('.');
+        std::size_t slash = source.find_last_of('/');
+        object = (dot != std::string::npos && (slash == std::string::npos || dot > slash) ? source.substr(0, dot) : source) + ".obj";
+    }
+    try {
+        auto start = std::chrono::steady_clock::now();
+        AssembledProgram program = assemble_file(source);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (program.segments.size() != 1) {
+            throw std::runtime_error(source + ": an object file holds exactly one .ORIG block, found " +
+                                     std::to_string(program.segments.size()) + ".");
+        }
+        write_object(program.segments[0], object);
+        std::fprintf(stderr, "Assembled %zu words at x%04X to %s in %.3f ms.\n", program.segments[0].words.size(),
+                     program.segments[0].origin, object.c_str(), seconds * 1e3);
+    } catch (const std::exception& e) {
+        std::cerr << "Assembler Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Loads images given on the command line, assembling .asm sources in place.
+ * Without sources this is LC3State::load_images(); with them, images are
+ * loaded one run at a time in command-line order.
+ * @param vm The VM.
+ * @param paths The .obj and .asm files.
+ * @throw std::runtime_error if a file cannot be read, is malformed or does not assemble.
+ */
+static void load_images_and_sources(LC3State& vm, const std::vector<std::string>& paths) {
+    auto is_source = [](const std::string& path) {
+        return path.size() > 4 && path.compare(path.size() - 4, 4, ".asm") == 0;
+    };
+    std::vector<std::string> objects;
+    for (const std::string& path : paths) {
+        if (!is_source(path)) {
+            objects.push_back(path);
+            continue;
+        }
+        if (!objects.empty()) {
+            vm.load_images(objects);
+            objects.clear();
+        }
+        vm.load_program(assemble_file(path));
+    }
+    if (!objects.empty()) vm.load_images(objects);
+}
+
+/**
+ * @brief Writes the control-flow graph of programs in DOT format and summarizes it on standard error.
+ * @param vm The VM to load the programs into.
+ * @param images The .obj and .asm files.
+ * @param path The DOT file, or "-" for standard output.
+ * @return 0 on success, 1 if a program cannot be loaded or the file cannot be written.
+ */
+static int write_cfg(LC3State& vm, const std::vector<std::string>& images, const std::string& path) {
+    try {
+        load_images_and_sources(vm, images);
+        auto start = std::chrono::steady_clock::now();
+        ControlFlowGraph cfg = vm.control_flow_graph();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (path == "-") {
+            cfg.write_dot(std::cout, vm.memory.memory);
+            std::cout.flush();
+        } else {
+            std::ofstream out(path);
+            if (!out) throw std::runtime_error("Failed to create " + path + ": " + std::strerror(errno));
+            cfg.write_dot(out, vm.memory.memory);
+            out.close();
+            if (!out) throw std::runtime_error("Failed to write " + path);
+        }
+        std::fprintf(stderr, "CFG of %zu blocks with %zu loops, %zu subroutines and %zu unreachable blocks built in %.3f ms.\n",
+                     cfg.blocks().size(), cfg.loops().size(), cfg.subroutines().size(), cfg.unreachable().size(),
+                     seconds * 1e3);
+    } catch (const std::exception& e) {
+        std::cerr << "CFG Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 /**
  * @brief Main function for the LC-3 virtual machine.
  * 
@@ -45,25 +323,160 @@ void handle_sigint(int sig) {
  * @param argc The number of command-line arguments.
  * @param argv An array of C-style strings representing the command-line arguments.
  *             The first argument (argv[0]) is the program name.
- *             Subsequent arguments (argv[1]...) are paths to LC-3 object files.
+ *             Leading options select disassembly (-d), the superblock engine (-s)
+ *             or the superblock engine with native compilation of hot blocks (--jit),
+ *             or run each image as a separate job without a terminal (--fleet), each for
+ *             at most --budget instructions; --record writes the keyboard input of an
+ *             interactive run to a log, and --replay runs it again from the log without a terminal;
+ *             --profile counts executed instructions and reports the hottest ones on exit;
+ *             --trace writes every executed instruction to a binary trace for lc3trace,
+ *             except with --cfg or --fleet, which it cannot be combined with;
+ *             --headless runs on keys from --input (standard input by default), optionally
+ *             --key-delay instructions apart, writing output to --output, without a terminal,
+ *             for at most --budget instructions;
+ *             this is also the default when standard input is not a terminal;
+ *             --cfg writes the control-flow graph of the images in DOT format and exits;
+ *             --assemble translates an assembly source into an object file (-o) and exits;
+ *             the remaining arguments are paths to LC-3 object files.
  * @return 0 on successful execution and halt, 1 on error (e.g., file not found, runtime error).
  */
 int main(int argc, const char* argv[]) {
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " [-d|--disassemble] <image_file1> [image_file2] ..." << std::endl;
+        print_usage(argv[0]);
         return 1;
     }
 
     LC3State vm;
-    g_vm_ptr = &vm;
 
-    try {
-        enable_raw_mode();
-        std::atexit(disable_raw_mode);
-    } catch (const std::exception& e) {
-        std::cerr << "Terminal Setup Error: " << e.what() << std::endl;
+    bool disassemble_mode = false;
+    bool fleet_mode = false;
+    std::string record_log;
+    std::string replay_log;
+    bool profiling = false;
+    std::string trace_file;
+    bool headless = false;
+    std::string input_file = "-";
+    std::string output_file = "-";
+    std::uint64_t key_delay = 0;
+    std::uint64_t budget = 0;
+    bool budget_given = false;
+    std::string assemble_source;
+    std::string cfg_file;
+    std::string assemble_output;
+    int first_image_arg_index = 1;
+
+    while (first_image_arg_index < argc && argv[first_image_arg_index][0] == '-') {
+        std::string arg = argv[first_image_arg_index];
+        if (arg == "-d" || arg == "--disassemble") {
+            disassemble_mode = true;
+        } else if (arg == "-s" || arg == "--superblock") {
+            vm.set_execution_mode(ExecutionMode::Superblock);
+        } else if (arg == "--jit") {
+            vm.set_execution_mode(ExecutionMode::Jit);
+        } else if (arg == "--fleet") {
+            fleet_mode = true;
+        } else if (arg == "--budget" && first_image_arg_index + 1 < argc) {
+            budget = std::strtoull(argv[++first_image_arg_index], nullptr, 0);
+            budget_given = true;
+        } else if (arg == "--record" && first_image_arg_index + 1 < argc) {
+            record_log = argv[++first_image_arg_index];
+        } else if (arg == "--replay" && first_image_arg_index + 1 < argc) {
+            replay_log = argv[++first_image_arg_index];
+        } else if (arg == "--profile") {
+            profiling = true;
+        } else if (arg == "--trace" && first_image_arg_index + 1 < argc) {
+            trace_file = argv[++first_image_arg_index];
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--input" && first_image_arg_index + 1 < argc) {
+            headless = true;
+            input_file = argv[++first_image_arg_index];
+        } else if (arg == "--output" && first_image_arg_index + 1 < argc) {
+            headless = true;
+            output_file = argv[++first_image_arg_index];
+        } else if (arg == "--key-delay" && first_image_arg_index + 1 < argc) {
+            headless = true;
+            key_delay = std::strtoull(argv[++first_image_arg_index], nullptr, 0);
+        } else if (arg == "--cfg" && first_image_arg_index + 1 < argc) {
+            cfg_file = argv[++first_image_arg_index];
+        } else if (arg == "--assemble" && first_image_arg_index + 1 < argc) {
+            assemble_source = argv[++first_image_arg_index];
+        } else if (arg == "-o" && first_image_arg_index + 1 < argc) {
+            assemble_output = argv[++first_image_arg_index];
+        } else {
+            print_usage(argv[0]);
+            std::cerr << "Error: Unknown option " << arg << std::endl;
+            return 1;
+        }
+        ++first_image_arg_index;
+    }
+
+    if (!assemble_source.empty()) {
+        if (first_image_arg_index < argc) {
+            print_usage(argv[0]);
+            std::cerr << "Error: --assemble takes a single source file." << std::endl;
+            return 1;
+        }
+        return assemble_to_object(assemble_source, assemble_output);
+    }
+
+    if (first_image_arg_index >= argc) {
+        print_usage(argv[0]);
+        std::cerr << "Error: At least one image file is required." << std::endl;
+        return 1;
+    }
+
+    if (headless && !record_log.empty()) {
+        print_usage(argv[0]);
+        std::cerr << "Error: --record needs a terminal and cannot be combined with --headless." << std::endl;
+        return 1;
+    }
+    if (!trace_file.empty() && (!cfg_file.empty() || fleet_mode)) {
+        print_usage(argv[0]);
+        std::cerr << "Error: --trace records a single run and cannot be combined with --cfg or --fleet." << std::endl;
         return 1;
     }
+    if (!headless && !disassemble_mode && record_log.empty() && replay_log.empty() && !isatty(STDIN_FILENO)) {
+        headless = true;
+    }
+
+    if (!cfg_file.empty()) {
+        return write_cfg(vm, std::vector<std::string>(argv + first_image_arg_index, argv + argc), cfg_file);
+    }
+
+    if (fleet_mode) {
+        return run_fleet(std::vector<std::string>(argv + first_image_arg_index, argv + argc), vm.get_execution_mode(),
+                         budget_given ? budget : FLEET_DEFAULT_BUDGET);
+    }
+
+    vm.set_profiling(profiling);
+
+    std::unique_ptr<TraceWriter> trace;
+    if (!trace_file.empty() && !disassemble_mode) {
+        try {
+            trace.reset(new TraceWriter(trace_file));
+        } catch (const std::exception& e) {
+            std::cerr << "Trace Error: " << e.what() << std::endl;
+            return 1;
+        }
+        vm.set_trace(trace.get());
+    }
+
+    if (!replay_log.empty()) {
+        int status = 1;
+        try {
+            load_images_and_sources(vm, std::vector<std::string>(argv + first_image_arg_index, argv + argc));
+            status = run_replay(vm, replay_log);
+        } catch (const std::exception& e) {
+            std::cerr << "Replay Error: " << e.what() << std::endl;
+        }
+        if (profiling) vm.write_profile(std::cerr);
+        if (trace && !finish_trace(*trace, trace_file)) status = 1;
+        return status;
+    }
+
+    g_vm_ptr = &vm;
+    g_report_on_interrupt = profiling || trace;
 
     struct sigaction sa;
     sa.sa_handler = handle_sigint;
@@ -75,43 +488,72 @@ int main(int argc, const char* argv[]) {
         return 1;
     }
 
-    bool disassemble_mode = false;
-    int first_image_arg_index = 1;
+    if (headless && !disassemble_mode) {
+        int status = 1;
+        try {
+            load_images_and_sources(vm, std::vector<std::string>(argv + first_image_arg_index, argv + argc));
+            status = run_script(vm, input_file, output_file, key_delay,
+                                budget_given ? budget : HEADLESS_DEFAULT_BUDGET);
+        } catch (const std::exception& e) {
+            std::cerr << "Headless Error: " << e.what() << std::endl;
+        }
+        if (profiling) vm.write_profile(std::cerr);
+        if (trace && !finish_trace(*trace, trace_file)) status = 1;
+        g_vm_ptr = nullptr;
+        return status;
+    }
 
-    if (argc > 1) {
-        std::string first_arg = argv[1];
-        if (first_arg == "-d" || first_arg == "--disassemble") {
-            disassemble_mode = true;
-            first_image_arg_index = 2;
-            if (argc < 3) {
-                 std::cerr << "Usage: " << argv[0] << " [-d|--disassemble] <image_file1> [image_file2] ..." << std::endl;
-                 std::cerr << "Error: At least one image file is required for disassembly." << std::endl;
-                 g_vm_ptr = nullptr;
-                 return 1;
+    TerminalConsole* terminal = nullptr;
+    RecordingConsole* recorder = nullptr;
+    if (!disassemble_mode) {
+        try {
+            terminal = new TerminalConsole();
+            if (record_log.empty()) {
+                vm.set_console(std::unique_ptr<Console>(terminal));
+            } else {
+                recorder = new RecordingConsole(std::unique_ptr<Console>(terminal), record_log);
+                vm.set_console(std::unique_ptr<Console>(recorder));
             }
+        } catch (const std::exception& e) {
+            std::cerr << "Terminal Setup Error: " << e.what() << std::endl;
+            g_vm_ptr = nullptr;
+            return 1;
         }
     }
 
+    int status = 0;
     try {
-        for (int i = first_image_arg_index; i < argc; ++i) {
-            std::string filename = argv[i];
-            vm.load_image(filename);
-        }
+        load_images_and_sources(vm, std::vector<std::string>(argv + first_image_arg_index, argv + argc));
 
         if (disassemble_mode) {
             vm.disassemble_all();
         } else {
             std::cout << "Starting LC-3 VM..." << std::endl;
-            vm.run();
+            terminal->start_reader();
+            if (recorder) {
+                RunResult result = run_recorded(vm, *recorder);
+                if (result.reason != StopReason::Halted) {
+                    throw std::runtime_error(describe(result.reason, result.fault_pc));
+                }
+            } else {
+                vm.run();
+            }
             std::cout << "LC-3 VM halted." << std::endl;
         }
 
     } catch (const std::exception& e) {
         std::cerr << "VM Runtime Error: " << e.what() << std::endl;
-        g_vm_ptr = nullptr;
-        return 1;
+        status = 1;
     }
 
+    if (profiling && !disassemble_mode) {
+        disable_raw_mode();
+        vm.write_profile(std::cerr);
+    }
+    if (trace) {
+        disable_raw_mode();
+        if (!finish_trace(*trace, trace_file)) status = 1;
+    }
     g_vm_ptr = nullptr;
-    return 0;
+    return status;
 }
@@ -2,46 +2,202 @@
  * @file memory.cpp
  * @brief Implements the Memory class methods for the LC-3 virtual machine.
  * 
- * This file contains the definitions for memory read and write operations,
- * including handling for memory-mapped keyboard input.
+ * This file contains the out-of-line paths of memory writes and the
+ * page-granular mapping of memory-mapped devices.
  */
 #include "memory.hpp"
+#include "image.hpp"
 #include "keyboard.hpp"
-#include <sys/select.h>
-#include <unistd.h>
-#include <cstdio>
-#include <iostream>
+#include <algorithm>
+#include <new>
+#include <sys/mman.h>
+#include "simd.hpp"
 
+/** @brief Size of the memory array in bytes; a whole number of host pages. */
+static const std::size_t MEMORY_BYTES = MEMORY_MAX * sizeof(std::uint16_t);
 
-void Memory::write(std::uint16_t address, std::uint16_t value) {
-    memory[address] = value;
+/**
+ * @brief Maps fresh zero pages for a memory array.
+ * @return The words.
+ * @throw std::bad_alloc if the mapping fails.
+ */
+static std::uint16_t* map_words() {
+    void* words = mmap(nullptr, MEMORY_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (words == MAP_FAILED) throw std::bad_alloc();
+    return static_cast<std::uint16_t*>(words);
 }
 
+Memory::Memory() : memory(map_words()) {
+    std::fill(page_flags, page_flags + MEMORY_PAGE_COUNT, PAGE_CLEAN);
+    map_device(Keyboard::MR_KBSR, &keyboard);
+}
 
-std::uint16_t check_key() {
-    fd_set readfds;
-    FD_ZERO(&readfds);
-    FD_SET(STDIN_FILENO, &readfds);
+Memory::~Memory() {
+    munmap(memory, MEMORY_BYTES);
+}
 
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
-    return select(1, &readfds, NULL, NULL, &timeout) != 0;
+bool Memory::remap(int fd) {
+    void* words = MAP_FAILED;
+    if (fd >= 0) {
+        words = mmap(memory, MEMORY_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    }
+    if (words == MAP_FAILED) {
+        words = mmap(memory, MEMORY_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if (words == MAP_FAILED) throw std::bad_alloc();
+        return fd < 0;
+    }
+    return true;
 }
 
-std::uint16_t Memory::read(std::uint16_t address) {
-    if (address == Keyboard::MR_KBSR) {
-        if (test_mode) {
-            return memory[Keyboard::MR_KBSR];
-        }
-        if (check_key()) {
-            memory[Keyboard::MR_KBSR] = (1 << 15);
-            char c_in;
-            std::cin.get(c_in);
-            memory[Keyboard::MR_KBDR] = static_cast<std::uint16_t>(c_in);
+void Memory::replaced_all() {
+    for (auto& word : dirty) {
+        word.store(~std::uint64_t(0), std::memory_order_relaxed);
+    }
+    for (auto& flags : page_flags) {
+        flags &= ~PAGE_CODE;
+    }
+}
+
+void Memory::load(std::uint16_t address, const std::uint16_t* words, std::size_t count) {
+    std::size_t done = 0;
+    while (done < count) {
+        std::size_t start = address + done;
+        unsigned page = static_cast<unsigned>(start >> MEMORY_PAGE_SHIFT);
+        std::size_t chunk = std::min<std::size_t>(MEMORY_PAGE_SIZE - (start & MEMORY_PAGE_MASK), count - done);
+        if (page_flags[page] & ~(PAGE_CLEAN | PAGE_WATCHED)) {
+            std::uint16_t swapped[MEMORY_PAGE_SIZE];
+            swap16_copy(swapped, words + done, chunk);
+            for (std::size_t i = 0; i < chunk; ++i) {
+                write_flagged(static_cast<std::uint16_t>(start + i), swapped[i]);
+            }
         } else {
-            memory[Keyboard::MR_KBSR] = 0;
+            // Extend the run over following plain pages.
+            while (done + chunk < count && !(page_flags[(start + chunk) >> MEMORY_PAGE_SHIFT] & ~(PAGE_CLEAN | PAGE_WATCHED))) {
+                chunk = std::min<std::size_t>(chunk + MEMORY_PAGE_SIZE, count - done);
+            }
+            swap16_copy(memory + start, words + done, chunk);
+            // Only the dirty bit is set here: PAGE_CLEAN stays until the next
+            // write(), so images sharing a page can be loaded concurrently.
+            for (std::size_t p = page; p <= (start + chunk - 1) >> MEMORY_PAGE_SHIFT; ++p) {
+                mark_dirty(static_cast<unsigned>(p));
+            }
+        }
+        done += chunk;
+    }
+}
+
+void Memory::watch_writes() {
+    for (auto& flags : page_flags) {
+        flags |= PAGE_WATCHED;
+    }
+}
+
+void Memory::assign(const std::uint16_t* words) {
+    for (unsigned page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+        assign_page(page, words);
+    }
+}
+
+void Memory::assign_pages(const std::uint16_t* words, const DirtyPages& pages) {
+    for (unsigned i = 0; i < pages.size(); ++i) {
+        for (std::uint64_t bits = pages[i]; bits; bits &= bits - 1) {
+            assign_page(i * 64 + __builtin_ctzll(bits), words);
+        }
+    }
+}
+
+void Memory::assign_page(unsigned page, const std::uint16_t* words) {
+    std::size_t start = static_cast<std::size_t>(page) << MEMORY_PAGE_SHIFT;
+    mark_dirty(page);
+    if (!(page_flags[page] & PAGE_CODE)) {
+        // Comparing first leaves shared and zero pages unwritten, so they stay unallocated.
+        if (!equal16(memory + start, words + start, MEMORY_PAGE_SIZE)) {
+            std::copy(words + start, words + start + MEMORY_PAGE_SIZE, memory + start);
+        }
+        return;
+    }
+    std::size_t offset = 0;
+    while ((offset += mismatch16(memory + start + offset, words + start + offset, MEMORY_PAGE_SIZE - offset)) < MEMORY_PAGE_SIZE) {
+        std::uint16_t address = static_cast<std::uint16_t>(start + offset);
+        memory[address] = words[address];
+        write_hook(write_hook_context, address);
+        ++offset;
+    }
+}
+
+DirtyPages Memory::dirty_pages() const {
+    DirtyPages pages;
+    for (unsigned i = 0; i < pages.size(); ++i) {
+        pages[i] = dirty[i].load(std::memory_order_relaxed);
+    }
+    return pages;
+}
+
+DirtyPages Memory::take_dirty_pages() {
+    DirtyPages pages;
+    for (unsigned i = 0; i < pages.size(); ++i) {
+        pages[i] = dirty[i].exchange(0, std::memory_order_relaxed);
+        for (std::uint64_t bits = pages[i]; bits; bits &= bits - 1) {
+            page_flags[i * 64 + __builtin_ctzll(bits)] |= PAGE_CLEAN;
         }
     }
-    return memory[address];
-}
\ No newline at end of file
+    ++epoch;
+    return pages;
+}
+
+void Memory::clear() {
+    remap(-1);
+    replaced_all();
+}
+
+void Memory::map_image(const SharedImage& image) {
+    if (!remap(image.descriptor())) {
+        std::copy(image.words(), image.words() + MEMORY_MAX, memory);
+    }
+    replaced_all();
+}
+
+bool Memory::equals(const Memory& other) const {
+    return equal16(memory, other.memory, MEMORY_MAX);
+}
+
+std::size_t Memory::first_difference(const Memory& other, std::size_t from) const {
+    if (from >= MEMORY_MAX) return MEMORY_MAX;
+    return from + mismatch16(memory + from, other.memory + from, MEMORY_MAX - from);
+}
+
+bool Memory::range_flagged(std::uint16_t address, std::size_t count) const {
+    if (count == 0) return false;
+    unsigned last = static_cast<unsigned>((address + count - 1) >> MEMORY_PAGE_SHIFT);
+    for (unsigned page = address >> MEMORY_PAGE_SHIFT; page <= last; ++page) {
+        if (page_flags[page] & ~(PAGE_CLEAN | PAGE_WATCHED)) return true;
+    }
+    return false;
+}
+
+void Memory::map_device(std::uint16_t address, Device* device) {
+    unsigned page = address >> MEMORY_PAGE_SHIFT;
+    devices[page] = device;
+    if (device) {
+        page_flags[page] |= PAGE_DEVICE;
+    } else {
+        page_flags[page] &= ~PAGE_DEVICE;
+    }
+}
+
+void Memory::write_flagged(std::uint16_t address, std::uint16_t value) {
+    unsigned page = address >> MEMORY_PAGE_SHIFT;
+    note_write(address);
+    if (page_flags[page] & PAGE_WATCHED) {
+        page_flags[page] &= ~PAGE_WATCHED;
+        ++watch_hits;
+    }
+    if (page_flags[page] & PAGE_DEVICE) {
+        devices[page]->write(*this, address, value);
+    } else {
+        memory[address] = value;
+    }
+    if (page_flags[page] & PAGE_CODE) {
+        write_hook(write_hook_context, address);
+    }
+}
@@ -0,0 +1,99 @@
+/**
+ * @file output_buffer.cpp
+ * @brief Implements flushing of the console output buffer.
+ */
+#include "output_buffer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/**
+ * @brief Writes a set of buffers completely, retrying after short writes.
+ * @param fd The destination descriptor; nothing is written if it is negative.
+ * @param iov The buffers; advanced in place as they are written.
+ * @param count The number of buffers.
+ */
+static void write_all(int fd, struct iovec* iov, int count) {
+    if (fd < 0) return;
+    while (count > 0) {
+        if (iov->iov_len == 0) {
+            ++iov;
+            --count;
+            continue;
+        }
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = {fd, POLLOUT, 0};
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            return;
+        }
+        std::size_t left = static_cast<std::size_t>(written);
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+}
+
+OutputBuffer::OutputBuffer(int fd) : size(0), fd(fd), sink(nullptr), last_flush(std::chrono::steady_clock::now()) {
+}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+void OutputBuffer::write(const char* data, std::size_t length) {
+    if (length <= OUTPUT_BUFFER_SIZE - size) {
+        std::copy(data, data + length, buffer.data() + size);
+        size += length;
+        return;
+    }
+    if (sink) {
+        sink->append(buffer.data(), size).append(data, length);
+    } else {
+        struct iovec iov[2] = {{buffer.data(), size}, {const_cast<char*>(data), length}};
+        write_all(fd, iov, 2);
+    }
+    size = 0;
+    last_flush = std::chrono::steady_clock::now();
+}
+
+void OutputBuffer::flush() {
+    if (size == 0) return;
+    if (sink) {
+        sink->append(buffer.data(), size);
+    } else {
+        struct iovec iov = {buffer.data(), size};
+        write_all(fd, &iov, 1);
+    }
+    size = 0;
+    last_flush = std::chrono::steady_clock::now();
+}
+
+void OutputBuffer::flush_if_due() {
+    if (size != 0 && std::chrono::steady_clock::now() - last_flush >= std::chrono::milliseconds(OUTPUT_FLUSH_INTERVAL_MS)) {
+        flush();
+    }
+}
+
+void OutputBuffer::set_descriptor(int fd) {
+    flush();
+    this->fd = fd;
+    this->sink = nullptr;
+}
+
+void OutputBuffer::capture(std::string* sink) {
+    flush();
+    this->sink = sink;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file profile.cpp
+ * @brief Implements execution profiles and the profile report.
+ */
+#include "profile.hpp"
+#include "lc3.hpp"
+#include "traps.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+
+/** @brief Mnemonic of each opcode, as used in the report. */
+static const char* const OPCODE_NAMES[16] = {
+    "BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR",
+    "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP"
+};
+
+/**
+ * @brief Returns the name of a TRAP vector.
+ * @param vector The vector.
+ * @return The service name, or an empty string for vectors the VM does not implement.
+ */
+static const char* trap_name(unsigned vector) {
+    switch (vector) {
+        case TRAP_GETC: return "GETC";
+        case TRAP_OUT: return "OUT";
+        case TRAP_PUTS: return "PUTS";
+        case TRAP_IN: return "IN";
+        case TRAP_PUTSP: return "PUTSP";
+        case TRAP_HALT: return "HALT";
+        default: return "";
+    }
+}
+
+/**
+ * @brief Formats a count and its share of a total.
+ * @param count The count.
+ * @param total The total; 0 prints a share of 0.
+ * @return The count right-aligned in 12 columns followed by the percentage.
+ */
+static std::string share(std::uint64_t count, std::uint64_t total) {
+    char text[40];
+    std::snprintf(text, sizeof(text), "%12llu %6.2f%%", static_cast<unsigned long long>(count),
+                  total ? 100.0 * static_cast<double>(count) / static_cast<double>(total) : 0.0);
+    return text;
+}
+
+Profile::Profile() : addresses(MEMORY_MAX, 0) {
+    opcodes.fill(0);
+    traps.fill(0);
+}
+
+std::uint64_t Profile::instructions() const {
+    return std::accumulate(opcodes.begin(), opcodes.end(), std::uint64_t(0));
+}
+
+std::vector<std::uint16_t> Profile::hottest(std::size_t count) const {
+    std::vector<std::uint16_t> executed;
+    for (std::uint32_t address = 0; address < MEMORY_MAX; ++address) {
+        if (addresses[address]) executed.push_back(static_cast<std::uint16_t>(address));
+    }
+    auto hotter = [this](std::uint16_t a, std::uint16_t b) {
+        return addresses[a] != addresses[b] ? addresses[a] > addresses[b] : a < b;
+    };
+    count = std::min(count, executed.size());
+    std::partial_sort(executed.begin(), executed.begin() + count, executed.end(), hotter);
+    executed.resize(count);
+    return executed;
+}
+
+void Profile::clear() {
+    std::fill(addresses.begin(), addresses.end(), 0);
+    opcodes.fill(0);
+    traps.fill(0);
+}
+
+void LC3State::set_profiling(bool enabled) {
+    if (!enabled) {
+        profiler.reset();
+    } else if (!profiler) {
+        profiler.reset(new Profile());
+    }
+}
+
+void LC3State::write_profile(std::ostream& out, std::size_t hot) {
+    if (!profiler) {
+        throw std::logic_error("Profiling is not enabled.");
+    }
+    const Profile& profile = *profiler;
+    std::uint64_t total = profile.instructions();
+    char line[96];
+
+    out << "Profile of " << total << " instructions\n\nOpcodes:\n";
+    std::vector<unsigned> ops(16);
+    std::iota(ops.begin(), ops.end(), 0);
+    std::stable_sort(ops.begin(), ops.end(), [&profile](unsigned a, unsigned b) {
+        return profile.opcode(a) > profile.opcode(b);
+    });
+    for (unsigned op : ops) {
+        if (!profile.opcode(op)) break;
+        std::snprintf(line, sizeof(line), "  %-10s", OPCODE_NAMES[op]);
+        out << line << share(profile.opcode(op), total) << '\n';
+    }
+
+    if (profile.opcode(OP_TRAP)) {
+        out << "\nTRAP vectors:\n";
+        for (unsigned vector = 0; vector < 256; ++vector) {
+            if (!profile.trap(static_cast<std::uint8_t>(vector))) continue;
+            std::snprintf(line, sizeof(line), "  x%02x %-5s", vector, trap_name(vector));
+            out << line << share(profile.trap(static_cast<std::uint8_t>(vector)), total) << '\n';
+        }
+    }
+
+    // Group the hottest addresses by the first loaded segment holding them.
+    std::vector<std::uint16_t> addresses = profile.hottest(hot);
+    std::size_t outside = loaded_code_segments.size();
+    std::vector<std::vector<std::uint16_t>> groups(outside + 1);
+    for (std::uint16_t address : addresses) {
+        std::size_t group = outside;
+        for (std::size_t i = 0; i < outside; ++i) {
+            const CodeSegment& segment = loaded_code_segments[i];
+            if (static_cast<std::uint16_t>(address - segment.start_address) < segment.size) {
+                group = i;
+                break;
+            }
+        }
+        groups[group].push_back(address);
+    }
+
+    out << "\nHot addresses:\n";
+    for (std::size_t i = 0; i <= outside; ++i) {
+        if (groups[i].empty()) continue;
+        if (i < outside) {
+            const CodeSegment& segment = loaded_code_segments[i];
+            std::uint64_t in_segment = 0;
+            for (std::uint16_t offset = 0; offset < segment.size; ++offset) {
+                in_segment += profile.at(static_cast<std::uint16_t>(segment.start_address + offset));
+            }
+            std::snprintf(line, sizeof(line), "  Segment 0x%04x-0x%04x (%u words):", segment.start_address,
+                          static_cast<unsigned>(static_cast<std::uint16_t>(segment.start_address + segment.size - 1)),
+                          static_cast<unsigned>(segment.size));
+            out << line << share(in_segment, total) << '\n';
+        } else {
+            out << "  Outside loaded segments:\n";
+        }
+        for (std::uint16_t address : groups[i]) {
+            out << "  " << share(profile.at(address), total) << "  " << disassemble(address) << '\n';
+        }
+    }
+    out.flush();
+}
@@ -0,0 +1,254 @@
+/**
+ * @file replay.cpp
+ * @brief Implements input recording and replay.
+ */
+#include "replay.hpp"
+#include "keyboard.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+/** @brief Magic bytes at the start of every log. */
+static const char RECORD_MAGIC[4] = {'L', 'C', '3', 'R'};
+
+RecordingConsole::RecordingConsole(std::unique_ptr<Console> inner, const std::string& path, std::uint64_t slice)
+    : inner(std::move(inner)), slice_budget(slice) {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to create input log " + path + ": " + std::strerror(errno));
+    }
+    buffer.append(RECORD_MAGIC, sizeof(RECORD_MAGIC));
+    buffer.push_back(static_cast<char>(RECORD_VERSION));
+    for (std::uint64_t value = slice_budget; ; value >>= 7) {
+        if (value < 0x80) {
+            buffer.push_back(static_cast<char>(value));
+            break;
+        }
+        buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    }
+}
+
+RecordingConsole::~RecordingConsole() {
+    // Answers after the last slice end belong to no slice and cannot be replayed.
+    close_full_slices();
+    try {
+        flush();
+    } catch (const std::exception&) {
+        // The log stays truncated; a destructor has nowhere to report it.
+    }
+    ::close(fd);
+}
+
+void RecordingConsole::put(RecordKind kind, std::uint64_t value) {
+    std::uint64_t word = (value << 3) | kind;
+    while (word >= 0x80) {
+        buffer.push_back(static_cast<char>((word & 0x7F) | 0x80));
+        word >>= 7;
+    }
+    buffer.push_back(static_cast<char>(word));
+}
+
+void RecordingConsole::close_run() {
+    if (run_length) {
+        put(run_kind, run_length);
+        run_length = 0;
+    }
+}
+
+void RecordingConsole::close_full_slices() {
+    if (full_slices) {
+        put(REC_FULL_SLICES, full_slices);
+        full_slices = 0;
+    }
+}
+
+void RecordingConsole::note(RecordKind kind) {
+    close_full_slices();
+    ++answers;
+    if (kind != REC_PENDING) ++misses;
+    if (run_length && kind == run_kind) {
+        ++run_length;
+        return;
+    }
+    close_run();
+    run_kind = kind;
+    run_length = 1;
+}
+
+bool RecordingConsole::key_pending() {
+    bool pending = inner->key_pending();
+    note(pending ? REC_PENDING : REC_IDLE);
+    return pending;
+}
+
+bool RecordingConsole::read_key(char& c, bool wait) {
+    if (!inner->read_key(c, wait)) {
+        note(REC_NO_KEY);
+        return false;
+    }
+    close_full_slices();
+    close_run();
+    put(REC_KEY, static_cast<unsigned char>(c));
+    ++answers;
+    keys = true;
+    return true;
+}
+
+void RecordingConsole::end_slice(std::uint64_t instructions) {
+    last_idle = !keys && misses >= KBSR_IDLE_POLLS;
+    if (answers == 0 && instructions == slice_budget) {
+        ++full_slices;
+    } else {
+        close_run();
+        close_full_slices();
+        put(REC_SLICE, instructions);
+    }
+    answers = 0;
+    misses = 0;
+    keys = false;
+    if (buffer.size() >= RECORD_BUFFER_SIZE) {
+        flush();
+    }
+}
+
+void RecordingConsole::flush() {
+    std::size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            buffer.erase(0, written);
+            throw std::runtime_error(std::string("Failed to write input log: ") + std::strerror(errno));
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    buffer.clear();
+}
+
+ReplayConsole::ReplayConsole(const std::string& path, int out_fd) : out_fd(out_fd) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open input log " + path);
+    }
+    log.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (log.size() < sizeof(RECORD_MAGIC) + 1 || log.compare(0, sizeof(RECORD_MAGIC), RECORD_MAGIC, sizeof(RECORD_MAGIC)) != 0) {
+        throw std::runtime_error(path + " is not an input log.");
+    }
+    if (static_cast<unsigned char>(log[sizeof(RECORD_MAGIC)]) != RECORD_VERSION) {
+        throw std::runtime_error(path + " has an unsupported input log version.");
+    }
+    position = sizeof(RECORD_MAGIC) + 1;
+    if (!varint(slice_budget) || slice_budget == 0) {
+        throw std::runtime_error(path + " has a malformed input log header.");
+    }
+}
+
+bool ReplayConsole::varint(std::uint64_t& result) {
+    result = 0;
+    for (unsigned shift = 0; position < log.size() && shift < 64; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(log[position++]);
+        result |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool ReplayConsole::current() {
+    while (remaining == 0) {
+        std::uint64_t word;
+        if (position >= log.size() || !varint(word)) {
+            position = log.size();
+            return false;
+        }
+        kind = static_cast<RecordKind>(word & 7);
+        value = word >> 3;
+        remaining = (kind == REC_KEY || kind == REC_SLICE) ? 1 : value;
+    }
+    return true;
+}
+
+bool ReplayConsole::take(RecordKind expected) {
+    if (divergence || !current() || kind != expected) return false;
+    --remaining;
+    return true;
+}
+
+bool ReplayConsole::finished() const {
+    return remaining == 0 && position >= log.size();
+}
+
+bool ReplayConsole::key_pending() {
+    if (take(REC_PENDING)) return true;
+    if (!take(REC_IDLE)) divergence = true;
+    return false;
+}
+
+bool ReplayConsole::read_key(char& c, bool) {
+    if (take(REC_KEY)) {
+        c = static_cast<char>(value);
+        return true;
+    }
+    if (!take(REC_NO_KEY)) divergence = true;
+    return false;
+}
+
+bool ReplayConsole::end_slice(std::uint64_t instructions) {
+    if (divergence || !current()) {
+        divergence = true;
+    } else if (kind == REC_SLICE && value == instructions) {
+        remaining = 0;
+    } else if (kind == REC_FULL_SLICES && instructions == slice_budget) {
+        --remaining;
+    } else {
+        divergence = true;
+    }
+    return !divergence;
+}
+
+RunResult run_recorded(LC3State& vm, RecordingConsole& console) {
+    RunResult total{StopReason::BudgetExhausted, 0, 0};
+    for (;;) {
+        RunResult slice = vm.run_for(console.slice());
+        console.end_slice(slice.instructions);
+        total.reason = slice.reason;
+        total.fault_pc = slice.fault_pc;
+        total.instructions += slice.instructions;
+        if (slice.reason != StopReason::BudgetExhausted && slice.reason != StopReason::WaitingForInput) {
+            break;
+        }
+        if (slice.reason == StopReason::WaitingForInput || console.idle()) {
+            // Nothing happens until a key arrives; save the log so far while waiting.
+            vm.output.flush();
+            console.flush();
+            console.wait_for_key(std::chrono::milliseconds(KBSR_IDLE_TIMEOUT_MS));
+        }
+    }
+    vm.output.flush();
+    console.flush();
+    return total;
+}
+
+RunResult run_replayed(LC3State& vm, ReplayConsole& console) {
+    RunResult total{StopReason::BudgetExhausted, 0, 0};
+    while (!console.finished()) {
+        RunResult slice = vm.run_for(console.slice());
+        total.reason = slice.reason;
+        total.fault_pc = slice.fault_pc;
+        total.instructions += slice.instructions;
+        if (!console.end_slice(slice.instructions)) {
+            vm.output.flush();
+            throw std::runtime_error("Replay diverged from the input log within " + std::to_string(total.instructions) + " instructions.");
+        }
+        if (slice.reason != StopReason::BudgetExhausted && slice.reason != StopReason::WaitingForInput) {
+            break;
+        }
+    }
+    vm.output.flush();
+    if (!console.finished()) {
+        throw std::runtime_error("The VM stopped after " + std::to_string(total.instructions) + " instructions, before the end of the input log.");
+    }
+    return total;
+}
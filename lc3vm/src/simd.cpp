@@ -0,0 +1,183 @@
+/**
+ * @file simd.cpp
+ * @brief Implements the 16-bit word kernels and their run-time dispatch.
+ *
+ * The SSE2 and AVX2 variants are compiled with per-function target
+ * attributes, so the rest of the program does not depend on AVX2 being
+ * available. All variants handle the elements that do not fill a whole
+ * vector with the scalar code.
+ */
+#include "simd.hpp"
+#include <atomic>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LC3_SIMD_X86 1
+#endif
+
+/**
+ * @brief One implementation of every kernel.
+ */
+struct SimdKernels {
+    SimdLevel level;
+    void (*swap16_copy)(std::uint16_t*, const std::uint16_t*, std::size_t);
+    std::size_t (*mismatch16)(const std::uint16_t*, const std::uint16_t*, std::size_t);
+};
+
+static void swap16_copy_scalar(std::uint16_t* dst, const std::uint16_t* src, std::size_t count) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        std::uint64_t x;
+        std::memcpy(&x, in + 2 * i, sizeof(x));
+        x = ((x & 0x00FF00FF00FF00FFull) << 8) | ((x >> 8) & 0x00FF00FF00FF00FFull);
+        std::memcpy(dst + i, &x, sizeof(x));
+    }
+    for (; i < count; ++i) {
+        std::uint16_t x;
+        std::memcpy(&x, in + 2 * i, sizeof(x));
+        dst[i] = static_cast<std::uint16_t>((x << 8) | (x >> 8));
+    }
+}
+
+static std::size_t mismatch16_scalar(const std::uint16_t* a, const std::uint16_t* b, std::size_t count) {
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        std::uint64_t x, y;
+        std::memcpy(&x, a + i, sizeof(x));
+        std::memcpy(&y, b + i, sizeof(y));
+        if (x != y) break;
+    }
+    for (; i < count; ++i) {
+        if (a[i] != b[i]) return i;
+    }
+    return count;
+}
+
+#ifdef LC3_SIMD_X86
+
+__attribute__((target("sse2")))
+static void swap16_copy_sse2(std::uint16_t* dst, const std::uint16_t* src, std::size_t count) {
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), x);
+    }
+    swap16_copy_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static std::size_t mismatch16_sse2(const std::uint16_t* a, const std::uint16_t* b, std::size_t count) {
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(x, y))) ^ 0xFFFFu;
+        if (mask) return i + __builtin_ctz(mask) / 2;
+    }
+    return i + mismatch16_scalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void swap16_copy_avx2(std::uint16_t* dst, const std::uint16_t* src, std::size_t count) {
+    const __m256i order = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                           1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(x, order));
+    }
+    swap16_copy_sse2(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static std::size_t mismatch16_avx2(const std::uint16_t* a, const std::uint16_t* b, std::size_t count) {
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(x, y)));
+        if (mask) return i + __builtin_ctz(mask) / 2;
+    }
+    return i + mismatch16_sse2(a + i, b + i, count - i);
+}
+
+#endif // LC3_SIMD_X86
+
+static const SimdKernels scalar_kernels = {SimdLevel::Scalar, swap16_copy_scalar, mismatch16_scalar};
+#ifdef LC3_SIMD_X86
+static const SimdKernels sse2_kernels = {SimdLevel::Sse2, swap16_copy_sse2, mismatch16_sse2};
+static const SimdKernels avx2_kernels = {SimdLevel::Avx2, swap16_copy_avx2, mismatch16_avx2};
+#endif
+
+/**
+ * @brief Returns the kernels for a level, or nullptr if the host cannot run them.
+ * @param level The level.
+ * @return The kernel table.
+ */
+static const SimdKernels* kernels_for(SimdLevel level) {
+    switch (level) {
+#ifdef LC3_SIMD_X86
+        case SimdLevel::Avx2:
+            return __builtin_cpu_supports("avx2") ? &avx2_kernels : nullptr;
+        case SimdLevel::Sse2:
+            return __builtin_cpu_supports("sse2") ? &sse2_kernels : nullptr;
+#endif
+        case SimdLevel::Scalar:
+            return &scalar_kernels;
+        default:
+            return nullptr;
+    }
+}
+
+/**
+ * @brief Returns the selected kernels, choosing the best supported ones on first use.
+ * @return The active kernel table.
+ */
+static std::atomic<const SimdKernels*>& active_kernels() {
+    static std::atomic<const SimdKernels*> active([] {
+        for (SimdLevel level : {SimdLevel::Avx2, SimdLevel::Sse2}) {
+            if (const SimdKernels* kernels = kernels_for(level)) return kernels;
+        }
+        return &scalar_kernels;
+    }());
+    return active;
+}
+
+/**
+ * @brief Returns the kernel table currently in use.
+ * @return The kernels.
+ */
+static const SimdKernels& kernels() {
+    return *active_kernels().load(std::memory_order_relaxed);
+}
+
+SimdLevel simd_level() {
+    return kernels().level;
+}
+
+bool simd_supported(SimdLevel level) {
+    return kernels_for(level) != nullptr;
+}
+
+bool set_simd_level(SimdLevel level) {
+    const SimdKernels* selected = kernels_for(level);
+    if (!selected) return false;
+    active_kernels().store(selected, std::memory_order_relaxed);
+    return true;
+}
+
+void swap16_copy(std::uint16_t* dst, const std::uint16_t* src, std::size_t count) {
+    kernels().swap16_copy(dst, src, count);
+}
+
+bool equal16(const std::uint16_t* a, const std::uint16_t* b, std::size_t count) {
+    return kernels().mismatch16(a, b, count) == count;
+}
+
+std::size_t mismatch16(const std::uint16_t* a, const std::uint16_t* b, std::size_t count) {
+    return kernels().mismatch16(a, b, count);
+}
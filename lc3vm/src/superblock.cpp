@@ -0,0 +1,365 @@
+/**
+ * @file superblock.cpp
+ * @brief Implements the superblock translator, its cache and the superblock run loop.
+ */
+#include "superblock.hpp"
+#include "lc3.hpp"
+#include "registers.hpp"
+#include "opcodes.hpp"
+#include "flags.hpp"
+#include <algorithm>
+
+/**
+ * @brief Checks whether an opcode ends a superblock.
+ * @param op The opcode.
+ * @return true for BR, JMP, JSR, TRAP and the illegal RTI/RES opcodes.
+ */
+static bool ends_block(unsigned op) {
+    switch (op) {
+        case OP_BR:
+        case OP_JMP:
+        case OP_JSR:
+        case OP_TRAP:
+        case OP_RTI:
+        case OP_RES:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Block* BlockCache::translate(Memory& memory, std::uint16_t address) {
+    std::unique_ptr<Block> block(new Block{});
+    block->start = address;
+
+    std::uint16_t pc = address;
+    do {
+        if (memory.is_device(pc)) break;
+
+        DecodedInstruction d = LC3State::decode(memory.memory[pc]);
+        std::uint16_t next_pc = pc + 1;
+        switch (d.op) {
+            case OP_BR:
+            case OP_LD:
+            case OP_ST:
+            case OP_LDI:
+            case OP_STI:
+            case OP_LEA:
+                d.imm = next_pc + d.imm;
+                break;
+            case OP_JSR:
+                if (d.mode) d.imm = next_pc + d.imm;
+                break;
+            default:
+                break;
+        }
+        block->ops.push_back(d);
+        pc = next_pc;
+
+        if (ends_block(d.op)) {
+            block->terminated = true;
+            break;
+        }
+    } while (block->ops.size() < SUPERBLOCK_MAX_LENGTH && pc != 0);
+
+    block->length = static_cast<std::uint16_t>(block->ops.size());
+    block->exit_pc[EXIT_FALLTHROUGH] = pc;
+    const DecodedInstruction& last = block->ops.back();
+    if (block->terminated && (last.op == OP_BR || (last.op == OP_JSR && last.mode))) {
+        block->exit_pc[EXIT_TAKEN] = last.imm;
+    }
+
+    unsigned first_page = address >> MEMORY_PAGE_SHIFT;
+    unsigned last_page = static_cast<std::uint16_t>(address + block->length - 1) >> MEMORY_PAGE_SHIFT;
+    memory.mark_code(address);
+    coverage[first_page].push_back(block.get());
+    if (last_page != first_page) {
+        memory.mark_code(static_cast<std::uint16_t>(address + block->length - 1));
+        coverage[last_page].push_back(block.get());
+    }
+
+    auto& page = starts[first_page];
+    if (!page) {
+        page.reset(new std::unique_ptr<Block>[MEMORY_PAGE_SIZE]());
+    }
+    auto& slot = page[address & MEMORY_PAGE_MASK];
+    if (slot) {
+        retired.push_back(std::move(slot));
+    }
+    slot = std::move(block);
+    return slot.get();
+}
+
+void BlockCache::invalidate(std::uint16_t address) {
+    auto& list = coverage[address >> MEMORY_PAGE_SHIFT];
+    bool removed = false;
+
+    for (std::size_t i = 0; i < list.size();) {
+        Block* block = list[i];
+        if (static_cast<std::uint16_t>(address - block->start) >= block->length) {
+            ++i;
+            continue;
+        }
+
+        unsigned first_page = block->start >> MEMORY_PAGE_SHIFT;
+        unsigned last_page = static_cast<std::uint16_t>(block->start + block->length - 1) >> MEMORY_PAGE_SHIFT;
+        for (unsigned p : {first_page, last_page}) {
+            auto& covering = coverage[p];
+            covering.erase(std::remove(covering.begin(), covering.end(), block), covering.end());
+        }
+        retired.push_back(std::move(starts[first_page][block->start & MEMORY_PAGE_MASK]));
+        removed = true;
+    }
+
+    if (removed) {
+        unchain_all();
+        invalidated = true;
+    }
+}
+
+void BlockCache::unchain_all() {
+    for (auto& list : coverage) {
+        for (Block* block : list) {
+            block->next[EXIT_FALLTHROUGH] = nullptr;
+            block->next[EXIT_TAKEN] = nullptr;
+        }
+    }
+}
+
+void BlockCache::drop_native() {
+    for (auto& list : coverage) {
+        for (Block* block : list) {
+            block->native = nullptr;
+            block->executions = 0;
+        }
+    }
+}
+
+void BlockCache::clear() {
+    for (auto& page : starts) {
+        page.reset();
+    }
+    for (auto& list : coverage) {
+        list.clear();
+    }
+    retired.clear();
+    invalidated = false;
+}
+
+/**
+ * @brief Checks whether compiling a hot block can pay for entering native code.
+ * @param block The block.
+ * @return true if it is at least JIT_MIN_LENGTH long or branches back to its own start.
+ */
+static bool worth_compiling(const Block& block) {
+    if (block.length >= JIT_MIN_LENGTH) return true;
+    return block.terminated && block.ops.back().op == OP_BR && block.exit_pc[EXIT_TAKEN] == block.start;
+}
+
+std::uint64_t LC3State::run_superblocks(std::uint64_t budget) {
+    std::uint16_t r[R_COUNT];
+    std::uint64_t remaining = budget;
+    std::copy(reg.begin(), reg.end(), r);
+
+#define SYNC_OUT() std::copy(r, r + R_COUNT, reg.begin())
+#define SYNC_IN() std::copy(reg.begin(), reg.end(), r)
+
+    const bool use_jit = execution_mode == ExecutionMode::Jit;
+    if (use_jit && !jit) {
+        jit.reset(new JitCompiler());
+    }
+    JitContext jit_context{};
+    jit_context.memory = memory.memory;
+    jit_context.page_flags = memory.page_flag_table();
+    jit_context.state = this;
+
+    block_cache.collect();
+    block_cache.take_invalidated();
+    Block* block = nullptr;
+
+    for (;;) {
+        if (!block) {
+            block_cache.collect();
+            if (memory.is_device(r[R_PC])) {
+                if (remaining == 0) break;
+                SYNC_OUT();
+                execute_one();
+                if (!running) {
+                    if (stop_reason == StopReason::Halted) --remaining;
+                    return budget - remaining;
+                }
+                --remaining;
+                SYNC_IN();
+                continue;
+            }
+            block = block_cache.lookup(r[R_PC]);
+            if (!block) block = block_cache.translate(memory, r[R_PC]);
+        }
+
+        if (block->length > remaining) {
+            // Too little budget left for a whole block: finish one instruction at a time.
+            SYNC_OUT();
+            while (remaining > 0) {
+                execute_one();
+                if (!running) {
+                    if (stop_reason == StopReason::Halted) --remaining;
+                    return budget - remaining;
+                }
+                --remaining;
+            }
+            return budget;
+        }
+
+        Block* current = block;
+        block = nullptr;
+        remaining -= current->length;
+        const DecodedInstruction* ops = current->ops.data();
+        const DecodedInstruction* body_end = ops + current->length - (current->terminated ? 1 : 0);
+        int exit = EXIT_FALLTHROUGH;
+
+        if (use_jit && !current->native && current->executions < JIT_HOT_THRESHOLD &&
+            ++current->executions == JIT_HOT_THRESHOLD && worth_compiling(*current)) {
+            current->native = jit->compile(*current);
+            if (!current->native && jit->available()) {
+                // The arena is full: start over with an empty one.
+                block_cache.drop_native();
+                jit->reset();
+                current->native = jit->compile(*current);
+            }
+        }
+
+        if (current->native) {
+            std::uint32_t loop_budget = static_cast<std::uint32_t>(
+                std::min<std::uint64_t>(JIT_LOOP_BUDGET, remaining / current->length + 1));
+            std::copy(r, r + R_COUNT, jit_context.reg);
+            jit_context.loop_budget = loop_budget;
+            std::uint32_t result = current->native(&jit_context);
+            std::copy(jit_context.reg, jit_context.reg + R_COUNT, r);
+            // The length charged up front stands for the final pass; loop_budget
+            // counts the passes before it that ended in a back-edge.
+            remaining += current->length;
+            remaining -= static_cast<std::uint64_t>(loop_budget - jit_context.loop_budget) * current->length + (result >> 2);
+            switch (result & 3) {
+                case JIT_EXIT_FALLTHROUGH:
+                    goto chain;
+                case JIT_EXIT_TAKEN:
+                    exit = EXIT_TAKEN;
+                    goto chain;
+                case JIT_EXIT_DYNAMIC:
+                    continue;
+                default:
+                    goto terminator;
+            }
+        }
+
+        {
+            bool left_early = false;
+            for (const DecodedInstruction* d = ops; d != body_end; ++d) {
+                switch (d->op) {
+                    case OP_ADD:
+                        r[d->dr] = r[d->sr1] + (d->mode ? d->imm : r[d->sr2]);
+                        r[R_COND] = flag_for(r[d->dr]);
+                        break;
+                    case OP_AND:
+                        r[d->dr] = r[d->sr1] & (d->mode ? d->imm : r[d->sr2]);
+                        r[R_COND] = flag_for(r[d->dr]);
+                        break;
+                    case OP_NOT:
+                        r[d->dr] = ~r[d->sr1];
+                        r[R_COND] = flag_for(r[d->dr]);
+                        break;
+                    case OP_LD:
+                        r[d->dr] = memory.read(d->imm);
+                        r[R_COND] = flag_for(r[d->dr]);
+                        break;
+                    case OP_LDI:
+                        r[d->dr] = memory.read(memory.read(d->imm));
+                        r[R_COND] = flag_for(r[d->dr]);
+                        break;
+                    case OP_LDR:
+                        r[d->dr] = memory.read(r[d->sr1] + d->imm);
+                        r[R_COND] = flag_for(r[d->dr]);
+                        break;
+                    case OP_LEA:
+                        r[d->dr] = d->imm;
+                        r[R_COND] = flag_for(r[d->dr]);
+                        break;
+                    case OP_ST:
+                        memory.write(d->imm, r[d->dr]);
+                        left_early = block_cache.take_invalidated();
+                        break;
+                    case OP_STI:
+                        memory.write(memory.read(d->imm), r[d->dr]);
+                        left_early = block_cache.take_invalidated();
+                        break;
+                    case OP_STR:
+                        memory.write(r[d->sr1] + d->imm, r[d->dr]);
+                        left_early = block_cache.take_invalidated();
+                        break;
+                    default:
+                        break;
+                }
+                if (left_early) {
+                    // A store replaced translated code; resume from a fresh lookup.
+                    std::uint16_t done = static_cast<std::uint16_t>(d - ops) + 1;
+                    r[R_PC] = current->start + done;
+                    remaining += current->length - done;
+                    break;
+                }
+            }
+            if (left_early) continue;
+        }
+
+    terminator:
+        if (current->terminated) {
+            const DecodedInstruction& t = *body_end;
+            std::uint16_t return_pc = current->exit_pc[EXIT_FALLTHROUGH];
+            switch (t.op) {
+                case OP_BR:
+                    if (t.dr & r[R_COND]) exit = EXIT_TAKEN;
+                    break;
+                case OP_JSR:
+                    r[R_R7] = return_pc;
+                    if (t.mode) {
+                        exit = EXIT_TAKEN;
+                        break;
+                    }
+                    r[R_PC] = r[t.sr1];
+                    continue;
+                case OP_JMP:
+                    r[R_PC] = r[t.sr1];
+                    continue;
+                case OP_TRAP:
+                    r[R_PC] = return_pc;
+                    SYNC_OUT();
+                    exec<OP_TRAP>(*this, t);
+                    if (!running) {
+                        if (stop_reason != StopReason::Halted) ++remaining;
+                        return budget - remaining;
+                    }
+                    SYNC_IN();
+                    break;
+                default:
+                    r[R_PC] = return_pc;
+                    SYNC_OUT();
+                    t.handler(*this, t);
+                    return budget - remaining - 1;
+            }
+        }
+
+    chain:
+        r[R_PC] = current->exit_pc[exit];
+        block = current->next[exit];
+        if (!block && !memory.is_device(r[R_PC])) {
+            block = block_cache.lookup(r[R_PC]);
+            if (!block) block = block_cache.translate(memory, r[R_PC]);
+            current->next[exit] = block;
+        }
+    }
+
+    SYNC_OUT();
+    return budget;
+
+#undef SYNC_OUT
+#undef SYNC_IN
+}
@@ -0,0 +1,237 @@
+/**
+ * @file threaded_dispatch.cpp
+ * @brief Implements the threaded-code run loop of the LC-3 virtual machine.
+ *
+ * The loop executes decoded instructions straight out of the decode cache and
+ * keeps the register file in a local array, so stores through Memory cannot
+ * force it to be reloaded. With GCC and Clang each handler jumps directly to
+ * the next one through a table of label addresses; other compilers get an
+ * equivalent switch inside a loop.
+ *
+ * The instruction budget is not checked per instruction. Between control
+ * transfers the PC advances by one per instruction, so the number retired
+ * since the last checkpoint is the distance from a mark to the PC, with
+ * words skipped by forward branches added to the mark. Taken backward
+ * branches, JMP, JSR and TRAP charge that distance to the budget and move
+ * the mark; so does fetching the last word of memory, which fetch() never
+ * caches, so a run wrapping around memory is charged too. Until the next
+ * checkpoint at most MEMORY_MAX instructions can retire, so once less than
+ * that remains the loop switches to checking the distance before every
+ * instruction, keeping run_for() exact.
+ */
+#include "lc3.hpp"
+#include "registers.hpp"
+#include "opcodes.hpp"
+#include "flags.hpp"
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__GNUC__) && !defined(LC3_NO_COMPUTED_GOTO)
+#define LC3_COMPUTED_GOTO 1
+#else
+#define LC3_COMPUTED_GOTO 0
+#endif
+
+std::uint64_t LC3State::run_threaded(std::uint64_t budget) {
+    std::uint16_t r[R_COUNT];
+    std::copy(reg.begin(), reg.end(), r);
+
+    const DecodedInstruction* d;
+    // Budget left at the last checkpoint; budgets beyond INT64_MAX are effectively unbounded.
+    std::int64_t remaining = budget > INT64_MAX ? INT64_MAX : static_cast<std::int64_t>(budget);
+    const std::int64_t initial = remaining;
+    std::uint16_t mark = r[R_PC];
+
+// Instructions retired since the last checkpoint, the one just fetched included.
+#define SINCE_MARK() static_cast<std::uint16_t>(r[R_PC] - mark)
+
+#define CHECKPOINT()                                            \
+    do {                                                        \
+        remaining -= SINCE_MARK();                              \
+        mark = r[R_PC];                                         \
+        if (remaining < MEMORY_MAX) EXACT();                    \
+    } while (0)
+
+// Charges up to the last word of memory, included, before the PC wraps to 0.
+#define WRAP()                                                  \
+    do {                                                        \
+        remaining -= SINCE_MARK() + 1;                          \
+        mark = 0;                                               \
+        if (remaining < MEMORY_MAX) EXACT();                    \
+    } while (0)
+
+#define FETCH()                                                 \
+    do {                                                        \
+        d = decode_cache.lookup(r[R_PC]);                       \
+        if (!d) {                                               \
+            d = &fetch(r[R_PC]);                                \
+            if (r[R_PC] == MEMORY_MAX - 1) WRAP();              \
+        }                                                       \
+        r[R_PC]++;                                              \
+    } while (0)
+
+// Leaves the PC on the fetched instruction if it would overrun the budget.
+#define CHECK_BUDGET()                                          \
+    do {                                                        \
+        if (SINCE_MARK() > remaining) {                         \
+            r[R_PC]--;                                          \
+            goto out_of_budget;                                 \
+        }                                                       \
+    } while (0)
+
+#define SYNC_OUT() std::copy(r, r + R_COUNT, reg.begin())
+#define SYNC_IN() std::copy(reg.begin(), reg.end(), r)
+
+#if LC3_COMPUTED_GOTO
+    static void* const dispatch_table[16] = {
+        &&L_OP_BR, &&L_OP_ADD, &&L_OP_LD, &&L_OP_ST,
+        &&L_OP_JSR, &&L_OP_AND, &&L_OP_LDR, &&L_OP_STR,
+        &&L_OP_ILLEGAL, &&L_OP_NOT, &&L_OP_LDI, &&L_OP_STI,
+        &&L_OP_JMP, &&L_OP_ILLEGAL, &&L_OP_LEA, &&L_OP_TRAP
+    };
+    // Dispatching through this table instead checks the budget first.
+    static void* const checked_table[16] = {
+        &&checked, &&checked, &&checked, &&checked, &&checked, &&checked, &&checked, &&checked,
+        &&checked, &&checked, &&checked, &&checked, &&checked, &&checked, &&checked, &&checked
+    };
+    void* const* table = remaining < MEMORY_MAX ? checked_table : dispatch_table;
+#define EXACT() table = checked_table
+#define CASE(op) L_##op:
+#define NEXT()                                                  \
+    do {                                                        \
+        FETCH();                                                \
+        goto *table[d->op];                                     \
+    } while (0)
+
+    NEXT();
+checked:
+    CHECK_BUDGET();
+    goto *dispatch_table[d->op];
+#else
+    bool exact = remaining < MEMORY_MAX;
+#define EXACT() exact = true
+#define CASE(op) case op:
+#define NEXT() continue
+
+    for (;;) {
+        FETCH();
+        if (exact) CHECK_BUDGET();
+        switch (d->op) {
+#endif
+
+    CASE(OP_BR)
+        if (d->dr & r[R_COND]) {
+            std::uint16_t target = r[R_PC] + d->imm;
+            if (target > r[R_PC]) {
+                mark += d->imm;
+                r[R_PC] = target;
+            } else {
+                CHECKPOINT();
+                r[R_PC] = mark = target;
+            }
+        }
+        NEXT();
+
+    CASE(OP_ADD)
+        r[d->dr] = r[d->sr1] + (d->mode ? d->imm : r[d->sr2]);
+        r[R_COND] = flag_for(r[d->dr]);
+        NEXT();
+
+    CASE(OP_AND)
+        r[d->dr] = r[d->sr1] & (d->mode ? d->imm : r[d->sr2]);
+        r[R_COND] = flag_for(r[d->dr]);
+        NEXT();
+
+    CASE(OP_NOT)
+        r[d->dr] = ~r[d->sr1];
+        r[R_COND] = flag_for(r[d->dr]);
+        NEXT();
+
+    CASE(OP_LD)
+        r[d->dr] = memory.read(r[R_PC] + d->imm);
+        r[R_COND] = flag_for(r[d->dr]);
+        NEXT();
+
+    CASE(OP_LDI)
+        r[d->dr] = memory.read(memory.read(r[R_PC] + d->imm));
+        r[R_COND] = flag_for(r[d->dr]);
+        NEXT();
+
+    CASE(OP_LDR)
+        r[d->dr] = memory.read(r[d->sr1] + d->imm);
+        r[R_COND] = flag_for(r[d->dr]);
+        NEXT();
+
+    CASE(OP_LEA)
+        r[d->dr] = r[R_PC] + d->imm;
+        r[R_COND] = flag_for(r[d->dr]);
+        NEXT();
+
+    CASE(OP_ST)
+        memory.write(r[R_PC] + d->imm, r[d->dr]);
+        NEXT();
+
+    CASE(OP_STI)
+        memory.write(memory.read(r[R_PC] + d->imm), r[d->dr]);
+        NEXT();
+
+    CASE(OP_STR)
+        memory.write(r[d->sr1] + d->imm, r[d->dr]);
+        NEXT();
+
+    CASE(OP_JMP)
+        CHECKPOINT();
+        r[R_PC] = mark = r[d->sr1];
+        NEXT();
+
+    CASE(OP_JSR)
+        CHECKPOINT();
+        r[R_R7] = r[R_PC];
+        r[R_PC] = mark = d->mode ? static_cast<std::uint16_t>(r[R_PC] + d->imm) : r[d->sr1];
+        NEXT();
+
+    CASE(OP_TRAP)
+        CHECKPOINT();
+        SYNC_OUT();
+        exec<OP_TRAP>(*this, *d);
+        if (!running) {
+            // Only a HALT retires; faults and waits for input do not count.
+            if (stop_reason != StopReason::Halted) ++remaining;
+            return static_cast<std::uint64_t>(initial - remaining);
+        }
+        SYNC_IN();
+        mark = r[R_PC];
+        NEXT();
+
+#if LC3_COMPUTED_GOTO
+    L_OP_ILLEGAL:
+#else
+    case OP_RTI:
+    case OP_RES:
+    default:
+#endif
+        CHECKPOINT();
+        SYNC_OUT();
+        d->handler(*this, *d);
+        return static_cast<std::uint64_t>(initial - remaining - 1);
+
+#if !LC3_COMPUTED_GOTO
+        }
+    }
+#endif
+
+out_of_budget:
+    SYNC_OUT();
+    return static_cast<std::uint64_t>(initial);
+
+#undef SINCE_MARK
+#undef EXACT
+#undef CHECKPOINT
+#undef WRAP
+#undef FETCH
+#undef CHECK_BUDGET
+#undef SYNC_OUT
+#undef SYNC_IN
+#undef CASE
+#undef NEXT
+}
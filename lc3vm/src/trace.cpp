@@ -0,0 +1,251 @@
+/**
+ * @file trace.cpp
+ * @brief Implements the execution trace writer and reader.
+ */
+#include "trace.hpp"
+#include "flags.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+/** @brief Magic bytes at the start of every trace. */
+static const char TRACE_MAGIC[4] = {'L', 'C', '3', 'T'};
+
+/** @brief Upper bound of the encoded size of one instruction, including a sync record. */
+#define TRACE_MAX_RECORD 64
+
+/**
+ * @brief Maps a condition flag to its code in the flags byte.
+ * @param cond FL_POS, FL_ZRO or FL_NEG.
+ * @return 1, 2 or 3.
+ */
+static std::uint8_t cond_code(std::uint16_t cond) {
+    switch (cond) {
+        case FL_POS: return 1;
+        case FL_ZRO: return 2;
+        default: return 3;
+    }
+}
+
+TraceWriter::TraceWriter(const std::string& path) : words(MEMORY_MAX, 0), seen(MEMORY_MAX, false) {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to create trace " + path + ": " + std::strerror(errno));
+    }
+    active.reserve(TRACE_CHUNK_SIZE);
+    pending.reserve(TRACE_CHUNK_SIZE);
+    active.insert(active.end(), TRACE_MAGIC, TRACE_MAGIC + sizeof(TRACE_MAGIC));
+    active.push_back(TRACE_VERSION);
+    writer = std::thread(&TraceWriter::drain, this);
+}
+
+TraceWriter::~TraceWriter() {
+    try {
+        close();
+    } catch (const std::exception&) {
+        // The trace stays truncated; a destructor has nowhere to report it.
+    }
+}
+
+void TraceWriter::put_delta(std::uint16_t difference) {
+    std::int16_t signed_difference = static_cast<std::int16_t>(difference);
+    std::uint32_t zigzag = signed_difference < 0 ? ((~static_cast<std::uint32_t>(signed_difference)) << 1) | 1
+                                                 : static_cast<std::uint32_t>(signed_difference) << 1;
+    while (zigzag >= 0x80) {
+        active.push_back(static_cast<std::uint8_t>(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    active.push_back(static_cast<std::uint8_t>(zigzag));
+}
+
+void TraceWriter::put_word(std::uint16_t word) {
+    active.push_back(static_cast<std::uint8_t>(word >> 8));
+    active.push_back(static_cast<std::uint8_t>(word));
+}
+
+void TraceWriter::record(std::uint16_t word, const std::array<std::uint16_t, R_COUNT>& before,
+                         const std::array<std::uint16_t, R_COUNT>& after,
+                         bool stored, std::uint16_t address, std::uint16_t value) {
+    if (fd == -1) return;
+    if (active.size() + TRACE_MAX_RECORD > TRACE_CHUNK_SIZE) {
+        submit();
+    }
+
+    if (!synced || before != last) {
+        active.push_back(TRACE_SYNC);
+        for (std::uint16_t r : before) put_word(r);
+        synced = true;
+    }
+
+    std::uint16_t pc = before[R_PC];
+    std::uint16_t next_pc = pc + 1;
+    std::uint8_t changed = 0;
+    for (unsigned r = R_R0; r <= R_R7; ++r) {
+        if (after[r] != before[r]) changed |= static_cast<std::uint8_t>(1u << r);
+    }
+    std::uint8_t flags = 0;
+    if (after[R_PC] != next_pc) flags |= TRACE_BRANCH;
+    if (!seen[pc] || words[pc] != word) flags |= TRACE_WORD;
+    if (changed) flags |= TRACE_REGISTERS;
+    if (stored) flags |= TRACE_STORE;
+    if (after[R_COND] != before[R_COND]) flags |= cond_code(after[R_COND]) << TRACE_COND_SHIFT;
+
+    active.push_back(flags);
+    if (flags & TRACE_BRANCH) put_delta(after[R_PC] - next_pc);
+    if (flags & TRACE_WORD) {
+        put_word(word);
+        words[pc] = word;
+        seen[pc] = true;
+    }
+    if (changed) {
+        active.push_back(changed);
+        for (unsigned r = R_R0; r <= R_R7; ++r) {
+            if (changed & (1u << r)) put_delta(after[r] - before[r]);
+        }
+    }
+    if (stored) {
+        put_delta(address - last_store);
+        put_word(value);
+        last_store = address;
+    }
+    last = after;
+    ++count;
+}
+
+void TraceWriter::submit() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return !pending_full; });
+    active.swap(pending);
+    pending_full = true;
+    changed.notify_all();
+    active.clear();
+}
+
+void TraceWriter::drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        changed.wait(lock, [this] { return pending_full || closing; });
+        if (!pending_full) return;
+
+        // The VM does not touch pending until pending_full is cleared.
+        lock.unlock();
+        std::size_t written = 0;
+        std::string failure;
+        while (written < pending.size()) {
+            ssize_t n = ::write(fd, pending.data() + written, pending.size() - written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                failure = std::strerror(errno);
+                break;
+            }
+            written += static_cast<std::size_t>(n);
+        }
+        pending.clear();
+        lock.lock();
+
+        if (!failure.empty() && error.empty()) error = "Failed to write trace: " + failure;
+        pending_full = false;
+        changed.notify_all();
+    }
+}
+
+void TraceWriter::close() {
+    if (fd == -1) return;
+    if (!active.empty()) submit();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    changed.notify_all();
+    writer.join();
+    ::close(fd);
+    fd = -1;
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
+
+TraceReader::TraceReader(const std::string& path) : file(path, std::ios::binary), words(MEMORY_MAX, 0) {
+    if (!file) {
+        throw std::runtime_error("Failed to open trace " + path);
+    }
+    char header[sizeof(TRACE_MAGIC) + 1];
+    if (!file.read(header, sizeof(header)) || std::memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        throw std::runtime_error(path + " is not a trace.");
+    }
+    if (static_cast<std::uint8_t>(header[sizeof(TRACE_MAGIC)]) != TRACE_VERSION) {
+        throw std::runtime_error(path + " has an unsupported trace version.");
+    }
+}
+
+std::uint8_t TraceReader::byte() {
+    int c = file.get();
+    if (c == std::char_traits<char>::eof()) {
+        throw std::runtime_error("The trace ends inside a record.");
+    }
+    return static_cast<std::uint8_t>(c);
+}
+
+std::uint16_t TraceReader::delta() {
+    std::uint32_t zigzag = 0;
+    for (unsigned shift = 0; ; shift += 7) {
+        std::uint8_t b = byte();
+        if (shift > 14) throw std::runtime_error("The trace holds an oversized difference.");
+        zigzag |= static_cast<std::uint32_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+    }
+    std::uint32_t magnitude = zigzag >> 1;
+    return static_cast<std::uint16_t>((zigzag & 1) ? ~magnitude : magnitude);
+}
+
+std::uint16_t TraceReader::word() {
+    std::uint16_t high = byte();
+    return static_cast<std::uint16_t>((high << 8) | byte());
+}
+
+bool TraceReader::next(TraceEvent& event) {
+    int c = file.get();
+    if (c == std::char_traits<char>::eof()) return false;
+    std::uint8_t flags = static_cast<std::uint8_t>(c);
+
+    if (flags == TRACE_SYNC) {
+        for (auto& r : registers) r = word();
+        synced = true;
+        flags = byte();
+    }
+    if (!synced || flags == TRACE_SYNC) {
+        throw std::runtime_error("The trace is malformed.");
+    }
+
+    std::uint16_t pc = registers[R_PC];
+    event.pc = pc;
+    registers[R_PC] = pc + 1;
+    if (flags & TRACE_BRANCH) registers[R_PC] += delta();
+    if (flags & TRACE_WORD) words[pc] = word();
+    event.word = words[pc];
+    event.changed = 0;
+    if (flags & TRACE_REGISTERS) {
+        event.changed = byte();
+        for (unsigned r = R_R0; r <= R_R7; ++r) {
+            if (event.changed & (1u << r)) registers[r] += delta();
+        }
+    }
+    switch ((flags & TRACE_COND_MASK) >> TRACE_COND_SHIFT) {
+        case 1: registers[R_COND] = FL_POS; break;
+        case 2: registers[R_COND] = FL_ZRO; break;
+        case 3: registers[R_COND] = FL_NEG; break;
+        default: break;
+    }
+    event.stored = (flags & TRACE_STORE) != 0;
+    event.address = 0;
+    event.value = 0;
+    if (event.stored) {
+        last_store += delta();
+        event.address = last_store;
+        event.value = word();
+    }
+    event.registers = registers;
+    return true;
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include "assembler.hpp"
+#include "headless.hpp"
+#include "lc3.hpp"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/** The echo loop of test_headless.cpp, written as source. */
+static const char* ECHO_SOURCE = R"(
+; Echo keys until 'q'.
+        .ORIG x3000
+        LD R2, MINUS_Q
+LOOP    GETC            ; read a key
+        OUT
+        ADD R1, R0, R2
+        BRnp LOOP
+        HALT
+        .FILL 0
+MINUS_Q .FILL #-113
+        .END
+)";
+
+TEST(AssemblerTest, MatchesHandEncodedProgram) {
+    AssembledProgram program = assemble(ECHO_SOURCE);
+
+    ASSERT_EQ(program.segments.size(), 1u);
+    EXPECT_EQ(program.segments[0].origin, 0x3000);
+    EXPECT_EQ(program.segments[0].words,
+              (std::vector<std::uint16_t>{0x2406, 0xF020, 0xF021, 0x1202, 0x0BFC, 0xF025, 0x0000, 0xFF8F}));
+    EXPECT_EQ(program.symbols.at("LOOP"), 0x3001);
+    EXPECT_EQ(program.symbols.at("MINUS_Q"), 0x3007);
+}
+
+TEST(AssemblerTest, EncodesEveryOpcode) {
+    AssembledProgram program = assemble(
+        ".orig x3000\n"
+        "start: add r1, r2, r3\n"
+        "  ADD R1, R2, #-16\n"
+        "  AND R7, R0, x0F\n"
+        "  NOT R4, R5\n"
+        "  BR start\n"
+        "  BRz start\n"
+        "  JMP R3\n"
+        "  RET\n"
+        "  JSR start\n"
+        "  JSRR R6\n"
+        "  LD R0, #5\n"
+        "  LDI R1, start\n"
+        "  LDR R2, R3, #-32\n"
+        "  LEA R3, 0x10\n"
+        "  ST R4, start\n"
+        "  STI R5, #-1\n"
+        "  STR R6, R7, #31\n"
+        "  TRAP x25\n"
+        "  RTI\n"
+        "  PUTS\n"
+        "  IN\n"
+        "  PUTSP\n"
+        ".END\n");
+
+    ASSERT_EQ(program.segments.size(), 1u);
+    EXPECT_EQ(program.segments[0].words, (std::vector<std::uint16_t>{
+        0x1283, 0x12B0, 0x5E2F, 0x997F, 0x0FFB, 0x05FA, 0xC0C0, 0xC1C0,
+        0x4FF7, 0x4180, 0x2005, 0xA3F4, 0x64E0, 0xE610, 0x39F1, 0xBBFF,
+        0x7DDF, 0xF025, 0x8000, 0xF022, 0xF023, 0xF024}));
+}
+
+TEST(AssemblerTest, LaysOutDirectivesAndSegments) {
+    AssembledProgram program = assemble(
+        ".ORIG x4000\n"
+        "TEXT .STRINGZ \"a\\n\\\"b\\\\\"\n"
+        "GAP .BLKW 3\n"
+        "PTR .FILL TEXT\n"
+        "TOP .FILL xFFFF\n"
+        ".END\n"
+        "; a second block\n"
+        ".ORIG x40FF\n"
+        "  LEA R0, TEXT\n"
+        ".END\n");
+
+    ASSERT_EQ(program.segments.size(), 2u);
+    EXPECT_EQ(program.segments[0].origin, 0x4000);
+    EXPECT_EQ(program.segments[0].words, (std::vector<std::uint16_t>{
+        'a', '\n', '"', 'b', '\\', 0, 0, 0, 0, 0x4000, 0xFFFF}));
+    EXPECT_EQ(program.symbols.at("GAP"), 0x4006);
+    EXPECT_EQ(program.symbols.at("PTR"), 0x4009);
+    ASSERT_EQ(program.segments[1].origin, 0x40FF);
+    EXPECT_EQ(program.segments[1].words, (std::vector<std::uint16_t>{0xE000 | (-0x100 & 0x1FF)}));
+    // Labels in other blocks are visible, but x4000 is out of LEA's reach from x5000.
+    EXPECT_THROW(assemble(".ORIG x5000\nLEA R0, FAR\n.END\n.ORIG x4000\nFAR .FILL 0\n.END\n"), std::runtime_error);
+}
+
+TEST(AssemblerTest, ReportsErrorsWithLineNumbers) {
+    auto error = [](const std::string& source) {
+        try {
+            assemble(source);
+        } catch (const std::runtime_error& e) {
+            return std::string(e.what());
+        }
+        return std::string("no error");
+    };
+
+    EXPECT_EQ(error(".ORIG x3000\nFOO R1\n.END\n").rfind("line 2:", 0), 0u);
+    EXPECT_EQ(error(".ORIG x3000\nADD R1, R2\n.END\n").rfind("line 2:", 0), 0u);
+    EXPECT_EQ(error(".ORIG x3000\nADD R1, R2, #16\n.END\n").rfind("line 2:", 0), 0u);
+    EXPECT_EQ(error(".ORIG x3000\n\nBR NOWHERE\n.END\n").rfind("line 3:", 0), 0u);
+    EXPECT_EQ(error(".ORIG x3000\nA HALT\nA HALT\n.END\n").rfind("line 3:", 0), 0u);
+    EXPECT_EQ(error("HALT\n").rfind("line 1:", 0), 0u);
+    EXPECT_EQ(error(".ORIG xFFFF\nHALT\nHALT\n.END\n").rfind("line 3:", 0), 0u);
+    EXPECT_EQ(error(".ORIG x3000\n.STRINGZ \"open\n.END\n").rfind("line 2:", 0), 0u);
+    EXPECT_EQ(error(".ORIG x3000\nLDR R1, R8, #0\n.END\n").rfind("line 2:", 0), 0u);
+    EXPECT_EQ(error(".ORIG x3000\nHALT\n.END\n"), "no error");
+}
+
+TEST(AssemblerTest, AssemblesLargeProgramsQuickly) {
+    // 30000 labelled instructions, each branching to the one 100 back.
+    std::string source = ".ORIG x1000\n";
+    for (int i = 0; i < 30000; ++i) {
+        source += "L" + std::to_string(i) + " ADD R1, R1, #1\n";
+        source += "  BRnzp L" + std::to_string(i < 100 ? i : i - 100) + " ; back\n";
+    }
+    source += "  HALT\n.END\n";
+
+    auto start = std::chrono::steady_clock::now();
+    AssembledProgram program = assemble(source);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ASSERT_EQ(program.segments[0].words.size(), 60001u);
+    EXPECT_EQ(program.symbols.size(), 30000u);
+    EXPECT_EQ(program.segments[0].words[1], 0x0FFE);            // BRnzp L0 from L0
+    EXPECT_EQ(program.segments[0].words[2 * 250 + 1], 0x0E00 | (-202 & 0x1FF));
+    EXPECT_LT(seconds, 1.0);
+}
+
+TEST(AssemblerTest, WritesLoadableObjectsAndRuns) {
+    AssembledProgram program = assemble(ECHO_SOURCE);
+    char object[] = "/tmp/lc3_asm_XXXXXX";
+    int fd = mkstemp(object);
+    ASSERT_NE(fd, -1);
+    close(fd);
+    write_object(program.segments[0], object);
+
+    LC3State loaded;
+    loaded.load_image(object);
+    unlink(object);
+    for (std::size_t i = 0; i < program.segments[0].words.size(); ++i) {
+        EXPECT_EQ(loaded.read_memory(static_cast<std::uint16_t>(0x3000 + i)), program.segments[0].words[i]);
+    }
+
+    LC3State vm;
+    vm.load_program(program);
+    char output[] = "/tmp/lc3_asm_out_XXXXXX";
+    int out_fd = mkstemp(output);
+    ASSERT_NE(out_fd, -1);
+    ScriptConsole* console = new ScriptConsole("hiq", out_fd);
+    vm.set_console(std::unique_ptr<Console>(console));
+    EXPECT_EQ(run_headless(vm, *console, 0, 1000).reason, StopReason::Halted);
+    char echoed[16] = {};
+    EXPECT_EQ(pread(out_fd, echoed, sizeof(echoed) - 1, 0), 8);
+    EXPECT_STREQ(echoed, "hiqHALT\n");
+    close(out_fd);
+    unlink(output);
+
+    EXPECT_THROW(assemble_file("/nonexistent/source.asm"), std::runtime_error);
+    EXPECT_THROW(write_object(program.segments[0], "/nonexistent/dir/out.obj"), std::runtime_error);
+}
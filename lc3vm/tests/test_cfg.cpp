@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+#include "assembler.hpp"
+#include "cfg.hpp"
+#include "lc3.hpp"
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** Nested loops calling a near and a far subroutine, dead code, and data. */
+static const char* NESTED_SOURCE = R"(
+        .ORIG x3000
+MAIN    AND R1, R1, #0      ; b0
+        ADD R1, R1, #3
+OUTER   AND R2, R2, #0      ; b1
+        ADD R2, R2, #2
+INNER   JSR WORK            ; b2
+        ADD R2, R2, #-1     ; b3
+        BRp INNER
+        ADD R1, R1, #-1     ; b4
+        BRp OUTER
+        LD R3, FAR          ; b5
+        JSRR R3
+        LD R0, COUNT        ; b6
+        HALT
+DEAD    ADD R0, R0, #1      ; b7
+        BRnzp DEAD
+WORK    ADD R0, R0, #1      ; b8
+        RET
+FARSUB  ST R0, COUNT        ; b9
+        RET
+FAR     .FILL FARSUB        ; b10, decodes as ST
+COUNT   .FILL 0
+        .END
+)";
+
+class ControlFlowGraphTest : public ::testing::Test {
+protected:
+    LC3State vm;
+
+    void SetUp() override {
+        vm.load_program(assemble(NESTED_SOURCE));
+    }
+};
+
+TEST_F(ControlFlowGraphTest, SplitsBlocksAtControlTransfers) {
+    ControlFlowGraph cfg = vm.control_flow_graph();
+    const std::vector<BasicBlock>& blocks = cfg.blocks();
+
+    ASSERT_EQ(blocks.size(), 11u);
+    std::vector<std::uint16_t> starts;
+    for (const BasicBlock& block : blocks) starts.push_back(block.start);
+    EXPECT_EQ(starts, (std::vector<std::uint16_t>{0x3000, 0x3002, 0x3004, 0x3005, 0x3007, 0x3009,
+                                                  0x300b, 0x300d, 0x300f, 0x3011, 0x3013}));
+    EXPECT_EQ(blocks[3].last, 0x3006);
+    EXPECT_EQ(blocks[3].successors, (std::vector<std::uint32_t>{2, 4}));
+    EXPECT_EQ(blocks[2].successors, (std::vector<std::uint32_t>{3}));
+    EXPECT_EQ(blocks[2].call, 8u);
+    EXPECT_EQ(blocks[5].call, 9u);
+    EXPECT_EQ(blocks[1].predecessors, (std::vector<std::uint32_t>{0, 4}));
+    EXPECT_TRUE(blocks[6].successors.empty());
+    EXPECT_EQ(cfg.block_at(0x3006), 3u);
+    EXPECT_EQ(cfg.block_at(0x3014), CFG_NONE);
+    EXPECT_EQ(cfg.entries(), (std::vector<std::uint32_t>{0}));
+}
+
+TEST_F(ControlFlowGraphTest, FindsNestedLoops) {
+    ControlFlowGraph cfg = vm.control_flow_graph();
+
+    ASSERT_EQ(cfg.loops().size(), 2u);
+    const NaturalLoop& outer = cfg.loops()[0];
+    const NaturalLoop& inner = cfg.loops()[1];
+    EXPECT_EQ(outer.header, 1u);
+    EXPECT_EQ(outer.latches, (std::vector<std::uint32_t>{4}));
+    EXPECT_EQ(outer.blocks, (std::vector<std::uint32_t>{1, 2, 3, 4}));
+    EXPECT_EQ(outer.parent, CFG_NONE);
+    EXPECT_EQ(inner.header, 2u);
+    EXPECT_EQ(inner.blocks, (std::vector<std::uint32_t>{2, 3}));
+    EXPECT_EQ(inner.parent, 0u);
+
+    EXPECT_TRUE(cfg.dominates(1, 4));
+    EXPECT_TRUE(cfg.dominates(0, 6));
+    EXPECT_FALSE(cfg.dominates(4, 1));
+    EXPECT_FALSE(cfg.dominates(0, 8)); // Subroutines are roots of their own.
+    EXPECT_FALSE(cfg.dominates(7, 7)); // Unreachable.
+}
+
+TEST(ControlFlowGraphLoopTest, StopsInnerLoopsAtTheirHeader) {
+    // The second latch of INNER comes after the latch of OUTER in reverse
+    // postorder, so the walk of OUTER reaches INNER first.
+    LC3State vm;
+    vm.load_program(assemble(R"(
+        .ORIG x3000
+        AND R1, R1, #0      ; b0
+        ADD R1, R1, #2
+OUTER   ADD R2, R1, #1      ; b1
+INNER   ADD R2, R2, #-1     ; b2
+        BRnp BODY
+        ADD R0, R0, #2      ; b3
+        BRnzp INNER
+BODY    ADD R0, R0, #1      ; b4
+        BRp INNER
+        ADD R1, R1, #-1     ; b5
+        BRp OUTER
+        HALT                ; b6
+        .END
+)"));
+    ControlFlowGraph cfg = vm.control_flow_graph();
+
+    ASSERT_EQ(cfg.blocks().size(), 7u);
+    ASSERT_EQ(cfg.loops().size(), 2u);
+    const NaturalLoop& outer = cfg.loops()[0];
+    const NaturalLoop& inner = cfg.loops()[1];
+    EXPECT_EQ(outer.header, 1u);
+    EXPECT_EQ(outer.latches, (std::vector<std::uint32_t>{5}));
+    EXPECT_EQ(outer.blocks, (std::vector<std::uint32_t>{1, 2, 3, 4, 5}));
+    EXPECT_EQ(outer.parent, CFG_NONE);
+    EXPECT_EQ(inner.header, 2u);
+    EXPECT_EQ(inner.latches, (std::vector<std::uint32_t>{3, 4}));
+    EXPECT_EQ(inner.blocks, (std::vector<std::uint32_t>{2, 3, 4}));
+    EXPECT_EQ(inner.parent, 0u);
+}
+
+TEST_F(ControlFlowGraphTest, FindsSubroutinesAndDeadCode) {
+    ControlFlowGraph cfg = vm.control_flow_graph();
+
+    ASSERT_EQ(cfg.subroutines().size(), 2u);
+    EXPECT_EQ(cfg.subroutines()[0].entry, 8u);
+    EXPECT_EQ(cfg.subroutines()[0].callers, (std::vector<std::uint32_t>{2}));
+    EXPECT_EQ(cfg.subroutines()[0].instructions, 2u);
+    EXPECT_EQ(cfg.subroutines()[1].entry, 9u);
+    EXPECT_EQ(cfg.subroutines()[1].callers, (std::vector<std::uint32_t>{5}));
+
+    // FAR decodes as an ST but is loaded as data, so only DEAD is dead code.
+    EXPECT_FALSE(cfg.blocks()[7].reachable);
+    EXPECT_FALSE(cfg.blocks()[10].reachable);
+    EXPECT_EQ(cfg.unreachable(), (std::vector<std::uint32_t>{7}));
+}
+
+TEST_F(ControlFlowGraphTest, WritesDot) {
+    ControlFlowGraph cfg = vm.control_flow_graph();
+    std::ostringstream out;
+    cfg.write_dot(out, vm.memory.memory);
+    std::string dot = out.str();
+
+    EXPECT_EQ(dot.rfind("digraph cfg {\n", 0), 0u);
+    EXPECT_NE(dot.find("    b7 [label=\"0x300d: ADD R0, R0, #1\\l0x300e: BRnzp 0x300d\\l\", style=dashed];\n"),
+              std::string::npos);
+    EXPECT_NE(dot.find("    b2 [label=\"0x3004: JSR 0x300f\\l\", penwidth=3];\n"), std::string::npos);
+    EXPECT_NE(dot.find("    b8 [label=\"0x300f: ADD R0, R0, #1\\l0x3010: RET\\l\", peripheries=2];\n"),
+              std::string::npos);
+    EXPECT_NE(dot.find("    b3 -> b2;\n"), std::string::npos);
+    EXPECT_NE(dot.find("    b2 -> b8 [style=dotted];\n"), std::string::npos);
+    EXPECT_EQ(dot.find("b10"), std::string::npos);
+    EXPECT_EQ(dot.substr(dot.size() - 2), "}\n");
+}
+
+TEST(ControlFlowGraphScaleTest, CoversAllOfMemoryQuickly) {
+    std::vector<std::uint16_t> memory(MEMORY_MAX);
+    std::mt19937 random(25);
+    for (std::uint16_t& word : memory) word = static_cast<std::uint16_t>(random());
+
+    auto start = std::chrono::steady_clock::now();
+    ControlFlowGraph cfg(memory.data(), {{0x0000, 0x8000}, {0x8000, 0x7FFF}});
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    EXPECT_GT(cfg.blocks().size(), 10000u);
+    std::size_t instructions = 0;
+    for (std::uint32_t b = 0; b < cfg.blocks().size(); ++b) {
+        const BasicBlock& block = cfg.blocks()[b];
+        instructions += block.last - block.start + 1u;
+        for (std::uint32_t s : block.successors) {
+            if (block.reachable) {
+                EXPECT_TRUE(cfg.blocks()[s].reachable);
+            }
+        }
+        ASSERT_EQ(cfg.block_at(block.start), b);
+    }
+    for (const NaturalLoop& loop : cfg.loops()) {
+        for (std::uint32_t block : loop.blocks) EXPECT_TRUE(cfg.dominates(loop.header, block));
+    }
+    EXPECT_GT(instructions, 50000u);
+    EXPECT_LT(seconds, 1.0);
+}
@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+#include "console.hpp"
+#include "lc3.hpp"
+#include "keyboard.hpp"
+#include "registers.hpp"
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * VM running an upper-casing echo loop on a console chosen by the test.
+ */
+class ConsoleTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    void load_upcase(LC3State& vm) {
+        const std::uint16_t program[] = {
+            0xF020, // GETC
+            0x1236, // ADD R1, R0, #-10
+            0x0404, // BRz done
+            0x1030, // ADD R0, R0, #-16
+            0x1030, // ADD R0, R0, #-16
+            0xF021, // OUT
+            0x0FF9, // BRnzp back to GETC
+            0xF025  // done: HALT
+        };
+        for (std::uint16_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+            vm.write_memory(0x3000 + i, program[i]);
+        }
+        vm.set_register_value(R_PC, 0x3000);
+        vm.set_execution_mode(GetParam());
+    }
+
+    BufferConsole* use_buffer(LC3State& vm, const std::string& input) {
+        BufferConsole* console = new BufferConsole(input);
+        vm.set_console(std::unique_ptr<Console>(console));
+        return console;
+    }
+};
+
+TEST_P(ConsoleTest, VmsInOneProcessHaveSeparateConsoles) {
+    LC3State first;
+    LC3State second;
+    load_upcase(first);
+    load_upcase(second);
+    BufferConsole* first_console = use_buffer(first, "abc\n");
+    BufferConsole* second_console = use_buffer(second, "xy");
+
+    // Interleave the two VMs one instruction at a time.
+    RunResult a{StopReason::BudgetExhausted, 0, 0};
+    RunResult b{StopReason::BudgetExhausted, 0, 0};
+    while (a.reason == StopReason::BudgetExhausted || b.reason == StopReason::BudgetExhausted) {
+        if (a.reason == StopReason::BudgetExhausted) a = first.run_for(1);
+        if (b.reason == StopReason::BudgetExhausted) b = second.run_for(1);
+    }
+    second.output.flush();
+
+    EXPECT_EQ(a.reason, StopReason::Halted);
+    EXPECT_EQ(first_console->output(), "ABCHALT\n");
+    EXPECT_EQ(b.reason, StopReason::WaitingForInput);
+    EXPECT_EQ(second_console->output(), "XY");
+    EXPECT_EQ(second_console->remaining_input(), 0u);
+
+    second_console->feed("z\n");
+    EXPECT_EQ(second.run_for(1000).reason, StopReason::Halted);
+    EXPECT_EQ(second_console->take_output(), "XYZHALT\n");
+    EXPECT_EQ(second_console->output(), "");
+}
+
+TEST_P(ConsoleTest, InTrapPromptsAndEchoes) {
+    LC3State vm;
+    vm.set_execution_mode(GetParam());
+    vm.write_memory(0x3000, 0xF023); // IN
+    vm.write_memory(0x3001, 0xF025); // HALT
+    BufferConsole* console = use_buffer(vm, "q");
+
+    vm.run();
+
+    EXPECT_EQ(vm.get_register_value(R_R0), 'q');
+    EXPECT_EQ(console->output(), "Enter a character: qHALT\n");
+}
+
+TEST_P(ConsoleTest, TestConsoleReadsTheKeyboardRegisters) {
+    LC3State vm;
+    load_upcase(vm);
+    vm.use_test_console();
+    vm.write_memory(Keyboard::MR_KBDR, 'b');
+
+    RunResult result = vm.run_for(6);
+
+    EXPECT_EQ(result.reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(vm.get_register_value(R_R0), 'B');
+    vm.write_memory(Keyboard::MR_KBSR, 0);
+    EXPECT_EQ(vm.read_memory(Keyboard::MR_KBSR), 0);
+    vm.write_memory(Keyboard::MR_KBSR, 0x8000);
+    EXPECT_EQ(vm.read_memory(Keyboard::MR_KBSR), 0x8000);
+    EXPECT_EQ(vm.read_memory(Keyboard::MR_KBDR), 'b');
+
+    BufferConsole* console = use_buffer(vm, "a\n");
+    vm.set_register_value(R_PC, 0x3000);
+    EXPECT_EQ(vm.run_for(1000).reason, StopReason::Halted);
+    EXPECT_EQ(console->output(), "AHALT\n");
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, ConsoleTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
+
+/**
+ * FdConsole on two pipes.
+ */
+class FdConsoleTest : public ::testing::Test {
+protected:
+    int input[2];
+    int output[2];
+
+    void SetUp() override {
+        ASSERT_EQ(pipe(input), 0);
+        ASSERT_EQ(pipe(output), 0);
+        fcntl(output[0], F_SETFL, O_NONBLOCK);
+    }
+
+    void TearDown() override {
+        close(input[0]);
+        close(input[1]);
+        close(output[0]);
+        close(output[1]);
+    }
+
+    std::string drain() {
+        std::string data;
+        char chunk[256];
+        ssize_t n;
+        while ((n = read(output[0], chunk, sizeof(chunk))) > 0) {
+            data.append(chunk, static_cast<std::size_t>(n));
+        }
+        return data;
+    }
+};
+
+TEST_F(FdConsoleTest, ReadsDirectlyAndThroughReader) {
+    FdConsole console(input[0], output[1]);
+    char c = 0;
+    EXPECT_FALSE(console.key_pending());
+    EXPECT_FALSE(console.read_key(c, false));
+
+    ASSERT_EQ(write(input[1], "ab", 2), 2);
+    EXPECT_TRUE(console.key_pending());
+    ASSERT_TRUE(console.read_key(c, false));
+    EXPECT_EQ(c, 'a');
+
+    console.start_reader();
+    ASSERT_TRUE(console.read_key(c, true));
+    EXPECT_EQ(c, 'b');
+    ASSERT_EQ(write(input[1], "c", 1), 1);
+    console.wait_for_key(std::chrono::milliseconds(1000));
+    EXPECT_TRUE(console.key_pending());
+    console.stop_reader();
+    ASSERT_TRUE(console.read_key(c, false));
+    EXPECT_EQ(c, 'c');
+}
+
+TEST_F(FdConsoleTest, VmWritesToItsOutputDescriptor) {
+    LC3State vm;
+    vm.set_console(std::unique_ptr<Console>(new FdConsole(input[0], output[1])));
+    vm.write_memory(0x3000, 0xF020); // GETC
+    vm.write_memory(0x3001, 0xF021); // OUT
+    vm.write_memory(0x3002, 0xF025); // HALT
+    ASSERT_EQ(write(input[1], "k", 1), 1);
+
+    vm.run();
+
+    EXPECT_EQ(drain(), "kHALT\n");
+}
@@ -0,0 +1,231 @@
+#include <gtest/gtest.h>
+#include "lc3.hpp"
+#include "memory.hpp"
+#include "device.hpp"
+#include "keyboard.hpp"
+#include "registers.hpp"
+#include <chrono>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * Device returning the low address bits and remembering the last write.
+ */
+class RecordingDevice : public Device {
+public:
+    int reads = 0;
+    int writes = 0;
+    std::uint16_t last_address = 0;
+    std::uint16_t last_value = 0;
+
+    std::uint16_t read(Memory&, std::uint16_t address) override {
+        ++reads;
+        return address & MEMORY_PAGE_MASK;
+    }
+
+    void write(Memory&, std::uint16_t address, std::uint16_t value) override {
+        ++writes;
+        last_address = address;
+        last_value = value;
+    }
+};
+
+TEST(DeviceTest, KeyboardIsMappedByDefault) {
+    Memory memory;
+
+    EXPECT_TRUE(memory.is_device(Keyboard::MR_KBSR));
+    EXPECT_TRUE(memory.is_device(Keyboard::MR_KBDR));
+    EXPECT_FALSE(memory.is_device(0x3000));
+    EXPECT_FALSE(memory.is_device(0xFDFF));
+    EXPECT_EQ(memory.memory[0x3000], 0);
+}
+
+TEST(DeviceTest, MappedPageDispatchesReadsAndWrites) {
+    Memory memory;
+    RecordingDevice device;
+    memory.memory[0x4005] = 0x1234;
+
+    memory.map_device(0x4080, &device);
+
+    EXPECT_TRUE(memory.is_device(0x4000));
+    EXPECT_TRUE(memory.is_device(0x40FF));
+    EXPECT_FALSE(memory.is_device(0x4100));
+    EXPECT_EQ(memory.read(0x4005), 0x05);
+    memory.write(0x40FF, 0xBEEF);
+    EXPECT_EQ(device.reads, 1);
+    EXPECT_EQ(device.writes, 1);
+    EXPECT_EQ(device.last_address, 0x40FF);
+    EXPECT_EQ(device.last_value, 0xBEEF);
+    EXPECT_EQ(memory.memory[0x40FF], 0);
+
+    memory.write(0x4100, 7);
+    EXPECT_EQ(memory.read(0x4100), 7);
+    EXPECT_EQ(device.reads, 1);
+    EXPECT_EQ(device.writes, 1);
+}
+
+TEST(DeviceTest, UnmappedPageIsPlainMemoryAgain) {
+    Memory memory;
+    RecordingDevice device;
+    memory.map_device(0x4000, &device);
+    memory.map_device(0x4000, nullptr);
+
+    memory.write(0x4001, 9);
+
+    EXPECT_FALSE(memory.is_device(0x4000));
+    EXPECT_EQ(memory.read(0x4001), 9);
+    EXPECT_EQ(device.reads, 0);
+    EXPECT_EQ(device.writes, 0);
+}
+
+class DeviceExecutionTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    LC3State vm;
+    RecordingDevice device;
+
+    void SetUp() override {
+        vm.use_test_console();
+        vm.memory.map_device(0x4000, &device);
+        vm.set_execution_mode(GetParam());
+    }
+};
+
+TEST_P(DeviceExecutionTest, LoadsAndStoresReachDevice) {
+    const std::uint16_t program[] = {
+        0x2209, // 0x3FF0: LD R1, 0x3FFA
+        0x2809, // 0x3FF1: LD R4, 0x3FFB
+        0x240D, // 0x3FF2: LD R2, 0x4000
+        0x16C2, // 0x3FF3: ADD R3, R3, R2
+        0x6502, // 0x3FF4: LDR R2, R4, #2
+        0x16C2, // 0x3FF5: ADD R3, R3, R2
+        0x7301, // 0x3FF6: STR R1, R4, #1
+        0x127F, // 0x3FF7: ADD R1, R1, #-1
+        0x03F9, // 0x3FF8: BRp 0x3FF2
+        0xF025, // 0x3FF9: HALT
+        0x0064, // 0x3FFA: .FILL 100
+        0x4000  // 0x3FFB: .FILL 0x4000
+    };
+    for (std::uint16_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+        vm.write_memory(0x3FF0 + i, program[i]);
+    }
+    vm.set_register_value(R_PC, 0x3FF0);
+
+    vm.run();
+
+    EXPECT_EQ(vm.get_register_value(R_R3), 200);
+    EXPECT_EQ(device.reads, 200);
+    EXPECT_EQ(device.writes, 100);
+    EXPECT_EQ(device.last_address, 0x4001);
+    EXPECT_EQ(device.last_value, 1);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, DeviceExecutionTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
+
+/**
+ * Guest spinning on KBSR until a key arrives through a pipe.
+ */
+class KeyboardIdleTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    LC3State vm;
+    int input[2];
+    int null_fd;
+
+    void SetUp() override {
+        ASSERT_EQ(pipe(input), 0);
+        null_fd = open("/dev/null", O_WRONLY);
+        ASSERT_NE(null_fd, -1);
+        vm.output.set_descriptor(null_fd);
+        vm.set_execution_mode(GetParam());
+
+        vm.write_memory(0x3000, 0xA203); // LDI R1, KBSR
+        vm.write_memory(0x3001, 0x07FE); // BRzp back to the LDI
+        vm.write_memory(0x3002, 0xA002); // LDI R0, KBDR
+        vm.write_memory(0x3003, 0xF025); // HALT
+        vm.write_memory(0x3004, Keyboard::MR_KBSR);
+        vm.write_memory(0x3005, Keyboard::MR_KBDR);
+        vm.set_register_value(R_PC, 0x3000);
+        vm.start_input_thread(input[0]);
+    }
+
+    void TearDown() override {
+        vm.stop_input_thread();
+        vm.output.flush();
+        close(input[0]);
+        close(input[1]);
+        close(null_fd);
+    }
+};
+
+static double thread_cpu_seconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+TEST_P(KeyboardIdleTest, SpinningGuestWaitsWithoutBurningCpu) {
+    std::thread typist([this] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        ASSERT_EQ(write(input[1], "z", 1), 1);
+    });
+
+    double cpu_before = thread_cpu_seconds();
+    auto start = std::chrono::steady_clock::now();
+    vm.run();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = thread_cpu_seconds() - cpu_before;
+    typist.join();
+
+    EXPECT_EQ(vm.get_register_value(R_R0), 'z');
+    EXPECT_EQ(vm.get_register_value(R_R1), 0x8000);
+    EXPECT_GT(vm.memory.keyboard_device().idle_waits(), 0u);
+    EXPECT_GE(wall, 0.25);
+    EXPECT_LT(cpu, wall / 2);
+}
+
+TEST_P(KeyboardIdleTest, RunForNeverWaits) {
+    RunResult result = vm.run_for(300000);
+
+    EXPECT_EQ(result.reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(vm.memory.keyboard_device().idle_waits(), 0u);
+    EXPECT_EQ(vm.get_register_value(R_R1), 0);
+}
+
+/**
+ * Polls KBSR between bouts of work until a key arrives, then reads it and halts.
+ * @param work The instruction doing the work: a store or an OUT.
+ */
+static void load_busy_poller(LC3State& vm, std::uint16_t work) {
+    vm.write_memory(0x3000, 0xA206); // poll: LDI R1, KBSR
+    vm.write_memory(0x3001, 0x0803); // BRn got
+    vm.write_memory(0x3002, 0x14A1); // ADD R2, R2, #1
+    vm.write_memory(0x3003, work);
+    vm.write_memory(0x3004, 0x0FFB); // BRnzp poll
+    vm.write_memory(0x3005, 0xA002); // got: LDI R0, KBDR
+    vm.write_memory(0x3006, 0xF025); // HALT
+    vm.write_memory(0x3007, Keyboard::MR_KBSR);
+    vm.write_memory(0x3008, Keyboard::MR_KBDR);
+    vm.set_register_value(R_PC, 0x3000);
+}
+
+TEST_P(KeyboardIdleTest, BusyPollersAreNotSlowedDown) {
+    // ST R2, count stores between polls; OUT prints between them.
+    for (std::uint16_t work : {std::uint16_t(0x3405), std::uint16_t(0xF021)}) {
+        load_busy_poller(vm, work);
+        std::thread typist([this] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            ASSERT_EQ(write(input[1], "z", 1), 1);
+        });
+
+        vm.run();
+        typist.join();
+
+        EXPECT_EQ(vm.get_register_value(R_R0), 'z');
+        EXPECT_EQ(vm.memory.keyboard_device().idle_waits(), 0u) << std::hex << work;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, KeyboardIdleTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
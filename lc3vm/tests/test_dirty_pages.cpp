@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include "lc3.hpp"
+#include "memory.hpp"
+#include "keyboard.hpp"
+#include "registers.hpp"
+#include <vector>
+
+/**
+ * Lists the pages set in a dirty bitmap.
+ */
+static std::vector<unsigned> page_list(const DirtyPages& pages) {
+    std::vector<unsigned> list;
+    for (unsigned page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+        if ((pages[page / 64] >> (page % 64)) & 1) list.push_back(page);
+    }
+    return list;
+}
+
+TEST(DirtyPageTest, WritesMarkTheirPageUntilTaken) {
+    Memory memory;
+    EXPECT_TRUE(page_list(memory.dirty_pages()).empty());
+
+    memory.write(0x3000, 1);
+    memory.write(0x30FF, 2);
+    memory.write(0xC001, 3);
+
+    EXPECT_TRUE(memory.is_dirty(0x3080));
+    EXPECT_FALSE(memory.is_dirty(0x3100));
+    EXPECT_EQ(page_list(memory.dirty_pages()), (std::vector<unsigned>{0x30, 0xC0}));
+    std::uint64_t epoch = memory.dirty_epoch();
+
+    EXPECT_EQ(page_list(memory.take_dirty_pages()), (std::vector<unsigned>{0x30, 0xC0}));
+    EXPECT_EQ(memory.dirty_epoch(), epoch + 1);
+    EXPECT_TRUE(page_list(memory.dirty_pages()).empty());
+    EXPECT_EQ(memory.read(0x30FF), 2);
+
+    memory.write(0x3001, 4);
+    EXPECT_EQ(page_list(memory.take_dirty_pages()), (std::vector<unsigned>{0x30}));
+}
+
+TEST(DirtyPageTest, LoadAndDeviceWritesAreTracked) {
+    Memory memory;
+    const std::uint16_t words[] = {0x3412, 0x7856};
+
+    memory.load(0x40FF, words, 2);
+    memory.write(Keyboard::MR_KBDR, 7);
+
+    EXPECT_EQ(page_list(memory.take_dirty_pages()), (std::vector<unsigned>{0x40, 0x41, 0xFE}));
+    EXPECT_EQ(memory.read(0x4100), 0x5678);
+}
+
+class DirtyPageEngineTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    LC3State vm;
+
+    void SetUp() override {
+        vm.use_test_console();
+        vm.set_execution_mode(GetParam());
+        const std::uint16_t program[] = {
+            0x2207, // LD R1, count
+            0x2407, // LD R2, first
+            0x2607, // LD R3, second
+            0x7280, // STR R1, R2, #0
+            0x72C0, // STR R1, R3, #0
+            0x127F, // ADD R1, R1, #-1
+            0x03FC, // BRp back to the first STR
+            0xF025, // HALT
+            0x0064, // count: .FILL 100
+            0x5000, // first: .FILL 0x5000
+            0x6123  // second: .FILL 0x6123
+        };
+        for (std::uint16_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+            vm.write_memory(0x3000 + i, program[i]);
+        }
+        vm.set_register_value(R_PC, 0x3000);
+    }
+};
+
+TEST_P(DirtyPageEngineTest, StoresFromEveryEngineAreTracked) {
+    vm.memory.take_dirty_pages();
+
+    vm.run();
+
+    EXPECT_EQ(page_list(vm.memory.dirty_pages()), (std::vector<unsigned>{0x50, 0x61}));
+    EXPECT_EQ(vm.read_memory(0x5000), 1);
+}
+
+TEST_P(DirtyPageEngineTest, DeltaRestoreAndChangesSinceSnapshot) {
+    Snapshot boot = vm.snapshot();
+    vm.write_memory(0x5000, 0xFFFF);
+    vm.write_memory(0x7000, 0xFFFF);
+    vm.restore(boot);
+    EXPECT_EQ(vm.read_memory(0x5000), 0);
+    EXPECT_EQ(vm.read_memory(0x7000), 0);
+
+    for (int job = 0; job < 3; ++job) {
+        vm.restore(boot);
+        EXPECT_TRUE(vm.memory_changes(boot).empty());
+        vm.run();
+        EXPECT_EQ(vm.memory_changes(boot), (std::vector<std::uint16_t>{0x5000, 0x6123}));
+        EXPECT_EQ(vm.read_memory(0x5000), 1);
+    }
+
+    // Resetting tracking elsewhere forces a full comparison and copy.
+    vm.memory.take_dirty_pages();
+    EXPECT_EQ(vm.memory_changes(boot), (std::vector<std::uint16_t>{0x5000, 0x6123}));
+    vm.restore(boot);
+    EXPECT_EQ(vm.read_memory(0x6123), 0);
+    EXPECT_TRUE(vm.memory_changes(boot).empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, DirtyPageEngineTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
@@ -3,9 +3,14 @@
 #include "opcodes.hpp"
 #include "registers.hpp"
 #include "flags.hpp"
+#include "assembler.hpp"
+#include "disassembler.hpp"
+#include "memory.hpp"
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 #include <cstdio>
+#include <iostream>
 
 
 TEST(LC3DisassembleTest, ADD_Reg) {
@@ -131,3 +136,115 @@ TEST(LC3DisassembleTest, BAD_OPCODE) {
     vm.write_memory(addr + 1, 0xD000); // RES (Opcode 13)
     EXPECT_EQ(vm.disassemble(addr + 1), "0x3901: BAD OPCODE");
 }
+
+TEST(LC3DisassembleTest, TargetsWrapAround) {
+    LC3State vm;
+    vm.write_memory(0x0001, 0x0F00); // BRnzp #-256
+    EXPECT_EQ(vm.disassemble(0x0001), "0x0001: BRnzp 0xff02");
+    vm.write_memory(0xFFFF, 0x4805); // JSR #5
+    EXPECT_EQ(vm.disassemble(0xFFFF), "0xffff: JSR 0x0005");
+    vm.write_memory(0x0002, 0x0000); // BR with no condition bits
+    EXPECT_EQ(vm.disassemble(0x0002), "0x0002: BR 0x0003");
+}
+
+TEST(LC3DisassembleTest, InstructionIntoBuffer) {
+    char line[DISASSEMBLY_MAX_LINE];
+    std::size_t length = disassemble_instruction(0x3000, 0x6FE0, line); // LDR R7, R7, #-32
+    EXPECT_EQ(std::string(line, length), "0x3000: LDR R7, R7, #-32");
+    length = disassemble_instruction(0x3000, 0xF0FF, line);
+    EXPECT_EQ(std::string(line, length), "0x3000: TRAP xff");
+}
+
+TEST(LC3DisassembleTest, RangeMatchesSingleLines) {
+    LC3State vm;
+    std::string expected;
+    // Every opcode with varied operands, across the top of memory and back to 0.
+    for (std::uint32_t i = 0; i < 4096; ++i) {
+        std::uint16_t address = static_cast<std::uint16_t>(0xF800 + i);
+        vm.write_memory(address, static_cast<std::uint16_t>(i * 40503u));
+        expected += vm.disassemble(address) + "\n";
+    }
+
+    std::ostringstream out;
+    vm.disassemble_range(out, 0xF800, 4096);
+    EXPECT_EQ(out.str(), expected);
+}
+
+/** Code with a string, a table, a near and a far call, and data that looks like code. */
+static const char* MIXED_SOURCE = R"(
+        .ORIG x3000
+        LEA R0, MSG
+        PUTS
+        LD R2, TABLE
+        BRnzp SKIP
+TABLE   .FILL x8000
+SKIP    LD R1, FAR
+        JSRR R1
+        JSR SUB
+        HALT
+SUB     RET
+FARSUB  ADD R0, R0, #1
+        RET
+FAR     .FILL FARSUB
+MSG     .STRINGZ "Hi"
+        .STRINGZ "\n"
+        .FILL x1234
+        .END
+)";
+
+TEST(LC3ListingTest, SeparatesCodeFromData) {
+    AssembledProgram program = assemble(MIXED_SOURCE);
+    std::vector<std::uint16_t> memory(MEMORY_MAX, 0);
+    const AssembledSegment& segment = program.segments[0];
+    std::copy(segment.words.begin(), segment.words.end(), memory.begin() + segment.origin);
+
+    std::vector<std::uint8_t> kinds = map_code(memory.data(), segment.origin, segment.words.size());
+    std::vector<std::uint8_t> code;
+    for (std::uint8_t kind : kinds) code.push_back(kind & WORD_CODE);
+    EXPECT_EQ(code, (std::vector<std::uint8_t>{1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0}));
+    EXPECT_TRUE(kinds[0x4] & WORD_TARGET);
+    EXPECT_TRUE(kinds[0xd] & WORD_TARGET);
+    EXPECT_FALSE(kinds[0x10] & WORD_TARGET);
+
+    std::ostringstream out;
+    write_listing(out, memory.data(), segment.origin, kinds);
+    EXPECT_EQ(out.str(),
+              "0x3000: LEA R0, 0x300d\n"
+              "0x3001: TRAP x22\n"
+              "0x3002: LD R2, 0x3004\n"
+              "0x3003: BRnzp 0x3005\n"
+              "0x3004: .FILL 0x8000\n"
+              "0x3005: LD R1, 0x300c\n"
+              "0x3006: JSR R1\n"
+              "0x3007: JSR 0x3009\n"
+              "0x3008: TRAP x25\n"
+              "0x3009: RET\n"
+              "0x300a: ADD R0, R0, #1\n"
+              "0x300b: RET\n"
+              "0x300c: .FILL 0x300a\n"
+              "0x300d: .STRINGZ \"Hi\"\n"
+              "0x3010: .FILL 0x000a\n"
+              "0x3011: .FILL 0x0000\n"
+              "0x3012: .FILL 0x1234\n");
+}
+
+TEST(LC3ListingTest, ListsEverySegment) {
+    AssembledProgram program = assemble(
+        ".ORIG x4000\nLEA R0, TEXT\nPUTS\nHALT\nTEXT .STRINGZ \"a \\\"b\\\"\\e\"\n.END\n"
+        ".ORIG x5000\nBRnzp #1\n.FILL xD000\nRET\n.END\n");
+    LC3State vm;
+    vm.load_program(program);
+
+    std::ostringstream out;
+    std::streambuf* previous = std::cout.rdbuf(out.rdbuf());
+    vm.disassemble_all();
+    std::cout.rdbuf(previous);
+    EXPECT_EQ(out.str(),
+              "0x4000: LEA R0, 0x4003\n"
+              "0x4001: TRAP x22\n"
+              "0x4002: TRAP x25\n"
+              "0x4003: .STRINGZ \"a \\\"b\\\"\\e\"\n"
+              "0x5000: BRnzp 0x5002\n"
+              "0x5001: .FILL 0xd000\n"
+              "0x5002: RET\n");
+}
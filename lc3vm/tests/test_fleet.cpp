@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include "fleet.hpp"
+#include "lc3.hpp"
+#include "registers.hpp"
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Boots programs into a snapshot that fleet jobs start from.
+ */
+class FleetTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    LC3State vm;
+
+    Snapshot boot(const std::vector<std::uint16_t>& program) {
+        for (std::size_t i = 0; i < program.size(); ++i) {
+            vm.write_memory(static_cast<std::uint16_t>(0x3000 + i), program[i]);
+        }
+        vm.set_register_value(R_PC, 0x3000);
+        return vm.snapshot();
+    }
+
+    /** Echoes input in upper case until a newline, then halts. */
+    Snapshot boot_upcase() {
+        return boot({
+            0xF020, // GETC
+            0x1236, // ADD R1, R0, #-10
+            0x0404, // BRz done
+            0x1030, // ADD R0, R0, #-16
+            0x1030, // ADD R0, R0, #-16
+            0xF021, // OUT
+            0x0FF9, // BRnzp back to GETC
+            0xF025  // done: HALT
+        });
+    }
+};
+
+TEST_P(FleetTest, JobsRunIndependentlyOnAnyNumberOfThreads) {
+    Snapshot upcase = boot_upcase();
+    std::vector<FleetJob> jobs(64);
+    std::vector<std::string> expected(jobs.size());
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        jobs[i].snapshot = &upcase;
+        jobs[i].mode = GetParam();
+        for (std::size_t c = 0; c < i; ++c) {
+            jobs[i].input += static_cast<char>('a' + (i + c) % 26);
+            expected[i] += static_cast<char>('A' + (i + c) % 26);
+        }
+        jobs[i].input += '\n';
+        expected[i] += "HALT\n";
+    }
+
+    std::vector<FleetResult> serial = Fleet(1).run(jobs);
+    std::vector<FleetResult> parallel = Fleet(4).run(jobs);
+
+    ASSERT_EQ(serial.size(), jobs.size());
+    ASSERT_EQ(parallel.size(), jobs.size());
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        EXPECT_TRUE(serial[i].error.empty());
+        EXPECT_EQ(serial[i].reason, StopReason::Halted);
+        EXPECT_EQ(serial[i].output, expected[i]);
+        EXPECT_EQ(serial[i].instructions, 7 * i + 4);
+        EXPECT_EQ(parallel[i].reason, serial[i].reason);
+        EXPECT_EQ(parallel[i].output, serial[i].output);
+        EXPECT_EQ(parallel[i].instructions, serial[i].instructions);
+    }
+}
+
+TEST_P(FleetTest, MissingInputBudgetsAndFaultsEndOnlyTheirJob) {
+    Snapshot upcase = boot_upcase();
+    Snapshot spin = boot({0x0FFF}); // BRnzp to itself
+    Snapshot illegal = boot({0x1021, 0x8000}); // ADD R0, R0, #1; RTI
+
+    std::vector<FleetJob> jobs(4);
+    for (auto& job : jobs) {
+        job.mode = GetParam();
+    }
+    jobs[0].snapshot = &upcase;
+    jobs[0].input = "ab";
+    jobs[1].snapshot = &spin;
+    jobs[1].max_instructions = 3 * FLEET_SLICE + 7;
+    jobs[2].snapshot = &illegal;
+    jobs[3].snapshot = &upcase;
+    jobs[3].input = "x\n";
+
+    std::vector<FleetResult> results = Fleet(2).run(jobs);
+
+    EXPECT_EQ(results[0].reason, StopReason::WaitingForInput);
+    EXPECT_EQ(results[0].fault_pc, 0x3000);
+    EXPECT_EQ(results[0].output, "AB");
+    EXPECT_EQ(results[1].reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(results[1].instructions, 3u * FLEET_SLICE + 7);
+    EXPECT_EQ(results[2].reason, StopReason::IllegalOpcode);
+    EXPECT_EQ(results[2].fault_pc, 0x3001);
+    EXPECT_EQ(results[2].instructions, 1u);
+    EXPECT_EQ(results[3].reason, StopReason::Halted);
+    EXPECT_EQ(results[3].output, "XHALT\n");
+}
+
+TEST_P(FleetTest, JobsPollingPastTheirInputEndAsWaitingForInput) {
+    Snapshot poll = boot({
+        0xA203, // LDI R1, KBSR
+        0x07FE, // BRzp back to the LDI
+        0xA002, // LDI R0, KBDR
+        0x0FFC, // BRnzp back to the LDI
+        0xFE00, // .FILL xFE00
+        0xFE02  // .FILL xFE02
+    });
+    FleetJob job;
+    job.snapshot = &poll;
+    job.input = "ab";
+    job.mode = GetParam();
+
+    std::vector<FleetResult> results = Fleet(1).run({job});
+
+    EXPECT_EQ(results[0].reason, StopReason::WaitingForInput);
+    EXPECT_TRUE(results[0].fault_pc == 0x3000 || results[0].fault_pc == 0x3001) << results[0].fault_pc;
+    EXPECT_LT(results[0].instructions, 2u * FLEET_IDLE_POLLS + FLEET_SLICE);
+}
+
+TEST_P(FleetTest, LongJobsTakeTurnsWithShortOnes) {
+    Snapshot spin = boot({0x0FFF}); // BRnzp to itself
+    std::vector<FleetJob> jobs(2);
+    jobs[0].snapshot = &spin;
+    jobs[0].max_instructions = 20 * FLEET_SLICE;
+    jobs[1].snapshot = &spin;
+    jobs[1].max_instructions = 3 * FLEET_SLICE;
+    for (auto& job : jobs) {
+        job.mode = GetParam();
+    }
+
+    std::vector<FleetResult> results = Fleet(1).run(jobs);
+
+    EXPECT_EQ(results[0].instructions, 20u * FLEET_SLICE);
+    EXPECT_EQ(results[1].instructions, 3u * FLEET_SLICE);
+    EXPECT_EQ(results[1].finish_order, 0u);
+    EXPECT_EQ(results[0].finish_order, 1u);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, FleetTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
+
+TEST(FleetImageTest, LoadsImagesAndReportsLoadErrors) {
+    char path[] = "/tmp/lc3_fleet_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    const unsigned char image[] = {
+        0x30, 0x00, // .ORIG x3000
+        0xE0, 0x02, // LEA R0, message
+        0xF0, 0x22, // PUTS
+        0xF0, 0x25, // HALT
+        0x00, 0x48, // message: "Hi"
+        0x00, 0x69,
+        0x00, 0x00
+    };
+    ASSERT_EQ(write(fd, image, sizeof(image)), static_cast<ssize_t>(sizeof(image)));
+    close(fd);
+
+    std::vector<FleetJob> jobs(2);
+    jobs[0].images = {path};
+    jobs[1].images = {std::string(path) + ".missing"};
+    std::vector<FleetResult> results = Fleet().run(jobs);
+    unlink(path);
+
+    EXPECT_TRUE(results[0].error.empty());
+    EXPECT_EQ(results[0].reason, StopReason::Halted);
+    EXPECT_EQ(results[0].output, "HiHALT\n");
+    EXPECT_EQ(results[0].instructions, 3u);
+    EXPECT_FALSE(results[1].error.empty());
+    EXPECT_EQ(results[1].instructions, 0u);
+}
+
+TEST(FleetImageTest, ThreadCountDefaultsToHardware) {
+    EXPECT_GE(Fleet().threads(), 1u);
+    EXPECT_EQ(Fleet(3).threads(), 3u);
+    EXPECT_TRUE(Fleet(2).run({}).empty());
+}
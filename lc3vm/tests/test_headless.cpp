@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include "headless.hpp"
+#include "lc3.hpp"
+#include "registers.hpp"
+#include <cstdio>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Drives programs from scripts on every engine.
+ */
+class HeadlessTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    LC3State vm;
+    char path[32] = "/tmp/lc3_headless_XXXXXX";
+    int out_fd = -1;
+
+    void SetUp() override {
+        out_fd = mkstemp(path);
+        ASSERT_NE(out_fd, -1);
+        vm.set_execution_mode(GetParam());
+    }
+
+    void TearDown() override {
+        close(out_fd);
+        unlink(path);
+    }
+
+    void load(std::uint16_t origin, const std::vector<std::uint16_t>& program) {
+        for (std::size_t i = 0; i < program.size(); ++i) {
+            vm.write_memory(static_cast<std::uint16_t>(origin + i), program[i]);
+        }
+    }
+
+    /** Echoes keys read with GETC until it reads 'q', then halts. */
+    void load_echo() {
+        load(0x3000, {
+            0x2406, // LD R2, minus_q
+            0xF020, // loop: GETC
+            0xF021, // OUT
+            0x1202, // ADD R1, R0, R2
+            0x0BFC, // BRnp loop
+            0xF025, // HALT
+            0x0000,
+            0xFF8F  // minus_q: .FILL #-113
+        });
+    }
+
+    std::string output() {
+        std::string text;
+        char buffer[256];
+        ssize_t n;
+        lseek(out_fd, 0, SEEK_SET);
+        while ((n = read(out_fd, buffer, sizeof(buffer))) > 0) text.append(buffer, static_cast<std::size_t>(n));
+        return text;
+    }
+};
+
+TEST_P(HeadlessTest, RunsScriptToHalt) {
+    load_echo();
+    ScriptConsole* console = new ScriptConsole("abqz", out_fd);
+    vm.set_console(std::unique_ptr<Console>(console));
+
+    RunResult result = run_headless(vm, *console, 0, 1000);
+
+    EXPECT_EQ(result.reason, StopReason::Halted);
+    EXPECT_EQ(result.instructions, 14u);
+    EXPECT_EQ(console->remaining_input(), 1u);
+    EXPECT_EQ(output(), "abqHALT\n");
+}
+
+TEST_P(HeadlessTest, StopsWhenTheScriptIsUsedUp) {
+    load_echo();
+    ScriptConsole* console = new ScriptConsole("ab", out_fd, true);
+    vm.set_console(std::unique_ptr<Console>(console));
+
+    RunResult result = run_headless(vm, *console, 500, 1000);
+
+    // A guest waiting in GETC gets a held key without waiting out the delay.
+    EXPECT_EQ(result.reason, StopReason::WaitingForInput);
+    EXPECT_EQ(result.fault_pc, 0x3001);
+    EXPECT_EQ(result.instructions, 9u);
+    EXPECT_EQ(output(), "ab");
+}
+
+TEST_P(HeadlessTest, DelaysKeysForPollingGuests) {
+    load(0x3000, {
+        0x1261, // poll: ADD R1, R1, #1
+        0xA006, // LDI R0, kbsr
+        0x07FD, // BRzp poll
+        0xA005, // LDI R0, kbdr
+        0x7300, // STR R1, R4, #0
+        0x1921, // ADD R4, R4, #1
+        0x0FF9, // BRnzp poll
+        0x0000,
+        0xFE00, // kbsr: .FILL xFE00
+        0xFE02  // kbdr: .FILL xFE02
+    });
+    vm.set_register_value(R_R4, 0x4000);
+    ScriptConsole* console = new ScriptConsole("abc", out_fd, true);
+    vm.set_console(std::unique_ptr<Console>(console));
+
+    RunResult result = run_headless(vm, *console, 3000, 20000);
+
+    EXPECT_EQ(result.reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(result.instructions, 20000u);
+    EXPECT_EQ(console->remaining_input(), 0u);
+    EXPECT_EQ(vm.read_memory(0x4000), 1);
+    for (std::uint16_t key = 1; key < 3; ++key) {
+        std::uint64_t gap = 3u * (vm.read_memory(0x4000 + key) - vm.read_memory(0x3FFF + key));
+        EXPECT_GE(gap, 3000u) << "key " << key;
+        EXPECT_LE(gap, 3000u + 3000u / 8 + 9) << "key " << key;
+    }
+}
+
+TEST_P(HeadlessTest, StopsGuestsPollingAfterTheScript) {
+    load(0x3000, {
+        0xA003, // poll: LDI R0, kbsr
+        0x07FE, // BRzp poll
+        0x0FFD, // BRnzp poll
+        0x0000,
+        0xFE00  // kbsr: .FILL xFE00
+    });
+    ScriptConsole* console = new ScriptConsole("wasd", out_fd);
+    vm.set_console(std::unique_ptr<Console>(console));
+
+    RunResult result = run_headless(vm, *console, 0, 1000000000);
+
+    EXPECT_EQ(result.reason, StopReason::WaitingForInput);
+    EXPECT_EQ(console->remaining_input(), 0u);
+    EXPECT_GE(result.fault_pc, 0x3000);
+    EXPECT_LE(result.fault_pc, 0x3002);
+    EXPECT_LE(result.instructions, 3u * HEADLESS_IDLE_POLLS + HEADLESS_SLICE);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, HeadlessTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
+
+TEST(ReadScriptTest, ReadsWholeFiles) {
+    char path[] = "/tmp/lc3_script_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    std::string keys(100000, 'w');
+    keys += "\x1b\n";
+    ASSERT_EQ(write(fd, keys.data(), keys.size()), static_cast<ssize_t>(keys.size()));
+    close(fd);
+
+    EXPECT_EQ(read_script(path), keys);
+    unlink(path);
+    EXPECT_THROW(read_script("/nonexistent/script"), std::runtime_error);
+}
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include "lc3.hpp"
+#include "image.hpp"
+#include "registers.hpp"
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Writes object files into a temporary directory that is removed afterwards.
+ */
+class ImageLoaderTest : public ::testing::Test {
+protected:
+    LC3State vm;
+    std::vector<std::string> files;
+
+    void SetUp() override {
+        vm.use_test_console();
+    }
+
+    void TearDown() override {
+        for (const auto& file : files) {
+            unlink(file.c_str());
+        }
+    }
+
+    std::string write_bytes(const std::vector<unsigned char>& bytes) {
+        char path[] = "/tmp/lc3_image_XXXXXX";
+        int fd = mkstemp(path);
+        EXPECT_NE(fd, -1);
+        EXPECT_EQ(write(fd, bytes.data(), bytes.size()), static_cast<ssize_t>(bytes.size()));
+        close(fd);
+        files.push_back(path);
+        return path;
+    }
+
+    std::string write_image(std::uint16_t origin, const std::vector<std::uint16_t>& words) {
+        std::vector<unsigned char> bytes = {static_cast<unsigned char>(origin >> 8), static_cast<unsigned char>(origin)};
+        for (std::uint16_t word : words) {
+            bytes.push_back(static_cast<unsigned char>(word >> 8));
+            bytes.push_back(static_cast<unsigned char>(word));
+        }
+        return write_bytes(bytes);
+    }
+};
+
+TEST_F(ImageLoaderTest, LoadsBigEndianWordsAtOrigin) {
+    std::vector<std::uint16_t> words;
+    for (std::uint16_t i = 0; i < 9; ++i) {
+        words.push_back(static_cast<std::uint16_t>(0x1200 + i * 0x0101));
+    }
+
+    vm.load_image(write_image(0x3000, words));
+
+    for (std::uint16_t i = 0; i < 9; ++i) {
+        EXPECT_EQ(vm.read_memory(0x3000 + i), words[i]);
+    }
+    EXPECT_EQ(vm.read_memory(0x3009), 0);
+}
+
+TEST_F(ImageLoaderTest, IgnoresTrailingOddByte) {
+    ProgramImage image(write_bytes({0x40, 0x00, 0xAB, 0xCD, 0xEF}));
+
+    EXPECT_EQ(image.origin(), 0x4000);
+    EXPECT_EQ(image.size(), 1u);
+}
+
+TEST_F(ImageLoaderTest, DropsWordsPastEndOfMemory) {
+    vm.load_image(write_image(0xFFFE, {0x1111, 0x2222, 0x3333, 0x4444}));
+
+    EXPECT_EQ(vm.read_memory(0xFFFE), 0x1111);
+    EXPECT_EQ(vm.read_memory(0xFFFF), 0x2222);
+    EXPECT_EQ(vm.read_memory(0x0000), 0);
+}
+
+TEST_F(ImageLoaderTest, RejectsMissingAndEmptyFiles) {
+    EXPECT_THROW(vm.load_image("/nonexistent/image.obj"), std::runtime_error);
+    EXPECT_THROW(vm.load_image(write_bytes({})), std::runtime_error);
+    EXPECT_THROW(vm.load_image(write_bytes({0x30})), std::runtime_error);
+}
+
+TEST_F(ImageLoaderTest, LoadsDisjointImagesTogether) {
+    std::vector<std::string> paths;
+    for (std::uint16_t i = 0; i < 6; ++i) {
+        paths.push_back(write_image(0x3000 + i * 0x100, {static_cast<std::uint16_t>(i), static_cast<std::uint16_t>(i + 100)}));
+    }
+
+    vm.load_images(paths);
+
+    for (std::uint16_t i = 0; i < 6; ++i) {
+        EXPECT_EQ(vm.read_memory(0x3000 + i * 0x100), i);
+        EXPECT_EQ(vm.read_memory(0x3001 + i * 0x100), i + 100);
+    }
+}
+
+TEST_F(ImageLoaderTest, OverlappingImagesLoadInOrder) {
+    vm.load_image(write_image(0x5000, {1, 1, 1, 1}));
+
+    vm.load_images({write_image(0x4FFE, {2, 2, 2, 2}), write_image(0x3000, {7}), write_image(0x5003, {3, 3})});
+
+    EXPECT_EQ(vm.read_memory(0x4FFF), 2);
+    EXPECT_EQ(vm.read_memory(0x5001), 2);
+    EXPECT_EQ(vm.read_memory(0x5002), 1);
+    EXPECT_EQ(vm.read_memory(0x5003), 3);
+    EXPECT_EQ(vm.read_memory(0x5004), 3);
+    EXPECT_EQ(vm.read_memory(0x3000), 7);
+}
+
+TEST_F(ImageLoaderTest, FailingImageLoadsNothing) {
+    std::string good = write_image(0x3000, {0x1234});
+
+    EXPECT_THROW(vm.load_images({good, "/nonexistent/image.obj"}), std::runtime_error);
+    EXPECT_EQ(vm.read_memory(0x3000), 0);
+}
+
+TEST_F(ImageLoaderTest, ReloadReplacesExecutedCode) {
+    vm.set_execution_mode(ExecutionMode::Superblock);
+    vm.load_image(write_image(0x3000, {0x5020, 0x1021, 0xF025})); // AND R0,R0,#0; ADD R0,R0,#1; HALT
+    vm.run();
+    ASSERT_EQ(vm.get_register_value(R_R0), 1);
+
+    vm.load_images({write_image(0x3001, {0x1022})}); // ADD R0,R0,#2
+    vm.set_register_value(R_PC, 0x3000);
+    vm.run();
+
+    EXPECT_EQ(vm.get_register_value(R_R0), 2);
+}
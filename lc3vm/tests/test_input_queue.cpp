@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include "input_queue.hpp"
+#include "lc3.hpp"
+#include "keyboard.hpp"
+#include "registers.hpp"
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+TEST(InputQueueTest, PopsInPushOrder) {
+    InputQueue queue;
+    char c;
+
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.pop(c));
+    ASSERT_TRUE(queue.push('a'));
+    ASSERT_TRUE(queue.push('b'));
+    EXPECT_FALSE(queue.empty());
+
+    ASSERT_TRUE(queue.pop(c));
+    EXPECT_EQ(c, 'a');
+    ASSERT_TRUE(queue.pop(c));
+    EXPECT_EQ(c, 'b');
+    EXPECT_FALSE(queue.pop(c));
+}
+
+TEST(InputQueueTest, RejectsPushWhenFullAndWrapsAround) {
+    InputQueue queue;
+    char c;
+
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < INPUT_QUEUE_CAPACITY; ++i) {
+            ASSERT_TRUE(queue.push(static_cast<char>(i)));
+        }
+        EXPECT_FALSE(queue.push('x'));
+        for (int i = 0; i < INPUT_QUEUE_CAPACITY; ++i) {
+            ASSERT_TRUE(queue.pop(c));
+            ASSERT_EQ(c, static_cast<char>(i));
+        }
+        EXPECT_TRUE(queue.empty());
+    }
+}
+
+TEST(InputQueueTest, WaitPopReceivesKeysFromAnotherThread) {
+    InputQueue queue;
+    const int count = 100000;
+
+    std::thread producer([&queue] {
+        for (int i = 0; i < count; ++i) {
+            while (!queue.push(static_cast<char>(i))) {
+                std::this_thread::yield();
+            }
+        }
+        queue.close();
+    });
+
+    char c;
+    int received = 0;
+    while (queue.wait_pop(c)) {
+        ASSERT_EQ(c, static_cast<char>(received));
+        ++received;
+    }
+    producer.join();
+
+    EXPECT_EQ(received, count);
+    EXPECT_TRUE(queue.closed());
+}
+
+TEST(InputQueueTest, ReaderForwardsDescriptorUntilEndOfInput) {
+    int pipefd[2];
+    ASSERT_EQ(pipe(pipefd), 0);
+    InputQueue queue;
+    {
+        InputReader reader(queue, pipefd[0]);
+        ASSERT_EQ(write(pipefd[1], "hi", 2), 2);
+        close(pipefd[1]);
+
+        std::string received;
+        char c;
+        while (queue.wait_pop(c)) {
+            received += c;
+        }
+        EXPECT_EQ(received, "hi");
+    }
+    close(pipefd[0]);
+}
+
+TEST(InputQueueTest, ReaderStopsWhileInputIsStillOpen) {
+    int pipefd[2];
+    ASSERT_EQ(pipe(pipefd), 0);
+    InputQueue queue;
+    {
+        InputReader reader(queue, pipefd[0]);
+    }
+    EXPECT_TRUE(queue.empty());
+    close(pipefd[0]);
+    close(pipefd[1]);
+}
+
+TEST(InputQueueTest, VmConsumesKeysThroughKbsrAndGetc) {
+    int pipefd[2];
+    ASSERT_EQ(pipe(pipefd), 0);
+    ASSERT_EQ(write(pipefd[1], "xy", 2), 2);
+
+    LC3State vm;
+    vm.write_memory(0x3000, 0xA205); // LDI R1, KBSR
+    vm.write_memory(0x3001, 0x07FE); // BRzp back to the LDI
+    vm.write_memory(0x3002, 0xA004); // LDI R0, KBDR
+    vm.write_memory(0x3003, 0x1420); // ADD R2, R0, #0
+    vm.write_memory(0x3004, 0xF020); // GETC
+    vm.write_memory(0x3005, 0xF025); // HALT
+    vm.write_memory(0x3006, Keyboard::MR_KBSR);
+    vm.write_memory(0x3007, Keyboard::MR_KBDR);
+    vm.set_register_value(R_PC, 0x3000);
+
+    vm.start_input_thread(pipefd[0]);
+    testing::internal::CaptureStdout();
+    RunResult result = vm.run_for(100000000);
+    testing::internal::GetCapturedStdout();
+    vm.stop_input_thread();
+
+    EXPECT_EQ(result.reason, StopReason::Halted);
+    EXPECT_EQ(vm.get_register_value(R_R2), 'x');
+    EXPECT_EQ(vm.get_register_value(R_R0), 'y');
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+}
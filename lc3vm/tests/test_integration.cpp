@@ -20,7 +20,7 @@ protected:
     
     void SetUp() override {
         vm.set_register_value(R_PC, 0x3000);
-        vm.memory.test_mode = true;
+        vm.use_test_console();
     }
 
     void TearDown() override {
@@ -52,7 +52,7 @@ TEST_F(IntegrationTest, MemoryOperations) {
 }
 
 TEST_F(IntegrationTest, MemoryKeyboardStatus) {
-    vm.memory.test_mode = true;
+    vm.use_test_console();
     
     vm.write_memory(Keyboard::MR_KBSR, 0x0000);
     EXPECT_EQ(vm.read_memory(Keyboard::MR_KBSR), 0x0000);
@@ -73,7 +73,7 @@ TEST_F(IntegrationTest, MemoryKeyboardStatus) {
 }
 
 TEST_F(IntegrationTest, MemoryKeyboardNonTestMode) {
-    vm.memory.test_mode = true;
+    vm.use_test_console();
     
     vm.write_memory(Keyboard::MR_KBSR, 0x0000);
     EXPECT_EQ(vm.read_memory(Keyboard::MR_KBSR), 0x0000);
@@ -87,7 +87,7 @@ TEST_F(IntegrationTest, MemoryKeyboardNonTestMode) {
 }
 
 TEST_F(IntegrationTest, MemoryKeyboardMultipleInputs) {
-    vm.memory.test_mode = true;
+    vm.use_test_console();
     
     const char inputs[] = "ABC";
     for (char input : inputs) {
@@ -104,7 +104,7 @@ TEST_F(IntegrationTest, MemoryKeyboardMultipleInputs) {
 }
 
 TEST_F(IntegrationTest, MemoryKeyboardTimeout) {
-    vm.memory.test_mode = true;
+    vm.use_test_console();
     
     vm.write_memory(Keyboard::MR_KBSR, 0x0000);
     EXPECT_EQ(vm.read_memory(Keyboard::MR_KBSR), 0x0000);
@@ -300,7 +300,7 @@ TEST_F(IntegrationTest, TerminalInputModeTransitions) {
 
 
 TEST_F(IntegrationTest, TrapRoutinesNonTestMode) {
-    vm.memory.test_mode = false;
+    vm.set_console(std::unique_ptr<Console>(new FdConsole()));
     
     int pipefd[2];
     ASSERT_EQ(pipe(pipefd), 0);
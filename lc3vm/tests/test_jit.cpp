@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+#include "lc3.hpp"
+#include "registers.hpp"
+#include "keyboard.hpp"
+#include <cstddef>
+
+/**
+ * Runs each program twice, once in ExecutionMode::Jit and once on the plain
+ * interpreter, and expects identical registers and memory afterwards. Every
+ * program loops well past JIT_HOT_THRESHOLD so its blocks run natively.
+ */
+class JitTest : public ::testing::Test {
+protected:
+    LC3State vm;
+    LC3State reference;
+
+    void SetUp() override {
+        vm.use_test_console();
+        reference.use_test_console();
+        vm.set_execution_mode(ExecutionMode::Jit);
+    }
+
+    void load(const std::uint16_t* program, std::size_t length) {
+        for (std::uint16_t i = 0; i < length; ++i) {
+            vm.write_memory(0x3000 + i, program[i]);
+            reference.write_memory(0x3000 + i, program[i]);
+        }
+    }
+
+    void poke(std::uint16_t address, std::uint16_t value) {
+        vm.write_memory(address, value);
+        reference.write_memory(address, value);
+    }
+
+    void run_and_compare() {
+        vm.run();
+        while (reference.is_running()) {
+            reference.step();
+        }
+
+        for (int r = R_R0; r < R_COUNT; ++r) {
+            EXPECT_EQ(vm.get_register_value(static_cast<Registers>(r)),
+                      reference.get_register_value(static_cast<Registers>(r))) << "register " << r;
+        }
+        for (std::uint32_t address = 0x3000; address < 0x3300; ++address) {
+            ASSERT_EQ(vm.read_memory(address), reference.read_memory(address)) << "address " << address;
+        }
+#if defined(__x86_64__)
+        EXPECT_GT(vm.jit_compiled_blocks(), 0u);
+#endif
+    }
+};
+
+TEST_F(JitTest, ArithmeticAndBranchConditionsMatchInterpreter) {
+    const std::uint16_t program[] = {
+        0x2212, // 0x3000: LD R1, 0x3013
+        0x54A0, // 0x3001: AND R2, R2, #0
+        0x5DA0, // 0x3002: AND R6, R6, #0
+        0x1481, // 0x3003: ADD R2, R2, R1
+        0x96BF, // 0x3004: NOT R3, R2
+        0x58E7, // 0x3005: AND R4, R3, #7
+        0x1B3D, // 0x3006: ADD R5, R4, #-3
+        0x0801, // 0x3007: BRn 0x3009
+        0x1DA1, // 0x3008: ADD R6, R6, #1
+        0x0401, // 0x3009: BRz 0x300B
+        0x1DA2, // 0x300A: ADD R6, R6, #2
+        0x0201, // 0x300B: BRp 0x300D
+        0x1DA4, // 0x300C: ADD R6, R6, #4
+        0x1160, // 0x300D: ADD R0, R5, #0
+        0x0C01, // 0x300E: BRnz 0x3010
+        0x1FE1, // 0x300F: ADD R7, R7, #1
+        0x127F, // 0x3010: ADD R1, R1, #-1
+        0x03F1, // 0x3011: BRp 0x3003
+        0xF025, // 0x3012: HALT
+        0x0064  // 0x3013: .FILL 100
+    };
+    load(program, sizeof(program) / sizeof(program[0]));
+
+    run_and_compare();
+}
+
+TEST_F(JitTest, SelfLoopOutlastsLoopBudget) {
+    const std::uint16_t program[] = {
+        0x2204, // 0x3000: LD R1, 0x3005
+        0x1023, // 0x3001: ADD R0, R0, #3
+        0x127F, // 0x3002: ADD R1, R1, #-1
+        0x03FD, // 0x3003: BRp 0x3001
+        0xF025, // 0x3004: HALT
+        0x2710  // 0x3005: .FILL 10000
+    };
+    load(program, sizeof(program) / sizeof(program[0]));
+
+    run_and_compare();
+
+    EXPECT_EQ(vm.get_register_value(R_R0), static_cast<std::uint16_t>(3 * 10000));
+}
+
+TEST_F(JitTest, LoadsAndStoresMatchInterpreter) {
+    const std::uint16_t program[] = {
+        0x220E, // 0x3000: LD R1, 0x300F
+        0x280E, // 0x3001: LD R4, 0x3010
+        0xEA0F, // 0x3002: LEA R5, 0x3012
+        0x6500, // 0x3003: LDR R2, R4, #0
+        0x1481, // 0x3004: ADD R2, R2, R1
+        0x7501, // 0x3005: STR R2, R4, #1
+        0x1921, // 0x3006: ADD R4, R4, #1
+        0xA609, // 0x3007: LDI R3, 0x3011
+        0x16E3, // 0x3008: ADD R3, R3, #3
+        0xB607, // 0x3009: STI R3, 0x3011
+        0x2007, // 0x300A: LD R0, 0x3012
+        0x3007, // 0x300B: ST R0, 0x3013
+        0x127F, // 0x300C: ADD R1, R1, #-1
+        0x03F5, // 0x300D: BRp 0x3003
+        0xF025, // 0x300E: HALT
+        0x0064, // 0x300F: .FILL 100
+        0x3100, // 0x3010: .FILL 0x3100
+        0x3012, // 0x3011: .FILL 0x3012
+        0x0000, // 0x3012: .FILL 0
+        0x0000  // 0x3013: .FILL 0
+    };
+    load(program, sizeof(program) / sizeof(program[0]));
+
+    run_and_compare();
+
+    EXPECT_EQ(vm.read_memory(0x3012), 300);
+    EXPECT_EQ(vm.read_memory(0x3013), 300);
+}
+
+TEST_F(JitTest, SubroutineCallsAndJumpsMatchInterpreter) {
+    // Every block in the loop is padded to JIT_MIN_LENGTH so the calls run natively.
+    const std::uint16_t program[] = {
+        0x2219, // 0x3000: LD R1, 0x301A
+        0xEA14, // 0x3001: LEA R5, 0x3016
+        0x1921, // 0x3002: ADD R4, R4, #1
+        0x1921, // 0x3003: ADD R4, R4, #1
+        0x1921, // 0x3004: ADD R4, R4, #1
+        0x480C, // 0x3005: JSR 0x3012
+        0x193F, // 0x3006: ADD R4, R4, #-1
+        0x193F, // 0x3007: ADD R4, R4, #-1
+        0x193F, // 0x3008: ADD R4, R4, #-1
+        0x4140, // 0x3009: JSRR R5
+        0x1DA1, // 0x300A: ADD R6, R6, #1
+        0x1DBF, // 0x300B: ADD R6, R6, #-1
+        0x127F, // 0x300C: ADD R1, R1, #-1
+        0x03F4, // 0x300D: BRp 0x3002
+        0xEC02, // 0x300E: LEA R6, 0x3011
+        0xC180, // 0x300F: JMP R6
+        0x102F, // 0x3010: ADD R0, R0, #15
+        0xF025, // 0x3011: HALT
+        0x14A1, // 0x3012: ADD R2, R2, #1
+        0x14A1, // 0x3013: ADD R2, R2, #1
+        0x14BF, // 0x3014: ADD R2, R2, #-1
+        0xC1C0, // 0x3015: RET
+        0x16C2, // 0x3016: ADD R3, R3, R2
+        0x16E1, // 0x3017: ADD R3, R3, #1
+        0x16FF, // 0x3018: ADD R3, R3, #-1
+        0xC1C0, // 0x3019: RET
+        0x0064  // 0x301A: .FILL 100
+    };
+    load(program, sizeof(program) / sizeof(program[0]));
+
+    run_and_compare();
+
+    EXPECT_EQ(vm.get_register_value(R_R0), 0);
+    EXPECT_EQ(vm.get_register_value(R_R2), 100);
+    EXPECT_EQ(vm.get_register_value(R_R4), 0);
+}
+
+TEST_F(JitTest, ShortCallBlocksStayOnTheSuperblockPath) {
+    // The bench's CALL_LOOP: no block reaches JIT_MIN_LENGTH or loops to itself,
+    // so the JIT must run it exactly as the superblock engine does.
+    const std::uint16_t program[] = {
+        0x2205, // 0x3000: LD R1, 0x3006
+        0x4803, // 0x3001: JSR 0x3005
+        0x127F, // 0x3002: ADD R1, R1, #-1
+        0x03FD, // 0x3003: BRp 0x3001
+        0xF025, // 0x3004: HALT
+        0xC1C0, // 0x3005: RET
+        0x2710  // 0x3006: .FILL 10000
+    };
+    load(program, sizeof(program) / sizeof(program[0]));
+
+    vm.run();
+
+    EXPECT_EQ(vm.get_register_value(R_R1), 0);
+    EXPECT_EQ(vm.jit_compiled_blocks(), 0u);
+}
+
+TEST_F(JitTest, StoreFromCompiledBlockInvalidatesCompiledCode) {
+    const std::uint16_t program[] = {
+        0x220B, // 0x3000: LD R1, 0x300C
+        0x2C0B, // 0x3001: LD R6, 0x300D
+        0x280B, // 0x3002: LD R4, 0x300E
+        0x1B01, // 0x3003: ADD R5, R4, R1
+        0x6B40, // 0x3004: LDR R5, R5, #0
+        0x7D40, // 0x3005: STR R6, R5, #0
+        0x4803, // 0x3006: JSR 0x300A
+        0x127F, // 0x3007: ADD R1, R1, #-1
+        0x03FA, // 0x3008: BRp 0x3003
+        0xF025, // 0x3009: HALT
+        0x14A1, // 0x300A: ADD R2, R2, #1
+        0xC1C0, // 0x300B: RET
+        0x0064, // 0x300C: .FILL 100
+        0x14A2, // 0x300D: .FILL 0x14A2
+        0x3100  // 0x300E: .FILL 0x3100
+    };
+    load(program, sizeof(program) / sizeof(program[0]));
+    // Every iteration stores R6 to table[R1]; only table[40] points at code.
+    for (std::uint16_t i = 1; i <= 100; ++i) {
+        poke(0x3100 + i, i == 40 ? 0x300A : 0x3200);
+    }
+
+    run_and_compare();
+
+    EXPECT_EQ(vm.get_register_value(R_R2), 60 * 1 + 40 * 2);
+}
+
+TEST_F(JitTest, KeyboardStatusReadsGoThroughMemory) {
+    const std::uint16_t program[] = {
+        0x2207, // 0x3000: LD R1, 0x3008
+        0xA407, // 0x3001: LDI R2, 0x3009
+        0x0602, // 0x3002: BRzp 0x3005
+        0xA606, // 0x3003: LDI R3, 0x300A
+        0x1903, // 0x3004: ADD R4, R4, R3
+        0x127F, // 0x3005: ADD R1, R1, #-1
+        0x03FA, // 0x3006: BRp 0x3001
+        0xF025, // 0x3007: HALT
+        0x0064, // 0x3008: .FILL 100
+        0xFE00, // 0x3009: .FILL 0xFE00
+        0xFE02  // 0x300A: .FILL 0xFE02
+    };
+    load(program, sizeof(program) / sizeof(program[0]));
+    poke(Keyboard::MR_KBSR, 0x8000);
+    poke(Keyboard::MR_KBDR, 'a');
+
+    run_and_compare();
+
+    EXPECT_EQ(vm.get_register_value(R_R4), static_cast<std::uint16_t>(100 * 'a'));
+}
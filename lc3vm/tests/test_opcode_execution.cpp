@@ -320,3 +320,92 @@ TEST(LC3VMTest, UndefinedTrapVector_DoesNotIncrementPC)
 
     EXPECT_THROW(vm.step(), std::runtime_error);
 }
+
+TEST(LC3VMTest, DecodeCache_RewrittenInstructionIsRedecoded)
+{
+    LC3State vm;
+    vm.set_register_value(R_R1, 5);
+    vm.set_register_value(R_PC, 0x3000);
+    vm.write_memory(0x3000, (Opcodes::OP_ADD << 12) | (R_R2 << 9) | (R_R1 << 6) | (1 << 5) | 1);
+    vm.step();
+    EXPECT_EQ(vm.get_register_value(R_R2), 6);
+
+    vm.write_memory(0x3000, (Opcodes::OP_ADD << 12) | (R_R2 << 9) | (R_R1 << 6) | (1 << 5) | 3);
+    vm.set_register_value(R_PC, 0x3000);
+    vm.step();
+    EXPECT_EQ(vm.get_register_value(R_R2), 8);
+}
+
+TEST(LC3VMTest, DecodeCache_SelfModifyingStore)
+{
+    LC3State vm;
+    vm.set_register_value(R_PC, 0x3000);
+    vm.set_register_value(R_R1, 0x3000);
+    // 0x3000: ADD R0, R0, #1
+    // 0x3001: LD  R3, 0x3004      ; R3 = ADD R0, R0, #2
+    // 0x3002: STR R3, R1, #0      ; overwrite 0x3000
+    // 0x3003: BRnzp 0x3000
+    // 0x3004: .FILL ADD R0, R0, #2
+    vm.write_memory(0x3000, 0x1021);
+    vm.write_memory(0x3001, (Opcodes::OP_LD << 12) | (R_R3 << 9) | 2);
+    vm.write_memory(0x3002, (Opcodes::OP_STR << 12) | (R_R3 << 9) | (R_R1 << 6));
+    vm.write_memory(0x3003, (Opcodes::OP_BR << 12) | (0x7 << 9) | 0x1FC);
+    vm.write_memory(0x3004, 0x1022);
+
+    for (int i = 0; i < 5; ++i) {
+        vm.step();
+    }
+
+    EXPECT_EQ(vm.get_register_value(R_R0), 3);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3001);
+}
+
+TEST(LC3VMTest, Run_CountingLoopUntilHalt)
+{
+    LC3State vm;
+    vm.use_test_console();
+    vm.write_memory(0x3000, 0x5020); // AND R0, R0, #0
+    vm.write_memory(0x3001, 0x5260); // AND R1, R1, #0
+    vm.write_memory(0x3002, 0x126A); // ADD R1, R1, #10
+    vm.write_memory(0x3003, 0x1023); // ADD R0, R0, #3
+    vm.write_memory(0x3004, 0x127F); // ADD R1, R1, #-1
+    vm.write_memory(0x3005, 0x03FD); // BRp 0x3003
+    vm.write_memory(0x3006, 0xF025); // HALT
+
+    vm.run();
+
+    EXPECT_FALSE(vm.is_running());
+    EXPECT_EQ(vm.get_register_value(R_R0), 30);
+    EXPECT_EQ(vm.get_register_value(R_R1), 0);
+    EXPECT_EQ(vm.get_register_value(R_COND), FL_ZRO);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3007);
+}
+
+TEST(LC3VMTest, Run_SubroutineCallAndReturn)
+{
+    LC3State vm;
+    vm.use_test_console();
+    vm.write_memory(0x3000, 0x4802); // JSR 0x3003
+    vm.write_memory(0x3001, 0x14A1); // ADD R2, R2, #1
+    vm.write_memory(0x3002, 0xF025); // HALT
+    vm.write_memory(0x3003, 0x1265); // ADD R1, R1, #5
+    vm.write_memory(0x3004, 0xC1C0); // RET
+
+    vm.run();
+
+    EXPECT_EQ(vm.get_register_value(R_R1), 5);
+    EXPECT_EQ(vm.get_register_value(R_R2), 1);
+    EXPECT_EQ(vm.get_register_value(R_R7), 0x3003);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3003);
+}
+
+TEST(LC3VMTest, Run_IllegalOpcodeKeepsRegisterState)
+{
+    LC3State vm;
+    vm.write_memory(0x3000, 0x1021); // ADD R0, R0, #1
+    vm.write_memory(0x3001, 0x8000); // RTI
+
+    EXPECT_THROW(vm.run(), std::runtime_error);
+    EXPECT_EQ(vm.get_register_value(R_R0), 1);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3002);
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include "output_buffer.hpp"
+#include "lc3.hpp"
+#include "registers.hpp"
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * Output buffer writing to a non-blocking pipe whose contents can be drained.
+ */
+class OutputBufferTest : public ::testing::Test {
+protected:
+    int pipefd[2];
+
+    void SetUp() override {
+        ASSERT_EQ(pipe(pipefd), 0);
+        fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+        fcntl(pipefd[1], F_SETPIPE_SZ, 1 << 20);
+    }
+
+    void TearDown() override {
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+
+    std::string drain() {
+        std::string data;
+        char chunk[4096];
+        ssize_t n;
+        while ((n = read(pipefd[0], chunk, sizeof(chunk))) > 0) {
+            data.append(chunk, static_cast<std::size_t>(n));
+        }
+        return data;
+    }
+};
+
+TEST_F(OutputBufferTest, HoldsOutputUntilFlushed) {
+    OutputBuffer output(pipefd[1]);
+
+    output.put('o');
+    output.write("k\n", 2);
+
+    EXPECT_EQ(output.pending(), 3u);
+    EXPECT_EQ(drain(), "");
+    output.flush();
+    EXPECT_EQ(output.pending(), 0u);
+    EXPECT_EQ(drain(), "ok\n");
+}
+
+TEST_F(OutputBufferTest, CaptureRedirectsFlushesToString) {
+    OutputBuffer output(pipefd[1]);
+    std::string captured;
+
+    output.put('a');
+    output.capture(&captured);
+    output.put('b');
+    std::string large(OUTPUT_BUFFER_SIZE, 'c');
+    output.write(large.data(), large.size());
+    EXPECT_EQ(captured, "b" + large);
+    output.put('d');
+    output.capture(nullptr);
+    output.put('e');
+    output.flush();
+
+    EXPECT_EQ(captured, "b" + large + "d");
+    EXPECT_EQ(drain(), "ae");
+}
+
+TEST_F(OutputBufferTest, FlushesWhenFull) {
+    OutputBuffer output(pipefd[1]);
+
+    for (int i = 0; i < OUTPUT_BUFFER_SIZE; ++i) {
+        output.put('a');
+    }
+    EXPECT_EQ(drain(), "");
+
+    output.put('b');
+    EXPECT_EQ(drain(), std::string(OUTPUT_BUFFER_SIZE, 'a'));
+    EXPECT_EQ(output.pending(), 1u);
+}
+
+TEST_F(OutputBufferTest, LargeWriteGoesOutWithPendingBytes) {
+    OutputBuffer output(pipefd[1]);
+    std::string large(OUTPUT_BUFFER_SIZE * 2, 'x');
+
+    output.put('<');
+    output.write(large.data(), large.size());
+
+    EXPECT_EQ(output.pending(), 0u);
+    EXPECT_EQ(drain(), "<" + large);
+}
+
+TEST_F(OutputBufferTest, DestructorFlushes) {
+    {
+        OutputBuffer output(pipefd[1]);
+        output.write("bye", 3);
+    }
+    EXPECT_EQ(drain(), "bye");
+}
+
+TEST_F(OutputBufferTest, GuestOutputIsFlushedOnHalt) {
+    LC3State vm;
+    vm.output.set_descriptor(pipefd[1]);
+    vm.write_memory(0x3000, 0xE002); // LEA R0, string
+    vm.write_memory(0x3001, 0xF022); // PUTS
+    vm.write_memory(0x3002, 0xF025); // HALT
+    vm.write_memory(0x3003, 'h');
+    vm.write_memory(0x3004, 'i');
+    vm.write_memory(0x3005, 0);
+
+    RunResult first = vm.run_for(2);
+    EXPECT_EQ(first.reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(drain(), "");
+
+    RunResult second = vm.run_for(1);
+    EXPECT_EQ(second.reason, StopReason::Halted);
+    EXPECT_EQ(drain(), "hiHALT\n");
+}
+
+TEST_F(OutputBufferTest, GuestOutputIsFlushedBeforeReadingInput) {
+    int input[2];
+    ASSERT_EQ(pipe(input), 0);
+    ASSERT_EQ(write(input[1], "q", 1), 1);
+
+    LC3State vm;
+    vm.output.set_descriptor(pipefd[1]);
+    vm.start_input_thread(input[0]);
+    vm.write_memory(0x3000, 0x5020); // AND R0, R0, #0
+    vm.write_memory(0x3001, 0x1023); // ADD R0, R0, #3
+    vm.write_memory(0x3002, 0xF021); // OUT
+    vm.write_memory(0x3003, 0xF023); // IN
+
+    vm.run_for(3);
+    RunResult result;
+    while ((result = vm.run_for(1)).reason == StopReason::WaitingForInput) {
+        std::this_thread::yield();
+    }
+    vm.stop_input_thread();
+
+    EXPECT_EQ(result.reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(vm.get_register_value(R_R0), 'q');
+    EXPECT_EQ(drain(), "\x03" "Enter a character: ");
+    vm.output.flush();
+    EXPECT_EQ(drain(), "q");
+
+    close(input[0]);
+    close(input[1]);
+}
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include "lc3.hpp"
+#include "profile.hpp"
+#include "registers.hpp"
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+/**
+ * Profiles a counting loop on every engine.
+ */
+class ProfileTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    LC3State vm;
+
+    void SetUp() override {
+        vm.use_test_console();
+        vm.set_execution_mode(GetParam());
+        vm.set_profiling(true);
+    }
+
+    /** Counts R1 down from 10, printing a character each time, then halts. */
+    void load_loop() {
+        const std::uint16_t program[] = {
+            0x5260, // AND R1, R1, #0
+            0x126A, // ADD R1, R1, #10
+            0xF021, // loop: OUT
+            0x127F, // ADD R1, R1, #-1
+            0x03FD, // BRp loop
+            0xF025  // HALT
+        };
+        for (std::uint16_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+            vm.write_memory(0x3000 + i, program[i]);
+        }
+    }
+};
+
+TEST_P(ProfileTest, CountsEveryRetiredInstruction) {
+    load_loop();
+
+    RunResult result = vm.run_for(1000);
+
+    ASSERT_EQ(result.reason, StopReason::Halted);
+    const Profile* profile = vm.profile();
+    ASSERT_NE(profile, nullptr);
+    EXPECT_EQ(profile->instructions(), result.instructions);
+    EXPECT_EQ(profile->at(0x3000), 1u);
+    EXPECT_EQ(profile->at(0x3002), 10u);
+    EXPECT_EQ(profile->at(0x3004), 10u);
+    EXPECT_EQ(profile->at(0x3005), 1u);
+    EXPECT_EQ(profile->at(0x3006), 0u);
+    EXPECT_EQ(profile->opcode(OP_ADD), 11u);
+    EXPECT_EQ(profile->opcode(OP_TRAP), 11u);
+    EXPECT_EQ(profile->trap(0x21), 10u);
+    EXPECT_EQ(profile->trap(0x25), 1u);
+
+    std::vector<std::uint16_t> hottest = profile->hottest(3);
+    ASSERT_EQ(hottest.size(), 3u);
+    EXPECT_EQ(hottest[0], 0x3002);
+    EXPECT_EQ(hottest[1], 0x3003);
+    EXPECT_EQ(hottest[2], 0x3004);
+    EXPECT_EQ(profile->hottest(100).size(), 6u);
+}
+
+TEST_P(ProfileTest, SkipsFaultingAndWaitingInstructions) {
+    BufferConsole* console = new BufferConsole();
+    vm.set_console(std::unique_ptr<Console>(console));
+    vm.write_memory(0x3000, 0xF020); // GETC
+    vm.write_memory(0x3001, 0xD000); // RES
+
+    EXPECT_EQ(vm.run_for(100).reason, StopReason::WaitingForInput);
+    EXPECT_EQ(vm.run_for(100).reason, StopReason::WaitingForInput);
+    EXPECT_EQ(vm.profile()->instructions(), 0u);
+
+    console->feed("x");
+    RunResult result = vm.run_for(100);
+
+    EXPECT_EQ(result.reason, StopReason::IllegalOpcode);
+    EXPECT_EQ(result.instructions, 1u);
+    EXPECT_EQ(vm.profile()->at(0x3000), 1u);
+    EXPECT_EQ(vm.profile()->at(0x3001), 0u);
+}
+
+TEST_P(ProfileTest, TurningProfilingOffDiscardsCounts) {
+    load_loop();
+    vm.run();
+    vm.set_profiling(false);
+    EXPECT_EQ(vm.profile(), nullptr);
+    std::ostringstream report;
+    EXPECT_THROW(vm.write_profile(report), std::logic_error);
+
+    vm.set_register_value(R_PC, 0x3000);
+    vm.run();
+    vm.set_profiling(true);
+    EXPECT_EQ(vm.profile()->instructions(), 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, ProfileTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
+
+TEST(ProfileReportTest, ListsHotAddressesBySegment) {
+    char path[] = "/tmp/lc3_profile_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    const unsigned char image[] = {
+        0x30, 0x00, // origin 0x3000
+        0x52, 0x60, // AND R1, R1, #0
+        0x12, 0x63, // ADD R1, R1, #3
+        0x12, 0x7F, // loop: ADD R1, R1, #-1
+        0x03, 0xFE, // BRp loop
+        0x20, 0x02, // LD R0, target
+        0xC0, 0x00, // JMP R0
+        0xF0, 0x25, // HALT
+        0x40, 0x00  // target: .FILL x4000
+    };
+    ASSERT_EQ(write(fd, image, sizeof(image)), static_cast<ssize_t>(sizeof(image)));
+    close(fd);
+
+    LC3State vm;
+    vm.use_test_console();
+    vm.set_profiling(true);
+    vm.load_image(path);
+    unlink(path);
+    vm.write_memory(0x4000, 0xF025); // HALT outside the image
+    vm.run();
+
+    std::ostringstream report;
+    vm.write_profile(report);
+    std::string text = report.str();
+
+    EXPECT_EQ(text.find("Profile of 11 instructions\n"), 0u) << text;
+    EXPECT_NE(text.find("  ADD                  4  36.36%\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("  x25 HALT            1   9.09%\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("  Segment 0x3000-0x3007 (8 words):          10  90.91%\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("             3  27.27%  0x3002: ADD R1, R1, #-1\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("  Outside loaded segments:\n             1   9.09%  0x4000: TRAP x25\n"), std::string::npos) << text;
+    EXPECT_LT(text.find("0x3002: ADD"), text.find("0x3000: AND"));
+    EXPECT_EQ(text.find("0x3006:"), std::string::npos);
+}
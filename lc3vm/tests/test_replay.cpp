@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+#include "replay.hpp"
+#include "lc3.hpp"
+#include "registers.hpp"
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+/**
+ * Console delivering scripted keys, each only after a number of polls, like a slow typist.
+ */
+class TypistConsole : public Console {
+public:
+    TypistConsole(std::string keys, unsigned gap) : keys(std::move(keys)), gap(gap) {}
+
+    std::string captured;
+
+    void connect(OutputBuffer& output) override { output.capture(&captured); }
+    bool key_pending() override { return ready(); }
+    bool read_key(char& c, bool) override {
+        if (!ready()) return false;
+        c = keys[position++];
+        polls = 0;
+        return true;
+    }
+    void wait_for_key(std::chrono::milliseconds) override {}
+
+private:
+    std::string keys;
+    unsigned gap;
+    std::size_t position = 0;
+    unsigned polls = 0;
+
+    bool ready() { return position < keys.size() && ++polls >= gap; }
+};
+
+/**
+ * Records programs into a temporary log and replays them.
+ */
+class ReplayTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    std::string log_path;
+    int output[2];
+
+    void SetUp() override {
+        char path[] = "/tmp/lc3_replay_XXXXXX";
+        int fd = mkstemp(path);
+        ASSERT_NE(fd, -1);
+        close(fd);
+        log_path = path;
+        ASSERT_EQ(pipe(output), 0);
+        fcntl(output[0], F_SETFL, O_NONBLOCK);
+    }
+
+    void TearDown() override {
+        unlink(log_path.c_str());
+        close(output[0]);
+        close(output[1]);
+    }
+
+    /** Echoes keys read by polling KBSR until a newline. */
+    void load_poller(LC3State& vm) {
+        const std::uint16_t program[] = {
+            0xA007, // LDI R0, [KBSR]
+            0x07FE, // BRzp back
+            0xA006, // LDI R0, [KBDR]
+            0xF021, // OUT
+            0x1236, // ADD R1, R0, #-10
+            0x0401, // BRz done
+            0x0FF9, // BRnzp to the start
+            0xF025, // done: HALT
+            0xFE00, // KBSR
+            0xFE02  // KBDR
+        };
+        for (std::uint16_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+            vm.write_memory(0x3000 + i, program[i]);
+        }
+    }
+
+    /** Reads keys with GETC, counting them in R2, until a newline. */
+    void load_getc(LC3State& vm) {
+        const std::uint16_t program[] = {
+            0xF020, // GETC
+            0x14A1, // ADD R2, R2, #1
+            0x1236, // ADD R1, R0, #-10
+            0x0BFC, // BRnp to the start
+            0xF025  // HALT
+        };
+        for (std::uint16_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+            vm.write_memory(0x3000 + i, program[i]);
+        }
+    }
+
+    RunResult record(LC3State& vm, Console* inner, std::uint64_t slice) {
+        RecordingConsole* recorder = new RecordingConsole(std::unique_ptr<Console>(inner), log_path, slice);
+        vm.set_console(std::unique_ptr<Console>(recorder));
+        return run_recorded(vm, *recorder); // Writes out the whole log.
+    }
+
+    RunResult replay(LC3State& vm) {
+        ReplayConsole* replayer = new ReplayConsole(log_path, output[1]);
+        vm.set_console(std::unique_ptr<Console>(replayer));
+        return run_replayed(vm, *replayer);
+    }
+
+    std::string drain() {
+        std::string data;
+        char chunk[256];
+        ssize_t n;
+        while ((n = read(output[0], chunk, sizeof(chunk))) > 0) {
+            data.append(chunk, static_cast<std::size_t>(n));
+        }
+        return data;
+    }
+};
+
+TEST_P(ReplayTest, ReplaysPolledKeysExactly) {
+    LC3State recorded;
+    load_poller(recorded);
+    TypistConsole* typist = new TypistConsole("hello\n", 5000);
+    RunResult original = record(recorded, typist, 1000);
+    ASSERT_EQ(original.reason, StopReason::Halted);
+    ASSERT_EQ(typist->captured, "hello\nHALT\n");
+
+    LC3State replayed;
+    replayed.set_execution_mode(GetParam());
+    load_poller(replayed);
+    RunResult result = replay(replayed);
+
+    EXPECT_EQ(result.reason, StopReason::Halted);
+    EXPECT_EQ(result.instructions, original.instructions);
+    EXPECT_EQ(drain(), "hello\nHALT\n");
+    EXPECT_TRUE(replayed.state_equals(recorded));
+
+    // About 30,000 polls, run-length encoded per slice.
+    std::ifstream log(log_path, std::ios::binary | std::ios::ate);
+    EXPECT_LT(static_cast<long>(log.tellg()), 1000);
+}
+
+TEST_P(ReplayTest, ReplaysGetcAcrossWaits) {
+    LC3State recorded;
+    recorded.set_execution_mode(GetParam());
+    load_getc(recorded);
+    RunResult original = record(recorded, new TypistConsole("abc\n", 3), 2);
+    ASSERT_EQ(original.reason, StopReason::Halted);
+    ASSERT_EQ(recorded.get_register_value(R_R2), 4);
+
+    LC3State replayed;
+    load_getc(replayed);
+    RunResult result = replay(replayed);
+
+    EXPECT_EQ(result.instructions, original.instructions);
+    EXPECT_EQ(replayed.get_register_value(R_R2), 4);
+    EXPECT_TRUE(replayed.state_equals(recorded));
+}
+
+TEST_P(ReplayTest, DetectsDivergence) {
+    LC3State recorded;
+    load_poller(recorded);
+    record(recorded, new TypistConsole("hi\n", 100), 50);
+
+    LC3State other;
+    other.set_execution_mode(GetParam());
+    load_getc(other);
+    EXPECT_THROW(replay(other), std::runtime_error);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, ReplayTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
+
+TEST(ReplayConsoleTest, RejectsFilesThatAreNotLogs) {
+    char path[] = "/tmp/lc3_replay_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(write(fd, "LC3X\x01\x10", 6), 6);
+    close(fd);
+
+    EXPECT_THROW(ReplayConsole console(path), std::runtime_error);
+    EXPECT_THROW(ReplayConsole console(std::string(path) + ".missing"), std::runtime_error);
+    unlink(path);
+}
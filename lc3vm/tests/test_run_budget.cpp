@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+#include "lc3.hpp"
+#include "registers.hpp"
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * Exercises run_for() and run_until() on every execution engine. The counting
+ * loop retires exactly 3 * count + 2 instructions.
+ */
+class RunBudgetTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    LC3State vm;
+
+    void SetUp() override {
+        vm.use_test_console();
+        vm.set_execution_mode(GetParam());
+    }
+
+    void load_counting_loop(std::uint16_t count) {
+        vm.write_memory(0x3000, 0x2204); // LD R1, 0x3005
+        vm.write_memory(0x3001, 0x1023); // ADD R0, R0, #3
+        vm.write_memory(0x3002, 0x127F); // ADD R1, R1, #-1
+        vm.write_memory(0x3003, 0x03FD); // BRp 0x3001
+        vm.write_memory(0x3004, 0xF025); // HALT
+        vm.write_memory(0x3005, count);
+    }
+};
+
+TEST_P(RunBudgetTest, RunsToHaltWithExactInstructionCount) {
+    load_counting_loop(1000);
+
+    RunResult result = vm.run_for(1000000);
+
+    EXPECT_EQ(result.reason, StopReason::Halted);
+    EXPECT_EQ(result.fault_pc, 0);
+    EXPECT_EQ(result.instructions, 3u * 1000 + 2);
+    EXPECT_EQ(vm.get_register_value(R_R0), 3000);
+    EXPECT_FALSE(vm.is_running());
+}
+
+TEST_P(RunBudgetTest, StopsExactlyAtBudgetAndResumes) {
+    load_counting_loop(1000);
+
+    RunResult first = vm.run_for(10);
+    EXPECT_EQ(first.reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(first.instructions, 10u);
+    EXPECT_TRUE(vm.is_running());
+    // LD, then three passes through the loop.
+    EXPECT_EQ(vm.get_register_value(R_R0), 9);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3001);
+
+    RunResult rest = vm.run_for(1000000);
+    EXPECT_EQ(rest.reason, StopReason::Halted);
+    EXPECT_EQ(first.instructions + rest.instructions, 3u * 1000 + 2);
+    EXPECT_EQ(vm.get_register_value(R_R0), 3000);
+}
+
+TEST_P(RunBudgetTest, HaltRequestsBetweenSlicesAreKept) {
+    load_counting_loop(1000);
+
+    EXPECT_EQ(vm.run_for(10).reason, StopReason::BudgetExhausted);
+    vm.request_halt();
+    RunResult halted = vm.run_for(1000000);
+
+    EXPECT_EQ(halted.reason, StopReason::Halted);
+    EXPECT_EQ(halted.instructions, 0u);
+    EXPECT_FALSE(vm.is_running());
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3001);
+}
+
+TEST_P(RunBudgetTest, HaltRequestsStopAtTheNextTrap) {
+    vm.write_memory(0x3000, 0xF022); // PUTS of the empty string at 0x0000
+    vm.write_memory(0x3001, 0x0FFE); // BRnzp 0x3000
+    std::thread requester([this] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        vm.request_halt();
+    });
+
+    RunResult result = vm.run_for(2000000000);
+    requester.join();
+
+    EXPECT_EQ(result.reason, StopReason::Halted);
+    EXPECT_LT(result.instructions, 2000000000u);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3001);
+}
+
+TEST_P(RunBudgetTest, LargeBudgetsStopExactly) {
+    load_counting_loop(30000);
+
+    RunResult first = vm.run_for(70001);
+    EXPECT_EQ(first.reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(first.instructions, 70001u);
+    // LD, 23333 passes, then the ADD of the next one.
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3002);
+    EXPECT_EQ(vm.get_register_value(R_R0), static_cast<std::uint16_t>(3 * 23334));
+
+    RunResult rest = vm.run_for(1000000);
+    EXPECT_EQ(rest.reason, StopReason::Halted);
+    EXPECT_EQ(first.instructions + rest.instructions, 3u * 30000 + 2);
+}
+
+TEST_P(RunBudgetTest, ChargesRunsWrappingAroundMemory) {
+    // Zeroed memory is BR without conditions, which never branches.
+    RunResult result = vm.run_for(3 * MEMORY_MAX + 5);
+
+    EXPECT_EQ(result.reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(result.instructions, 3u * MEMORY_MAX + 5);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3005);
+}
+
+TEST_P(RunBudgetTest, SmallSlicesAddUpToFullRun) {
+    load_counting_loop(5000);
+
+    std::uint64_t total = 0;
+    RunResult result;
+    do {
+        result = vm.run_for(7);
+        EXPECT_LE(result.instructions, 7u);
+        total += result.instructions;
+    } while (result.reason == StopReason::BudgetExhausted);
+
+    EXPECT_EQ(result.reason, StopReason::Halted);
+    EXPECT_EQ(total, 3u * 5000 + 2);
+    EXPECT_EQ(vm.get_register_value(R_R0), static_cast<std::uint16_t>(3 * 5000));
+}
+
+TEST_P(RunBudgetTest, IllegalOpcodeReportsFaultPc) {
+    vm.write_memory(0x3000, 0x1021); // ADD R0, R0, #1
+    vm.write_memory(0x3001, 0x1021); // ADD R0, R0, #1
+    vm.write_memory(0x3002, 0xD000); // RES
+
+    RunResult result;
+    EXPECT_NO_THROW(result = vm.run_for(100));
+
+    EXPECT_EQ(result.reason, StopReason::IllegalOpcode);
+    EXPECT_EQ(result.fault_pc, 0x3002);
+    EXPECT_EQ(result.instructions, 2u);
+    EXPECT_EQ(vm.get_register_value(R_R0), 2);
+}
+
+TEST_P(RunBudgetTest, UnknownTrapReportsFaultPc) {
+    vm.write_memory(0x3000, 0x1021); // ADD R0, R0, #1
+    vm.write_memory(0x3001, 0xF0FF); // TRAP xFF
+
+    RunResult result;
+    EXPECT_NO_THROW(result = vm.run_for(100));
+
+    EXPECT_EQ(result.reason, StopReason::UnknownTrap);
+    EXPECT_EQ(result.fault_pc, 0x3001);
+    EXPECT_EQ(result.instructions, 1u);
+}
+
+TEST_P(RunBudgetTest, GetcWithoutInputWaitsAndRetries) {
+    vm.set_console(std::unique_ptr<Console>(new FdConsole()));
+    int pipefd[2];
+    ASSERT_EQ(pipe(pipefd), 0);
+    int original_stdin = dup(STDIN_FILENO);
+    ASSERT_NE(original_stdin, -1);
+    ASSERT_EQ(dup2(pipefd[0], STDIN_FILENO), STDIN_FILENO);
+
+    vm.write_memory(0x3000, 0x1021); // ADD R0, R0, #1
+    vm.write_memory(0x3001, 0xF020); // GETC
+    vm.write_memory(0x3002, 0xF025); // HALT
+
+    RunResult waiting = vm.run_for(100);
+    EXPECT_EQ(waiting.reason, StopReason::WaitingForInput);
+    EXPECT_EQ(waiting.fault_pc, 0x3001);
+    EXPECT_EQ(waiting.instructions, 1u);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3001);
+    EXPECT_EQ(vm.get_register_value(R_R7), 0);
+
+    const char input = 'k';
+    ASSERT_EQ(write(pipefd[1], &input, 1), 1);
+    RunResult resumed = vm.run_for(1);
+    EXPECT_EQ(resumed.reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(resumed.instructions, 1u);
+    EXPECT_EQ(vm.get_register_value(R_R0), 'k');
+    EXPECT_EQ(vm.get_register_value(R_R7), 0x3002);
+
+    ASSERT_EQ(dup2(original_stdin, STDIN_FILENO), STDIN_FILENO);
+    close(original_stdin);
+    close(pipefd[0]);
+    close(pipefd[1]);
+}
+
+TEST_P(RunBudgetTest, RunUntilPastDeadlineDoesNothing) {
+    load_counting_loop(1000);
+
+    RunResult result = vm.run_until(std::chrono::steady_clock::now() - std::chrono::seconds(1));
+
+    EXPECT_EQ(result.reason, StopReason::BudgetExhausted);
+    EXPECT_EQ(result.instructions, 0u);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3000);
+}
+
+TEST_P(RunBudgetTest, RunUntilStopsAtHalt) {
+    load_counting_loop(30000);
+
+    RunResult result = vm.run_until(std::chrono::steady_clock::now() + std::chrono::seconds(60));
+
+    EXPECT_EQ(result.reason, StopReason::Halted);
+    EXPECT_EQ(result.instructions, 3u * 30000 + 2);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, RunBudgetTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include "fleet.hpp"
+#include "image.hpp"
+#include "lc3.hpp"
+#include "memory.hpp"
+#include "registers.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Writes object files into temporary files that are removed afterwards.
+ */
+class SharedImageTest : public ::testing::Test {
+protected:
+    std::vector<std::string> files;
+
+    void TearDown() override {
+        for (const auto& file : files) {
+            unlink(file.c_str());
+        }
+    }
+
+    std::string write_image(std::uint16_t origin, const std::vector<std::uint16_t>& words) {
+        char path[] = "/tmp/lc3_shared_XXXXXX";
+        int fd = mkstemp(path);
+        EXPECT_NE(fd, -1);
+        std::vector<unsigned char> bytes = {static_cast<unsigned char>(origin >> 8), static_cast<unsigned char>(origin)};
+        for (std::uint16_t word : words) {
+            bytes.push_back(static_cast<unsigned char>(word >> 8));
+            bytes.push_back(static_cast<unsigned char>(word));
+        }
+        EXPECT_EQ(write(fd, bytes.data(), bytes.size()), static_cast<ssize_t>(bytes.size()));
+        close(fd);
+        files.push_back(path);
+        return path;
+    }
+
+    /** Program storing R0 + 1 at 0x3004, followed by a large data block. */
+    std::vector<std::string> counter_program() {
+        std::vector<std::uint16_t> data(0xB000);
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<std::uint16_t>(i * 7);
+        }
+        return {
+            write_image(0x3000, {
+                0x1021, // ADD R0, R0, #1
+                0x3002, // ST R0, result (0x3004)
+                0xF025  // HALT
+            }),
+            write_image(0x4000, data)
+        };
+    }
+};
+
+/**
+ * Returns the Private_Dirty total of the process in KiB, or -1 if unavailable.
+ */
+static long private_dirty_kib() {
+    std::ifstream rollup("/proc/self/smaps_rollup");
+    std::string line;
+    while (std::getline(rollup, line)) {
+        if (line.compare(0, 14, "Private_Dirty:") == 0) {
+            return std::strtol(line.c_str() + 14, nullptr, 10);
+        }
+    }
+    return -1;
+}
+
+TEST_F(SharedImageTest, HoldsFilesInLoadOrder) {
+    std::string first = write_image(0x3000, {0x1111, 0x2222, 0x3333});
+    std::string second = write_image(0x3001, {0x4444});
+
+    SharedImage image({first, second});
+
+    EXPECT_EQ(image.words()[0x3000], 0x1111);
+    EXPECT_EQ(image.words()[0x3001], 0x4444);
+    EXPECT_EQ(image.words()[0x3002], 0x3333);
+    EXPECT_EQ(image.words()[0x2FFF], 0);
+    ASSERT_EQ(image.ranges().size(), 2u);
+    EXPECT_EQ(image.ranges()[0], (std::pair<std::uint16_t, std::uint16_t>(0x3000, 3)));
+    EXPECT_EQ(image.ranges()[1], (std::pair<std::uint16_t, std::uint16_t>(0x3001, 1)));
+    EXPECT_THROW(SharedImage({first, first + ".missing"}), std::runtime_error);
+}
+
+TEST_F(SharedImageTest, WritesStayPrivateToEachVm) {
+    std::unique_ptr<SharedImage> image(new SharedImage(counter_program()));
+    LC3State first;
+    LC3State second;
+    first.use_test_console();
+    second.use_test_console();
+    first.load_shared_image(*image);
+    second.load_shared_image(*image);
+    image.reset(); // The VMs keep their views.
+
+    first.set_register_value(R_R0, 10);
+    first.run();
+    second.set_register_value(R_R0, 20);
+    second.run();
+
+    EXPECT_EQ(first.read_memory(0x3004), 11);
+    EXPECT_EQ(second.read_memory(0x3004), 21);
+    EXPECT_EQ(first.read_memory(0x4000 + 100), 700);
+    second.write_memory(0x4000 + 100, 1);
+    EXPECT_EQ(first.read_memory(0x4000 + 100), 700);
+    EXPECT_TRUE(first.memory.is_dirty(0x4000));
+
+    first.reset();
+    EXPECT_EQ(first.read_memory(0x4000 + 100), 0);
+    EXPECT_EQ(first.read_memory(0x3000), 0);
+}
+
+TEST_F(SharedImageTest, ReplacesCodeTheVmAlreadyRan) {
+    std::string adds_one = write_image(0x3000, {0x1021, 0xF025});   // ADD R0, R0, #1; HALT
+    std::string adds_two = write_image(0x3000, {0x1022, 0xF025});   // ADD R0, R0, #2; HALT
+    SharedImage one({adds_one});
+    SharedImage two({adds_two});
+    LC3State vm;
+    vm.use_test_console();
+    vm.set_execution_mode(ExecutionMode::Jit);
+
+    vm.load_shared_image(one);
+    for (int i = 0; i < 40; ++i) {
+        vm.set_register_value(R_PC, 0x3000);
+        vm.run();
+    }
+    ASSERT_EQ(vm.get_register_value(R_R0), 40);
+
+    vm.load_shared_image(two);
+    vm.set_register_value(R_PC, 0x3000);
+    vm.run();
+    EXPECT_EQ(vm.get_register_value(R_R0), 42);
+}
+
+TEST_F(SharedImageTest, VmsOnlyAllocateThePagesTheyWrite) {
+    SharedImage image(counter_program());
+    long before = private_dirty_kib();
+    if (before < 0) GTEST_SKIP() << "/proc/self/smaps_rollup not available";
+
+    const int count = 64;
+    std::vector<std::unique_ptr<Memory>> memories;
+    for (int i = 0; i < count; ++i) {
+        memories.emplace_back(new Memory());
+        memories.back()->map_image(image);
+        ASSERT_TRUE(memories.back()->equals(*memories.front()));
+        memories.back()->write(0x3004, static_cast<std::uint16_t>(i));
+    }
+    long growth = private_dirty_kib() - before;
+
+    // A private copy of the image would be over 100 KiB per memory.
+    EXPECT_LT(growth, count * 32);
+    EXPECT_EQ(memories[5]->read(0x3004), 5);
+    EXPECT_EQ(memories[5]->read(0x4000 + 3), 21);
+}
+
+TEST_F(SharedImageTest, FleetSharesImagesBetweenJobs) {
+    std::vector<std::string> program = counter_program();
+    std::vector<FleetJob> jobs(6);
+    jobs[4].images = {program[0], program[1] + ".missing"};
+    jobs[5].images = jobs[4].images;
+    for (int i = 0; i < 4; ++i) {
+        jobs[i].images = program;
+    }
+
+    std::vector<FleetResult> results = Fleet(2).run(jobs);
+
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(results[i].error.empty());
+        EXPECT_EQ(results[i].reason, StopReason::Halted);
+        EXPECT_EQ(results[i].instructions, 3u);
+        EXPECT_EQ(results[i].output, "HALT\n");
+    }
+    EXPECT_FALSE(results[4].error.empty());
+    EXPECT_EQ(results[5].error, results[4].error);
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include "simd.hpp"
+#include "lc3.hpp"
+#include "memory.hpp"
+#include "registers.hpp"
+#include <random>
+#include <vector>
+
+/**
+ * Runs every kernel test once per instruction set the host supports.
+ */
+class SimdKernelTest : public ::testing::TestWithParam<SimdLevel> {
+protected:
+    SimdLevel previous;
+    std::mt19937 random{42};
+
+    void SetUp() override {
+        previous = simd_level();
+        if (!set_simd_level(GetParam())) {
+            GTEST_SKIP() << "Instruction set not supported by this CPU";
+        }
+    }
+
+    void TearDown() override {
+        set_simd_level(previous);
+    }
+
+    std::vector<std::uint16_t> random_words(std::size_t count) {
+        std::vector<std::uint16_t> words(count);
+        for (auto& word : words) {
+            word = static_cast<std::uint16_t>(random());
+        }
+        return words;
+    }
+};
+
+TEST_P(SimdKernelTest, SwapCopyMatchesScalarAtEveryLengthAndOffset) {
+    std::vector<std::uint16_t> source = random_words(80);
+    for (std::size_t offset = 0; offset < 3; ++offset) {
+        for (std::size_t count = 0; count + offset <= 70; ++count) {
+            std::vector<std::uint16_t> destination(72, 0xAAAA);
+            swap16_copy(destination.data() + offset, source.data() + offset, count);
+            for (std::size_t i = 0; i < destination.size(); ++i) {
+                std::uint16_t expected = 0xAAAA;
+                if (i >= offset && i < offset + count) {
+                    expected = static_cast<std::uint16_t>((source[i] << 8) | (source[i] >> 8));
+                }
+                ASSERT_EQ(destination[i], expected) << "offset " << offset << " count " << count << " index " << i;
+            }
+        }
+    }
+}
+
+TEST_P(SimdKernelTest, MismatchFindsFirstDifference) {
+    std::vector<std::uint16_t> a = random_words(100);
+    for (std::size_t count = 0; count <= 70; ++count) {
+        EXPECT_EQ(mismatch16(a.data(), a.data(), count), count);
+        EXPECT_TRUE(equal16(a.data(), a.data(), count));
+        for (std::size_t diff = 0; diff < count; ++diff) {
+            std::vector<std::uint16_t> b = a;
+            b[diff] ^= 0x0100;
+            if (diff + 1 < count) b[count - 1] ^= 1;
+            ASSERT_EQ(mismatch16(a.data(), b.data(), count), diff) << "count " << count;
+            ASSERT_FALSE(equal16(a.data(), b.data(), count));
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(AllLevels, SimdKernelTest,
+                         ::testing::Values(SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2));
+
+TEST(SimdDispatchTest, ScalarIsAlwaysSupported) {
+    EXPECT_TRUE(simd_supported(SimdLevel::Scalar));
+    EXPECT_TRUE(simd_supported(simd_level()));
+}
+
+TEST(MemoryCompareTest, WalksAllDifferences) {
+    Memory a;
+    Memory b;
+    EXPECT_TRUE(a.equals(b));
+    EXPECT_EQ(a.first_difference(b), static_cast<std::size_t>(MEMORY_MAX));
+
+    b.memory[0x0000] = 1;
+    b.memory[0x3005] = 2;
+    b.memory[0xFFFF] = 3;
+
+    EXPECT_FALSE(a.equals(b));
+    std::vector<std::size_t> differences;
+    for (std::size_t at = a.first_difference(b); at < MEMORY_MAX; at = a.first_difference(b, at + 1)) {
+        differences.push_back(at);
+    }
+    EXPECT_EQ(differences, (std::vector<std::size_t>{0x0000, 0x3005, 0xFFFF}));
+}
+
+TEST(VmResetTest, ResetMatchesFreshVm) {
+    LC3State vm;
+    vm.use_test_console();
+    vm.set_execution_mode(ExecutionMode::Superblock);
+    vm.write_memory(0x3000, 0x1021); // ADD R0, R0, #1
+    vm.write_memory(0x3001, 0xF025); // HALT
+    vm.run();
+    ASSERT_EQ(vm.get_register_value(R_R0), 1);
+
+    vm.reset();
+
+    LC3State fresh;
+    EXPECT_TRUE(vm.state_equals(fresh));
+    EXPECT_TRUE(vm.is_running());
+
+    // The old translation must be gone: new code at the same address runs.
+    vm.use_test_console();
+    vm.write_memory(0x3000, 0x1022); // ADD R0, R0, #2
+    vm.write_memory(0x3001, 0xF025); // HALT
+    vm.run();
+    EXPECT_EQ(vm.get_register_value(R_R0), 2);
+    EXPECT_FALSE(vm.state_equals(fresh));
+}
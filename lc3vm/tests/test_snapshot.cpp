@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include "lc3.hpp"
+#include "console.hpp"
+#include "device.hpp"
+#include "keyboard.hpp"
+#include "memory.hpp"
+#include "registers.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * Device counting its reads, with the count as saved state.
+ */
+class CountingDevice : public Device {
+public:
+    std::uint8_t count = 0;
+
+    std::uint16_t read(Memory&, std::uint16_t) override { return ++count; }
+    void write(Memory&, std::uint16_t, std::uint16_t) override {}
+    std::vector<std::uint8_t> save_state() const override { return {count}; }
+    void restore_state(const std::vector<std::uint8_t>& state) override { count = state.at(0); }
+};
+
+class SnapshotTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    LC3State vm;
+
+    void SetUp() override {
+        vm.use_test_console();
+        vm.set_execution_mode(GetParam());
+    }
+
+    void load(std::uint16_t origin, const std::vector<std::uint16_t>& program) {
+        for (std::size_t i = 0; i < program.size(); ++i) {
+            vm.write_memory(static_cast<std::uint16_t>(origin + i), program[i]);
+        }
+        vm.set_register_value(R_PC, origin);
+    }
+};
+
+TEST_P(SnapshotTest, RestoreResumesFromSnapshotPoint) {
+    load(0x3000, {
+        0x5020, // AND R0, R0, #0
+        0x2204, // LD R1, count
+        0x1021, // ADD R0, R0, #1
+        0x127F, // ADD R1, R1, #-1
+        0x03FD, // BRp back to ADD R0
+        0xF025, // HALT
+        0x03E8  // count: .FILL 1000
+    });
+    RunResult first = vm.run_for(500);
+    ASSERT_EQ(first.reason, StopReason::BudgetExhausted);
+    Snapshot snapshot = vm.snapshot();
+    std::uint16_t r0 = vm.get_register_value(R_R0);
+    std::uint16_t pc = vm.get_register_value(R_PC);
+
+    vm.run();
+    ASSERT_EQ(vm.get_register_value(R_R0), 1000);
+    ASSERT_FALSE(vm.is_running());
+
+    vm.restore(snapshot);
+    EXPECT_TRUE(vm.is_running());
+    EXPECT_EQ(vm.get_register_value(R_R0), r0);
+    EXPECT_EQ(vm.get_register_value(R_PC), pc);
+    vm.run();
+    EXPECT_EQ(vm.get_register_value(R_R0), 1000);
+}
+
+TEST_P(SnapshotTest, RestoreDropsCodeTranslatedAfterSnapshot) {
+    load(0x3000, {0x1021, 0xF025}); // ADD R0, R0, #1; HALT
+    Snapshot snapshot = vm.snapshot();
+
+    for (int i = 0; i < 40; ++i) {
+        vm.set_register_value(R_PC, 0x3000);
+        vm.run();
+    }
+    vm.write_memory(0x3000, 0x1022); // ADD R0, R0, #2
+    vm.set_register_value(R_R0, 0);
+    vm.set_register_value(R_PC, 0x3000);
+    vm.run();
+    ASSERT_EQ(vm.get_register_value(R_R0), 2);
+
+    vm.restore(snapshot);
+    vm.run();
+    EXPECT_EQ(vm.get_register_value(R_R0), 1);
+}
+
+TEST_P(SnapshotTest, RepeatedJobsFromOneSnapshot) {
+    load(0x3000, {
+        0x2003, // LD R0, input
+        0x1000, // ADD R0, R0, R0
+        0x3002, // ST R0, output
+        0xF025, // HALT
+        0x0000, // input
+        0x0000  // output
+    });
+    Snapshot boot = vm.snapshot();
+
+    for (std::uint16_t job = 1; job <= 50; ++job) {
+        vm.restore(boot);
+        vm.write_memory(0x3004, job);
+        vm.run();
+        ASSERT_EQ(vm.read_memory(0x3005), 2 * job);
+    }
+}
+
+TEST_P(SnapshotTest, DeviceStateIsRestored) {
+    CountingDevice device;
+    vm.memory.map_device(0x4000, &device);
+    load(0x3000, {
+        0xA202, // LDI R1, device
+        0xA201, // LDI R1, device
+        0xF025, // HALT
+        0x4000  // device: .FILL 0x4000
+    });
+
+    Snapshot snapshot = vm.snapshot();
+    vm.run();
+    ASSERT_EQ(device.count, 2);
+    ASSERT_EQ(vm.get_register_value(R_R1), 2);
+
+    vm.restore(snapshot);
+    EXPECT_EQ(device.count, 0);
+    vm.run();
+    EXPECT_EQ(vm.get_register_value(R_R1), 2);
+}
+
+TEST_P(SnapshotTest, RestoresIntoAnotherVm) {
+    load(0x3000, {0x1025, 0xF025}); // ADD R0, R0, #5; HALT
+    vm.run();
+    Snapshot snapshot = vm.snapshot();
+
+    LC3State other;
+    EXPECT_FALSE(other.state_equals(vm));
+    other.restore(snapshot);
+
+    EXPECT_TRUE(other.state_equals(vm));
+    EXPECT_FALSE(other.is_running());
+}
+
+TEST(SnapshotKeyboardTest, RestoresKeyboardRegisters) {
+    LC3State vm;
+    vm.set_console(std::unique_ptr<Console>(new BufferConsole("z")));
+    Snapshot snapshot = vm.snapshot();
+
+    ASSERT_EQ(vm.read_memory(Keyboard::MR_KBSR), 0x8000);
+    ASSERT_EQ(vm.read_memory(Keyboard::MR_KBDR), 'z');
+    EXPECT_EQ(vm.memory_changes(snapshot),
+              (std::vector<std::uint16_t>{Keyboard::MR_KBSR, Keyboard::MR_KBDR}));
+
+    vm.restore(snapshot);
+    EXPECT_EQ(vm.memory.memory[Keyboard::MR_KBSR], 0);
+    EXPECT_EQ(vm.memory.memory[Keyboard::MR_KBDR], 0);
+    EXPECT_TRUE(vm.memory_changes(snapshot).empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, SnapshotTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
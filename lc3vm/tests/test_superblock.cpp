@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include "lc3.hpp"
+#include "registers.hpp"
+#include "flags.hpp"
+#include "opcodes.hpp"
+
+class SuperblockTest : public ::testing::Test {
+protected:
+    LC3State vm;
+
+    void SetUp() override {
+        vm.use_test_console();
+        vm.set_execution_mode(ExecutionMode::Superblock);
+    }
+};
+
+TEST_F(SuperblockTest, CountingLoopMatchesInterpreter) {
+    const std::uint16_t program[] = {
+        0x5020, // AND R0, R0, #0
+        0x5260, // AND R1, R1, #0
+        0x126A, // ADD R1, R1, #10
+        0x1023, // ADD R0, R0, #3
+        0x127F, // ADD R1, R1, #-1
+        0x03FD, // BRp 0x3003
+        0xF025  // HALT
+    };
+    LC3State reference;
+    reference.use_test_console();
+    for (std::uint16_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+        vm.write_memory(0x3000 + i, program[i]);
+        reference.write_memory(0x3000 + i, program[i]);
+    }
+
+    vm.run();
+    while (reference.is_running()) {
+        reference.step();
+    }
+
+    for (int r = R_R0; r < R_COUNT; ++r) {
+        EXPECT_EQ(vm.get_register_value(static_cast<Registers>(r)),
+                  reference.get_register_value(static_cast<Registers>(r))) << "register " << r;
+    }
+    EXPECT_EQ(vm.get_register_value(R_R0), 30);
+}
+
+TEST_F(SuperblockTest, PcRelativeLoadsAndStores) {
+    vm.write_memory(0x3000, 0x2205); // LD R1, 0x3006
+    vm.write_memory(0x3001, 0xE405); // LEA R2, 0x3007
+    vm.write_memory(0x3002, 0x1261); // ADD R1, R1, #1
+    vm.write_memory(0x3003, 0x3204); // ST R1, 0x3008
+    vm.write_memory(0x3004, 0xA602); // LDI R3, 0x3007
+    vm.write_memory(0x3005, 0xF025); // HALT
+    vm.write_memory(0x3006, 41);
+    vm.write_memory(0x3007, 0x3006);
+
+    vm.run();
+
+    EXPECT_EQ(vm.get_register_value(R_R1), 42);
+    EXPECT_EQ(vm.get_register_value(R_R2), 0x3007);
+    EXPECT_EQ(vm.get_register_value(R_R3), 41);
+    EXPECT_EQ(vm.read_memory(0x3008), 42);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3006);
+}
+
+TEST_F(SuperblockTest, SubroutineCallAndReturn) {
+    vm.write_memory(0x3000, 0x4802); // JSR 0x3003
+    vm.write_memory(0x3001, 0x14A1); // ADD R2, R2, #1
+    vm.write_memory(0x3002, 0xF025); // HALT
+    vm.write_memory(0x3003, 0x1265); // ADD R1, R1, #5
+    vm.write_memory(0x3004, 0xC1C0); // RET
+
+    vm.run();
+
+    EXPECT_EQ(vm.get_register_value(R_R1), 5);
+    EXPECT_EQ(vm.get_register_value(R_R2), 1);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3003);
+}
+
+TEST_F(SuperblockTest, StoreIntoCurrentBlockIsObserved) {
+    vm.set_register_value(R_R1, 0x3003);
+    vm.write_memory(0x3000, 0x2404); // LD R2, 0x3005
+    vm.write_memory(0x3001, 0x7440); // STR R2, R1, #0   ; overwrite 0x3003
+    vm.write_memory(0x3002, 0x1021); // ADD R0, R0, #1
+    vm.write_memory(0x3003, 0x1021); // ADD R0, R0, #1   ; becomes ADD R0, R0, #5
+    vm.write_memory(0x3004, 0xF025); // HALT
+    vm.write_memory(0x3005, 0x1025);
+
+    vm.run();
+
+    EXPECT_EQ(vm.get_register_value(R_R0), 6);
+}
+
+TEST_F(SuperblockTest, ChainedBlockIsRetranslatedAfterWrite) {
+    vm.write_memory(0x3000, 0x0E01); // BRnzp 0x3002
+    vm.write_memory(0x3001, 0xF025); // HALT
+    vm.write_memory(0x3002, 0x1021); // ADD R0, R0, #1
+    vm.write_memory(0x3003, 0x0FFD); // BRnzp 0x3001
+
+    vm.run();
+    EXPECT_EQ(vm.get_register_value(R_R0), 1);
+
+    vm.write_memory(0x3002, 0x1027); // ADD R0, R0, #7
+    vm.set_register_value(R_PC, 0x3000);
+    vm.run();
+    EXPECT_EQ(vm.get_register_value(R_R0), 8);
+}
+
+TEST_F(SuperblockTest, IllegalOpcodeThrowsWithStateInSync) {
+    vm.write_memory(0x3000, 0x1021); // ADD R0, R0, #1
+    vm.write_memory(0x3001, 0xD000); // RES
+
+    EXPECT_THROW(vm.run(), std::runtime_error);
+    EXPECT_EQ(vm.get_register_value(R_R0), 1);
+    EXPECT_EQ(vm.get_register_value(R_PC), 0x3002);
+}
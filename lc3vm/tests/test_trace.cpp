@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+#include "lc3.hpp"
+#include "registers.hpp"
+#include "trace.hpp"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Traces programs on every engine and reads the traces back.
+ */
+class TraceTest : public ::testing::TestWithParam<ExecutionMode> {
+protected:
+    LC3State vm;
+    std::string path;
+
+    void SetUp() override {
+        char name[] = "/tmp/lc3_trace_XXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_NE(fd, -1);
+        close(fd);
+        path = name;
+        vm.use_test_console();
+        vm.set_execution_mode(GetParam());
+    }
+
+    void TearDown() override {
+        unlink(path.c_str());
+    }
+
+    void load(std::uint16_t origin, const std::vector<std::uint16_t>& program) {
+        for (std::size_t i = 0; i < program.size(); ++i) {
+            vm.write_memory(static_cast<std::uint16_t>(origin + i), program[i]);
+        }
+    }
+
+    std::vector<TraceEvent> read_all() {
+        TraceReader reader(path);
+        std::vector<TraceEvent> events;
+        TraceEvent event;
+        while (reader.next(event)) events.push_back(event);
+        return events;
+    }
+};
+
+TEST_P(TraceTest, RecordsEveryRetiredInstruction) {
+    load(0x3000, {
+        0x5260, // AND R1, R1, #0
+        0x1265, // ADD R1, R1, #5
+        0xE40D, // LEA R2, data
+        0x7280, // loop: STR R1, R2, #0
+        0x14A1, // ADD R2, R2, #1
+        0x127F, // ADD R1, R1, #-1
+        0x03FC, // BRp loop
+        0x3207, // ST R1, last
+        0xB205, // STI R1, pointer
+        0xF025  // HALT
+    });
+    vm.write_memory(0x300E, 0x4000); // pointer: .FILL x4000
+
+    TraceWriter trace(path);
+    vm.set_trace(&trace);
+    RunResult result = vm.run_for(1000);
+    trace.close();
+
+    ASSERT_EQ(result.reason, StopReason::Halted);
+    EXPECT_EQ(trace.records(), result.instructions);
+    std::vector<TraceEvent> events = read_all();
+    ASSERT_EQ(events.size(), 26u);
+
+    EXPECT_EQ(events[0].pc, 0x3000);
+    EXPECT_EQ(events[0].word, 0x5260);
+    EXPECT_EQ(events[1].changed, 1u << R_R1);
+    EXPECT_EQ(events[1].registers[R_R1], 5);
+    EXPECT_EQ(events[1].registers[R_COND], FL_POS);
+    EXPECT_EQ(events[2].registers[R_R2], 0x3010);
+
+    std::vector<std::pair<std::uint16_t, std::uint16_t>> stores;
+    for (const TraceEvent& event : events) {
+        if (event.stored) stores.emplace_back(event.address, event.value);
+    }
+    std::vector<std::pair<std::uint16_t, std::uint16_t>> expected = {
+        {0x3010, 5}, {0x3011, 4}, {0x3012, 3}, {0x3013, 2}, {0x3014, 1}, {0x300F, 0}, {0x4000, 0}
+    };
+    EXPECT_EQ(stores, expected);
+
+    EXPECT_EQ(events[6].pc, 0x3006);
+    EXPECT_EQ(events[6].registers[R_PC], 0x3003);
+    EXPECT_EQ(events.back().pc, 0x3009);
+    for (int r = 0; r < R_COUNT; ++r) {
+        EXPECT_EQ(events.back().registers[r], vm.get_register_value(static_cast<Registers>(r))) << "register " << r;
+    }
+}
+
+TEST_P(TraceTest, ResynchronizesAfterExternalChanges) {
+    load(0x3000, {
+        0x1261, // ADD R1, R1, #1
+        0xF025  // HALT
+    });
+
+    TraceWriter trace(path);
+    vm.set_trace(&trace);
+    vm.run();
+    vm.set_register_value(R_PC, 0x3000);
+    vm.set_register_value(R_R1, 40);
+    vm.write_memory(0x3000, 0x1262); // ADD R1, R1, #2
+    vm.run();
+    vm.set_trace(nullptr);
+    vm.set_register_value(R_PC, 0x3000);
+    vm.run();
+    trace.close();
+
+    std::vector<TraceEvent> events = read_all();
+    ASSERT_EQ(events.size(), 4u);
+    EXPECT_EQ(events[0].word, 0x1261);
+    EXPECT_EQ(events[0].registers[R_R1], 1);
+    EXPECT_EQ(events[2].pc, 0x3000);
+    EXPECT_EQ(events[2].word, 0x1262);
+    EXPECT_EQ(events[2].registers[R_R1], 42);
+    EXPECT_EQ(events[3].word, 0xF025);
+}
+
+TEST_P(TraceTest, FollowsSelfModifyingCode) {
+    load(0x3000, {
+        0x2203, // LD R1, new
+        0x3201, // ST R1, target
+        0x1000, // ADD R0, R0, #0 (placeholder)
+        0xD000, // target: RES, replaced by HALT
+        0xF025  // new: .FILL xF025
+    });
+
+    TraceWriter trace(path);
+    vm.set_trace(&trace);
+    ASSERT_EQ(vm.run_for(100).reason, StopReason::Halted);
+    trace.close();
+
+    std::vector<TraceEvent> events = read_all();
+    ASSERT_EQ(events.size(), 4u);
+    EXPECT_EQ(events[1].address, 0x3003);
+    EXPECT_EQ(events[3].pc, 0x3003);
+    EXPECT_EQ(events[3].word, 0xF025);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllEngines, TraceTest,
+                         ::testing::Values(ExecutionMode::Interpreter, ExecutionMode::Superblock, ExecutionMode::Jit));
+
+TEST(TraceFileTest, SpansSeveralChunks) {
+    char path[] = "/tmp/lc3_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    close(fd);
+
+    LC3State vm;
+    vm.use_test_console();
+    vm.write_memory(0x3000, 0x1261); // loop: ADD R1, R1, #1
+    vm.write_memory(0x3001, 0x0FFE); // BRnzp loop
+    {
+        TraceWriter trace(path);
+        vm.set_trace(&trace);
+        EXPECT_EQ(vm.run_for(1000000).instructions, 1000000u);
+        vm.set_trace(nullptr);
+    }
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    EXPECT_GT(static_cast<std::uint64_t>(file.tellg()), 2u * TRACE_CHUNK_SIZE);
+
+    TraceReader reader(path);
+    TraceEvent event;
+    std::uint64_t count = 0;
+    TraceEvent last{};
+    while (reader.next(event)) {
+        last = event;
+        ++count;
+    }
+    unlink(path);
+    EXPECT_EQ(count, 1000000u);
+    EXPECT_EQ(last.registers[R_R1], vm.get_register_value(R_R1));
+    EXPECT_EQ(last.registers[R_PC], vm.get_register_value(R_PC));
+}
+
+TEST(TraceFileTest, RejectsMalformedTraces) {
+    char path[] = "/tmp/lc3_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(write(fd, "LC3R\x01", 5), 5);
+    close(fd);
+    EXPECT_THROW(TraceReader reader(path), std::runtime_error);
+
+    LC3State vm;
+    vm.use_test_console();
+    vm.write_memory(0x3000, 0xF025); // HALT
+    {
+        TraceWriter trace(path);
+        vm.set_trace(&trace);
+        vm.run();
+    }
+    ASSERT_EQ(truncate(path, 10), 0);
+    TraceReader reader(path);
+    TraceEvent event;
+    EXPECT_THROW(reader.next(event), std::runtime_error);
+    unlink(path);
+
+    EXPECT_THROW(TraceReader missing("/nonexistent/trace"), std::runtime_error);
+    EXPECT_THROW(TraceWriter unwritable("/nonexistent/trace"), std::runtime_error);
+}